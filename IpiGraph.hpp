@@ -0,0 +1,499 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application, 
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL) 
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ * 
+ * If using the Work as, or as part of, a network application, by 
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading, 
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#ifndef FIFTYONE_DEGREES_IPI_GRAPH_HPP
+#define FIFTYONE_DEGREES_IPI_GRAPH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#if defined(__has_include)
+#if __has_include(<span>) && __cplusplus >= 202002L
+#include <span>
+#define FIFTYONE_DEGREES_IPI_GRAPH_SPAN
+#endif
+#endif
+#include "../common-cxx/Exceptions.hpp"
+#include "graph.h"
+
+namespace FiftyoneDegrees {
+	namespace IpIntelligence {
+
+		/**
+		 * Result of an evaluation that reports failure through a status
+		 * rather than an exception. Either holds the result of the
+		 * evaluation or the status code of the failure, in the manner of
+		 * std::expected.
+		 */
+		class IpiGraphResult {
+		public:
+			/**
+			 * Constructs a result for the status of an evaluation.
+			 * @param value result of the evaluation
+			 * @param status of the evaluation,
+			 * FIFTYONE_DEGREES_STATUS_NOT_SET if successful
+			 */
+			IpiGraphResult(
+				const fiftyoneDegreesIpiCgResult &value,
+				fiftyoneDegreesStatusCode status) noexcept
+				: resultValue(value), resultStatus(status) {}
+
+			/**
+			 * @return true if the evaluation was successful and value can
+			 * be used
+			 */
+			bool hasValue() const noexcept {
+				return resultStatus == FIFTYONE_DEGREES_STATUS_NOT_SET;
+			}
+
+			/**
+			 * @return true if the evaluation was successful
+			 */
+			explicit operator bool() const noexcept { return hasValue(); }
+
+			/**
+			 * Returns the result of the evaluation, throwing if the
+			 * evaluation failed.
+			 * @return result of the evaluation
+			 */
+			const fiftyoneDegreesIpiCgResult& value() const {
+				if (hasValue() == false) {
+					throw Common::StatusCodeException(resultStatus);
+				}
+				return resultValue;
+			}
+
+			/**
+			 * @return result of the evaluation which is
+			 * FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT values if the
+			 * evaluation failed
+			 */
+			const fiftyoneDegreesIpiCgResult& operator*() const noexcept {
+				return resultValue;
+			}
+
+			/**
+			 * @return pointer to the result of the evaluation. See
+			 * operator*
+			 */
+			const fiftyoneDegreesIpiCgResult* operator->() const noexcept {
+				return &resultValue;
+			}
+
+			/**
+			 * @return status code of the failure, or
+			 * FIFTYONE_DEGREES_STATUS_NOT_SET if successful
+			 */
+			fiftyoneDegreesStatusCode error() const noexcept {
+				return resultStatus;
+			}
+
+		private:
+			fiftyoneDegreesIpiCgResult resultValue;
+			fiftyoneDegreesStatusCode resultStatus;
+		};
+
+		/**
+		 * Owns an array of graphs created from the graph information in a
+		 * data set and frees it when destroyed. Instances can be moved but
+		 * not copied. Evaluation does not modify the graphs so const
+		 * instances can be shared by many threads. Methods that return a
+		 * status rather than throw do not allocate and can be used in hot
+		 * loops.
+		 */
+		class IpiGraph {
+		public:
+			/**
+			 * @name Constructors and Destructors
+			 * @{
+			 */
+
+			/**
+			 * Takes ownership of an array created with one of the
+			 * fiftyoneDegreesIpiGraphCreate methods.
+			 * @param graphs array to own, or nullptr for an empty instance
+			 */
+			explicit IpiGraph(fiftyoneDegreesIpiCgArray *graphs = nullptr)
+				noexcept : graphs(graphs) {}
+
+			IpiGraph(const IpiGraph&) = delete;
+
+			IpiGraph& operator=(const IpiGraph&) = delete;
+
+			/**
+			 * Moves ownership of the array leaving the other instance
+			 * empty.
+			 * @param other instance to move from
+			 */
+			IpiGraph(IpiGraph &&other) noexcept : graphs(other.graphs) {
+				other.graphs = nullptr;
+			}
+
+			/**
+			 * Frees any array already owned and moves ownership of the
+			 * array leaving the other instance empty.
+			 * @param other instance to move from
+			 * @return this instance
+			 */
+			IpiGraph& operator=(IpiGraph &&other) noexcept {
+				if (this != &other) {
+					reset(other.graphs);
+					other.graphs = nullptr;
+				}
+				return *this;
+			}
+
+			/**
+			 * Frees the array if owned.
+			 */
+			~IpiGraph() { reset(nullptr); }
+
+			/**
+			 * @}
+			 * @name Factory Methods
+			 * @{
+			 */
+
+			/**
+			 * The default options for the graphs. Equivalent to
+			 * FIFTYONE_DEGREES_IPI_CG_CONFIG_DEFAULT which is not valid
+			 * C++.
+			 * @return default options
+			 */
+			static fiftyoneDegreesIpiCgConfig defaultConfig() noexcept {
+				fiftyoneDegreesIpiCgConfig config = {};
+				config.numaNode = -1;
+				return config;
+			}
+
+			/**
+			 * Creates the graphs for a data set held in memory. See
+			 * fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig.
+			 * @param collection of fiftyoneDegreesIpiCgInfo records
+			 * @param reader to the source data
+			 * @param config options to apply to the graphs
+			 * @return instance owning the graphs
+			 * @throws Common::StatusCodeException if the graphs could not
+			 * be created
+			 */
+			static IpiGraph createFromMemory(
+				fiftyoneDegreesCollection *collection,
+				fiftyoneDegreesMemoryReader *reader,
+				const fiftyoneDegreesIpiCgConfig &config = defaultConfig()) {
+				fiftyoneDegreesException exception;
+				exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+				fiftyoneDegreesIpiCgArray *graphs =
+					fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig(
+						collection,
+						reader,
+						&config,
+						&exception);
+				return fromCreated(graphs, exception);
+			}
+
+			/**
+			 * Creates the graphs for a data set on the file system. See
+			 * fiftyoneDegreesIpiGraphCreateFromFileWithConfig.
+			 * @param collection of fiftyoneDegreesIpiCgInfo records
+			 * @param file for to the source data
+			 * @param reader pool connected to the file
+			 * @param collectionConfig for the collections created for each
+			 * graph
+			 * @param config options to apply to the graphs
+			 * @return instance owning the graphs
+			 * @throws Common::StatusCodeException if the graphs could not
+			 * be created
+			 */
+			static IpiGraph createFromFile(
+				fiftyoneDegreesCollection *collection,
+				FILE *file,
+				fiftyoneDegreesFilePool *reader,
+				const fiftyoneDegreesCollectionConfig &collectionConfig,
+				const fiftyoneDegreesIpiCgConfig &config = defaultConfig()) {
+				fiftyoneDegreesException exception;
+				exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+				fiftyoneDegreesIpiCgArray *graphs =
+					fiftyoneDegreesIpiGraphCreateFromFileWithConfig(
+						collection,
+						file,
+						reader,
+						collectionConfig,
+						&config,
+						&exception);
+				return fromCreated(graphs, exception);
+			}
+
+			/**
+			 * @}
+			 * @name Ownership
+			 * @{
+			 */
+
+			/**
+			 * @return the array owned, or nullptr if empty
+			 */
+			const fiftyoneDegreesIpiCgArray* get() const noexcept {
+				return graphs;
+			}
+
+			/**
+			 * @return true if an array is owned
+			 */
+			explicit operator bool() const noexcept {
+				return graphs != nullptr;
+			}
+
+			/**
+			 * Returns the array without freeing it. The caller becomes
+			 * responsible for freeing the array.
+			 * @return the array owned, or nullptr if empty
+			 */
+			fiftyoneDegreesIpiCgArray* release() noexcept {
+				fiftyoneDegreesIpiCgArray *result = graphs;
+				graphs = nullptr;
+				return result;
+			}
+
+			/**
+			 * Frees any array owned and takes ownership of the one
+			 * provided.
+			 * @param replacement array to own, or nullptr
+			 */
+			void reset(fiftyoneDegreesIpiCgArray *replacement) noexcept {
+				if (graphs != nullptr) {
+					fiftyoneDegreesIpiGraphFree(graphs);
+				}
+				graphs = replacement;
+			}
+
+			/**
+			 * @}
+			 * @name Evaluation
+			 * @{
+			 */
+
+			/**
+			 * Evaluates the address without throwing.
+			 * @param componentId of the graph to evaluate
+			 * @param address to evaluate
+			 * @return the result or the status code of the failure
+			 */
+			IpiGraphResult tryEvaluate(
+				byte componentId,
+				const fiftyoneDegreesIpAddress &address) const noexcept {
+				fiftyoneDegreesException exception;
+				exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+				if (graphs == nullptr) {
+					exception.status = FIFTYONE_DEGREES_STATUS_NULL_POINTER;
+					return IpiGraphResult(defaultResult(), exception.status);
+				}
+				const fiftyoneDegreesIpiCgResult result =
+					fiftyoneDegreesIpiGraphEvaluate(
+						graphs,
+						componentId,
+						address,
+						&exception);
+				return IpiGraphResult(result, exception.status);
+			}
+
+			/**
+			 * Evaluates the address.
+			 * @param componentId of the graph to evaluate
+			 * @param address to evaluate
+			 * @return the result of the evaluation
+			 * @throws Common::StatusCodeException if the evaluation failed
+			 */
+			fiftyoneDegreesIpiCgResult evaluate(
+				byte componentId,
+				const fiftyoneDegreesIpAddress &address) const {
+				return tryEvaluate(componentId, address).value();
+			}
+
+			/**
+			 * Evaluates the addresses together without throwing. See
+			 * fiftyoneDegreesIpiGraphEvaluateBatch. If a failure occurs the
+			 * remaining results are FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT
+			 * values.
+			 * @param componentId of the graph to evaluate
+			 * @param addresses to evaluate
+			 * @param results populated with the result for each address
+			 * @param count number of addresses and results
+			 * @return FIFTYONE_DEGREES_STATUS_NOT_SET if successful,
+			 * otherwise the status code of the failure
+			 */
+			fiftyoneDegreesStatusCode tryEvaluate(
+				byte componentId,
+				const fiftyoneDegreesIpAddress *addresses,
+				fiftyoneDegreesIpiCgResult *results,
+				size_t count) const noexcept {
+				fiftyoneDegreesException exception;
+				exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+				if (count > 0 && (
+					graphs == nullptr ||
+					addresses == nullptr ||
+					results == nullptr)) {
+					return FIFTYONE_DEGREES_STATUS_NULL_POINTER;
+				}
+
+				// The C interface takes a 32 bit count so larger counts are
+				// evaluated in parts.
+				size_t done = 0;
+				while (done < count &&
+					exception.status == FIFTYONE_DEGREES_STATUS_NOT_SET) {
+					const size_t remaining = count - done;
+					const uint32_t part = remaining > UINT32_MAX ?
+						UINT32_MAX : (uint32_t)remaining;
+					fiftyoneDegreesIpiGraphEvaluateBatch(
+						graphs,
+						componentId,
+						addresses + done,
+						results + done,
+						part,
+						&exception);
+					done += part;
+				}
+				for (; done < count; done++) {
+					results[done] = defaultResult();
+				}
+				return exception.status;
+			}
+
+			/**
+			 * Evaluates the addresses together. See
+			 * fiftyoneDegreesIpiGraphEvaluateBatch.
+			 * @param componentId of the graph to evaluate
+			 * @param addresses to evaluate
+			 * @param results populated with the result for each address
+			 * @param count number of addresses and results
+			 * @throws Common::StatusCodeException if the evaluation failed
+			 */
+			void evaluate(
+				byte componentId,
+				const fiftyoneDegreesIpAddress *addresses,
+				fiftyoneDegreesIpiCgResult *results,
+				size_t count) const {
+				const fiftyoneDegreesStatusCode status = tryEvaluate(
+					componentId,
+					addresses,
+					results,
+					count);
+				if (status != FIFTYONE_DEGREES_STATUS_NOT_SET) {
+					throw Common::StatusCodeException(status);
+				}
+			}
+
+#ifdef FIFTYONE_DEGREES_IPI_GRAPH_SPAN
+			/**
+			 * Evaluates the addresses together without throwing. The
+			 * results must be the same size as the addresses.
+			 * @param componentId of the graph to evaluate
+			 * @param addresses to evaluate
+			 * @param results populated with the result for each address
+			 * @return FIFTYONE_DEGREES_STATUS_NOT_SET if successful,
+			 * FIFTYONE_DEGREES_STATUS_INVALID_INPUT if the sizes differ,
+			 * otherwise the status code of the failure
+			 */
+			fiftyoneDegreesStatusCode tryEvaluate(
+				byte componentId,
+				std::span<const fiftyoneDegreesIpAddress> addresses,
+				std::span<fiftyoneDegreesIpiCgResult> results)
+				const noexcept {
+				if (addresses.size() != results.size()) {
+					return FIFTYONE_DEGREES_STATUS_INVALID_INPUT;
+				}
+				return tryEvaluate(
+					componentId,
+					addresses.data(),
+					results.data(),
+					addresses.size());
+			}
+
+			/**
+			 * Evaluates the addresses together. The results must be the
+			 * same size as the addresses.
+			 * @param componentId of the graph to evaluate
+			 * @param addresses to evaluate
+			 * @param results populated with the result for each address
+			 * @throws Common::StatusCodeException if the sizes differ or
+			 * the evaluation failed
+			 */
+			void evaluate(
+				byte componentId,
+				std::span<const fiftyoneDegreesIpAddress> addresses,
+				std::span<fiftyoneDegreesIpiCgResult> results) const {
+				const fiftyoneDegreesStatusCode status = tryEvaluate(
+					componentId,
+					addresses,
+					results);
+				if (status != FIFTYONE_DEGREES_STATUS_NOT_SET) {
+					throw Common::StatusCodeException(status);
+				}
+			}
+#endif
+
+			/**
+			 * @}
+			 */
+
+		private:
+			/**
+			 * @return result used when an evaluation has failed
+			 */
+			static fiftyoneDegreesIpiCgResult defaultResult() noexcept {
+				fiftyoneDegreesIpiCgResult result;
+				result.rawOffset = UINT32_MAX;
+				result.offset = UINT32_MAX;
+				result.isGroupOffset = false;
+				return result;
+			}
+
+			/**
+			 * Takes ownership of newly created graphs, throwing if they
+			 * could not be created.
+			 */
+			static IpiGraph fromCreated(
+				fiftyoneDegreesIpiCgArray *graphs,
+				const fiftyoneDegreesException &exception) {
+				if (graphs == nullptr) {
+					throw Common::StatusCodeException(
+						exception.status != FIFTYONE_DEGREES_STATUS_NOT_SET ?
+						exception.status :
+						FIFTYONE_DEGREES_STATUS_INSUFFICIENT_MEMORY);
+				}
+				if (exception.status != FIFTYONE_DEGREES_STATUS_NOT_SET) {
+					fiftyoneDegreesIpiGraphFree(graphs);
+					throw Common::StatusCodeException(exception.status);
+				}
+				return IpiGraph(graphs);
+			}
+
+			/** Array of graphs owned, or nullptr if empty */
+			fiftyoneDegreesIpiCgArray *graphs;
+		};
+	}
+}
+
+#endif
@@ -25,15 +25,50 @@
  * such notice(s) shall fulfill the requirements of that article.
  * ********************************************************************* */
 
+#ifdef __linux__
+// Needed for sched_getcpu.
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// The mmap flag mask is not used and conflicts with the macro of fiftyone.h.
+#undef MAP_TYPE
+#endif
+
 #include "graph.h"
 
 #include "../common-cxx/collectionKeyTypes.h"
+#include "../common-cxx/threading.h"
 #include "../common-cxx/fiftyone.h"
 
 MAP_TYPE(IpiCg)
 MAP_TYPE(IpiCgArray)
 MAP_TYPE(IpiCgMember)
+MAP_TYPE(IpiCgMemberNode)
 MAP_TYPE(IpiCgInfo)
+MAP_TYPE(IpiCgClusterRange)
+MAP_TYPE(IpiCgNode)
+MAP_TYPE(IpiCgConfig)
+MAP_TYPE(IpiCgSpan)
+MAP_TYPE(IpiCgSkip)
+MAP_TYPE(IpiCgUniform)
+MAP_TYPE(IpiCgReplica)
+MAP_TYPE(IpiCgReplicaArray)
+MAP_TYPE(IpiCgSegment)
+MAP_TYPE(IpiCgBulkConfig)
+MAP_TYPE(IpiCgResult)
+MAP_TYPE(IpiCgTextRow)
+MAP_TYPE(IpiCgShared)
+MAP_TYPE(IpiCgDeltaHeader)
+MAP_TYPE(IpiCgDeltaGraph)
+MAP_TYPE(IpiCgVerifier)
+MAP_TYPE(IpiCgVerifyConfig)
+MAP_TYPE(IpiCgStats)
 MAP_TYPE(Collection)
 
 /**
@@ -51,6 +86,24 @@ typedef enum {
 // Number of bytes that can form an IP value or span limit.
 #define VAR_SIZE 16
 
+// Alignment used for data decoded into memory to avoid records straddling
+// cache lines.
+#define FIFTYONE_DEGREES_IPI_CG_CACHE_LINE 64
+
+// Size of a huge page. Arenas at least this large are aligned to and sized in
+// multiples of huge pages so that they can be backed by them.
+#define FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE (2 * 1024 * 1024)
+
+// Hints that the memory at the address will be read soon. Only issued for 
+// addresses within the memory of the graph.
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#elif defined(_MSC_VER)
+#define PREFETCH(p) PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, (p))
+#else
+#define PREFETCH(p)
+#endif
+
 /**
  * DATA STRUCTURES
  */
@@ -60,6 +113,7 @@ typedef struct file_collection_t {
 	FILE* file;
 	fiftyoneDegreesFilePool* reader;
 	const fiftyoneDegreesCollectionConfig config;
+	const bool directReads; // True to read without the pool and cache
 } FileCollection;
 
 // Function used to create the collection for each of the graphs.
@@ -86,15 +140,56 @@ typedef struct cluster_t {
 } Cluster;
 #pragma pack(pop)
 
+// Number of nodes in each block of the compressed nodes.
+#define COMPRESSED_BLOCK_NODES 64
+
+// Bytes after the last block of the compressed nodes so that the bits of any
+// node can be read with a single 64 bit load.
+#define COMPRESSED_PADDING sizeof(uint64_t)
+
+// Widest code that can be read from a 64 bit load at any bit offset.
+#define COMPRESSED_WIDTH_MAX 57
+
+// Header for each block of the compressed nodes. The headers of every block
+// are followed by the packed bits of each block. The packed bits start with
+// the zigzag encoded distance from each node that is not a leaf to the node
+// its value points to, in node order. The leaf values less the leaf base 
+// follow. If leafValues is not 0 these are the distinct leaf values of the 
+// block and each leaf then has an index into them, otherwise there is a leaf
+// value for each leaf. The cluster span index less the span base of every 
+// node is last. The position of a node among the leaves or the other nodes 
+// of its block is found by counting the bits set in the leaves mask.
+typedef struct compressed_block_t {
+	uint64_t lowFlags; // Bit set for each node of the block with the low flag
+	uint64_t leaves; // Bit set for each node of the block with a leaf value
+	uint32_t offset; // Offset of the packed bits of the block from the first
+					 // block header
+	uint32_t leafBase; // Smallest leaf value of the nodes in the block
+	uint32_t spanBase; // Smallest cluster span index of the nodes in the 
+					   // block
+	uint16_t leavesStart; // Bit index of the first leaf value
+	uint16_t indexesStart; // Bit index of the first leaf value index
+	uint16_t spansStart; // Bit index of the first cluster span index
+	byte distanceWidth; // Bits used for the distance of each node
+	byte leafWidth; // Bits used for each leaf value
+	byte indexWidth; // Bits used for the leaf value index of each leaf
+	byte spanWidth; // Bits used for the cluster span index of each node
+	byte leafValues; // Number of distinct leaf values if the leaves index 
+					 // them, otherwise 0
+} CompressedBlock;
+
 // Cursor used to traverse the graph for each of the bits in the IP address.
 typedef struct cursor_t {
 	const IpiCg* const graph; // Graph the cursor is working with
 	IpAddress const ip; // The IP address source
+	byte const ipLength; // Number of bytes in the IP address for the graph
 	CollectionKeyType nodeBytesKeyType; // keyType for extracting node bytes
-	byte ipValue[VAR_SIZE]; // The value that should be compared to the span
+	uint64_t ipWords[2]; // The IP address as two words, most significant
+						 // first
 	byte bitIndex; // Current bit index from high to low in the IP address 
 				   // value array
 	uint64_t nodeBits; // The value of the current item in the graph
+	const IpiCgNode* node; // The current aligned node if the graph has them
 	uint32_t index; // The current index in the graph values collection
 	uint32_t previousHighIndex; // The index of the last high index
 	struct ClusterWrapper {
@@ -104,8 +199,10 @@ typedef struct cursor_t {
 	} cluster; // The current cluster that relates to the node index
 	uint32_t spanIndex; // The current span index
 	Span span; // The current span that relates to the node index
-	byte spanLow[VAR_SIZE]; // Low limit for the span
-	byte spanHigh[VAR_SIZE]; // High limit for the span
+	const IpiCgSpan* decodedSpan; // The current decoded span if the graph
+								  // has them
+	IpiCgSpan spanLimits; // Limits of the current span as words if the graph
+						  // does not have decoded spans
 	byte spanSet; // True after the first time the span is set
 	CompareResult compareResult; // Result of comparing the current bits to the
 								 // span value
@@ -127,24 +224,24 @@ typedef struct cursor_t {
 #define TRACE_RESULT(c,r)
 #endif
 
-// Get the bit as a bool for the byte array and bit index from the left. High
-// order bit is index 0.
-#define GET_BIT(b,i) ((((b)[(i) / 8] >> (7 - ((i) % 8))) & 1))
-
-// Sets the bit in the destination byte array where the bit index is from 
-// left. High order bit is index 0.
-#define SET_BIT(b,i) (b[i / 8] |= 1 << (7 - (i % 8)))
+// Get the bit as a bool for the 128 bit value held in two words and bit index
+// from the left. High order bit is index 0. Bits after the value are zero.
+#define GET_WORD_BIT(w,i) ((i) < 128 && \
+	(((w)[(i) / 64] >> (63 - ((i) % 64))) & 1))
 
-// Outputs to the string builder the bits from left to right from the bytes
-// provided.
-static void bytesToBinary(
+// Outputs to the string builder the bits from left to right from the 128 bit
+// value provided starting at the start bit.
+static void wordsToBinary(
 	const Cursor * const cursor,
-	const byte * const bytes,
+	const uint64_t * const words,
+	const int start,
 	const int length) {
 	int count = 0;
 	for (int i = 0; i < length; i++)
 	{
-		StringBuilderAddChar(cursor->sb, GET_BIT(bytes, i) ? '1' : '0');
+		StringBuilderAddChar(
+			cursor->sb, 
+			GET_WORD_BIT(words, start + i) ? '1' : '0');
 		count++;
 		if (count % 4 == 0 && count < length) {
 			StringBuilderAddChar(cursor->sb, ' ');
@@ -167,6 +264,13 @@ static IpType getIpTypeFromGraph(const IpiCgInfo* const info) {
 	return getIpTypeFromVersion(info->version);
 }
 
+// The number of bytes in an IP address evaluated by the component graph.
+static byte getIpLengthFromGraph(const IpiCgInfo* const info) {
+	return getIpTypeFromGraph(info) == IP_TYPE_IPV4 ?
+		FIFTYONE_DEGREES_IPV4_LENGTH :
+		FIFTYONE_DEGREES_IPV6_LENGTH;
+}
+
 // Manipulates the source using the mask and shift parameters of the member.
 static uint32_t getMemberValue(IpiCgMember member, uint64_t source) {
 	return (uint32_t)((source & member.mask) >> member.shift);
@@ -174,6 +278,9 @@ static uint32_t getMemberValue(IpiCgMember member, uint64_t source) {
 
 // Returns the value from the current node value.
 static uint32_t getValue(const Cursor* const cursor) {
+	if (cursor->node != NULL) {
+		return cursor->node->value;
+	}
 	uint32_t result = getMemberValue(
 		cursor->graph->info.nodes.value,
 		cursor->nodeBits);
@@ -195,6 +302,16 @@ static uint32_t getSpanIndex(
 	return cursor->cluster.ptr->spanIndexes[clusterSpanIndex];
 }
 
+// Returns the span index resolved for the node index when the graph was
+// created.
+static uint32_t getSpanIndexResolved(
+	const IpiCg* const graph,
+	const uint32_t index) {
+	return graph->spanIndexesSize == sizeof(uint16_t) ?
+		((const uint16_t*)graph->spanIndexes)[index] :
+		((const uint32_t*)graph->spanIndexes)[index];
+}
+
 // The larger of the two span limits.
 static int getMaxSpanLimitLength(const Cursor* const cursor) {
 	return cursor->span.lengthLow > cursor->span.lengthHigh ?
@@ -207,6 +324,13 @@ static int getTotalSpanLimitLength(const Cursor* const cursor) {
 	return cursor->span.lengthLow + cursor->span.lengthHigh;
 }
 
+// The limits of the current span as words.
+static const IpiCgSpan* getSpanLimits(const Cursor* const cursor) {
+	return cursor->decodedSpan != NULL ? 
+		cursor->decodedSpan : 
+		&cursor->spanLimits;
+}
+
 static void traceNewLine(const Cursor* const cursor) {
 	StringBuilderAddChar(cursor->sb, '\r');
 	StringBuilderAddChar(cursor->sb, '\n');
@@ -290,13 +414,25 @@ static void traceCompare(const Cursor* const cursor) {
 	}
 	StringBuilderAddChar(cursor->sb, ' ');
 	StringBuilderAddChars(cursor->sb, IP, sizeof(IP) - 1);
-	bytesToBinary(cursor, cursor->ipValue, getMaxSpanLimitLength(cursor));
+	wordsToBinary(
+		cursor, 
+		cursor->ipWords, 
+		cursor->bitIndex, 
+		getMaxSpanLimitLength(cursor));
 	StringBuilderAddChar(cursor->sb, ' ');
 	StringBuilderAddChars(cursor->sb, LV, sizeof(LV) - 1);
-	bytesToBinary(cursor, cursor->spanLow, cursor->span.lengthLow);
+	wordsToBinary(
+		cursor, 
+		getSpanLimits(cursor)->low, 
+		0, 
+		cursor->span.lengthLow);
 	StringBuilderAddChar(cursor->sb, ' ');
 	StringBuilderAddChars(cursor->sb, HV, sizeof(HV) - 1);
-	bytesToBinary(cursor, cursor->spanHigh, cursor->span.lengthHigh);
+	wordsToBinary(
+		cursor, 
+		getSpanLimits(cursor)->high, 
+		0, 
+		cursor->span.lengthHigh);
 	StringBuilderAddChar(cursor->sb, ' ');
 	StringBuilderAddChars(cursor->sb, CLI, sizeof(CLI) - 1);
 	StringBuilderAddInteger(cursor->sb, cursor->cluster.index);
@@ -317,7 +453,8 @@ static void traceMove(Cursor* cursor, const char* method) {
 	StringBuilderAddChar(cursor->sb, ' ');
 	StringBuilderAddInteger(cursor->sb, cursor->spanIndex);
 	StringBuilderAddChar(cursor->sb, ' ');
-	bytesToBinary(cursor, (byte*)&cursor->nodeBits, 64);
+	const uint64_t nodeBits[2] = { cursor->nodeBits, 0 };
+	wordsToBinary(cursor, nodeBits, 0, 64);
 	traceNewLine(cursor);
 }
 
@@ -348,6 +485,19 @@ static uint32_t getProfileIndex(const Cursor* const cursor) {
 	return result;
 }
 
+// Profile index returned by the walk when every bit of the address value has
+// been consumed at a node that is not a leaf. The address is not covered by 
+// the graph and the default result is returned.
+#define PROFILE_INDEX_NONE UINT32_MAX
+
+// The profile index at the end of a walk, or PROFILE_INDEX_NONE if the walk
+// ended at a node that is not a leaf because the address was exhausted.
+static uint32_t getWalkResult(const Cursor* const cursor) {
+	return getValue(cursor) >= cursor->graph->info.nodes.collection.count ?
+		getProfileIndex(cursor) :
+		PROFILE_INDEX_NONE;
+}
+
 // True if the cursor is currently positioned on a leaf and therefore profile 
 // index.
 static bool getIsProfileIndex(const Cursor* const cursor) {
@@ -366,167 +516,176 @@ static bool isLeaf(const Cursor* const cursor) {
 
 // True if the cursor value has the low flag set, otherwise false.
 static bool isLowFlag(const Cursor* const cursor) {
-	bool result = getMemberValue(
-		cursor->graph->info.nodes.lowFlag,
-		cursor->nodeBits) != 0;
+	bool result = cursor->node != NULL ?
+		(cursor->node->flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) != 0 :
+		getMemberValue(
+			cursor->graph->info.nodes.lowFlag,
+			cursor->nodeBits) != 0;
 	TRACE_BOOL(cursor, "isLowFlag", result);
 	return result;
 }
 
-// Resets the bytes to zero.
-static void bytesReset(byte* bytes) {
-	memset(bytes, 0, VAR_SIZE);
+// Returns the 8 bytes as a word where the first byte is the most significant.
+static uint64_t bytesToWord(const byte* const bytes) {
+	uint64_t word = 0;
+	for (int i = 0; i < 8; i++) {
+		word = (word << 8) | bytes[i];
+	}
+	return word;
+}
+
+// Returns a mask for the most significant bits of a word. Bits can be less 
+// than zero or greater than 64.
+static uint64_t wordMask(const int bits) {
+	if (bits <= 0) {
+		return 0;
+	}
+	if (bits >= 64) {
+		return UINT64_MAX;
+	}
+	return ~(UINT64_MAX >> bits);
 }
 
 // If the bits of first and second that are needed to cover the bits are equal
 // returns 0, otherwise -1 or 1 depending on whether they are higher or lower.
-static int bitsCompare(
-	const byte* const first,
-	const byte* const second,
+// The first and second are 128 bit values and all the bits of second after 
+// the bits are zero.
+static int wordsCompare(
+	const uint64_t* const first,
+	const uint64_t* const second,
 	const int bits) {
-	for (int i = 0; i < bits; i++) {
-		int firstBit = GET_BIT(first, i);
-		int secondBit = GET_BIT(second, i);
-		if (firstBit < secondBit) {
-			return -1;
-		}
-		if (firstBit > secondBit) {
-			return 1;
-		}
+	const uint64_t high = first[0] & wordMask(bits);
+	if (high != second[0]) {
+		return high < second[0] ? -1 : 1;
+	}
+	const uint64_t low = first[1] & wordMask(bits - 64);
+	if (low != second[1]) {
+		return low < second[1] ? -1 : 1;
 	}
 	return 0;
 }
 
-// Copies bits from the source to the destination starting at the start bit in
-// the source provided and including the subsequent bits.
-static void copyBits(byte* dest, const byte* src, int startBit, int bits) {
-	for (int i = 0, s = startBit; i < bits; i++, s++) {
+// Sets the words to the bits of the source words from the shift bit index.
+// Bits after the end of the source are zero.
+static void shiftWords(
+	const uint64_t* const source,
+	const int shift,
+	uint64_t* const words) {
+	if (shift == 0) {
+		words[0] = source[0];
+		words[1] = source[1];
+	}
+	else if (shift < 64) {
+		words[0] = (source[0] << shift) | (source[1] >> (64 - shift));
+		words[1] = source[1] << shift;
+	}
+	else if (shift < 128) {
+		words[0] = source[1] << (shift - 64);
+		words[1] = 0;
+	}
+	else {
+		words[0] = 0;
+		words[1] = 0;
+	}
+}
 
-		// If 1 then set the bit in the destination.
-		if (GET_BIT(src, s)) {
-			SET_BIT(dest, i);
-		}
+// Equivalent of wordsCompare where the second word of first is zero. Used for
+// IPv4 addresses which always fit in the first word.
+static int wordCompare(
+	const uint64_t first,
+	const uint64_t* const second,
+	const int bits) {
+	const uint64_t high = first & wordMask(bits);
+	if (high != second[0]) {
+		return high < second[0] ? -1 : 1;
 	}
+	return second[1] != 0 ? -1 : 0;
 }
 
-// Sets the cursor->ipValue to the bits needed to perform an integer comparison
-// operation with the cursor->span.
-static void setIpValue(Cursor* cursor) {
-	
-	// Reset the IP value ready to include the new bits.
-	bytesReset(cursor->ipValue);
-
-	// Copy the bits from the IP address to the compare field.
-	copyBits(
-		cursor->ipValue, 
-		cursor->ip.value, 
-		cursor->bitIndex,
-		getMaxSpanLimitLength(cursor));
+// Sets the words to the bits of the source from the start bit where the 
+// source is length bytes long. Bits after the end of the source, or after the
+// number of bits which must be no more than 128, are zero.
+static void bitsToWords(
+	const byte* const source,
+	const uint32_t length,
+	const uint32_t startBit,
+	const int bits,
+	uint64_t* const words) {
+
+	// Copy the bytes that contain the bits into a buffer that can always be 
+	// read as three words.
+	byte bytes[24];
+	const uint32_t first = startBit / 8;
+	const uint32_t available = first < length ? length - first : 0;
+	memset(bytes, 0, sizeof(bytes));
+	if (available > 0) {
+		memcpy(bytes, source + first, available < 17 ? available : 17);
+	}
+
+	// Move the bits to the start of the words and clear those not needed.
+	const int shift = startBit % 8;
+	const uint64_t source0 = bytesToWord(bytes);
+	const uint64_t source1 = bytesToWord(bytes + 8);
+	const uint64_t source2 = bytesToWord(bytes + 16);
+	if (shift == 0) {
+		words[0] = source0;
+		words[1] = source1;
+	}
+	else {
+		words[0] = (source0 << shift) | (source1 >> (64 - shift));
+		words[1] = (source1 << shift) | (source2 >> (64 - shift));
+	}
+	words[0] &= wordMask(bits);
+	words[1] &= wordMask(bits - 64);
+}
+
+// Sets the words to the bits of the IP address from the cursor bit index. Bits
+// after the end of the address are zero.
+static void setIpWords(const Cursor* const cursor, uint64_t* const words) {
+	shiftWords(cursor->ipWords, cursor->bitIndex, words);
 }
 
-// True if all the bytes of the address have been consumed.
+// True if all the bits the walk can compare have been consumed. A graph might
+// not reach a leaf at the end of a shorter address such as IPv4, so the walk
+// continues over the zero bits that follow it as it always has, and only ends
+// once every byte of the address value is consumed.
 static bool isExhausted(const Cursor* const cursor) {
 	byte byteIndex = cursor->bitIndex / 8;
 	return byteIndex >= sizeof(cursor->ip.value);
 }
 
-// Comparer used to determine if the selected cluster is higher or lower than
-// the target.
-static int setClusterComparer(
-	Cursor* const cursor,
-	Item* const item) {
-	// Swap the ownership, so that Cursor now owns this item
-	{
-		const Item t = cursor->cluster.item;
-		cursor->cluster.item = *item;
-		cursor->cluster.ptr = (const Cluster*)item->data.ptr;
-		*item = t;
-	}
-
-	// If this cluster is within the require range then its the correct one
-	// to return.
-	const uint32_t searchIndex = cursor->index;
-	const uint32_t startIndex = cursor->cluster.ptr->startIndex;
-	if (searchIndex >= startIndex &&
-		searchIndex <= cursor->cluster.ptr->endIndex) {
-		return 0;
+// Releases the cluster held by the cursor if any.
+static void cursorReleaseData(Cursor* const cursor) {
+	if (cursor->cluster.ptr) {
+		COLLECTION_RELEASE(
+			cursor->cluster.item.collection,
+			&cursor->cluster.item);
+		cursor->cluster.ptr = NULL;
 	}
-
-	return (startIndex > searchIndex) ? 1 : (startIndex < searchIndex) ? -1 : 0;
 }
 
-static uint32_t setClusterSearch(
-	const fiftyoneDegreesCollection* const collection,
-	const uint32_t lowerIndex,
-	const uint32_t upperIndex,
-	Cursor* const cursor,
-	fiftyoneDegreesException* exception) {
-	uint32_t upper = upperIndex,
-		lower = lowerIndex,
-		middle = 0;
-	const CollectionKeyType keyType = {
-		FIFTYONE_DEGREES_COLLECTION_ENTRY_TYPE_GRAPH_DATA_CLUSTER,
-		collection->elementSize,
-		NULL,
-	};
-
-	fiftyoneDegreesCollectionItem item;
-	DataReset(&item.data);
-	item.collection = NULL;
-
-	while (lower <= upper) {
-		// Get the middle index for the next item to be compared.
-		middle = lower + (upper - lower) / 2;
-
-		// Get the item from the collection checking for NULL or an error.
-		const CollectionKey key = {
-			middle,
-			&keyType,
-		};
-		if (!collection->get(collection, &key, &item, exception)
-			|| EXCEPTION_FAILED) {
-			return 0;
-		}
-
-		// Perform the binary search using the comparer provided with the item
-		// just returned.
-        
-        // setClusterComparer does a clever hack by moving ownership of the
-        // item's memory into the cursor->cluster, and moving the ownership of
-        // a previously fetched item from cursor->cluster back to item
-        // essentially it's a swap of pointers, ownership means:
-        // who is responsible for freeing that memory, so essentially after a
-        // call to setClusterComparer the item will be owned by this code,
-        // but it will be the one retrieved on a previous iteration of the loop
-		const int comparisonResult = setClusterComparer(cursor, &item);
-        
-        // Item is now the one from previous iteration, so needs to be freed
-		if (item.collection) {
-			COLLECTION_RELEASE(collection, &item);
-		}
-		if (EXCEPTION_FAILED) {
-			return 0;
-		}
-
-		if (comparisonResult == 0) {
-			return middle;
+// Returns the index of the cluster whose node range contains the cursor index
+// using a binary search of the cluster ranges held in memory. Only the cluster
+// found is then fetched from the collection. If no cluster contains the index
+// then the count of clusters is returned.
+static uint32_t setClusterSearch(const Cursor* const cursor) {
+	const IpiCgClusterRange* const ranges = cursor->graph->clusterRanges;
+	const uint32_t searchIndex = cursor->index;
+	uint32_t lower = 0,
+		upper = cursor->graph->clustersCount;
+	while (lower < upper) {
+		const uint32_t middle = lower + (upper - lower) / 2;
+		if (searchIndex < ranges[middle].startIndex) {
+			upper = middle;
 		}
-		else if (comparisonResult > 0) {
-			if (middle) { // guard against underflow of unsigned type
-				upper = middle - 1;
-			}
-			else {
-				lower += 1; // break once iteration finishes
-			}
+		else if (searchIndex > ranges[middle].endIndex) {
+			lower = middle + 1;
 		}
 		else {
-			lower = middle + 1;
+			return middle;
 		}
 	}
-
-	// The item could not be found so return the index of the span that covers 
-	// the range required.
-	return middle;
+	return cursor->graph->clustersCount;
 }
 
 static void setCluster(Cursor* cursor) {
@@ -540,19 +699,41 @@ static void setCluster(Cursor* cursor) {
 		return;
 	}
 
-	// Use binary search to find the index for the cluster. The comparer
-	// records the last cluster checked the cursor will have the correct 
-	// cluster after the search operation.
-	const uint32_t index = setClusterSearch(
-		cursor->graph->clusters,
-		0,
-		cursor->graph->clustersCount - 1,
-		cursor,
-		cursor->ex);
+	// Find the index of the cluster from the ranges in memory. Validate that
+	// the index returned is less than the number of entries in the graph 
+	// collection.
+	const uint32_t index = setClusterSearch(cursor);
+	if (index >= cursor->graph->clustersCount) {
+		EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA);
+		return;
+	}
 
-	if (EXCEPTION_FAILED) {
+	// Fetch the cluster from the collection. The cursor holds at most one
+	// cluster at a time so the previous one is released once the new one is
+	// available.
+	Item item;
+	DataReset(&item.data);
+	item.collection = NULL;
+	const CollectionKeyType keyType = {
+		FIFTYONE_DEGREES_COLLECTION_ENTRY_TYPE_GRAPH_DATA_CLUSTER,
+		cursor->graph->clusters->elementSize,
+		NULL,
+	};
+	const CollectionKey key = {
+		index,
+		&keyType,
+	};
+	const Cluster* const cluster = (const Cluster*)cursor->graph->clusters->get(
+		cursor->graph->clusters,
+		&key,
+		&item,
+		exception);
+	if (!cluster || EXCEPTION_FAILED) {
 		return;
 	}
+	cursorReleaseData(cursor);
+	cursor->cluster.item = item;
+	cursor->cluster.ptr = cluster;
 
 	// Validate that the cluster set has a start index equal to or greater than
 	// the current cursor position.
@@ -565,13 +746,6 @@ static void setCluster(Cursor* cursor) {
 		return;
 	}
 
-	// Validate that the index returned is less than the number of entries in
-	// the graph collection.
-	if (index >= cursor->graph->clustersCount) {
-		EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA);
-		return;
-	}
-
 	// Next time the set method is called the check to see if the cluster needs
 	// to be modified can be applied.
 	cursor->cluster.index = index;
@@ -602,23 +776,25 @@ static void setSpanBytes(Cursor* cursor) {
 		cursor->ex);
 	if (EXCEPTION_FAILED) return;
 
-	// Copy the bits to the low and high bytes ready for comparison.
-	copyBits(
-		cursor->spanLow, 
-		bytes, 
+	// Copy the bits to the low and high words ready for comparison.
+	bitsToWords(
+		bytes,
+		totalBytes,
 		0,
-		cursor->span.lengthLow);
-	copyBits(
-		cursor->spanHigh,
+		cursor->span.lengthLow,
+		cursor->spanLimits.low);
+	bitsToWords(
 		bytes,
-		cursor->span.lengthLow, 
-		cursor->span.lengthHigh);
+		totalBytes,
+		cursor->span.lengthLow,
+		cursor->span.lengthHigh,
+		cursor->spanLimits.high);
 
 	COLLECTION_RELEASE(cursor->graph->spanBytes, &cursorItem);
 
-	if (bitsCompare(
-		cursor->spanLow, 
-		cursor->spanHigh, 
+	if (wordsCompare(
+		cursor->spanLimits.low, 
+		cursor->spanLimits.high, 
 		getMaxSpanLimitLength(cursor)) >= 0) {
 		EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA);
 		return;
@@ -627,16 +803,18 @@ static void setSpanBytes(Cursor* cursor) {
 
 // Set the span low and high limits from the limits bytes.
 void setSpanLimits(Cursor* cursor) {
-	copyBits(
-		cursor->spanLow,
+	bitsToWords(
 		cursor->span.trail.limits,
+		sizeof(cursor->span.trail.limits),
 		0,
-		cursor->span.lengthLow);
-	copyBits(
-		cursor->spanHigh,
+		cursor->span.lengthLow,
+		cursor->spanLimits.low);
+	bitsToWords(
 		cursor->span.trail.limits,
+		sizeof(cursor->span.trail.limits),
 		cursor->span.lengthLow,
-		cursor->span.lengthHigh);
+		cursor->span.lengthHigh,
+		cursor->spanLimits.high);
 }
 
 static const CollectionKeyType CollectionKeyType_Span = {
@@ -645,21 +823,10 @@ static const CollectionKeyType CollectionKeyType_Span = {
 	NULL,
 };
 
-// Sets the cursor span to the correct settings for the current node value 
-// index. Uses the binary search feature of the collection.
-static void setSpan(Cursor* cursor) {
+// Sets the cursor span to the span index provided.
+static void setSpanIndex(Cursor* cursor, const uint32_t spanIndex) {
 	Exception* exception = cursor->ex;
 
-	// First ensure that the correct cluster is set.
-	setCluster(cursor);
-	if (EXCEPTION_FAILED) return;
-
-	// Get the cluster span index.
-	uint32_t spanIndexCluster = getSpanIndexCluster(cursor);
-
-	// Get the actual span index.
-	uint32_t spanIndex = getSpanIndex(cursor, spanIndexCluster);
-
 	// Check if the span needs to be updated.
 	if (cursor->spanSet && cursor->spanIndex == spanIndex) {
 		return;
@@ -672,6 +839,17 @@ static void setSpan(Cursor* cursor) {
 		return;
 	}
 
+	// Use the span decoded when the graph was created if available. The 
+	// limits were validated when decoded and are compared as words.
+	if (cursor->graph->decodedSpans != NULL) {
+		cursor->decodedSpan = &cursor->graph->decodedSpans[spanIndex];
+		cursor->span.lengthLow = cursor->decodedSpan->lengthLow;
+		cursor->span.lengthHigh = cursor->decodedSpan->lengthHigh;
+		cursor->spanSet = true;
+		cursor->spanIndex = spanIndex;
+		return;
+	}
+
 	// Set the span for the current span index.
 	Item cursorItem;
 	DataReset(&cursorItem.data);
@@ -688,9 +866,11 @@ static void setSpan(Cursor* cursor) {
 	cursor->span = *span;
 	COLLECTION_RELEASE(cursor->graph->spans, &cursorItem);
 
-	// Ensure set to 0s before the bits are copied.
-	bytesReset(cursor->spanLow);
-	bytesReset(cursor->spanHigh);
+	// Limits are compared as 128 bit values so can't be any longer.
+	if (getMaxSpanLimitLength(cursor) > VAR_SIZE * 8) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
 
 	// If the span is more than 32 bits then the span bytes are contained in
 	// the span bytes collection.
@@ -708,6 +888,42 @@ static void setSpan(Cursor* cursor) {
 	cursor->spanIndex = spanIndex;
 }
 
+// Sets the cursor span to the correct settings for the current node value 
+// index. Uses the binary search feature of the collection.
+static void setSpan(Cursor* cursor) {
+	Exception* exception = cursor->ex;
+
+	// Aligned nodes already hold the span index.
+	if (cursor->node != NULL) {
+		setSpanIndex(cursor, cursor->node->spanIndex);
+		return;
+	}
+
+	// Use the span index resolved when the graph was created if available.
+	if (cursor->graph->spanIndexes != NULL) {
+		if (cursor->index >= cursor->graph->info.nodes.collection.count) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return;
+		}
+		setSpanIndex(cursor, getSpanIndexResolved(
+			cursor->graph, 
+			cursor->index));
+		return;
+	}
+
+	// First ensure that the correct cluster is set.
+	setCluster(cursor);
+	if (EXCEPTION_FAILED) return;
+
+	// Get the cluster span index.
+	uint32_t spanIndexCluster = getSpanIndexCluster(cursor);
+
+	// Get the actual span index.
+	uint32_t spanIndex = getSpanIndex(cursor, spanIndexCluster);
+
+	setSpanIndex(cursor, spanIndex);
+}
+
 /// Extract `bitCount` bits from `byteValue` starting at `startBit`
 /// @param byteValue raw (full) byte
 /// @param startBit first bit to extract (0 -- MSB, 7 -- LSB)
@@ -758,8 +974,8 @@ static uint64_t extractValue(
 
 // Moves the cursor to the index in the collection returning the value of the
 // record. Uses CgInfo.recordSize to convert the byte array of the record into
-// a 64 bit positive integer.
-static void cursorMove(Cursor* const cursor, const uint32_t index) {
+// a 64 bit positive integer. The span is not changed.
+static void cursorMoveBits(Cursor* const cursor, const uint32_t index) {
 	Exception* const exception = cursor->ex;
 
 	// Work out the byte index for the record index and the starting bit index
@@ -801,6 +1017,166 @@ static void cursorMove(Cursor* const cursor, const uint32_t index) {
 
 	// Set the record index.
 	cursor->index = index;
+}
+
+// Returns the number of bits set in the word.
+static uint32_t bitsCount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint32_t)__builtin_popcountll(word);
+#else
+	uint32_t count = 0;
+	while (word != 0) {
+		word &= word - 1;
+		count++;
+	}
+	return count;
+#endif
+}
+
+// Returns the bits from the bit index of the bytes as a little endian value.
+// The width must not be more than COMPRESSED_WIDTH_MAX.
+static uint64_t compressedBitsRead(
+	const byte* const bytes,
+	const uint64_t bitIndex,
+	const byte width) {
+	const byte* const b = bytes + (bitIndex >> 3);
+	const uint64_t word =
+		(uint64_t)b[0] |
+		((uint64_t)b[1] << 8) |
+		((uint64_t)b[2] << 16) |
+		((uint64_t)b[3] << 24) |
+		((uint64_t)b[4] << 32) |
+		((uint64_t)b[5] << 40) |
+		((uint64_t)b[6] << 48) |
+		((uint64_t)b[7] << 56);
+	return (word >> (bitIndex & 7)) & ((1ULL << width) - 1);
+}
+
+// Returns the record of the node at the index decoded from its block of the
+// compressed nodes. The members are placed in the record in the same 
+// positions as the nodes collection so the node is used in the same way.
+static uint64_t compressedNodeGet(
+	const IpiCg* const graph, 
+	const uint32_t index) {
+	const CompressedBlock* const block = 
+		&((const CompressedBlock*)graph->compressedNodes)[
+			index / COMPRESSED_BLOCK_NODES];
+	const byte* const bits = (const byte*)graph->compressedNodes + 
+		block->offset;
+	const uint32_t position = index % COMPRESSED_BLOCK_NODES;
+	const uint64_t bit = 1ULL << position;
+	const uint32_t rank = bitsCount(block->leaves & (bit - 1));
+	uint64_t value;
+	if (block->leaves & bit) {
+		const uint64_t slot = block->leafValues == 0 ? rank :
+			compressedBitsRead(
+				bits,
+				block->indexesStart + (uint64_t)rank * block->indexWidth,
+				block->indexWidth);
+		value = (uint64_t)graph->info.nodes.collection.count + 
+			block->leafBase + compressedBitsRead(
+				bits,
+				block->leavesStart + slot * block->leafWidth,
+				block->leafWidth);
+	}
+	else {
+		const uint64_t distance = compressedBitsRead(
+			bits,
+			(uint64_t)(position - rank) * block->distanceWidth,
+			block->distanceWidth);
+		value = (uint64_t)(uint32_t)(index + (uint32_t)(distance & 1 ? 
+			~(distance >> 1) : 
+			distance >> 1));
+	}
+	const uint64_t spanIndex = block->spanBase + compressedBitsRead(
+		bits,
+		block->spansStart + (uint64_t)position * block->spanWidth,
+		block->spanWidth);
+	const uint64_t lowFlag = (block->lowFlags >> position) & 1;
+	const IpiCgMemberNode* const members = &graph->info.nodes;
+	return ((value << members->value.shift) & members->value.mask) |
+		((lowFlag << members->lowFlag.shift) & members->lowFlag.mask) |
+		((spanIndex << members->spanIndex.shift) & members->spanIndex.mask);
+}
+
+// Moves the cursor to the index in the compressed nodes.
+static void cursorMoveCompressed(
+	Cursor* const cursor, 
+	const uint32_t index) {
+	Exception* const exception = cursor->ex;
+	if (index >= cursor->graph->info.nodes.collection.count) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
+	cursor->nodeBits = compressedNodeGet(cursor->graph, index);
+	cursor->index = index;
+}
+
+// Moves the cursor to the index in the aligned nodes.
+static void cursorMoveAligned(Cursor* const cursor, const uint32_t index) {
+	Exception* const exception = cursor->ex;
+	if (index >= cursor->graph->info.nodes.collection.count) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
+	cursor->node = &cursor->graph->alignedNodes[index];
+	cursor->index = index;
+}
+
+// Prefetches the node at the index, and the span index resolved for it, if 
+// they are held in memory.
+static void cursorPrefetchNode(
+	const Cursor* const cursor, 
+	const uint32_t index) {
+	const IpiCg* const graph = cursor->graph;
+	if (index >= graph->info.nodes.collection.count) {
+		return;
+	}
+	if (graph->alignedNodes != NULL) {
+		PREFETCH(&graph->alignedNodes[index]);
+		return;
+	}
+	if (graph->compressedNodes != NULL) {
+		PREFETCH(&((const CompressedBlock*)graph->compressedNodes)[
+			index / COMPRESSED_BLOCK_NODES]);
+	}
+	else if (graph->nodesMemory != NULL) {
+		PREFETCH(graph->nodesMemory + 
+			((uint64_t)index * graph->info.nodes.recordSize) / 8);
+	}
+	if (graph->spanIndexes != NULL) {
+		PREFETCH((const byte*)graph->spanIndexes + 
+			(size_t)index * graph->spanIndexesSize);
+	}
+}
+
+// Prefetches both the nodes the cursor might move to from the current node 
+// before the span compare decides which. One is the node the value points to
+// and the other is the node that follows the current one. The loads are then
+// in flight while the span for the current node is fetched and compared.
+static void cursorPrefetch(const Cursor* const cursor) {
+	cursorPrefetchNode(cursor, getValue(cursor));
+	cursorPrefetchNode(
+		cursor, 
+		cursor->node != NULL ? cursor->node->next : cursor->index + 1);
+}
+
+// Moves the cursor to the index and sets the span for the node.
+static void cursorMove(Cursor* const cursor, const uint32_t index) {
+	Exception* const exception = cursor->ex;
+	if (cursor->graph->alignedNodes != NULL) {
+		cursorMoveAligned(cursor, index);
+	}
+	else if (cursor->graph->compressedNodes != NULL) {
+		cursorMoveCompressed(cursor, index);
+	}
+	else {
+		cursorMoveBits(cursor, index);
+	}
+	if (EXCEPTION_FAILED) return;
+
+	// Start loading the candidates for the next move.
+	cursorPrefetch(cursor);
 
 	// Set the correct span to use for any compare operations.
 	setSpan(cursor);
@@ -815,7 +1191,16 @@ static void cursorMoveTo(Cursor* cursor) {
 
 // Moves the cursor to the next entry.
 static void cursorMoveNext(Cursor* cursor) {
-	cursorMove(cursor, cursor->index + 1);
+	cursorMove(
+		cursor, 
+		cursor->node != NULL ? cursor->node->next : cursor->index + 1);
+}
+
+// The index of the root node for the graph.
+static uint32_t getRootIndex(const IpiCg* const graph) {
+	return graph->alignedNodes != NULL ? 
+		graph->alignedRootIndex :
+		graph->info.graphIndex;
 }
 
 // Creates a cursor ready for evaluation with the graph and IP address.
@@ -824,45 +1209,39 @@ static Cursor cursorCreate(
 	IpAddress ip,
 	StringBuilder* sb,
 	Exception* exception) {
+
+	// Bytes after the length of the address for the graph are never part of
+	// the address and are set to zero.
+	const byte ipLength = getIpLengthFromGraph(&graph->info);
+	memset(ip.value + ipLength, 0, sizeof(ip.value) - ipLength);
 	Cursor cursor = {
-		graph,
-		ip,
+		graph, // graph
+		ip, // ip
+		ipLength, // ipLength
 		{ // nodeBytesKeyType
 			FIFTYONE_DEGREES_COLLECTION_ENTRY_TYPE_GRAPH_DATA_NODE_BYTES,
 			0, // TBD
 			NULL,
 		},
+		{ bytesToWord(ip.value), bytesToWord(ip.value + 8) }, // ipWords
+		0, // bitIndex
+		0, // nodeBits
+		NULL, // node
+		0, // index
+		getRootIndex(graph), // previousHighIndex
+		{ 0 }, // cluster
+		0, // spanIndex
+		{ 0 }, // span
+		NULL, // decodedSpan
+		{ { 0, 0 }, { 0, 0 }, 0, 0 }, // spanLimits
+		false, // spanSet
+		NO_COMPARE, // compareResult
+		sb, // sb
+		exception, // ex
 	};
-	bytesReset(cursor.ipValue);
-	cursor.bitIndex = 0;
-	cursor.nodeBits = 0;
-	cursor.index = 0;
-	cursor.previousHighIndex = graph->info.graphIndex;
-	cursor.cluster.index = 0;
-	cursor.cluster.ptr = NULL;
-	DataReset(&cursor.cluster.item.data);
-	cursor.cluster.item.handle = NULL;
-	cursor.cluster.item.collection = NULL;
-	cursor.spanIndex = 0;
-	cursor.span.lengthLow = 0;
-	cursor.span.lengthHigh = 0;
-	cursor.span.trail.offset = 0;
-	cursor.spanSet = false;
-	cursor.compareResult = NO_COMPARE;
-	cursor.sb = sb;
-	cursor.ex = exception;
 	return cursor;
 }
 
-static void cursorReleaseData(Cursor* const cursor) {
-	if (cursor->cluster.ptr) {
-		COLLECTION_RELEASE(
-			cursor->cluster.item.collection,
-			&cursor->cluster.item);
-		cursor->cluster.ptr = NULL;
-	}
-}
-
 // Moves the cursor for an low entry.
 // Returns true if a leaf has been found and getProfileIndex can be used to
 // return a result.
@@ -969,100 +1348,323 @@ static void selectCompleteLow(Cursor* cursor) {
 	}
 }
 
-// Compares the current span to the relevant bits in the IP address. The
-// comparison varies depending on whether the limit is lower or higher than the
-// equal span.
-static void compareIpToSpan(Cursor* cursor) {
-	// Set the cursor->ipValue to the required bits from the IP address for
-	// numeric comparison.
-	setIpValue(cursor); 
+// Moves the cursor for the current compare result. Returns true if a leaf has
+// been found and getProfileIndex can be used to return a result.
+static bool cursorSelect(Cursor* cursor) {
+	Exception* exception = cursor->ex;
+	switch (cursor->compareResult) {
+	case LESS_THAN_LOW:
+		selectCompleteLow(cursor);
+		return true;
+	case EQUAL_LOW:
+		// Advance the bits before the cursor is changed.
+		cursor->bitIndex += cursor->span.lengthLow;
+		return selectLow(cursor);
+	case INBETWEEN:
+		selectCompleteLowHigh(cursor);
+		return true;
+	case EQUAL_HIGH:
+		// Advance the bits before the cursor is changed.
+		cursor->previousHighIndex = cursor->index;
+		cursor->bitIndex += cursor->span.lengthHigh;
+		return selectHigh(cursor);
+	case GREATER_THAN_HIGH:
+		selectCompleteHigh(cursor);
+		return true;
+	default:
+		EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA);
+		return true;
+	}
+}
 
-	// Set the comparison result.
-	int lowCompare = bitsCompare(
-		cursor->ipValue,
-		cursor->spanLow,
-		cursor->span.lengthLow);
-	int highCompare = bitsCompare(
-		cursor->ipValue,
-		cursor->spanHigh,
-		cursor->span.lengthHigh);
+// The compare result for the results of comparing the bits of the IP address
+// to the low and high limits of the span.
+static CompareResult getCompareResult(
+	const int lowCompare,
+	const int highCompare) {
 	if (lowCompare < 0) {
-		cursor->compareResult = LESS_THAN_LOW;
-	}
-	else if (lowCompare == 0) {
-		cursor->compareResult = EQUAL_LOW;
+		return LESS_THAN_LOW;
 	}
-	else if (lowCompare > 0 && highCompare < 0)
-	{
-		cursor->compareResult = INBETWEEN;
+	if (lowCompare == 0) {
+		return EQUAL_LOW;
 	}
-	else if (highCompare == 0) {
-		cursor->compareResult = EQUAL_HIGH;
-		cursor->previousHighIndex = cursor->index;
+	if (lowCompare > 0 && highCompare < 0) {
+		return INBETWEEN;
 	}
-	else if (highCompare > 0) {
-		cursor->compareResult = GREATER_THAN_HIGH;
+	if (highCompare == 0) {
+		return EQUAL_HIGH;
 	}
-	else {
-		// Should never happen.
-		cursor->compareResult = NO_COMPARE;
+	if (highCompare > 0) {
+		return GREATER_THAN_HIGH;
 	}
+	
+	// Should never happen.
+	return NO_COMPARE;
+}
+
+// Compares the current span to the relevant bits of an IPv4 address. The 32
+// bits of the address are in the first word so only that word is shifted and
+// compared.
+static void compareIpv4ToSpan(Cursor* cursor) {
+	const IpiCgSpan* const limits = getSpanLimits(cursor);
+	const uint64_t ipWord = cursor->bitIndex < 64 ?
+		cursor->ipWords[0] << cursor->bitIndex :
+		0;
+	cursor->compareResult = getCompareResult(
+		wordCompare(ipWord, limits->low, cursor->span.lengthLow),
+		wordCompare(ipWord, limits->high, cursor->span.lengthHigh));
 
 	// If tracing enabled output the results.
 	TRACE_COMPARE(cursor);
 }
 
-// Evaluates the cursor until a leaf is found and then returns the profile
-// index.
-static uint32_t evaluate(Cursor* cursor) {
-	Exception* exception = cursor->ex;
-	bool found = false;
-	traceNewLine(cursor);
+// Compares the current span to the relevant bits of an IPv6 address a word at
+// a time.
+static void compareIpv6ToSpan(Cursor* cursor) {
+	const IpiCgSpan* const limits = getSpanLimits(cursor);
+	uint64_t ipWords[2];
+	setIpWords(cursor, ipWords);
+	cursor->compareResult = getCompareResult(
+		wordsCompare(ipWords, limits->low, cursor->span.lengthLow),
+		wordsCompare(ipWords, limits->high, cursor->span.lengthHigh));
 
-	// Move the cursor to the entry for the graph.
-	cursorMove(cursor, cursor->graph->info.graphIndex);
-	if (EXCEPTION_FAILED) return 0;
+	// If tracing enabled output the results.
+	TRACE_COMPARE(cursor);
+}
 
-	do
-	{
-		// Compare the current cursor IP bits against the span limits.
-		compareIpToSpan(cursor);
+// Returns the chain of nodes that starts at the cursor if the bits of the 
+// address from the bit index are equal to the bits of the chain, otherwise
+// NULL. Chains are only checked once the compare at the node is equal to a 
+// limit so addresses that leave the chain at its first node pay nothing. The
+// whole chain must be followed before all the bytes of the address are 
+// consumed as the walk would otherwise end part way along it. Trace builds 
+// never skip so that every step is recorded.
+static const IpiCgSkip* getSkip(const Cursor* const cursor) {
+#ifdef FIFTYONE_DEGREES_IPI_GRAPH_TRACE
+	return NULL;
+#else
+	const IpiCg* const graph = cursor->graph;
+	if (graph->skipIndexes == NULL ||
+		(cursor->compareResult != EQUAL_LOW && 
+			cursor->compareResult != EQUAL_HIGH)) {
+		return NULL;
+	}
+	const uint32_t skipIndex = graph->skipIndexes[cursor->index];
+	if (skipIndex == UINT32_MAX) {
+		return NULL;
+	}
+	const IpiCgSkip* const skip = &graph->skips[skipIndex];
+	if (cursor->bitIndex + skip->length >= cursor->ipLength * 8) {
+		return NULL;
+	}
+	uint64_t ipWords[2];
+	setIpWords(cursor, ipWords);
+	return wordsCompare(ipWords, skip->bits, skip->length) == 0 ? 
+		skip : 
+		NULL;
+#endif
+}
 
-		switch (cursor->compareResult) {
-		case LESS_THAN_LOW:
-			selectCompleteLow(cursor);
-			if (EXCEPTION_FAILED) return 0;
-			found = true;
-			break;
-		case EQUAL_LOW:
-			// Advance the bits before the cursor is changed.
-			cursor->bitIndex += cursor->span.lengthLow;
-			found = selectLow(cursor);
-			if (EXCEPTION_FAILED) return 0;
-			break;
-		case INBETWEEN:
-			selectCompleteLowHigh(cursor);
-			if (EXCEPTION_FAILED) return 0;
-			found = true;
-			break;
-		case EQUAL_HIGH:
-			// Advance the bits before the cursor is changed.
-			cursor->bitIndex += cursor->span.lengthHigh;
-			found = selectHigh(cursor);
-			if (EXCEPTION_FAILED) return 0;
-			break;
-		case GREATER_THAN_HIGH:
-			selectCompleteHigh(cursor);
-			if (EXCEPTION_FAILED) return 0;
-			found = true;
-			break;
-		default:
-			EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA);
-			return UINT32_MAX;
-		}
+// Advances the bits and the previous high index as following each node of 
+// the chain would.
+static void skipAdvance(Cursor* const cursor, const IpiCgSkip* const skip) {
+	cursor->bitIndex += skip->length;
+	if (skip->previousHigh != UINT32_MAX) {
+		cursor->previousHighIndex = skip->previousHigh;
+	}
+}
+
+// Returns the result shared by every walk from the node at the cursor if 
+// there is one, otherwise NULL. The result is only returned if the bits of 
+// the address that follow the bit index can't be consumed before a leaf is
+// reached. Trace builds never return early so that every step is recorded.
+static const IpiCgUniform* getUniform(const Cursor* const cursor) {
+#ifdef FIFTYONE_DEGREES_IPI_GRAPH_TRACE
+	return NULL;
+#else
+	const IpiCg* const graph = cursor->graph;
+	if (graph->uniformBits == NULL) {
+		return NULL;
+	}
+	const uint64_t word = graph->uniformBits[cursor->index / 64];
+	const uint64_t bit = (uint64_t)1 << (cursor->index % 64);
+	if ((word & bit) == 0) {
+		return NULL;
+	}
+	const IpiCgUniform* const uniform = &graph->uniforms[
+		graph->uniformRanks[cursor->index / 64] + bitsCount(word & (bit - 1))];
+	return cursor->bitIndex + uniform->length < cursor->ipLength * 8 ?
+		uniform :
+		NULL;
+#endif
+}
+
+// Defines a function that evaluates the cursor with the compare method until
+// a leaf is found and then returns the profile index. A separate function is
+// defined for each address width so that the compare method is known to the
+// compiler and called directly whether or not the walk is inlined. At each 
+// node the result is returned if every walk from the node returns it. 
+// Otherwise the bits of the address are compared to the span limits and the
+// cursor moves to the end of the chain that starts at the node if the bits 
+// are equal to it, or for the result of the comparison.
+#define EVALUATE_WITH(n,c) \
+static uint32_t n(Cursor* cursor) { \
+	Exception* exception = cursor->ex; \
+	bool found = false; \
+	traceNewLine(cursor); \
+	cursorMove(cursor, getRootIndex(cursor->graph)); \
+	if (EXCEPTION_FAILED) return 0; \
+	do \
+	{ \
+		const IpiCgUniform* const uniform = getUniform(cursor); \
+		if (uniform != NULL) { \
+			return uniform->profileIndex; \
+		} \
+		c(cursor); \
+		const IpiCgSkip* const skip = getSkip(cursor); \
+		if (skip != NULL) { \
+			skipAdvance(cursor, skip); \
+			cursorMove(cursor, skip->target); \
+		} \
+		else { \
+			found = cursorSelect(cursor); \
+		} \
+		if (EXCEPTION_FAILED) return 0; \
+	} while (found == false && isExhausted(cursor) == false); \
+	return getWalkResult(cursor); \
+}
+
+// Returns the node placed after the aligned nodes of the graph that the last
+// node points to as its next node. The checked walk treats a move to it as
+// corrupt data. The validated walk can move to it without a check. Its span
+// has no limits so it is always equal to the low limit, and it is a low leaf
+// so the walk then ends. The profile index is out of range so the result is
+// corrupt data as for the checked walk.
+static IpiCgNode validatedTrapNode(const IpiCg* const graph) {
+	IpiCgNode node;
+	node.value = UINT32_MAX;
+	node.next = graph->info.nodes.collection.count;
+	node.spanIndex = graph->spansCount;
+	node.flags = FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG;
+	return node;
+}
+
+// Moves the cursor to the node of a validated graph. The node and its span 
+// were checked when the graph was created so no checks are needed.
+static void validatedMove(Cursor* const cursor, const uint32_t index) {
+	const IpiCg* const graph = cursor->graph;
+	cursor->node = &graph->alignedNodes[index];
+	cursor->index = index;
+	cursorPrefetch(cursor);
+	cursor->decodedSpan = &graph->decodedSpans[cursor->node->spanIndex];
+	cursor->span.lengthLow = cursor->decodedSpan->lengthLow;
+	cursor->span.lengthHigh = cursor->decodedSpan->lengthHigh;
+}
+
+// Equivalent of selectLow for a validated graph.
+static bool validatedSelectLow(Cursor* const cursor) {
+	const IpiCgNode* const node = cursor->node;
+	if ((node->flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) == 0) {
+		validatedMove(cursor, node->next);
+		return false;
+	}
+	if (node->value >= cursor->graph->info.nodes.collection.count) {
+		return true;
+	}
+	validatedMove(cursor, node->value);
+	return false;
+}
+
+// Equivalent of selectHigh for a validated graph.
+static bool validatedSelectHigh(Cursor* const cursor) {
+	if (cursor->node->flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) {
+		validatedMove(cursor, cursor->node->next);
+	}
+	if (cursor->node->value >= cursor->graph->info.nodes.collection.count) {
+		return true;
+	}
+	validatedMove(cursor, cursor->node->value);
+	return false;
+}
+
+// Equivalent of cursorSelect for a validated graph.
+static bool validatedSelect(Cursor* const cursor) {
+	switch (cursor->compareResult) {
+	case LESS_THAN_LOW:
+		validatedMove(cursor, cursor->previousHighIndex);
+		if (validatedSelectLow(cursor)) return true;
+		while (validatedSelectHigh(cursor) == false);
+		return true;
+	case EQUAL_LOW:
+		cursor->bitIndex += cursor->span.lengthLow;
+		return validatedSelectLow(cursor);
+	case INBETWEEN:
+		if (validatedSelectLow(cursor)) return true;
+		while (validatedSelectHigh(cursor) == false);
+		return true;
+	case EQUAL_HIGH:
+		cursor->previousHighIndex = cursor->index;
+		cursor->bitIndex += cursor->span.lengthHigh;
+		return validatedSelectHigh(cursor);
+	default:
+		// The only other result of a compare is GREATER_THAN_HIGH.
+		while (validatedSelectHigh(cursor) == false);
+		return true;
+	}
+}
+
+// Equivalent of EVALUATE_WITH for a validated graph. There are no checks or
+// exceptions in the walk and the collections of the graph are not used.
+#define EVALUATE_VALIDATED_WITH(n,c) \
+static uint32_t n(Cursor* cursor) { \
+	bool found = false; \
+	validatedMove(cursor, cursor->graph->alignedRootIndex); \
+	do \
+	{ \
+		const IpiCgUniform* const uniform = getUniform(cursor); \
+		if (uniform != NULL) { \
+			return uniform->profileIndex; \
+		} \
+		c(cursor); \
+		const IpiCgSkip* const skip = getSkip(cursor); \
+		if (skip != NULL) { \
+			skipAdvance(cursor, skip); \
+			validatedMove(cursor, skip->target); \
+		} \
+		else { \
+			found = validatedSelect(cursor); \
+		} \
+	} while (found == false && isExhausted(cursor) == false); \
+	return getWalkResult(cursor); \
+}
+
+// Evaluates a cursor for an IPv4 graph.
+EVALUATE_WITH(evaluateIpv4, compareIpv4ToSpan)
+
+// Evaluates a cursor for an IPv6 graph.
+EVALUATE_WITH(evaluateIpv6, compareIpv6ToSpan)
 
- 	} while (found == false && isExhausted(cursor) == false);
-	return getProfileIndex(cursor);
+// Evaluates a cursor for a validated IPv4 graph.
+EVALUATE_VALIDATED_WITH(evaluateValidatedIpv4, compareIpv4ToSpan)
+
+// Evaluates a cursor for a validated IPv6 graph.
+EVALUATE_VALIDATED_WITH(evaluateValidatedIpv6, compareIpv6ToSpan)
+
+// Evaluates the cursor until a leaf is found and then returns the profile
+// index. The walk specialised for the address width of the graph is used,
+// without checks if the graph was validated when created. Trace builds 
+// always use the checked walk as it records each step.
+static uint32_t evaluate(Cursor* cursor) {
+#ifndef FIFTYONE_DEGREES_IPI_GRAPH_TRACE
+	if (cursor->graph->validated) {
+		return cursor->ipLength == FIFTYONE_DEGREES_IPV4_LENGTH ?
+			evaluateValidatedIpv4(cursor) :
+			evaluateValidatedIpv6(cursor);
+	}
+#endif
+	return cursor->ipLength == FIFTYONE_DEGREES_IPV4_LENGTH ?
+		evaluateIpv4(cursor) :
+		evaluateIpv6(cursor);
 }
 
 // Applies profile mappings from graph info to evaluation result.
@@ -1078,7 +1680,10 @@ static fiftyoneDegreesIpiCgResult toResult(
 		0,
 		false,
 	};
-	if (profileIndex < graph->info.profileCount) {
+	if (profileIndex == PROFILE_INDEX_NONE) {
+		result = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+	}
+	else if (profileIndex < graph->info.profileCount) {
 		result.offset = profileIndex + graph->info.firstProfileIndex;
 	}
 	else {
@@ -1094,32 +1699,360 @@ static fiftyoneDegreesIpiCgResult toResult(
 	return result;
 }
 
-static fiftyoneDegreesIpiCgResult ipiGraphEvaluate(
+// Returns the graph for the component id and IP version, or NULL if there is
+// no graph available.
+static const IpiCg* getGraph(
 	const fiftyoneDegreesIpiCgArray * const graphs,
-	byte componentId,
+	const byte componentId,
+	const byte version) {
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		const IpiCg* const graph = &graphs->items[i];
+		if (version == graph->info.version &&
+			componentId == graph->info.componentId) {
+			return graph;
+		}
+	}
+	return NULL;
+}
+
+// Evaluates the graph for the IP address returning the mapped result.
+static fiftyoneDegreesIpiCgResult ipiGraphEvaluateGraph(
+	const IpiCg* const graph,
 	fiftyoneDegreesIpAddress address,
 	StringBuilder* sb,
 	fiftyoneDegreesException* exception) {
 	fiftyoneDegreesIpiCgResult result = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
-	for (uint32_t i = 0; i < graphs->count; i++) {
-		const IpiCg* const graph = &graphs->items[i];
-		if (address.type == graph->info.version &&
-			componentId == graph->info.componentId) {
-			Cursor cursor = cursorCreate(graph, address, sb, exception);
-			const uint32_t profileIndex = evaluate(&cursor);
-			if (EXCEPTION_OKAY) {
-				result = toResult(profileIndex, graph, exception);
-				if (EXCEPTION_OKAY) {
-					TRACE_RESULT(&cursor, result);
-				}
-			}
-			cursorReleaseData(&cursor);
-			break;
+	Cursor cursor = cursorCreate(graph, address, sb, exception);
+	const uint32_t profileIndex = evaluate(&cursor);
+	if (EXCEPTION_OKAY) {
+		result = toResult(profileIndex, graph, exception);
+		if (EXCEPTION_OKAY) {
+			TRACE_RESULT(&cursor, result);
 		}
 	}
+	cursorReleaseData(&cursor);
 	return result;
 }
 
+// Returns the IPv4 address embedded in the IPv6 address as an IPv4-mapped 
+// (::ffff:a.b.c.d), IPv4-compatible (::a.b.c.d) or 6to4 (2002:aabb:ccdd::)
+// address. Returns false if the address does not embed an IPv4 address. The
+// unspecified (::) and loopback (::1) addresses are not IPv4-compatible.
+static bool getEmbeddedIpv4(
+	const IpAddress* const address,
+	IpAddress* const ipv4) {
+	static const byte zeros[12] = { 0 };
+	const byte* source;
+	if (address->type != IP_TYPE_IPV6) {
+		return false;
+	}
+	if (memcmp(address->value, zeros, 10) == 0 &&
+		address->value[10] == 0xff &&
+		address->value[11] == 0xff) {
+		source = address->value + 12;
+	}
+	else if (memcmp(address->value, zeros, 12) == 0 &&
+		(memcmp(address->value + 12, zeros, 3) != 0 ||
+		address->value[15] > 1)) {
+		source = address->value + 12;
+	}
+	else if (address->value[0] == 0x20 && address->value[1] == 0x02) {
+		source = address->value + 2;
+	}
+	else {
+		return false;
+	}
+	memset(ipv4, 0, sizeof(IpAddress));
+	memcpy(ipv4->value, source, FIFTYONE_DEGREES_IPV4_LENGTH);
+	ipv4->type = IP_TYPE_IPV4;
+	return true;
+}
+
+// Returns the graph for the component and the address. If the graphs were 
+// created with the normalizeIpv4 option and the address is an IPv6 address
+// that embeds an IPv4 address then the address is replaced with the IPv4 
+// address and the IPv4 graph is returned if there is one for the component.
+static const IpiCg* getGraphForAddress(
+	const fiftyoneDegreesIpiCgArray * const graphs,
+	const byte componentId,
+	IpAddress* const address) {
+	IpAddress ipv4;
+	if (graphs->config.normalizeIpv4 && getEmbeddedIpv4(address, &ipv4)) {
+		const IpiCg* const graph = getGraph(graphs, componentId, ipv4.type);
+		if (graph != NULL) {
+			*address = ipv4;
+			return graph;
+		}
+	}
+	return getGraph(graphs, componentId, address->type);
+}
+
+// Graphs of a component looked up once for many addresses.
+typedef struct component_graphs_t {
+	const IpiCg* ipv4; // Graph for IPv4 addresses or NULL
+	const IpiCg* ipv6; // Graph for IPv6 addresses or NULL
+	bool normalizeIpv4; // True if embedded IPv4 addresses use the IPv4 graph
+} ComponentGraphs;
+
+// Returns the graphs for each IP version of the component.
+static ComponentGraphs getComponentGraphs(
+	const fiftyoneDegreesIpiCgArray * const graphs,
+	const byte componentId) {
+	ComponentGraphs component;
+	component.ipv4 = getGraph(graphs, componentId, IP_TYPE_IPV4);
+	component.ipv6 = getGraph(graphs, componentId, IP_TYPE_IPV6);
+	component.normalizeIpv4 = graphs->config.normalizeIpv4;
+	return component;
+}
+
+// Returns the graph of the component for the address in the same way as 
+// getGraphForAddress without searching the array of graphs.
+static const IpiCg* getComponentGraph(
+	const ComponentGraphs* const component,
+	IpAddress* const address) {
+	IpAddress ipv4;
+	switch (address->type) {
+	case IP_TYPE_IPV4:
+		return component->ipv4;
+	case IP_TYPE_IPV6:
+		if (component->normalizeIpv4 && 
+			component->ipv4 != NULL &&
+			getEmbeddedIpv4(address, &ipv4)) {
+			*address = ipv4;
+			return component->ipv4;
+		}
+		return component->ipv6;
+	default:
+		return NULL;
+	}
+}
+
+static fiftyoneDegreesIpiCgResult ipiGraphEvaluate(
+	const fiftyoneDegreesIpiCgArray * const graphs,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
+	StringBuilder* sb,
+	fiftyoneDegreesException* exception) {
+	const IpiCg* const graph = getGraphForAddress(
+		graphs, 
+		componentId, 
+		&address);
+	if (graph == NULL) {
+		return FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+	}
+	return ipiGraphEvaluateGraph(graph, address, sb, exception);
+}
+
+/**
+ * DIRECT FILE COLLECTIONS
+ *
+ * A collection that reads the bytes of each fetch with a positional read of
+ * the file on the calling thread. Positional reads do not move a shared file
+ * offset so any number of threads read at the same time without a pool of 
+ * readers. Pages read are held in a table where each entry is set once with
+ * a compare and swap and never changed until the collection is freed, so 
+ * pages are found without a lock or a reference count. Once the limit of 
+ * pages is reached further fetches are read into the item.
+ */
+
+#ifdef __linux__
+
+// Number of bytes in each page held by a direct collection.
+#define DIRECT_PAGE 4096
+
+// State of a direct collection.
+typedef struct direct_collection_t {
+	int file; // Descriptor owned by the collection
+	uint64_t startPosition; // Position of the first byte of the collection
+	byte** pages; // Pages read, or NULL entries for pages not yet read
+	uint32_t pagesCount; // Number of pages the collection covers
+	uint32_t pagesLimit; // Maximum number of pages to hold
+	uint32_t pagesHeld; // Number of pages held or being read
+} DirectCollection;
+
+// Reads the bytes at the position of the collection, repeating the read if 
+// fewer bytes are returned. Returns true if all the bytes were read.
+static bool directRead(
+	const DirectCollection* const state,
+	byte* const buffer,
+	const uint64_t offset,
+	const uint32_t length) {
+	uint32_t done = 0;
+	while (done < length) {
+		const ssize_t count = pread(
+			state->file,
+			buffer + done,
+			length - done,
+			(off_t)(state->startPosition + offset + done));
+		if (count <= 0) {
+			return false;
+		}
+		done += (uint32_t)count;
+	}
+	return true;
+}
+
+// Returns the page, reading it if it is not held and the limit has not been
+// reached. Returns NULL if the page is not held and can't be.
+static byte* directPage(
+	const Collection* const collection,
+	DirectCollection* const state,
+	const uint32_t page) {
+	byte* held = __atomic_load_n(&state->pages[page], __ATOMIC_ACQUIRE);
+	if (held != NULL) {
+		return held;
+	}
+	if (__atomic_add_fetch(&state->pagesHeld, 1, __ATOMIC_RELAXED) > 
+		state->pagesLimit) {
+		__atomic_sub_fetch(&state->pagesHeld, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	const uint64_t offset = (uint64_t)page * DIRECT_PAGE;
+	const uint32_t length = (uint32_t)(collection->size - offset < 
+		DIRECT_PAGE ? collection->size - offset : DIRECT_PAGE);
+	byte* const bytes = (byte*)Malloc(length);
+	if (bytes == NULL || directRead(state, bytes, offset, length) == false) {
+		if (bytes != NULL) {
+			Free(bytes);
+		}
+		__atomic_sub_fetch(&state->pagesHeld, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	// Another thread may have read the same page. Keep the first.
+	if (__atomic_compare_exchange_n(
+		&state->pages[page],
+		&held,
+		bytes,
+		false,
+		__ATOMIC_ACQ_REL,
+		__ATOMIC_ACQUIRE) == false) {
+		Free(bytes);
+		__atomic_sub_fetch(&state->pagesHeld, 1, __ATOMIC_RELAXED);
+		return held;
+	}
+	return bytes;
+}
+
+// Collection get method that returns the bytes from a held page if they are
+// within one, otherwise reads them into the item.
+static void* directGet(
+	const Collection* collection,
+	const CollectionKey* key,
+	Item* item,
+	Exception* exception) {
+	DirectCollection* const state = (DirectCollection*)collection->state;
+	const uint32_t index = key->indexOrOffset.index;
+	if (index >= collection->count) {
+		EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_POINTER_OUT_OF_BOUNDS);
+		return NULL;
+	}
+
+	// Variable width keys need more bytes than the element size.
+	uint32_t length = collection->elementSize;
+	if (key->keyType->initialBytesCount > length) {
+		length = key->keyType->initialBytesCount;
+	}
+	const uint64_t offset = (uint64_t)index * collection->elementSize;
+	if (offset + length > collection->size) {
+		length = (uint32_t)(collection->size - offset);
+	}
+
+	const uint32_t page = (uint32_t)(offset / DIRECT_PAGE);
+	if ((offset + length - 1) / DIRECT_PAGE == page) {
+		byte* const held = directPage(collection, state, page);
+		if (held != NULL) {
+			item->data.ptr = held + (offset - (uint64_t)page * DIRECT_PAGE);
+			item->data.used = length;
+			item->handle = NULL;
+			item->collection = collection;
+			return item->data.ptr;
+		}
+	}
+
+	byte* const ptr = (byte*)DataMalloc(&item->data, length);
+	if (ptr == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	if (directRead(state, ptr, offset, length) == false) {
+		Free(ptr);
+		DataReset(&item->data);
+		EXCEPTION_SET(FILE_READ_ERROR);
+		return NULL;
+	}
+	item->data.used = length;
+	item->handle = ptr;
+	item->collection = collection;
+	return ptr;
+}
+
+// Frees the bytes read into the item if they are not in a held page.
+static void directRelease(Item* item) {
+	if (item->handle != NULL) {
+		Free(item->handle);
+		DataReset(&item->data);
+		item->handle = NULL;
+	}
+}
+
+static void directFree(Collection* collection) {
+	DirectCollection* const state = (DirectCollection*)collection->state;
+	for (uint32_t i = 0; i < state->pagesCount; i++) {
+		if (state->pages[i] != NULL) {
+			Free(state->pages[i]);
+		}
+	}
+	Free(state->pages);
+	close(state->file);
+	Free(state);
+	Free(collection);
+}
+
+// Creates a direct collection for the header with its own descriptor for 
+// the file. Holds at most the number of pages given. Returns NULL if the 
+// collection can't be created.
+static Collection* directCreate(
+	FILE* const file,
+	const CollectionHeader header,
+	const uint32_t pagesLimit) {
+	Collection* const collection = (Collection*)Malloc(sizeof(Collection));
+	DirectCollection* const state = (DirectCollection*)Malloc(
+		sizeof(DirectCollection));
+	const uint32_t pagesCount = (uint32_t)(
+		((uint64_t)header.length + DIRECT_PAGE - 1) / DIRECT_PAGE);
+	byte** const pages = (byte**)Malloc(
+		sizeof(byte*) * (pagesCount > 0 ? pagesCount : 1));
+	const int descriptor = collection != NULL && state != NULL && 
+		pages != NULL ? dup(fileno(file)) : -1;
+	if (descriptor < 0) {
+		if (collection != NULL) Free(collection);
+		if (state != NULL) Free(state);
+		if (pages != NULL) Free(pages);
+		return NULL;
+	}
+	memset(pages, 0, sizeof(byte*) * (pagesCount > 0 ? pagesCount : 1));
+	state->file = descriptor;
+	state->startPosition = header.startPosition;
+	state->pages = pages;
+	state->pagesCount = pagesCount;
+	state->pagesLimit = pagesLimit;
+	state->pagesHeld = 0;
+	memset(collection, 0, sizeof(Collection));
+	collection->get = directGet;
+	collection->release = directRelease;
+	collection->freeCollection = directFree;
+	collection->state = state;
+	collection->count = header.count;
+	collection->elementSize = header.count > 0 ? 
+		header.length / header.count : 
+		0;
+	collection->size = header.length;
+	return collection;
+}
+
+#endif
+
 // Graph headers might be duplicated across different graphs. As such the 
 // reader passed may not be at the first byte of the graph being created. The
 // current reader position is therefore modified to that of the header and then
@@ -1129,6 +2062,13 @@ static Collection* ipiGraphCreateFromFile(
 	void* state) {
 	FileCollection * const s = (FileCollection*)state;
 
+#ifdef __linux__
+	// Collections that are loaded into memory don't need the pool or cache.
+	if (s->directReads && s->config.loaded < header.count) {
+		return directCreate(s->file, header, s->config.capacity);
+	}
+#endif
+
 	const FileOffset current = FileTell(s->file);
 	if (current < 0) {
 		return NULL;
@@ -1181,197 +2121,6147 @@ static const CollectionKeyType CollectionKeyType_GraphInfo = {
 	NULL,
 };
 
-static IpiCgArray* ipiGraphCreate(
-	Collection* collection,
-	collectionCreate collectionCreate,
-	void* state,
-	Exception* exception) {
-	IpiCgArray* graphs;
+// Block of memory that the prepared structures of all the graphs are 
+// allocated from when the useArena option is enabled.
+typedef struct arena_t {
+	byte* base; // Start of the block
+	size_t size; // Number of bytes in the block
+	size_t used; // Number of bytes allocated from the block
+} Arena;
+
+// Returns the size rounded up to the alignment which must be a power of 2.
+static size_t alignSize(const size_t size, const size_t alignment) {
+	return (size + alignment - 1) & ~(alignment - 1);
+}
 
-	// Create the array for each of the graphs.
-	uint32_t count = CollectionGetCount(collection);
-	FIFTYONE_DEGREES_ARRAY_CREATE(IpiCg, graphs, count); 
-	if (graphs == NULL) {
-		EXCEPTION_SET(INSUFFICIENT_MEMORY);
-		return NULL;
-	}
+/**
+ * MEMORY PLACEMENT
+ * 
+ * On Linux an arena can be mapped directly from the kernel so that it can be
+ * backed by huge pages and placed on particular NUMA nodes. The memory policy
+ * system calls are used directly to avoid a dependency on libnuma. Policies 
+ * are applied before the memory is first written so that the pages are 
+ * allocated where requested. Failures to apply a policy are ignored as the 
+ * memory is still usable. On other platforms the options are ignored and
+ * arenas are allocated from the heap.
+ */
 
-	for (uint32_t i = 0; i < count; i++) {
-		graphs->items[i].nodes = NULL;
-		graphs->items[i].spans = NULL;
+// Maximum number of NUMA nodes supported. One for each bit of a node mask.
+#define PLACEMENT_MAX_NODES (sizeof(unsigned long) * 8)
 
-		Item itemInfo;
-		DataReset(&itemInfo.data);
+#ifdef __linux__
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << 26)
+#endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
 
-		// Get the information from the collection provided.
-		const CollectionKey infoKey = {
-			i,
-			&CollectionKeyType_GraphInfo,
-		};
-		const IpiCgInfo* const info = (IpiCgInfo*)collection->get(
-			collection, 
-			&infoKey,
-			&itemInfo,
-			exception);
-		if (!info || EXCEPTION_FAILED) {
-			fiftyoneDegreesIpiGraphFree(graphs);
-			return NULL;
-		}
-		graphs->items[i].info = *info;
-		COLLECTION_RELEASE(collection, &itemInfo);
-		graphs->count++;
+// Applies the memory policy for the nodes in the mask to the memory.
+static void placementBind(
+	void* const pointer,
+	const size_t size,
+	const int mode,
+	const unsigned long mask) {
+	syscall(
+		SYS_mbind, 
+		pointer, 
+		size, 
+		mode, 
+		&mask, 
+		PLACEMENT_MAX_NODES, 
+		0);
+}
+#endif
 
-		// Create the collection for the node values. Must overwrite the count
-		// to zero as it is consumed as a variable width collection.
-		CollectionHeader headerNodes = graphs->items[i].info.nodes.collection;
-		headerNodes.count = headerNodes.length;
-		graphs->items[i].nodes = collectionCreate(headerNodes, state);
-		if (graphs->items[i].nodes == NULL) {
-			EXCEPTION_SET(CORRUPT_DATA);
-			fiftyoneDegreesIpiGraphFree(graphs);
-			return NULL;
-		}
+// True if the options need the arena to be mapped from the kernel.
+static bool isPlacementNeeded(const IpiCgConfig* const config) {
+	return config->hugePages || config->interleave || config->numaNode >= 0;
+}
 
-		// Create the collection for the spans.
-		graphs->items[i].spans = collectionCreate(
-			graphs->items[i].info.spans,
-			state);
-		if (graphs->items[i].spans == NULL) {
-			EXCEPTION_SET(CORRUPT_DATA);
-			fiftyoneDegreesIpiGraphFree(graphs);
-			return NULL;
+// Returns the number of NUMA nodes, or 1 if not known.
+static uint32_t placementGetNodeCount(void) {
+	uint32_t count = 1;
+#ifdef __linux__
+	FILE* const file = fopen("/sys/devices/system/node/online", "r");
+	if (file != NULL) {
+
+		// The file is a list of ranges such as 0-1 or 0,2-3. The highest node
+		// determines the count.
+		unsigned int node;
+		int separator;
+		while (fscanf(file, "%u", &node) == 1) {
+			if (node + 1 > count) {
+				count = node + 1;
+			}
+			separator = fgetc(file);
+			if (separator != ',' && separator != '-') {
+				break;
+			}
 		}
-		graphs->items[i].spansCount = CollectionGetCount(
-			graphs->items[i].spans);
+		fclose(file);
+	}
+	if (count > PLACEMENT_MAX_NODES) {
+		count = PLACEMENT_MAX_NODES;
+	}
+#endif
+	return count;
+}
 
-		// Create the collection for the span bytes.
-		{
-			const CollectionHeader spanBytesHeader = {
-				graphs->items[i].info.spanBytes.startPosition,
-				graphs->items[i].info.spanBytes.length,
-				graphs->items[i].info.spanBytes.length,
-			};
-			graphs->items[i].spanBytes = collectionCreate(
-				spanBytesHeader,
-				state);
-		}
-		if (graphs->items[i].spanBytes == NULL) {
-			EXCEPTION_SET(CORRUPT_DATA);
-			fiftyoneDegreesIpiGraphFree(graphs);
-			return NULL;
+// Returns the NUMA node of the CPU the calling thread is running on, or 0 if
+// not known. The CPU is read with sched_getcpu which doesn't enter the kernel.
+// The node of the last CPU is kept for each thread so the kernel is only 
+// asked for the node when the thread has moved to another CPU.
+static uint32_t placementGetNode(void) {
+#ifdef __linux__
+	static __thread int lastCpu = -1;
+	static __thread uint32_t lastNode = 0;
+	const int cpu = sched_getcpu();
+	if (cpu != lastCpu) {
+		unsigned int current, node;
+		if (syscall(SYS_getcpu, &current, &node, NULL) == 0) {
+			lastCpu = (int)current;
+			lastNode = node;
 		}
+	}
+	return lastNode;
+#else
+	return 0;
+#endif
+}
 
-		// Create the collection for the clusters.
-		graphs->items[i].clusters = collectionCreate(
-			graphs->items[i].info.clusters,
-			state);
-		if (graphs->items[i].clusters == NULL) {
-			EXCEPTION_SET(CORRUPT_DATA);
-			fiftyoneDegreesIpiGraphFree(graphs);
+// Allocates memory of at least the size requested using the placement 
+// options. The size is updated with the number of bytes allocated. Mapped is
+// set to true if the memory was mapped from the kernel. Returns NULL if the
+// memory could not be allocated.
+static byte* placementMalloc(
+	const IpiCgConfig* const config,
+	size_t* const size,
+	bool* const mapped) {
+	*mapped = false;
+#ifdef __linux__
+	if (isPlacementNeeded(config)) {
+		byte* base = NULL;
+		*size = alignSize(*size, FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE);
+
+		// Try explicit huge pages first. These are only available if huge 
+		// pages have been reserved. The 2MB page size is requested 
+		// explicitly as the size is only rounded to 2MB and the default 
+		// huge page size of the system might be larger.
+#ifdef MAP_HUGETLB
+		if (config->hugePages) {
+			void* const pointer = mmap(
+				NULL,
+				*size,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB,
+				-1,
+				0);
+			if (pointer != MAP_FAILED) {
+				base = (byte*)pointer;
+			}
+		}
+#endif
+
+		// Otherwise map an extra huge page so the start can be aligned to a 
+		// huge page, and release the unused memory either side.
+		if (base == NULL) {
+			const size_t extra = *size + FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE;
+			void* const pointer = mmap(
+				NULL,
+				extra,
+				PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS,
+				-1,
+				0);
+			if (pointer == MAP_FAILED) {
+				return NULL;
+			}
+			base = (byte*)alignSize(
+				(size_t)pointer, 
+				FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE);
+			const size_t head = (size_t)(base - (byte*)pointer);
+			if (head > 0) {
+				munmap(pointer, head);
+			}
+			if (extra - head > *size) {
+				munmap(base + *size, extra - head - *size);
+			}
+#ifdef MADV_HUGEPAGE
+			if (config->hugePages) {
+				madvise(base, *size, MADV_HUGEPAGE);
+			}
+#endif
+		}
+
+		// Place the pages on the NUMA nodes.
+		if (config->interleave) {
+			const uint32_t nodes = placementGetNodeCount();
+			placementBind(
+				base,
+				*size,
+				MPOL_INTERLEAVE,
+				nodes >= PLACEMENT_MAX_NODES ? 
+					~0UL : 
+					(1UL << nodes) - 1);
+		}
+		else if (config->numaNode >= 0 &&
+			(size_t)config->numaNode < PLACEMENT_MAX_NODES) {
+			placementBind(
+				base,
+				*size,
+				MPOL_PREFERRED,
+				1UL << config->numaNode);
+		}
+		*mapped = true;
+		return base;
+	}
+#endif
+	int alignment = FIFTYONE_DEGREES_IPI_CG_CACHE_LINE;
+	if (*size >= FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE) {
+		alignment = FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE;
+		*size = alignSize(*size, FIFTYONE_DEGREES_IPI_CG_HUGE_PAGE);
+	}
+	return (byte*)fiftyoneDegreesMallocAligned(alignment, *size);
+}
+
+// Frees memory allocated with placementMalloc.
+static void placementFree(
+	void* const pointer,
+	const size_t size,
+	const bool mapped) {
+#ifdef __linux__
+	if (mapped) {
+		munmap(pointer, size);
+		return;
+	}
+#endif
+	fiftyoneDegreesFreeAligned(pointer);
+}
+
+// Allocates memory for a prepared structure aligned to a cache line. Uses the
+// arena if there is one, otherwise the heap.
+static void* preparedMalloc(Arena* const arena, const size_t size) {
+	if (arena == NULL) {
+		return fiftyoneDegreesMallocAligned(
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE, 
+			size);
+	}
+	const size_t aligned = alignSize(size, FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	if (aligned > arena->size - arena->used) {
+		return NULL;
+	}
+	void* const pointer = arena->base + arena->used;
+	arena->used += aligned;
+	return pointer;
+}
+
+// Frees memory allocated with preparedMalloc. Memory in an arena is only 
+// freed with the arena.
+static void preparedFree(Arena* const arena, void* const pointer) {
+	if (arena == NULL) {
+		fiftyoneDegreesFreeAligned(pointer);
+	}
+}
+
+/**
+ * SHARED MEMORY
+ *
+ * The collections and prepared structures of a graph are held by reference
+ * counted records so that an array created from a delta can use those of the
+ * existing array that are unchanged. Each record starts with an IpiCgShared 
+ * and is freed with the memory it holds when the last graph using it is 
+ * freed. Prepared structures allocated from an arena hold a reference to the
+ * arena which is freed when the prepared structures of every graph in it 
+ * have been freed.
+ */
+
+// Collection used by one or more graphs.
+typedef struct shared_collection_t {
+	IpiCgShared shared; // Reference count
+	Collection* collection; // Collection freed with the last reference
+	CollectionHeader header; // Header the collection was created from
+} SharedCollection;
+
+// Collections created from the same source by one operation. A graph whose
+// header is the same as one already created uses that collection.
+typedef struct collection_share_t {
+	SharedCollection** records; // Records of the collections created
+	uint32_t count; // Number of records
+	uint32_t capacity; // Maximum number of records
+} CollectionShare;
+
+// Arena holding the prepared structures of one or more graphs.
+typedef struct shared_arena_t {
+	IpiCgShared shared; // Reference count
+	Arena arena; // Block of memory allocated from
+	bool mapped; // True if mapped from the operating system
+} SharedArena;
+
+// Prepared structures of a graph used by one or more graphs.
+typedef struct shared_prepared_t {
+	IpiCgShared shared; // Reference count
+	IpiCgShared* arena; // Arena the structures are allocated from, or NULL
+						// if allocated from the heap
+	void* clusterRanges; // Cluster ranges of the graph
+	void* alignedNodes; // Aligned nodes of the graph, or NULL
+	void* spanIndexes; // Span indexes of the graph, or NULL
+	void* decodedSpans; // Decoded spans of the graph, or NULL
+	void* compressedNodes; // Compressed nodes of the graph, or NULL
+	void* skips; // Chains of nodes of the graph, or NULL
+	void* uniforms; // Uniform nodes of the graph, or NULL
+} SharedPrepared;
+
+// Adds a reference to the shared memory if there is any.
+static void sharedRetain(IpiCgShared* const shared) {
+	if (shared != NULL) {
+		FIFTYONE_DEGREES_INTERLOCK_INC(&shared->references);
+	}
+}
+
+// Releases a reference to the shared memory if there is any, freeing it if 
+// this was the last reference.
+static void sharedRelease(IpiCgShared* const shared) {
+	if (shared != NULL &&
+		FIFTYONE_DEGREES_INTERLOCK_DEC(&shared->references) == 0) {
+		shared->free(shared);
+	}
+}
+
+static void sharedCollectionFree(void* shared) {
+	SharedCollection* const record = (SharedCollection*)shared;
+	FIFTYONE_DEGREES_COLLECTION_FREE(record->collection);
+	Free(record);
+}
+
+static void sharedArenaFree(void* shared) {
+	SharedArena* const record = (SharedArena*)shared;
+	placementFree(record->arena.base, record->arena.size, record->mapped);
+	Free(record);
+}
+
+static void sharedPreparedFree(void* shared) {
+	SharedPrepared* const record = (SharedPrepared*)shared;
+	if (record->arena != NULL) {
+		sharedRelease(record->arena);
+	}
+	else {
+		if (record->clusterRanges != NULL) {
+			fiftyoneDegreesFreeAligned(record->clusterRanges);
+		}
+		if (record->alignedNodes != NULL) {
+			fiftyoneDegreesFreeAligned(record->alignedNodes);
+		}
+		if (record->spanIndexes != NULL) {
+			fiftyoneDegreesFreeAligned(record->spanIndexes);
+		}
+		if (record->decodedSpans != NULL) {
+			fiftyoneDegreesFreeAligned(record->decodedSpans);
+		}
+		if (record->compressedNodes != NULL) {
+			fiftyoneDegreesFreeAligned(record->compressedNodes);
+		}
+		if (record->skips != NULL) {
+			fiftyoneDegreesFreeAligned(record->skips);
+		}
+		if (record->uniforms != NULL) {
+			fiftyoneDegreesFreeAligned(record->uniforms);
+		}
+	}
+	Free(record);
+}
+
+// Returns the collection for the header adding a reference to the record of
+// one already created by the operation if the header is the same. Otherwise
+// creates the collection and the record that holds it. Returns NULL if 
+// either can not be created.
+static Collection* sharedCollectionCreate(
+	collectionCreate collectionCreate,
+	const CollectionHeader header,
+	void* state,
+	CollectionShare* const share,
+	IpiCgShared** const shared,
+	Exception* exception) {
+	for (uint32_t i = 0; i < share->count; i++) {
+		SharedCollection* const existing = share->records[i];
+		if (existing->header.startPosition == header.startPosition &&
+			existing->header.length == header.length &&
+			existing->header.count == header.count) {
+			sharedRetain(&existing->shared);
+			*shared = &existing->shared;
+			return existing->collection;
+		}
+	}
+	Collection* const collection = collectionCreate(header, state);
+	if (collection == NULL) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return NULL;
+	}
+	SharedCollection* const record = (SharedCollection*)Malloc(
+		sizeof(SharedCollection));
+	if (record == NULL) {
+		FIFTYONE_DEGREES_COLLECTION_FREE(collection);
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	record->shared.references = 1;
+	record->shared.free = sharedCollectionFree;
+	record->collection = collection;
+	record->header = header;
+	if (share->count < share->capacity) {
+		share->records[share->count++] = record;
+	}
+	*shared = &record->shared;
+	return collection;
+}
+
+// Allocates the records of the share for the collections of the number of
+// graphs provided. Returns false if the memory can not be allocated.
+static bool collectionShareCreate(
+	CollectionShare* const share,
+	const uint32_t graphsCount,
+	Exception* exception) {
+	share->count = 0;
+	share->capacity = graphsCount * 4;
+	share->records = (SharedCollection**)Malloc(
+		sizeof(SharedCollection*) * ((size_t)share->capacity + 1));
+	if (share->records == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return false;
+	}
+	return true;
+}
+
+// The number of bytes used for each resolved span index of the graph. The
+// narrowest size that can hold every span index.
+static byte getSpanIndexesSize(const IpiCg* const graph) {
+	return graph->spansCount <= UINT16_MAX ?
+		sizeof(uint16_t) :
+		sizeof(uint32_t);
+}
+
+// True if the nodes of the graph should be compressed with the options. The
+// nodes are only compressed if they are then smaller. See 
+// preparedCreateAll.
+static bool isCompressNeeded(
+	const IpiCg* const graph,
+	const IpiCgConfig* const config) {
+	return config->compressNodes && 
+		config->alignNodes == false && 
+		graph->info.nodes.collection.count > 0;
+}
+
+// Returns the bytes needed for the chains and the skip index of every node,
+// including the trap node of aligned nodes which never starts a chain.
+static size_t getSkipsSize(const IpiCg* const graph) {
+	return sizeof(IpiCgSkip) * graph->skipsCount +
+		sizeof(uint32_t) * ((size_t)graph->info.nodes.collection.count + 1);
+}
+
+// Returns the number of words in the bits of the uniform nodes, including 
+// the trap node of aligned nodes which is never marked.
+static size_t getUniformWords(const IpiCg* const graph) {
+	return ((size_t)graph->info.nodes.collection.count + 64) / 64;
+}
+
+// Returns the bytes needed for the uniform nodes, the bits and the ranks.
+static size_t getUniformsSize(const IpiCg* const graph) {
+	return sizeof(IpiCgUniform) * graph->uniformsCount +
+		(sizeof(uint64_t) + sizeof(uint32_t)) * getUniformWords(graph);
+}
+
+// True if the chains of nodes of the graph should be found with the options.
+// The chains are only created if there are any. See preparedCreateAll.
+static bool isSkipsNeeded(
+	const IpiCg* const graph,
+	const IpiCgConfig* const config) {
+	return config->compressPaths && graph->info.nodes.collection.count > 0;
+}
+
+// True if the uniform nodes of the graph should be found with the options.
+// The uniform nodes are only created if there are any. See 
+// preparedCreateAll.
+static bool isUniformNeeded(
+	const IpiCg* const graph,
+	const IpiCgConfig* const config) {
+	return config->markUniform && graph->info.nodes.collection.count > 0;
+}
+
+// Returns the number of bytes needed to allocate all the prepared structures
+// of the graph with the options from an arena. Must match the sizes 
+// requested by the functions that create the structures.
+static size_t getPreparedSize(
+	const IpiCg* const graph,
+	const IpiCgConfig* const config) {
+	const size_t count = graph->info.nodes.collection.count;
+	size_t size = alignSize(
+		sizeof(IpiCgClusterRange) * ((size_t)graph->clustersCount + 1),
+		FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	if (config->alignNodes) {
+		size += alignSize(
+			sizeof(IpiCgNode) * (count + 1),
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	}
+	else if (config->resolveSpanIndexes) {
+		size += alignSize(
+			getSpanIndexesSize(graph) * (count + 1),
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	}
+	if (config->decodeSpans) {
+		size += alignSize(
+			sizeof(IpiCgSpan) * ((size_t)graph->spansCount + 1),
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	}
+	if (graph->compressedNodesSize > 0) {
+		size += alignSize(
+			graph->compressedNodesSize,
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	}
+	if (graph->skipsCount > 0) {
+		size += alignSize(
+			getSkipsSize(graph),
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	}
+	if (graph->uniformsCount > 0) {
+		size += alignSize(
+			getUniformsSize(graph),
+			FIFTYONE_DEGREES_IPI_CG_CACHE_LINE);
+	}
+	return size;
+}
+
+// True if the prepared structures of the graph have not been created. The
+// cluster ranges are always prepared.
+static bool isPreparedNeeded(const IpiCg* const graph) {
+	return graph->clusterRanges == NULL;
+}
+
+// Allocates an arena large enough for the prepared structures of all the 
+// graphs that need them using the placement options of the graphs. Arenas of
+// a huge page or more are aligned to and rounded up to whole huge pages. The
+// caller holds the only reference to the arena returned.
+static SharedArena* arenaCreate(
+	IpiCgArray* const graphs,
+	Exception* exception) {
+	size_t size = 0;
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		if (isPreparedNeeded(&graphs->items[i])) {
+			size += getPreparedSize(&graphs->items[i], &graphs->config);
+		}
+	}
+	SharedArena* const record = (SharedArena*)Malloc(sizeof(SharedArena));
+	if (record == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	record->arena.base = placementMalloc(
+		&graphs->config, 
+		&size, 
+		&record->mapped);
+	if (record->arena.base == NULL) {
+		Free(record);
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	record->arena.size = size;
+	record->arena.used = 0;
+	record->shared.references = 1;
+	record->shared.free = sharedArenaFree;
+	graphs->arena = record->arena.base;
+	graphs->arenaSize = size;
+	graphs->arenaMapped = record->mapped;
+	return record;
+}
+
+// Reads the start and end node index of every cluster into an array so that
+// the cluster for a node can be found without fetching the clusters visited
+// by the search from the collection. Returns NULL if a cluster can not be
+// fetched or memory can not be allocated.
+static IpiCgClusterRange* clusterRangesCreate(
+	const IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	IpiCgClusterRange* const ranges = (IpiCgClusterRange*)preparedMalloc(
+		arena,
+		sizeof(IpiCgClusterRange) * ((size_t)graph->clustersCount + 1));
+	if (ranges == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	const CollectionKeyType keyType = {
+		FIFTYONE_DEGREES_COLLECTION_ENTRY_TYPE_GRAPH_DATA_CLUSTER,
+		graph->clusters->elementSize,
+		NULL,
+	};
+	for (uint32_t i = 0; i < graph->clustersCount; i++) {
+		Item item;
+		DataReset(&item.data);
+		const CollectionKey key = {
+			i,
+			&keyType,
+		};
+		const Cluster* const cluster = (const Cluster*)graph->clusters->get(
+			graph->clusters,
+			&key,
+			&item,
+			exception);
+		if (!cluster || EXCEPTION_FAILED) {
+			preparedFree(arena, ranges);
 			return NULL;
 		}
-		graphs->items[i].clustersCount = CollectionGetCount(
-			graphs->items[i].clusters);
+		ranges[i].startIndex = cluster->startIndex;
+		ranges[i].endIndex = cluster->endIndex;
+		COLLECTION_RELEASE(graph->clusters, &item);
+	}
+	return ranges;
+}
 
-		// Check that the element size for the clusters is not larger than the
-		// structure.
-		if (graphs->items[i].clusters->elementSize > sizeof(Cluster)) {
-			EXCEPTION_SET(CORRUPT_DATA);
-			fiftyoneDegreesIpiGraphFree(graphs);
+// Checks that the cluster ranges are in order, do not overlap and are within
+// the nodes of the graph. Used for cluster ranges that were not created by 
+// this process.
+static bool clusterRangesCheck(
+	const IpiCg* const graph,
+	const IpiCgClusterRange* const ranges) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	for (uint32_t i = 0; i < graph->clustersCount; i++) {
+		if (ranges[i].startIndex > ranges[i].endIndex ||
+			ranges[i].endIndex >= count ||
+			(i > 0 && ranges[i].startIndex <= ranges[i - 1].endIndex)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns a cursor used to decode the nodes, or the spans, of the graph in
+// their original order rather than by walking the graph. Used to create the
+// prepared structures. The address of the cursor is not used.
+static Cursor decodeCursorCreate(
+	const IpiCg* const graph,
+	StringBuilder* const sb,
+	Exception* exception) {
+	IpAddress address;
+	memset(&address, 0, sizeof(IpAddress));
+	return cursorCreate(graph, address, sb, exception);
+}
+
+// Reads the bits of the node at the index, and if cluster is true then also
+// fetches the cluster that resolves the span index of the node. Returns false
+// if the node or its cluster can't be read.
+static bool decodeCursorMove(
+	Cursor* const cursor,
+	const uint32_t index,
+	const bool cluster) {
+	Exception* const exception = cursor->ex;
+	cursorMoveBits(cursor, index);
+	if (EXCEPTION_OKAY && cluster) {
+		setCluster(cursor);
+	}
+	return EXCEPTION_OKAY;
+}
+
+// Decodes the node at the index into an aligned node where the next node is
+// the one that follows in the original order. Returns false if the node can't
+// be read.
+static bool decodeCursorRead(
+	Cursor* const cursor,
+	const uint32_t index,
+	IpiCgNode* const node) {
+	const uint32_t count = cursor->graph->info.nodes.collection.count;
+	if (decodeCursorMove(cursor, index, true) == false) {
+		return false;
+	}
+	node->value = getValue(cursor);
+	node->next = index + 1 < count ? index + 1 : UINT32_MAX;
+	node->spanIndex = getSpanIndex(cursor, getSpanIndexCluster(cursor));
+	node->flags = isLowFlag(cursor) ? 
+		FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG : 0;
+	return true;
+}
+
+// Assigns the next aligned position to the node if it does not already have
+// one. A node with the low flag is always followed by the next node as this
+// holds the high entry needed whenever the low entry is not taken.
+static void alignedNodesPlace(
+	const IpiCgNode* const decoded,
+	const uint32_t count,
+	uint32_t* const positions,
+	uint32_t* const order,
+	uint32_t* const placed,
+	const uint32_t index) {
+	if (positions[index] != UINT32_MAX) {
+		return;
+	}
+	positions[index] = *placed;
+	order[(*placed)++] = index;
+	if ((decoded[index].flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) &&
+		index + 1 < count &&
+		positions[index + 1] == UINT32_MAX) {
+		positions[index + 1] = *placed;
+		order[(*placed)++] = index + 1;
+	}
+}
+
+// Decodes every node of the graph in its original order.
+static bool alignedNodesDecode(
+	const IpiCg* const graph,
+	IpiCgNode* const decoded,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	bool read = true;
+	StringBuilder sb = { NULL, 0 };
+	Cursor cursor = decodeCursorCreate(graph, &sb, exception);
+	for (uint32_t i = 0; i < count && read; i++) {
+		read = decodeCursorRead(&cursor, i, &decoded[i]);
+	}
+	cursorReleaseData(&cursor);
+	return read;
+}
+
+// Sets the order array to the original index of the node for each aligned
+// position, and positions to the aligned position of each original index. 
+// Positions are assigned breadth first from the root of the graph and the
+// order array is also the queue of nodes still to visit. Nodes that can't be
+// reached from the root are placed at the end in their original order.
+static void alignedNodesOrder(
+	const IpiCg* const graph,
+	const IpiCgNode* const decoded,
+	uint32_t* const positions,
+	uint32_t* const order) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	uint32_t placed = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		positions[i] = UINT32_MAX;
+	}
+	if (graph->info.graphIndex < count) {
+		alignedNodesPlace(
+			decoded,
+			count,
+			positions,
+			order,
+			&placed,
+			graph->info.graphIndex);
+	}
+	for (uint32_t head = 0; head < placed; head++) {
+		const IpiCgNode* const node = &decoded[order[head]];
+		if (node->next != UINT32_MAX) {
+			alignedNodesPlace(
+				decoded,
+				count,
+				positions,
+				order,
+				&placed,
+				node->next);
+		}
+		if (node->value < count) {
+			alignedNodesPlace(
+				decoded,
+				count,
+				positions,
+				order,
+				&placed,
+				node->value);
+		}
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		alignedNodesPlace(decoded, count, positions, order, &placed, i);
+	}
+}
+
+// Decodes every node of the graph into an aligned record with the span index
+// resolved and then reorders the records breadth first from the root of the
+// graph. The value and next indexes are rewritten to the new positions.
+static IpiCgNode* alignedNodesCreate(
+	IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	IpiCgNode* aligned = NULL;
+	IpiCgNode* const decoded = (IpiCgNode*)Malloc(
+		sizeof(IpiCgNode) * ((size_t)count + 1));
+	uint32_t* const positions = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	uint32_t* const order = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	if (decoded == NULL || positions == NULL || order == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+	}
+	else if (alignedNodesDecode(graph, decoded, exception)) {
+		alignedNodesOrder(graph, decoded, positions, order);
+		aligned = (IpiCgNode*)preparedMalloc(
+			arena,
+			sizeof(IpiCgNode) * ((size_t)count + 1));
+		if (aligned == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		}
+	}
+
+	// Write the nodes in their new positions rewriting the indexes.
+	if (aligned != NULL) {
+		for (uint32_t i = 0; i < count; i++) {
+			IpiCgNode node = decoded[order[i]];
+			if (node.value < count) {
+				node.value = positions[node.value];
+			}
+			node.next = node.next != UINT32_MAX ? 
+				positions[node.next] :
+				count;
+			aligned[i] = node;
+		}
+
+		// The last node has no next node and instead points to a trap node
+		// after the others. See validatedTrapNode.
+		aligned[count] = validatedTrapNode(graph);
+		graph->alignedRootIndex = graph->info.graphIndex < count ?
+			positions[graph->info.graphIndex] :
+			graph->info.graphIndex;
+	}
+
+	if (decoded != NULL) Free(decoded);
+	if (positions != NULL) Free(positions);
+	if (order != NULL) Free(order);
+	return aligned;
+}
+
+// Checks that the next node and span index of every aligned node are within
+// the graph and that the trap node follows the others. Used for aligned nodes
+// that were not created by this process. Values are checked by the walk as 
+// either a node index or a profile index.
+static bool alignedNodesCheck(
+	const IpiCg* const graph,
+	const IpiCgNode* const aligned) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const IpiCgNode trap = validatedTrapNode(graph);
+	for (uint32_t i = 0; i < count; i++) {
+		if (aligned[i].next > count || 
+			aligned[i].spanIndex >= graph->spansCount) {
+			return false;
+		}
+	}
+	return memcmp(&aligned[count], &trap, sizeof(IpiCgNode)) == 0;
+}
+
+// Resolves the span index of every node from its cluster into an array in the
+// original node order. The narrowest entry size that can hold every span
+// index is used.
+static void* spanIndexesCreate(
+	IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	graph->spanIndexesSize = getSpanIndexesSize(graph);
+	void* const spanIndexes = preparedMalloc(
+		arena,
+		graph->spanIndexesSize * ((size_t)count + 1));
+	if (spanIndexes == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	StringBuilder sb = { NULL, 0 };
+	Cursor cursor = decodeCursorCreate(graph, &sb, exception);
+	for (uint32_t i = 0; i < count; i++) {
+		IpiCgNode node;
+		if (decodeCursorRead(&cursor, i, &node) == false) {
+			cursorReleaseData(&cursor);
+			preparedFree(arena, spanIndexes);
+			return NULL;
+		}
+		if (graph->spanIndexesSize == sizeof(uint16_t)) {
+			((uint16_t*)spanIndexes)[i] = (uint16_t)node.spanIndex;
+		}
+		else {
+			((uint32_t*)spanIndexes)[i] = node.spanIndex;
+		}
+	}
+	cursorReleaseData(&cursor);
+	return spanIndexes;
+}
+
+// Checks that the entry size is one spanIndexesCreate uses and that every 
+// span index is within the spans of the graph. Used for span indexes that 
+// were not created by this process.
+static bool spanIndexesCheck(
+	const IpiCg* const graph,
+	const void* const spanIndexes) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	if (graph->spanIndexesSize != sizeof(uint16_t) &&
+		graph->spanIndexesSize != sizeof(uint32_t)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t spanIndex = graph->spanIndexesSize == sizeof(uint16_t) ?
+			((const uint16_t*)spanIndexes)[i] :
+			((const uint32_t*)spanIndexes)[i];
+		if (spanIndex >= graph->spansCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Decodes every span of the graph into fixed width records with the limits as
+// words. Spans with limits longer than an IP address, or where the low limit 
+// is not less than the high limit, are corrupt.
+static IpiCgSpan* decodedSpansCreate(
+	IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	IpiCgSpan* const spans = (IpiCgSpan*)preparedMalloc(
+		arena,
+		sizeof(IpiCgSpan) * ((size_t)graph->spansCount + 1));
+	if (spans == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	StringBuilder sb = { NULL, 0 };
+	Cursor cursor = decodeCursorCreate(graph, &sb, exception);
+	for (uint32_t i = 0; i < graph->spansCount; i++) {
+		setSpanIndex(&cursor, i);
+		if (EXCEPTION_FAILED) {
+			cursorReleaseData(&cursor);
+			preparedFree(arena, spans);
 			return NULL;
 		}
+		spans[i] = cursor.spanLimits;
+		spans[i].lengthLow = cursor.span.lengthLow;
+		spans[i].lengthHigh = cursor.span.lengthHigh;
+	}
+	cursorReleaseData(&cursor);
+
+	// The span of the trap node has no limits. See validatedTrapNode.
+	memset(&spans[graph->spansCount], 0, sizeof(IpiCgSpan));
+	return spans;
+}
+
+// Checks that the limits of every decoded span fit the words they are 
+// compared with and that the span of the trap node has no limits. Used for 
+// decoded spans that were not created by this process.
+static bool decodedSpansCheck(
+	const IpiCg* const graph,
+	const IpiCgSpan* const spans) {
+	for (uint32_t i = 0; i < graph->spansCount; i++) {
+		if (spans[i].lengthLow > VAR_SIZE * 8 || 
+			spans[i].lengthHigh > VAR_SIZE * 8) {
+			return false;
+		}
+	}
+	return spans[graph->spansCount].lengthLow == 0 &&
+		spans[graph->spansCount].lengthHigh == 0;
+}
+
+// Returns the number of bits needed to hold the value.
+static byte compressedWidth(uint64_t value) {
+	byte width = 0;
+	while (value > 0) {
+		width++;
+		value >>= 1;
+	}
+	return width;
+}
+
+// Sets the bits from the bit index of the bytes to the value as little 
+// endian. The bits must be zero beforehand.
+static void compressedBitsWrite(
+	byte* const bytes,
+	const uint64_t bitIndex,
+	const byte width,
+	const uint64_t value) {
+	for (byte i = 0; i < width; i++) {
+		if ((value >> i) & 1) {
+			bytes[(bitIndex + i) >> 3] |= (byte)(1 << ((bitIndex + i) & 7));
+		}
+	}
+}
+
+// Compresses the nodes of the graph into the memory provided, or if NULL 
+// just works out the size needed. Returns the size in bytes of the 
+// compressed nodes, or 0 if the nodes can not be read.
+static size_t compressedNodesEncode(
+	const IpiCg* const graph,
+	byte* const compressed,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const uint32_t blocks = (uint32_t)(
+		((uint64_t)count + COMPRESSED_BLOCK_NODES - 1) / 
+		COMPRESSED_BLOCK_NODES);
+	CompressedBlock* const headers = (CompressedBlock*)compressed;
+	uint64_t distances[COMPRESSED_BLOCK_NODES];
+	uint32_t leaves[COMPRESSED_BLOCK_NODES];
+	uint32_t leafValues[COMPRESSED_BLOCK_NODES];
+	byte leafIndexes[COMPRESSED_BLOCK_NODES];
+	uint32_t spanIndexes[COMPRESSED_BLOCK_NODES];
+	size_t size = sizeof(CompressedBlock) * blocks;
+	StringBuilder sb = { NULL, 0 };
+	Cursor cursor = decodeCursorCreate(graph, &sb, exception);
+	for (uint32_t b = 0; b < blocks; b++) {
+		CompressedBlock block;
+		uint32_t children = 0, leafCount = 0, distinct = 0;
+		const uint32_t first = b * COMPRESSED_BLOCK_NODES;
+		const uint32_t nodes = count - first < COMPRESSED_BLOCK_NODES ?
+			count - first :
+			COMPRESSED_BLOCK_NODES;
+		memset(&block, 0, sizeof(CompressedBlock));
+		block.leafBase = UINT32_MAX;
+		block.spanBase = UINT32_MAX;
+
+		// Read the members of the nodes in the block finding the distinct 
+		// leaf values and the smallest leaf value and span index.
+		for (uint32_t i = 0; i < nodes; i++) {
+			if (decodeCursorMove(&cursor, first + i, false) == false) {
+				cursorReleaseData(&cursor);
+				return 0;
+			}
+			const uint32_t value = getValue(&cursor);
+			spanIndexes[i] = getSpanIndexCluster(&cursor);
+			if (isLowFlag(&cursor)) {
+				block.lowFlags |= 1ULL << i;
+			}
+			if (value >= count) {
+				uint32_t d = 0;
+				while (d < distinct && leafValues[d] != value - count) {
+					d++;
+				}
+				if (d == distinct) {
+					leafValues[distinct++] = value - count;
+				}
+				block.leaves |= 1ULL << i;
+				leafIndexes[leafCount] = (byte)d;
+				leaves[leafCount++] = value - count;
+				if (value - count < block.leafBase) {
+					block.leafBase = value - count;
+				}
+			}
+			else {
+				const int64_t distance = (int64_t)value - (first + i);
+				distances[children++] = distance >= 0 ? 
+					(uint64_t)distance << 1 : 
+					((uint64_t)(-distance) << 1) - 1;
+			}
+			if (spanIndexes[i] < block.spanBase) {
+				block.spanBase = spanIndexes[i];
+			}
+		}
+		if (block.leafBase == UINT32_MAX) block.leafBase = 0;
+
+		// Find the widths needed. The leaves index the distinct leaf values
+		// only if this uses fewer bits than a leaf value for every leaf.
+		uint64_t maxDistance = 0, maxLeaf = 0, maxSpan = 0;
+		for (uint32_t i = 0; i < children; i++) {
+			if (distances[i] > maxDistance) maxDistance = distances[i];
+		}
+		for (uint32_t i = 0; i < leafCount; i++) {
+			leaves[i] -= block.leafBase;
+			if (leaves[i] > maxLeaf) maxLeaf = leaves[i];
+		}
+		for (uint32_t i = 0; i < distinct; i++) {
+			leafValues[i] -= block.leafBase;
+		}
+		for (uint32_t i = 0; i < nodes; i++) {
+			spanIndexes[i] -= block.spanBase;
+			if (spanIndexes[i] > maxSpan) maxSpan = spanIndexes[i];
+		}
+		block.distanceWidth = compressedWidth(maxDistance);
+		block.leafWidth = compressedWidth(maxLeaf);
+		block.spanWidth = compressedWidth(maxSpan);
+		block.indexWidth = compressedWidth(distinct > 0 ? distinct - 1 : 0);
+		if ((uint64_t)distinct * block.leafWidth + 
+			(uint64_t)leafCount * block.indexWidth <
+			(uint64_t)leafCount * block.leafWidth) {
+			block.leafValues = (byte)distinct;
+		}
+		else {
+			block.indexWidth = 0;
+		}
+		const uint64_t leavesStart = (uint64_t)children * block.distanceWidth;
+		const uint64_t indexesStart = leavesStart + block.leafWidth * 
+			(uint64_t)(block.leafValues > 0 ? distinct : leafCount);
+		const uint64_t spansStart = indexesStart + 
+			(uint64_t)leafCount * block.indexWidth;
+		const uint64_t end = spansStart + (uint64_t)nodes * block.spanWidth;
+		if (size > UINT32_MAX ||
+			block.distanceWidth > COMPRESSED_WIDTH_MAX || 
+			block.leafWidth > COMPRESSED_WIDTH_MAX || 
+			block.spanWidth > COMPRESSED_WIDTH_MAX) {
+			cursorReleaseData(&cursor);
+			EXCEPTION_SET(CORRUPT_DATA);
+			return 0;
+		}
+		block.offset = (uint32_t)size;
+		block.leavesStart = (uint16_t)leavesStart;
+		block.indexesStart = (uint16_t)indexesStart;
+		block.spansStart = (uint16_t)spansStart;
+
+		// Write the header and the packed bits of the block.
+		if (compressed != NULL) {
+			byte* const bits = compressed + block.offset;
+			headers[b] = block;
+			for (uint32_t i = 0; i < children; i++) {
+				compressedBitsWrite(
+					bits,
+					(uint64_t)i * block.distanceWidth,
+					block.distanceWidth,
+					distances[i]);
+			}
+			for (uint32_t i = 0; i < leafCount; i++) {
+				if (block.leafValues > 0) {
+					compressedBitsWrite(
+						bits,
+						indexesStart + (uint64_t)i * block.indexWidth,
+						block.indexWidth,
+						leafIndexes[i]);
+				}
+				else {
+					compressedBitsWrite(
+						bits,
+						leavesStart + (uint64_t)i * block.leafWidth,
+						block.leafWidth,
+						leaves[i]);
+				}
+			}
+			for (uint32_t i = 0; i < block.leafValues; i++) {
+				compressedBitsWrite(
+					bits,
+					leavesStart + (uint64_t)i * block.leafWidth,
+					block.leafWidth,
+					leafValues[i]);
+			}
+			for (uint32_t i = 0; i < nodes; i++) {
+				compressedBitsWrite(
+					bits,
+					spansStart + (uint64_t)i * block.spanWidth,
+					block.spanWidth,
+					spanIndexes[i]);
+			}
+		}
+		size += (size_t)((end + 7) / 8);
+	}
+	cursorReleaseData(&cursor);
+	return size + COMPRESSED_PADDING;
+}
+
+// Compresses the nodes of the graph into blocks. The size must already have
+// been set with compressedNodesEncode.
+static void* compressedNodesCreate(
+	IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	byte* const compressed = (byte*)preparedMalloc(
+		arena,
+		graph->compressedNodesSize);
+	if (compressed == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	memset(compressed, 0, graph->compressedNodesSize);
+	if (compressedNodesEncode(graph, compressed, exception) != 
+		graph->compressedNodesSize) {
+		if (EXCEPTION_OKAY) {
+			EXCEPTION_SET(CORRUPT_DATA);
+		}
+		preparedFree(arena, compressed);
+		return NULL;
+	}
+	return compressed;
+}
+
+// Checks that the header of every block of the compressed nodes and the bits
+// it points to are within the size, and that every leaf value index is for 
+// one of the leaf values of the block. Used for compressed nodes that were 
+// not created by this process.
+static bool compressedNodesCheck(
+	const IpiCg* const graph,
+	const void* const compressed) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const uint64_t blocks = ((uint64_t)count + COMPRESSED_BLOCK_NODES - 1) /
+		COMPRESSED_BLOCK_NODES;
+	const CompressedBlock* const headers = (const CompressedBlock*)compressed;
+	if (graph->compressedNodesSize < 
+		sizeof(CompressedBlock) * blocks + COMPRESSED_PADDING) {
+		return false;
+	}
+	for (uint64_t b = 0; b < blocks; b++) {
+		const CompressedBlock* const block = &headers[b];
+		const uint64_t nodes = count - b * COMPRESSED_BLOCK_NODES < 
+			COMPRESSED_BLOCK_NODES ?
+			count - b * COMPRESSED_BLOCK_NODES :
+			COMPRESSED_BLOCK_NODES;
+		const uint64_t leafCount = bitsCount(nodes < COMPRESSED_BLOCK_NODES ? 
+			block->leaves & ((1ULL << nodes) - 1) : 
+			block->leaves);
+		if (block->offset > graph->compressedNodesSize - COMPRESSED_PADDING) {
+			return false;
+		}
+		const uint64_t bits = ((uint64_t)graph->compressedNodesSize - 
+			COMPRESSED_PADDING - block->offset) * 8;
+		if (block->distanceWidth > COMPRESSED_WIDTH_MAX ||
+			block->leafWidth > COMPRESSED_WIDTH_MAX ||
+			block->indexWidth > COMPRESSED_WIDTH_MAX ||
+			block->spanWidth > COMPRESSED_WIDTH_MAX ||
+			(nodes - leafCount) * block->distanceWidth > bits ||
+			block->leavesStart + block->leafWidth * (block->leafValues > 0 ?
+				block->leafValues : leafCount) > bits ||
+			(block->leafValues > 0 && block->indexesStart + 
+				leafCount * block->indexWidth > bits) ||
+			block->spansStart + nodes * block->spanWidth > bits) {
+			return false;
+		}
+		for (uint64_t i = 0; block->leafValues > 0 && i < leafCount; i++) {
+			if (compressedBitsRead(
+				(const byte*)compressed + block->offset,
+				block->indexesStart + i * block->indexWidth,
+				block->indexWidth) >= block->leafValues) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Nodes the walk moves to from a node when the bits of the address are equal
+// to a limit of its span and the longest chain of such moves from the node.
+typedef struct skip_node_t {
+	uint32_t low; // Node for an equal low result, or UINT32_MAX if the walk
+				  // ends or the result is not certain from the limit alone
+	uint32_t high; // Node for an equal high result, or UINT32_MAX
+	uint32_t steps; // Nodes in the longest chain from the node
+	bool isHigh; // True if the longest chain follows the high result
+} SkipNode;
+
+// Sets the nodes moved to for the equal results of the node. An equal high
+// result is only certain from the high limit alone if the low limit is no 
+// longer and the start of the high limit is greater than the low limit. 
+// Moves that end the walk at a leaf or the trap node are not part of a 
+// chain.
+static void skipsNodeSet(
+	const IpiCg* const graph,
+	const IpiCgNode* const nodes,
+	const uint32_t index,
+	const Cursor* const cursor,
+	SkipNode* const skipNode) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const IpiCgNode* const node = &nodes[index];
+	const IpiCgSpan* const limits = getSpanLimits(cursor);
+	const bool lowFlag = 
+		(node->flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) != 0;
+	skipNode->low = lowFlag ? node->value : node->next;
+	if (skipNode->low >= count) {
+		skipNode->low = UINT32_MAX;
+	}
+	skipNode->high = UINT32_MAX;
+	if (cursor->span.lengthLow <= cursor->span.lengthHigh &&
+		wordsCompare(
+			limits->high, 
+			limits->low, 
+			cursor->span.lengthLow) > 0) {
+		const uint32_t high = lowFlag ? node->next : index;
+		if (high < count && nodes[high].value < count) {
+			skipNode->high = nodes[high].value;
+		}
+	}
+	skipNode->steps = 0;
+	skipNode->isHigh = false;
+}
+
+// Sets the longest chain from every node. The nodes are ordered so that 
+// every node comes before the nodes it moves to, and the chains are then 
+// found from the last. Nodes that are part of a cycle are never ordered so 
+// have no chain.
+static bool skipsStepsSet(
+	const IpiCg* const graph,
+	SkipNode* const skipNodes,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	uint32_t* const inDegrees = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	uint32_t* const order = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	if (inDegrees == NULL || order == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		if (inDegrees != NULL) Free(inDegrees);
+		if (order != NULL) Free(order);
+		return false;
+	}
+	memset(inDegrees, 0, sizeof(uint32_t) * count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (skipNodes[i].low != UINT32_MAX) inDegrees[skipNodes[i].low]++;
+		if (skipNodes[i].high != UINT32_MAX) inDegrees[skipNodes[i].high]++;
+	}
+	uint32_t ordered = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (inDegrees[i] == 0) {
+			order[ordered++] = i;
+		}
+	}
+	for (uint32_t next = 0; next < ordered; next++) {
+		const SkipNode* const skipNode = &skipNodes[order[next]];
+		if (skipNode->low != UINT32_MAX && 
+			--inDegrees[skipNode->low] == 0) {
+			order[ordered++] = skipNode->low;
+		}
+		if (skipNode->high != UINT32_MAX && 
+			--inDegrees[skipNode->high] == 0) {
+			order[ordered++] = skipNode->high;
+		}
+	}
+	while (ordered > 0) {
+		SkipNode* const skipNode = &skipNodes[order[--ordered]];
+		if (skipNode->low != UINT32_MAX) {
+			skipNode->steps = skipNodes[skipNode->low].steps + 1;
+		}
+		if (skipNode->high != UINT32_MAX &&
+			skipNodes[skipNode->high].steps + 1 > skipNode->steps) {
+			skipNode->steps = skipNodes[skipNode->high].steps + 1;
+			skipNode->isHigh = true;
+		}
+	}
+	Free(inDegrees);
+	Free(order);
+	return true;
+}
+
+// Adds the limit to the end of the bits of the chain which are length bits
+// long.
+static void skipsAppend(
+	uint64_t* const bits,
+	const int length,
+	const uint64_t* const limit) {
+	if (length == 0) {
+		bits[0] |= limit[0];
+		bits[1] |= limit[1];
+	}
+	else if (length < 64) {
+		bits[0] |= limit[0] >> length;
+		bits[1] |= (limit[0] << (64 - length)) | (limit[1] >> length);
+	}
+	else if (length < 128) {
+		bits[1] |= limit[0] >> (length - 64);
+	}
+}
+
+// Follows the longest chain from the node for as many nodes as fit in the 
+// bits of an address, less one so the walk can't end part way along it. 
+// Returns true if the chain has at least two nodes.
+static bool skipsFollow(
+	const IpiCg* const graph,
+	const IpiCgNode* const nodes,
+	const SkipNode* const skipNodes,
+	uint32_t index,
+	Cursor* const cursor,
+	IpiCgSkip* const skip) {
+	const int maxLength = getIpLengthFromGraph(&graph->info) * 8 - 1;
+	Exception* const exception = cursor->ex;
+	uint32_t steps = 0;
+	int length = 0;
+	memset(skip, 0, sizeof(IpiCgSkip));
+	skip->previousHigh = UINT32_MAX;
+	while (skipNodes[index].steps > 0) {
+		const SkipNode* const skipNode = &skipNodes[index];
+		setSpanIndex(cursor, nodes[index].spanIndex);
+		if (EXCEPTION_FAILED) return false;
+		const IpiCgSpan* const limits = getSpanLimits(cursor);
+		const int stepLength = skipNode->isHigh ?
+			cursor->span.lengthHigh :
+			cursor->span.lengthLow;
+		if (length + stepLength > maxLength) {
+			break;
+		}
+		skipsAppend(
+			skip->bits, 
+			length, 
+			skipNode->isHigh ? limits->high : limits->low);
+		length += stepLength;
+		if (skipNode->isHigh) {
+			skip->previousHigh = index;
+			index = skipNode->high;
+		}
+		else {
+			index = skipNode->low;
+		}
+		steps++;
+	}
+	skip->target = index;
+	skip->length = (byte)length;
+	return steps >= 2;
+}
+
+// Finds the chains of the graph where the walk only continues if the bits of
+// the address are equal to the limits of the spans. The nodes are those the
+// walk uses, or NULL to decode the nodes of the collection. If the skips are
+// provided then they and the skip indexes are set, otherwise only counted.
+// Returns the number of chains.
+static uint32_t skipsFind(
+	const IpiCg* const graph,
+	const IpiCgNode* nodes,
+	IpiCgSkip* const skips,
+	uint32_t* const skipIndexes,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	uint32_t skipsCount = 0;
+	IpiCgNode* decoded = NULL;
+	SkipNode* const skipNodes = (SkipNode*)Malloc(
+		sizeof(SkipNode) * ((size_t)count + 1));
+	if (skipNodes == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return 0;
+	}
+	if (nodes == NULL) {
+		decoded = (IpiCgNode*)Malloc(sizeof(IpiCgNode) * ((size_t)count + 1));
+		if (decoded == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		}
+		else {
+			alignedNodesDecode(graph, decoded, exception);
+		}
+		nodes = decoded;
+	}
+	StringBuilder sb = { NULL, 0 };
+	Cursor cursor = decodeCursorCreate(graph, &sb, exception);
+	for (uint32_t i = 0; i < count && EXCEPTION_OKAY; i++) {
+		setSpanIndex(&cursor, nodes[i].spanIndex);
+		if (EXCEPTION_OKAY) {
+			skipsNodeSet(graph, nodes, i, &cursor, &skipNodes[i]);
+		}
+	}
+	if (EXCEPTION_OKAY && skipsStepsSet(graph, skipNodes, exception)) {
+		for (uint32_t i = 0; i < count && EXCEPTION_OKAY; i++) {
+			IpiCgSkip skip;
+			if (skipNodes[i].steps < 2 ||
+				skipsFollow(graph, nodes, skipNodes, i, &cursor, &skip) == 
+				false) {
+				if (skipIndexes != NULL) {
+					skipIndexes[i] = UINT32_MAX;
+				}
+				continue;
+			}
+			if (skips != NULL) {
+				skips[skipsCount] = skip;
+				skipIndexes[i] = skipsCount;
+			}
+			skipsCount++;
+		}
+	}
+	cursorReleaseData(&cursor);
+	if (decoded != NULL) {
+		Free(decoded);
+	}
+	Free(skipNodes);
+	return skipsCount;
+}
+
+// Returns the number of chains of the graph before any of its prepared
+// structures are created. The cluster ranges needed to decode the nodes are
+// created for the count and then freed.
+static uint32_t skipsCount(const IpiCg* const graph, Exception* exception) {
+	IpiCg decoding = *graph;
+	decoding.clusterRanges = clusterRangesCreate(graph, NULL, exception);
+	if (decoding.clusterRanges == NULL) {
+		return 0;
+	}
+	const uint32_t count = skipsFind(&decoding, NULL, NULL, NULL, exception);
+	fiftyoneDegreesFreeAligned(decoding.clusterRanges);
+	return count;
+}
+
+// Finds the chains of the nodes the walk uses. The number of chains must 
+// already have been set with skipsCount. The skip indexes follow the chains
+// in the same memory.
+static IpiCgSkip* skipsCreate(
+	IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	IpiCgSkip* const skips = (IpiCgSkip*)preparedMalloc(
+		arena, 
+		getSkipsSize(graph));
+	if (skips == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	uint32_t* const skipIndexes = (uint32_t*)(skips + graph->skipsCount);
+	skipIndexes[count] = UINT32_MAX;
+	if (skipsFind(
+		graph, 
+		graph->alignedNodes, 
+		skips, 
+		skipIndexes, 
+		exception) != graph->skipsCount) {
+		if (EXCEPTION_OKAY) {
+			EXCEPTION_SET(CORRUPT_DATA);
+		}
+		preparedFree(arena, skips);
+		return NULL;
+	}
+	graph->skipIndexes = skipIndexes;
+	return skips;
+}
+
+// Checks that every skip index and the nodes of every chain are within the
+// graph. Used for chains that were not created by this process.
+static bool skipsCheck(const IpiCg* const graph, const IpiCgSkip* skips) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const uint32_t* const skipIndexes = 
+		(const uint32_t*)(skips + graph->skipsCount);
+	for (uint32_t i = 0; i < graph->skipsCount; i++) {
+		if (skips[i].target >= count ||
+			(skips[i].previousHigh != UINT32_MAX &&
+				skips[i].previousHigh >= count) ||
+			skips[i].length > VAR_SIZE * 8) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i <= count; i++) {
+		if (skipIndexes[i] != UINT32_MAX && 
+			skipIndexes[i] >= graph->skipsCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Results of walks while the uniform nodes are found. A node has either no
+// results, a single profile index or mixed results.
+#define UNIFORM_NONE UINT64_MAX
+#define UNIFORM_MIXED (UINT64_MAX - 1)
+
+// Result of a node whose high entries are being followed.
+#define UNIFORM_VISITING (UINT64_MAX - 2)
+
+// Results of the walks from a node while the uniform nodes are found.
+typedef struct uniform_node_t {
+	uint64_t low; // Result of following the low entry then every high entry
+	uint64_t high; // Result of following every high entry
+	uint64_t lowEqual; // Result of an equal low compare if it ends the walk
+	uint64_t highEqual; // Result of an equal high compare if it ends the
+						// walk
+	uint64_t in; // Results of moving back to the previous high node for
+				 // every way the walk reaches the node
+	uint64_t out; // Results of every walk from the node other than those
+				  // that move back to the previous high node
+	uint32_t lowNode; // Node moved to for an equal low compare, or 
+					  // UINT32_MAX if the walk ends
+	uint32_t highNode; // Node moved to for an equal high compare, or 
+					   // UINT32_MAX if the walk ends
+	uint32_t length; // Most bits consumed before a leaf is reached
+	byte lengthLow; // Bit length of the low limit
+	byte lengthHigh; // Bit length of the high limit
+	bool less; // True if the compare can be less than the low limit
+	bool back; // True if a walk from the node can move back to the previous
+			   // high node
+} UniformNode;
+
+// Returns the results of both sets of results.
+static uint64_t uniformJoin(const uint64_t first, const uint64_t second) {
+	if (first == UNIFORM_NONE || first == second) {
+		return second;
+	}
+	if (second == UNIFORM_NONE) {
+		return first;
+	}
+	return UNIFORM_MIXED;
+}
+
+// Sets the result of following every high entry from each node. A walk that
+// can't reach a leaf would end with corrupt data, or never end if it is a 
+// cycle, so has mixed results. The high entries from each node lead to a 
+// single node so each chain is followed until a known result and the nodes
+// on the stack then all share it.
+static void uniformHighSet(
+	const IpiCg* const graph,
+	const IpiCgNode* const nodes,
+	UniformNode* const uniformNodes,
+	uint32_t* const stack) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	for (uint32_t i = 0; i < count; i++) {
+		uniformNodes[i].high = UNIFORM_NONE;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t depth = 0;
+		uint32_t index = i;
+		uint64_t result;
+		while (true) {
+			if (uniformNodes[index].high == UNIFORM_VISITING) {
+				result = UNIFORM_MIXED;
+				break;
+			}
+			if (uniformNodes[index].high != UNIFORM_NONE) {
+				result = uniformNodes[index].high;
+				break;
+			}
+			uniformNodes[index].high = UNIFORM_VISITING;
+			stack[depth++] = index;
+			const uint32_t high = 
+				(nodes[index].flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) ?
+				nodes[index].next :
+				index;
+			if (high >= count) {
+				result = UNIFORM_MIXED;
+				break;
+			}
+			if (nodes[high].value >= count) {
+				result = nodes[high].value - count;
+				break;
+			}
+			index = nodes[high].value;
+		}
+		while (depth > 0) {
+			uniformNodes[stack[--depth]].high = result;
+		}
+	}
+}
+
+// Sets the results of the node that don't depend on other nodes being set.
+// Any compare is assumed possible other than one less than a low limit that
+// is all zeros, or any but an equal low compare when the low limit has no
+// bits. Moves to nodes that don't exist have mixed results so the walk 
+// raises the same exceptions as without the uniform nodes.
+static void uniformNodeSet(
+	const IpiCg* const graph,
+	const IpiCgNode* const nodes,
+	const uint32_t index,
+	const Cursor* const cursor,
+	UniformNode* const uniformNodes) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const IpiCgNode* const node = &nodes[index];
+	const IpiCgSpan* const limits = getSpanLimits(cursor);
+	UniformNode* const uniformNode = &uniformNodes[index];
+	uniformNode->lengthLow = cursor->span.lengthLow;
+	uniformNode->lengthHigh = cursor->span.lengthHigh;
+	uniformNode->less = cursor->span.lengthLow > 0 &&
+		(limits->low[0] != 0 || limits->low[1] != 0);
+	uniformNode->lowNode = UINT32_MAX;
+	uniformNode->highNode = UINT32_MAX;
+	uniformNode->lowEqual = UNIFORM_NONE;
+	uniformNode->highEqual = UNIFORM_NONE;
+	uniformNode->in = UNIFORM_NONE;
+	uniformNode->out = UNIFORM_NONE;
+	uniformNode->length = 0;
+	uniformNode->back = false;
+
+	// Set the results of an equal low compare and of following the low 
+	// entry then every high entry.
+	if (node->flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) {
+		if (node->value >= count) {
+			uniformNode->lowEqual = node->value - count;
+			uniformNode->low = node->value - count;
+		}
+		else {
+			uniformNode->lowNode = node->value;
+			uniformNode->low = uniformNodes[node->value].high;
+		}
+	}
+	else if (node->next >= count) {
+		uniformNode->lowEqual = UNIFORM_MIXED;
+		uniformNode->low = UNIFORM_MIXED;
+	}
+	else {
+		uniformNode->lowNode = node->next;
+		uniformNode->low = uniformNodes[node->next].high;
+	}
+
+	// Set the results of an equal high compare if possible.
+	if (uniformNode->lengthLow > 0) {
+		const uint32_t high = 
+			(node->flags & FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) ?
+			node->next :
+			index;
+		if (high >= count) {
+			uniformNode->highEqual = UNIFORM_MIXED;
+		}
+		else if (nodes[high].value >= count) {
+			uniformNode->highEqual = nodes[high].value - count;
+		}
+		else {
+			uniformNode->highNode = nodes[high].value;
+		}
+	}
+}
+
+// Sets the uniform nodes to an order where every node comes before the nodes
+// an equal compare moves to. Nodes that are part of a cycle are never 
+// ordered. Returns the number of nodes ordered.
+static uint32_t uniformOrder(
+	const IpiCg* const graph,
+	const UniformNode* const uniformNodes,
+	uint32_t* const inDegrees,
+	uint32_t* const order) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	memset(inDegrees, 0, sizeof(uint32_t) * count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (uniformNodes[i].lowNode != UINT32_MAX) {
+			inDegrees[uniformNodes[i].lowNode]++;
+		}
+		if (uniformNodes[i].highNode != UINT32_MAX) {
+			inDegrees[uniformNodes[i].highNode]++;
+		}
+	}
+	uint32_t ordered = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (inDegrees[i] == 0) {
+			order[ordered++] = i;
+		}
+	}
+	for (uint32_t next = 0; next < ordered; next++) {
+		const UniformNode* const uniformNode = &uniformNodes[order[next]];
+		if (uniformNode->lowNode != UINT32_MAX &&
+			--inDegrees[uniformNode->lowNode] == 0) {
+			order[ordered++] = uniformNode->lowNode;
+		}
+		if (uniformNode->highNode != UINT32_MAX &&
+			--inDegrees[uniformNode->highNode] == 0) {
+			order[ordered++] = uniformNode->highNode;
+		}
+	}
+	return ordered;
+}
+
+// Sets the results of every walk to and from each ordered node. A walk that
+// is less than a low limit moves back to the previous high node, the root 
+// if none, and follows its low entry then every high entry. The results of
+// moving back are carried forward from the root, and the results of the 
+// walks from each node are carried back from the leaves along with the most
+// bits they can consume before a leaf is reached.
+static void uniformResultsSet(
+	const IpiCg* const graph,
+	const uint32_t rootIndex,
+	UniformNode* const uniformNodes,
+	const uint32_t* const order,
+	const uint32_t ordered) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	if (rootIndex < count) {
+		uniformNodes[rootIndex].in = uniformNodes[rootIndex].low;
+	}
+	for (uint32_t i = 0; i < ordered; i++) {
+		const UniformNode* const uniformNode = &uniformNodes[order[i]];
+		if (uniformNode->in == UNIFORM_NONE) {
+			continue;
+		}
+		if (uniformNode->lowNode != UINT32_MAX) {
+			UniformNode* const low = &uniformNodes[uniformNode->lowNode];
+			low->in = uniformJoin(low->in, uniformNode->in);
+		}
+		if (uniformNode->highNode != UINT32_MAX) {
+			UniformNode* const high = &uniformNodes[uniformNode->highNode];
+			high->in = uniformJoin(high->in, uniformNode->low);
+		}
+	}
+	for (uint32_t i = ordered; i > 0; i--) {
+		UniformNode* const uniformNode = &uniformNodes[order[i - 1]];
+		uint64_t out = UNIFORM_NONE;
+		if (uniformNode->lengthLow > 0) {
+			uniformNode->back = uniformNode->less;
+			out = uniformJoin(uniformNode->low, uniformNode->high);
+			out = uniformJoin(out, uniformNode->highEqual);
+		}
+		out = uniformJoin(out, uniformNode->lowEqual);
+		if (uniformNode->lowNode != UINT32_MAX) {
+			const UniformNode* const low = &uniformNodes[uniformNode->lowNode];
+			out = uniformJoin(out, low->out);
+			uniformNode->back |= low->back;
+			if (low->length + uniformNode->lengthLow > uniformNode->length) {
+				uniformNode->length = low->length + uniformNode->lengthLow;
+			}
+		}
+		if (uniformNode->highNode != UINT32_MAX) {
+			const UniformNode* const high = 
+				&uniformNodes[uniformNode->highNode];
+			out = uniformJoin(out, high->out);
+			if (high->back) {
+				out = uniformJoin(out, uniformNode->low);
+			}
+			if (high->length + uniformNode->lengthHigh > 
+				uniformNode->length) {
+				uniformNode->length = high->length + uniformNode->lengthHigh;
+			}
+		}
+		uniformNode->out = out;
+	}
+}
+
+// Finds the nodes of the graph where every walk returns the same profile
+// index. The nodes are those the walk uses, or NULL to decode the nodes of 
+// the collection. If the uniforms are provided then they and the bits are 
+// set, otherwise only counted. Returns the number of nodes found.
+static uint32_t uniformsFind(
+	const IpiCg* const graph,
+	const IpiCgNode* nodes,
+	const uint32_t rootIndex,
+	IpiCgUniform* const uniforms,
+	uint64_t* const uniformBits,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	uint32_t uniformsCount = 0;
+	IpiCgNode* decoded = NULL;
+	UniformNode* const uniformNodes = (UniformNode*)Malloc(
+		sizeof(UniformNode) * ((size_t)count + 1));
+	uint32_t* const inDegrees = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	uint32_t* const order = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	if (uniformNodes == NULL || inDegrees == NULL || order == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+	}
+	else if (nodes == NULL) {
+		decoded = (IpiCgNode*)Malloc(sizeof(IpiCgNode) * ((size_t)count + 1));
+		if (decoded == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		}
+		else {
+			alignedNodesDecode(graph, decoded, exception);
+		}
+		nodes = decoded;
+	}
+	if (EXCEPTION_OKAY) {
+		uniformHighSet(graph, nodes, uniformNodes, order);
+		StringBuilder sb = { NULL, 0 };
+		Cursor cursor = decodeCursorCreate(graph, &sb, exception);
+		for (uint32_t i = 0; i < count && EXCEPTION_OKAY; i++) {
+			setSpanIndex(&cursor, nodes[i].spanIndex);
+			if (EXCEPTION_OKAY) {
+				uniformNodeSet(graph, nodes, i, &cursor, uniformNodes);
+			}
+		}
+		cursorReleaseData(&cursor);
+	}
+	if (EXCEPTION_OKAY) {
+		uniformResultsSet(
+			graph,
+			rootIndex,
+			uniformNodes,
+			order,
+			uniformOrder(graph, uniformNodes, inDegrees, order));
+
+		// Nodes the walk never reaches, or that are part of a cycle, have no
+		// results moving back and are not marked.
+		for (uint32_t i = 0; i < count; i++) {
+			const UniformNode* const uniformNode = &uniformNodes[i];
+			const uint64_t result = uniformNode->back ?
+				uniformJoin(uniformNode->out, uniformNode->in) :
+				uniformNode->out;
+			if (uniformNode->in == UNIFORM_NONE ||
+				result > UINT32_MAX ||
+				uniformNode->length > UINT8_MAX) {
+				continue;
+			}
+			if (uniforms != NULL) {
+				uniforms[uniformsCount].profileIndex = (uint32_t)result;
+				uniforms[uniformsCount].length = (byte)uniformNode->length;
+				uniformBits[i / 64] |= (uint64_t)1 << (i % 64);
+			}
+			uniformsCount++;
+		}
+	}
+	if (decoded != NULL) Free(decoded);
+	if (uniformNodes != NULL) Free(uniformNodes);
+	if (inDegrees != NULL) Free(inDegrees);
+	if (order != NULL) Free(order);
+	return uniformsCount;
+}
+
+// Sets the bits and ranks of the uniform nodes which follow the uniform nodes
+// in the same memory.
+static void uniformsPointersSet(
+	IpiCg* const graph, 
+	IpiCgUniform* const uniforms) {
+	graph->uniformBits = (uint64_t*)(uniforms + graph->uniformsCount);
+	graph->uniformRanks = (uint32_t*)(
+		graph->uniformBits + getUniformWords(graph));
+}
+
+// Returns the number of uniform nodes of the graph before any of its 
+// prepared structures are created. The cluster ranges needed to decode the 
+// nodes are created for the count and then freed.
+static uint32_t uniformsCount(const IpiCg* const graph, Exception* exception) {
+	IpiCg decoding = *graph;
+	decoding.clusterRanges = clusterRangesCreate(graph, NULL, exception);
+	if (decoding.clusterRanges == NULL) {
+		return 0;
+	}
+	const uint32_t count = uniformsFind(
+		&decoding, 
+		NULL, 
+		getRootIndex(&decoding), 
+		NULL, 
+		NULL, 
+		exception);
+	fiftyoneDegreesFreeAligned(decoding.clusterRanges);
+	return count;
+}
+
+// Finds the uniform nodes of the nodes the walk uses and sets the bits and 
+// ranks that locate them. The number of uniform nodes must already have 
+// been set with uniformsCount.
+static IpiCgUniform* uniformsCreate(
+	IpiCg* const graph,
+	Arena* const arena,
+	Exception* exception) {
+	IpiCgUniform* const uniforms = (IpiCgUniform*)preparedMalloc(
+		arena,
+		getUniformsSize(graph));
+	if (uniforms == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	uniformsPointersSet(graph, uniforms);
+	memset(graph->uniformBits, 0, sizeof(uint64_t) * getUniformWords(graph));
+	if (uniformsFind(
+		graph,
+		graph->alignedNodes,
+		getRootIndex(graph),
+		uniforms,
+		graph->uniformBits,
+		exception) != graph->uniformsCount) {
+		if (EXCEPTION_OKAY) {
+			EXCEPTION_SET(CORRUPT_DATA);
+		}
+		graph->uniformBits = NULL;
+		graph->uniformRanks = NULL;
+		preparedFree(arena, uniforms);
+		return NULL;
+	}
+	uint32_t rank = 0;
+	for (size_t w = 0; w < getUniformWords(graph); w++) {
+		graph->uniformRanks[w] = rank;
+		rank += bitsCount(graph->uniformBits[w]);
+	}
+	return uniforms;
+}
+
+// Checks that the ranks of the uniform nodes match the bits. Used for 
+// uniform nodes that were not created by this process.
+static bool uniformsCheck(
+	const IpiCg* const graph, 
+	const IpiCgUniform* const uniforms) {
+	const uint64_t* const uniformBits = 
+		(const uint64_t*)(uniforms + graph->uniformsCount);
+	const uint32_t* const uniformRanks = 
+		(const uint32_t*)(uniformBits + getUniformWords(graph));
+	uint64_t rank = 0;
+	for (size_t w = 0; w < getUniformWords(graph); w++) {
+		if (uniformRanks[w] != rank) {
+			return false;
+		}
+		rank += bitsCount(uniformBits[w]);
+	}
+	return rank == graph->uniformsCount;
+}
+
+/**
+ * VALIDATION
+ *
+ * Graphs created with the validate option are checked once so that the walk
+ * can skip the checks made at every step. Every node that can be reached 
+ * from the root is visited following both its entries, so the checks hold 
+ * whatever the address evaluated. The walk of a validated graph uses the 
+ * aligned nodes and decoded spans, so the clusters, spans and span bytes 
+ * were already checked when these were created.
+ */
+
+// State of the validation of one graph.
+typedef struct validate_t {
+	IpiCg* graph; // Graph to validate
+	Exception exception; // Exception for the validation of the graph
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	FIFTYONE_DEGREES_THREAD thread; // Thread validating the graph
+#endif
+	bool started; // True if the thread was started
+} Validate;
+
+// Checks that the node exists, adding it to the queue if not already visited.
+static bool validateVisit(
+	const IpiCg* const graph,
+	const uint32_t index,
+	uint32_t* const queue,
+	uint32_t* const queued,
+	byte* const visited) {
+	if (index >= graph->info.nodes.collection.count) {
+		return false;
+	}
+	if (visited[index] == 0) {
+		visited[index] = 1;
+		queue[(*queued)++] = index;
+	}
+	return true;
+}
+
+// Checks the nodes of the chain that starts at the node if there is one, 
+// adding them to the queue if not already visited.
+static bool validateSkip(
+	const IpiCg* const graph,
+	const uint32_t index,
+	uint32_t* const queue,
+	uint32_t* const queued,
+	byte* const visited) {
+	if (graph->skipIndexes == NULL || 
+		graph->skipIndexes[index] == UINT32_MAX) {
+		return true;
+	}
+	const IpiCgSkip* const skip = &graph->skips[graph->skipIndexes[index]];
+	return (skip->previousHigh == UINT32_MAX ||
+		validateVisit(graph, skip->previousHigh, queue, queued, visited)) &&
+		validateVisit(graph, skip->target, queue, queued, visited);
+}
+
+// Checks every node that the walk can reach and every span. Sets the graph
+// as validated if the checks pass, otherwise sets a corrupt data exception.
+static void validateGraph(IpiCg* const graph, Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const uint32_t results = graph->info.profileCount + 
+		graph->info.profileGroupCount;
+
+	// The trap node and its span must be present.
+	const IpiCgNode trap = validatedTrapNode(graph);
+	const IpiCgSpan* const trapSpan = &graph->decodedSpans[graph->spansCount];
+	if (memcmp(&graph->alignedNodes[count], &trap, sizeof(IpiCgNode)) != 0 ||
+		trapSpan->lengthLow != 0 ||
+		trapSpan->lengthHigh != 0) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
+
+	// The limits of the spans must fit the words they are compared with.
+	for (uint32_t i = 0; i < graph->spansCount; i++) {
+		const IpiCgSpan* const span = &graph->decodedSpans[i];
+		if (span->lengthLow > VAR_SIZE * 8 || 
+			span->lengthHigh > VAR_SIZE * 8) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return;
+		}
+	}
+
+	// The result of every uniform node must map to a profile or group.
+	for (uint32_t i = 0; i < graph->uniformsCount; i++) {
+		if (graph->uniforms[i].profileIndex >= results) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return;
+		}
+	}
+
+	// Visit the nodes breadth first from the root.
+	uint32_t* const queue = (uint32_t*)Malloc(
+		sizeof(uint32_t) * ((size_t)count + 1));
+	byte* const visited = (byte*)Malloc((size_t)count + 1);
+	if (queue == NULL || visited == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+	}
+	else {
+		uint32_t queued = 0;
+		memset(visited, 0, (size_t)count + 1);
+		bool valid = validateVisit(
+			graph,
+			graph->alignedRootIndex,
+			queue,
+			&queued,
+			visited);
+		for (uint32_t head = 0; valid && head < queued; head++) {
+			const IpiCgNode* const node = &graph->alignedNodes[queue[head]];
+
+			// The walk can move to the next node from any node, to the node
+			// the value points to if not a leaf, and to the end of a chain
+			// that starts at the node. It must be able to map the value of a
+			// leaf to a profile or group.
+			valid = node->spanIndex < graph->spansCount &&
+				validateSkip(graph, queue[head], queue, &queued, visited) &&
+				(node->next == count ||
+					validateVisit(
+						graph, 
+						node->next, 
+						queue, 
+						&queued, 
+						visited)) &&
+				(node->value < count ?
+					validateVisit(
+						graph, 
+						node->value, 
+						queue, 
+						&queued, 
+						visited) :
+					node->value - count < results);
+		}
+		if (valid) {
+			graph->validated = true;
+		}
+		else {
+			EXCEPTION_SET(CORRUPT_DATA);
+		}
+	}
+	if (queue != NULL) Free(queue);
+	if (visited != NULL) Free(visited);
+}
+
+// Validates the graph of the state on the thread.
+static void* validateRun(void* state) {
+	Validate* const validate = (Validate*)state;
+	validateGraph(validate->graph, &validate->exception);
+	return NULL;
+}
+
+// True if the graph has not been validated and has the aligned nodes and 
+// decoded spans needed to be. Graphs without them, which can only happen if
+// they came from a snapshot created without the validate option, are left to
+// use the checked walk.
+static bool isValidateNeeded(const IpiCg* const graph) {
+	return graph->validated == false &&
+		graph->alignedNodes != NULL &&
+		graph->decodedSpans != NULL;
+}
+
+// Validates every graph that needs it, each on its own thread if threading
+// is available.
+static void validateGraphs(IpiCgArray* const graphs, Exception* exception) {
+	Validate* const states = (Validate*)Malloc(
+		sizeof(Validate) * graphs->count);
+	if (states == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return;
+	}
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		states[i].graph = &graphs->items[i];
+		states[i].exception.status = NOT_SET;
+		states[i].started = false;
+	}
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	for (uint32_t i = 1; i < graphs->count; i++) {
+		if (isValidateNeeded(states[i].graph)) {
+			states[i].started = FIFTYONE_DEGREES_THREAD_CREATE(
+				states[i].thread,
+				(FIFTYONE_DEGREES_THREAD_ROUTINE)&validateRun,
+				&states[i]) == 0;
+		}
+	}
+#endif
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		if (states[i].started) {
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+			FIFTYONE_DEGREES_THREAD_JOIN(states[i].thread);
+			FIFTYONE_DEGREES_THREAD_CLOSE(states[i].thread);
+#endif
+		}
+		else if (isValidateNeeded(states[i].graph)) {
+			validateRun(&states[i]);
+		}
+		if (states[i].exception.status != NOT_SET && EXCEPTION_OKAY) {
+			EXCEPTION_SET(states[i].exception.status);
+		}
+	}
+	Free(states);
+}
+
+/**
+ * SNAPSHOTS
+ * 
+ * A snapshot holds the structures prepared when the graphs were created so
+ * that they can be loaded without being built again. The layout is a header,
+ * an entry for each graph, and then the prepared structures of each graph
+ * aligned to cache lines. All positions are offsets from the start of the 
+ * snapshot so the snapshot can be loaded from any address. Snapshots are
+ * only valid for the same build of the library and the same data.
+ */
+
+// Identifies the start of a snapshot.
+static const byte snapshotMagic[8] = { 
+	'5', '1', 'D', 'I', 'P', 'I', 'C', 'G' };
+
+// Incremented whenever the layout of a snapshot changes.
+#define SNAPSHOT_FORMAT 6
+
+// Used to detect snapshots created on a machine with different endianness.
+#define SNAPSHOT_ENDIAN 0x01020304
+
+// Number of prepared structures for each graph. In order the cluster ranges,
+// aligned nodes, span indexes, decoded spans, compressed nodes, chains of 
+// nodes with their skip indexes and uniform nodes with their bits and ranks.
+#define SNAPSHOT_SECTIONS 7
+
+// Header at the start of a snapshot.
+typedef struct snapshot_header_t {
+	byte magic[8]; // Always snapshotMagic
+	uint32_t format; // SNAPSHOT_FORMAT when created
+	uint32_t endian; // SNAPSHOT_ENDIAN when created
+	uint32_t nodeSize; // Size of IpiCgNode when created
+	uint32_t spanSize; // Size of IpiCgSpan when created
+	uint32_t configSize; // Size of IpiCgConfig when created
+	uint32_t graphsCount; // Number of graphs in the snapshot
+	uint64_t checksum; // Checksum of the information for every graph
+	IpiCgConfig config; // Options the graphs were created with
+} SnapshotHeader;
+
+// Entry for each graph following the header.
+typedef struct snapshot_graph_t {
+	uint64_t offsets[SNAPSHOT_SECTIONS]; // Offset of each prepared structure
+										 // or 0 if not present
+	uint32_t alignedRootIndex; // Root index in the aligned nodes
+	uint32_t spanIndexesSize; // Bytes used for each span index
+	uint64_t compressedNodesSize; // Bytes used by the compressed nodes
+	uint32_t skipsCount; // Number of chains of nodes
+	uint32_t uniformsCount; // Number of uniform nodes
+} SnapshotGraph;
+
+// Returns the offset rounded up to the next cache line.
+static uint64_t snapshotAlign(const uint64_t offset) {
+	return (offset + FIFTYONE_DEGREES_IPI_CG_CACHE_LINE - 1) &
+		~(uint64_t)(FIFTYONE_DEGREES_IPI_CG_CACHE_LINE - 1);
+}
+
+// Returns a checksum of the information for every graph using the FNV-1a 
+// hash. The information includes the position and size of every collection 
+// so a snapshot can not be used with different data.
+static uint64_t snapshotChecksum(const IpiCgArray* const graphs) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		const byte* const bytes = (const byte*)&graphs->items[i].info;
+		for (size_t b = 0; b < sizeof(IpiCgInfo); b++) {
+			hash = (hash ^ bytes[b]) * 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+// Sets the size in bytes of each prepared structure of the graph.
+static void snapshotSizes(const IpiCg* const graph, size_t* const sizes) {
+	const size_t count = graph->info.nodes.collection.count;
+	sizes[0] = sizeof(IpiCgClusterRange) * graph->clustersCount;
+	sizes[1] = sizeof(IpiCgNode) * (count + 1);
+	sizes[2] = graph->spanIndexesSize * count;
+	sizes[3] = sizeof(IpiCgSpan) * ((size_t)graph->spansCount + 1);
+	sizes[4] = graph->compressedNodesSize;
+	sizes[5] = getSkipsSize(graph);
+	sizes[6] = getUniformsSize(graph);
+}
+
+// Sets the pointer to each prepared structure of the graph.
+static void snapshotPointers(
+	const IpiCg* const graph,
+	const void** const pointers) {
+	pointers[0] = graph->clusterRanges;
+	pointers[1] = graph->alignedNodes;
+	pointers[2] = graph->spanIndexes;
+	pointers[3] = graph->decodedSpans;
+	pointers[4] = graph->compressedNodes;
+	pointers[5] = graph->skips;
+	pointers[6] = graph->uniforms;
+}
+
+// Writes the bytes to the destination returning false if they could not all
+// be written.
+typedef bool(*snapshotWriter)(
+	void* state,
+	const void* bytes,
+	const size_t length);
+
+// Writes the bytes to the file provided as the state.
+static bool snapshotWriteFile(
+	void* state,
+	const void* bytes,
+	const size_t length) {
+	return length == 0 || fwrite(bytes, length, 1, (FILE*)state) == 1;
+}
+
+// Writes the snapshot of the graphs with the writer. Returns false if the
+// writer failed.
+static bool snapshotWrite(
+	const IpiCgArray* const graphs,
+	const snapshotWriter write,
+	void* const state) {
+	static const byte padding[FIFTYONE_DEGREES_IPI_CG_CACHE_LINE] = { 0 };
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(SnapshotHeader));
+	memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+	header.format = SNAPSHOT_FORMAT;
+	header.endian = SNAPSHOT_ENDIAN;
+	header.nodeSize = sizeof(IpiCgNode);
+	header.spanSize = sizeof(IpiCgSpan);
+	header.configSize = sizeof(IpiCgConfig);
+	header.graphsCount = graphs->count;
+	header.checksum = snapshotChecksum(graphs);
+	header.config = graphs->config;
+	if (write(state, &header, sizeof(SnapshotHeader)) == false) {
+		return false;
+	}
+
+	// Write the entry for each graph with the offsets of the structures.
+	uint64_t offset = snapshotAlign(
+		sizeof(SnapshotHeader) + 
+		(uint64_t)graphs->count * sizeof(SnapshotGraph));
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		const IpiCg* const graph = &graphs->items[i];
+		SnapshotGraph entry;
+		size_t sizes[SNAPSHOT_SECTIONS];
+		const void* pointers[SNAPSHOT_SECTIONS];
+		memset(&entry, 0, sizeof(SnapshotGraph));
+		snapshotSizes(graph, sizes);
+		snapshotPointers(graph, pointers);
+		for (int s = 0; s < SNAPSHOT_SECTIONS; s++) {
+			if (pointers[s] != NULL) {
+				entry.offsets[s] = offset;
+				offset = snapshotAlign(offset + sizes[s]);
+			}
+		}
+		entry.alignedRootIndex = graph->alignedRootIndex;
+		entry.spanIndexesSize = graph->spanIndexesSize;
+		entry.compressedNodesSize = graph->compressedNodesSize;
+		entry.skipsCount = graph->skipsCount;
+		entry.uniformsCount = graph->uniformsCount;
+		if (write(state, &entry, sizeof(SnapshotGraph)) == false) {
+			return false;
+		}
+	}
+
+	// Write the structures padding each to the start of a cache line.
+	offset = sizeof(SnapshotHeader) + 
+		(uint64_t)graphs->count * sizeof(SnapshotGraph);
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		size_t sizes[SNAPSHOT_SECTIONS];
+		const void* pointers[SNAPSHOT_SECTIONS];
+		snapshotSizes(&graphs->items[i], sizes);
+		snapshotPointers(&graphs->items[i], pointers);
+		for (int s = 0; s < SNAPSHOT_SECTIONS; s++) {
+			if (pointers[s] == NULL) {
+				continue;
+			}
+			const size_t pad = (size_t)(snapshotAlign(offset) - offset);
+			if (write(state, padding, pad) == false ||
+				write(state, pointers[s], sizes[s]) == false) {
+				return false;
+			}
+			offset += pad + sizes[s];
+		}
+	}
+	return true;
+}
+
+// Returns the header of the snapshot if it was created by this build of the
+// library, otherwise NULL.
+static const SnapshotHeader* snapshotGetHeader(
+	const void* const snapshot,
+	const size_t length,
+	Exception* exception) {
+	const SnapshotHeader* const header = (const SnapshotHeader*)snapshot;
+	if (snapshot == NULL) {
+		EXCEPTION_SET(NULL_POINTER);
+		return NULL;
+	}
+	if (((uintptr_t)snapshot % sizeof(uint64_t)) != 0) {
+		EXCEPTION_SET(INVALID_INPUT);
+		return NULL;
+	}
+	if (length < sizeof(SnapshotHeader) ||
+		memcmp(header->magic, snapshotMagic, sizeof(snapshotMagic)) != 0) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return NULL;
+	}
+	if (header->format != SNAPSHOT_FORMAT ||
+		header->endian != SNAPSHOT_ENDIAN ||
+		header->nodeSize != sizeof(IpiCgNode) ||
+		header->spanSize != sizeof(IpiCgSpan) ||
+		header->configSize != sizeof(IpiCgConfig)) {
+		EXCEPTION_SET(INCORRECT_VERSION);
+		return NULL;
+	}
+	if (length < sizeof(SnapshotHeader) + 
+		(uint64_t)header->graphsCount * sizeof(SnapshotGraph)) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return NULL;
+	}
+	return header;
+}
+
+// Sets the prepared structures of the graphs to those in the snapshot after
+// checking that the snapshot was created from the same data.
+static void snapshotAttach(
+	IpiCgArray* const graphs,
+	const void* const snapshot,
+	const size_t length,
+	Exception* exception) {
+	const SnapshotHeader* const header = (const SnapshotHeader*)snapshot;
+	const SnapshotGraph* const entries = (const SnapshotGraph*)(header + 1);
+	if (header->graphsCount != graphs->count ||
+		header->checksum != snapshotChecksum(graphs)) {
+		EXCEPTION_SET(INCORRECT_VERSION);
+		return;
+	}
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		IpiCg* const graph = &graphs->items[i];
+		const SnapshotGraph* const entry = &entries[i];
+		size_t sizes[SNAPSHOT_SECTIONS];
+		const void* pointers[SNAPSHOT_SECTIONS];
+		graph->spanIndexesSize = (byte)entry->spanIndexesSize;
+		graph->compressedNodesSize = (size_t)entry->compressedNodesSize;
+		graph->skipsCount = entry->skipsCount;
+		graph->uniformsCount = entry->uniformsCount;
+		snapshotSizes(graph, sizes);
+		for (int s = 0; s < SNAPSHOT_SECTIONS; s++) {
+			if (entry->offsets[s] == 0) {
+				pointers[s] = NULL;
+			}
+			else if (entry->offsets[s] % sizeof(uint64_t) != 0 ||
+				entry->offsets[s] > length ||
+				sizes[s] > length - entry->offsets[s]) {
+				EXCEPTION_SET(CORRUPT_DATA);
+				return;
+			}
+			else {
+				pointers[s] = (const byte*)snapshot + entry->offsets[s];
+			}
+		}
+
+		// The cluster ranges are always needed and the other structures must
+		// be valid for the graph. The snapshot could have been changed since
+		// it was created so the indexes and lengths in each structure are
+		// checked against the counts of the graph.
+		if (pointers[0] == NULL ||
+			clusterRangesCheck(
+				graph, 
+				(const IpiCgClusterRange*)pointers[0]) == false ||
+			(pointers[1] != NULL && 
+				(entry->alignedRootIndex >= 
+					graph->info.nodes.collection.count ||
+				alignedNodesCheck(
+					graph, 
+					(const IpiCgNode*)pointers[1]) == false)) ||
+			(pointers[2] != NULL &&
+				spanIndexesCheck(graph, pointers[2]) == false) ||
+			(pointers[3] != NULL &&
+				decodedSpansCheck(
+					graph, 
+					(const IpiCgSpan*)pointers[3]) == false) ||
+			(pointers[4] != NULL &&
+				compressedNodesCheck(graph, pointers[4]) == false) ||
+			(pointers[5] != NULL &&
+				skipsCheck(graph, (const IpiCgSkip*)pointers[5]) == false) ||
+			(pointers[6] != NULL &&
+				uniformsCheck(
+					graph, 
+					(const IpiCgUniform*)pointers[6]) == false)) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return;
+		}
+		graph->clusterRanges = (IpiCgClusterRange*)pointers[0];
+		graph->alignedNodes = (IpiCgNode*)pointers[1];
+		graph->alignedRootIndex = entry->alignedRootIndex;
+		graph->spanIndexes = (void*)pointers[2];
+		graph->decodedSpans = (IpiCgSpan*)pointers[3];
+		graph->compressedNodes = (void*)pointers[4];
+		graph->skips = (IpiCgSkip*)pointers[5];
+		graph->skipIndexes = graph->skips != NULL ?
+			(uint32_t*)(graph->skips + graph->skipsCount) :
+			NULL;
+		if (graph->skips == NULL) {
+			graph->skipsCount = 0;
+		}
+		graph->uniforms = (IpiCgUniform*)pointers[6];
+		if (graph->uniforms != NULL) {
+			uniformsPointersSet(graph, graph->uniforms);
+		}
+		else {
+			graph->uniformsCount = 0;
+		}
+	}
+}
+
+// Creates the structures prepared for the graph when it is created with the
+// options. The cluster ranges are always created.
+static void preparedCreateStructures(
+	IpiCg* const graph,
+	const IpiCgConfig* const config,
+	Arena* const arena,
+	Exception* exception) {
+
+	// Load the node ranges of the clusters into memory.
+	graph->clusterRanges = clusterRangesCreate(graph, arena, exception);
+	if (graph->clusterRanges == NULL) return;
+
+	// Decode the nodes into aligned records if enabled.
+	if (config->alignNodes) {
+		graph->alignedNodes = alignedNodesCreate(graph, arena, exception);
+		if (graph->alignedNodes == NULL) return;
+	}
+
+	// Otherwise resolve the span index for each node if enabled.
+	else if (config->resolveSpanIndexes) {
+		graph->spanIndexes = spanIndexesCreate(graph, arena, exception);
+		if (graph->spanIndexes == NULL) return;
+	}
+
+	// Decode the spans if enabled.
+	if (config->decodeSpans) {
+		graph->decodedSpans = decodedSpansCreate(graph, arena, exception);
+		if (graph->decodedSpans == NULL) return;
+	}
+
+	// Compress the nodes if enabled and smaller than the nodes collection.
+	if (graph->compressedNodesSize > 0) {
+		graph->compressedNodes = compressedNodesCreate(
+			graph, 
+			arena, 
+			exception);
+		if (graph->compressedNodes == NULL) return;
+	}
+
+	// Find the chains of nodes the walk can skip if enabled and there are
+	// any. The nodes the walk uses must already be prepared.
+	if (graph->skipsCount > 0) {
+		graph->skips = skipsCreate(graph, arena, exception);
+		if (graph->skips == NULL) return;
+	}
+
+	// Find the nodes where every walk returns the same result if enabled and
+	// there are any.
+	if (graph->uniformsCount > 0) {
+		graph->uniforms = uniformsCreate(graph, arena, exception);
+	}
+}
+
+// Creates the prepared structures for the graph, from the arena if provided,
+// and the record that holds them.
+static void preparedCreate(
+	IpiCg* const graph,
+	const IpiCgConfig* const config,
+	SharedArena* const arena,
+	Exception* exception) {
+	SharedPrepared* const record = (SharedPrepared*)Malloc(
+		sizeof(SharedPrepared));
+	if (record == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return;
+	}
+	record->shared.references = 1;
+	record->shared.free = sharedPreparedFree;
+	record->arena = arena == NULL ? NULL : &arena->shared;
+	sharedRetain(record->arena);
+	graph->preparedShared = &record->shared;
+	preparedCreateStructures(
+		graph, 
+		config, 
+		arena == NULL ? NULL : &arena->arena, 
+		exception);
+
+	// Record the structures created, even if some failed, so that they are
+	// freed with the graph.
+	record->clusterRanges = graph->clusterRanges;
+	record->alignedNodes = graph->alignedNodes;
+	record->spanIndexes = graph->spanIndexes;
+	record->decodedSpans = graph->decodedSpans;
+	record->compressedNodes = graph->compressedNodes;
+	record->skips = graph->skips;
+	record->uniforms = graph->uniforms;
+}
+
+// Creates the prepared structures of every graph that needs them, from a 
+// single arena if enabled or needed to place the memory.
+static void preparedCreateAll(IpiCgArray* const graphs, Exception* exception) {
+	SharedArena* arena = NULL;
+	bool needed = false;
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		needed |= isPreparedNeeded(&graphs->items[i]);
+	}
+	if (needed == false) {
+		return;
+	}
+
+	// The size of the compressed nodes is needed to size the arena. Nodes
+	// that would not be smaller compressed are left as they are.
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		IpiCg* const graph = &graphs->items[i];
+		if (isPreparedNeeded(graph) && 
+			isCompressNeeded(graph, &graphs->config)) {
+			const size_t size = compressedNodesEncode(graph, NULL, exception);
+			if (EXCEPTION_FAILED) return;
+			graph->compressedNodesSize = 
+				size < graph->info.nodes.collection.length ? size : 0;
+		}
+	}
+
+	// The number of chains of nodes and uniform nodes are also needed to 
+	// size the arena.
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		IpiCg* const graph = &graphs->items[i];
+		if (isPreparedNeeded(graph) && 
+			isSkipsNeeded(graph, &graphs->config)) {
+			graph->skipsCount = skipsCount(graph, exception);
+			if (EXCEPTION_FAILED) return;
+		}
+		if (isPreparedNeeded(graph) && 
+			isUniformNeeded(graph, &graphs->config)) {
+			graph->uniformsCount = uniformsCount(graph, exception);
+			if (EXCEPTION_FAILED) return;
+		}
+	}
+	if (graphs->config.useArena || isPlacementNeeded(&graphs->config)) {
+		arena = arenaCreate(graphs, exception);
+		if (arena == NULL) return;
+	}
+	for (uint32_t i = 0; i < graphs->count && EXCEPTION_OKAY; i++) {
+		if (isPreparedNeeded(&graphs->items[i])) {
+			preparedCreate(
+				&graphs->items[i], 
+				&graphs->config, 
+				arena, 
+				exception);
+		}
+	}
+
+	// Each graph prepared in the arena holds its own reference.
+	if (arena != NULL) {
+		sharedRelease(&arena->shared);
+	}
+}
+
+// Creates the collections for the parts of the graph from the source, 
+// replacing any the graph already holds. Collections with the same header as
+// one in the share are used by both graphs. The information for the graph 
+// must already contain the headers. Returns false if a collection can not be 
+// created.
+static bool collectionsCreate(
+	IpiCg* const graph,
+	const uint32_t parts,
+	collectionCreate collectionCreate,
+	void* state,
+	CollectionShare* const share,
+	Exception* exception) {
+
+	// Create the collection for the node values. Must overwrite the count
+	// to zero as it is consumed as a variable width collection.
+	if (parts & FIFTYONE_DEGREES_IPI_CG_DELTA_NODES) {
+		CollectionHeader headerNodes = graph->info.nodes.collection;
+		headerNodes.count = headerNodes.length;
+		sharedRelease(graph->nodesShared);
+		graph->nodesShared = NULL;
+		graph->nodes = sharedCollectionCreate(
+			collectionCreate,
+			headerNodes,
+			state,
+			share,
+			&graph->nodesShared,
+			exception);
+		if (graph->nodes == NULL) return false;
+
+		// If the nodes are in memory then record where so that nodes can be
+		// prefetched before they are fetched from the collection.
+		graph->nodesMemory = collectionCreate == ipiGraphCreateFromMemory ?
+			((MemoryReader*)state)->startByte + headerNodes.startPosition :
+			NULL;
+	}
+
+	// Create the collection for the spans.
+	if (parts & FIFTYONE_DEGREES_IPI_CG_DELTA_SPANS) {
+		sharedRelease(graph->spansShared);
+		graph->spansShared = NULL;
+		graph->spans = sharedCollectionCreate(
+			collectionCreate,
+			graph->info.spans,
+			state,
+			share,
+			&graph->spansShared,
+			exception);
+		if (graph->spans == NULL) return false;
+		graph->spansCount = CollectionGetCount(graph->spans);
+	}
+
+	// Create the collection for the span bytes.
+	if (parts & FIFTYONE_DEGREES_IPI_CG_DELTA_SPAN_BYTES) {
+		const CollectionHeader spanBytesHeader = {
+			graph->info.spanBytes.startPosition,
+			graph->info.spanBytes.length,
+			graph->info.spanBytes.length,
+		};
+		sharedRelease(graph->spanBytesShared);
+		graph->spanBytesShared = NULL;
+		graph->spanBytes = sharedCollectionCreate(
+			collectionCreate,
+			spanBytesHeader,
+			state,
+			share,
+			&graph->spanBytesShared,
+			exception);
+		if (graph->spanBytes == NULL) return false;
+	}
+
+	// Create the collection for the clusters.
+	if (parts & FIFTYONE_DEGREES_IPI_CG_DELTA_CLUSTERS) {
+		sharedRelease(graph->clustersShared);
+		graph->clustersShared = NULL;
+		graph->clusters = sharedCollectionCreate(
+			collectionCreate,
+			graph->info.clusters,
+			state,
+			share,
+			&graph->clustersShared,
+			exception);
+		if (graph->clusters == NULL) return false;
+		graph->clustersCount = CollectionGetCount(graph->clusters);
+
+		// Check that the element size for the clusters is not larger than 
+		// the structure.
+		if (graph->clusters->elementSize > sizeof(Cluster)) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * DELTAS
+ *
+ * A delta holds the parts of the graphs that changed since the data an 
+ * existing array was created from. The new array starts as a copy of the 
+ * existing array's graphs holding another reference to every collection and
+ * prepared structure. The references to the parts that changed are then 
+ * released and the parts created from the delta, so the existing array is 
+ * never modified. The layout is described by fiftyoneDegreesIpiCgDeltaHeader
+ * and fiftyoneDegreesIpiCgDeltaGraph.
+ */
+
+// True if the collection header is within the delta. The header is passed
+// by value as the information of a graph is packed and may not be aligned.
+static bool deltaIsInside(
+	const CollectionHeader header, 
+	const size_t length) {
+	return header.startPosition <= length &&
+		header.length <= length - header.startPosition;
+}
+
+// Returns the header of the delta if it applies to the graphs and every entry
+// is within the delta, otherwise NULL.
+static const IpiCgDeltaHeader* deltaGetHeader(
+	const IpiCgArray* const graphs,
+	const void* const delta,
+	const size_t length,
+	Exception* exception) {
+	const IpiCgDeltaHeader* const header = (const IpiCgDeltaHeader*)delta;
+	if (delta == NULL) {
+		EXCEPTION_SET(NULL_POINTER);
+		return NULL;
+	}
+	if (length < sizeof(IpiCgDeltaHeader)) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return NULL;
+	}
+	if (header->format != FIFTYONE_DEGREES_IPI_CG_DELTA_FORMAT ||
+		header->graphsCount != graphs->count ||
+		header->checksum != snapshotChecksum(graphs)) {
+		EXCEPTION_SET(INCORRECT_VERSION);
+		return NULL;
+	}
+	if (length < sizeof(IpiCgDeltaHeader) +
+		(uint64_t)header->count * sizeof(IpiCgDeltaGraph)) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return NULL;
+	}
+
+	// Entries must be in ascending order of graph index so each graph is 
+	// changed once, and only have known flags and collections in the delta.
+	const IpiCgDeltaGraph* const entries = (const IpiCgDeltaGraph*)(header + 1);
+	for (uint32_t i = 0; i < header->count; i++) {
+		const IpiCgDeltaGraph* const entry = &entries[i];
+		const uint32_t changed = entry->changed;
+		if (entry->index >= graphs->count ||
+			(i > 0 && entry->index <= entries[i - 1].index) ||
+			(changed & ~(FIFTYONE_DEGREES_IPI_CG_DELTA_COLLECTIONS |
+				FIFTYONE_DEGREES_IPI_CG_DELTA_PROFILES)) != 0 ||
+			((changed & FIFTYONE_DEGREES_IPI_CG_DELTA_NODES) &&
+				!deltaIsInside(entry->info.nodes.collection, length)) ||
+			((changed & FIFTYONE_DEGREES_IPI_CG_DELTA_SPANS) &&
+				!deltaIsInside(entry->info.spans, length)) ||
+			((changed & FIFTYONE_DEGREES_IPI_CG_DELTA_SPAN_BYTES) &&
+				!deltaIsInside(entry->info.spanBytes, length)) ||
+			((changed & FIFTYONE_DEGREES_IPI_CG_DELTA_CLUSTERS) &&
+				!deltaIsInside(entry->info.clusters, length))) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return NULL;
+		}
+	}
+	return header;
+}
+
+// Replaces the parts of the graph that changed with those from the entry,
+// creating collections from the reader for the delta. Prepared structures 
+// are released if any collection changed so that they can be created again,
+// and the graph is validated again if it changed at all.
+static void deltaApply(
+	IpiCg* const graph,
+	const IpiCgDeltaGraph* const entry,
+	MemoryReader* const reader,
+	CollectionShare* const share,
+	Exception* exception) {
+	const uint32_t changed = entry->changed;
+	if (changed & FIFTYONE_DEGREES_IPI_CG_DELTA_NODES) {
+		graph->info.nodes = entry->info.nodes;
+	}
+	if (changed & FIFTYONE_DEGREES_IPI_CG_DELTA_SPANS) {
+		graph->info.spans = entry->info.spans;
+	}
+	if (changed & FIFTYONE_DEGREES_IPI_CG_DELTA_SPAN_BYTES) {
+		graph->info.spanBytes = entry->info.spanBytes;
+	}
+	if (changed & FIFTYONE_DEGREES_IPI_CG_DELTA_CLUSTERS) {
+		graph->info.clusters = entry->info.clusters;
+	}
+	if (changed & FIFTYONE_DEGREES_IPI_CG_DELTA_PROFILES) {
+		graph->info.firstProfileIndex = entry->info.firstProfileIndex;
+		graph->info.profileCount = entry->info.profileCount;
+		graph->info.firstProfileGroupIndex = 
+			entry->info.firstProfileGroupIndex;
+		graph->info.profileGroupCount = entry->info.profileGroupCount;
+	}
+	graph->validated = false;
+	if ((changed & FIFTYONE_DEGREES_IPI_CG_DELTA_COLLECTIONS) == 0) {
+		return;
+	}
+	sharedRelease(graph->preparedShared);
+	graph->preparedShared = NULL;
+	graph->clusterRanges = NULL;
+	graph->alignedNodes = NULL;
+	graph->alignedRootIndex = 0;
+	graph->spanIndexes = NULL;
+	graph->spanIndexesSize = 0;
+	graph->decodedSpans = NULL;
+	graph->compressedNodes = NULL;
+	graph->compressedNodesSize = 0;
+	graph->skips = NULL;
+	graph->skipIndexes = NULL;
+	graph->skipsCount = 0;
+	graph->uniforms = NULL;
+	graph->uniformBits = NULL;
+	graph->uniformRanks = NULL;
+	graph->uniformsCount = 0;
+	collectionsCreate(
+		graph,
+		changed,
+		ipiGraphCreateFromMemory,
+		reader,
+		share,
+		exception);
+}
+
+static IpiCgArray* ipiGraphCreate(
+	Collection* collection,
+	collectionCreate collectionCreate,
+	void* state,
+	const IpiCgConfig* const config,
+	const void* const snapshot,
+	const size_t snapshotLength,
+	Exception* exception) {
+	IpiCgArray* graphs;
+
+	// Create the array for each of the graphs.
+	uint32_t count = CollectionGetCount(collection);
+	FIFTYONE_DEGREES_ARRAY_CREATE(IpiCg, graphs, count); 
+	if (graphs == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	graphs->config = *config;
+	if (config->validate) {
+		graphs->config.alignNodes = true;
+		graphs->config.decodeSpans = true;
+	}
+	graphs->snapshot = NULL;
+	graphs->arena = NULL;
+	graphs->arenaSize = 0;
+	graphs->arenaMapped = false;
+
+	// Graphs with the same header use the same collection.
+	CollectionShare share;
+	if (collectionShareCreate(&share, count, exception) == false) {
+		fiftyoneDegreesIpiGraphFree(graphs);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		graphs->items[i].nodes = NULL;
+		graphs->items[i].spans = NULL;
+		graphs->items[i].spanBytes = NULL;
+		graphs->items[i].clusters = NULL;
+		graphs->items[i].clusterRanges = NULL;
+		graphs->items[i].alignedNodes = NULL;
+		graphs->items[i].alignedRootIndex = 0;
+		graphs->items[i].spanIndexes = NULL;
+		graphs->items[i].spanIndexesSize = 0;
+		graphs->items[i].decodedSpans = NULL;
+		graphs->items[i].compressedNodes = NULL;
+		graphs->items[i].compressedNodesSize = 0;
+		graphs->items[i].skips = NULL;
+		graphs->items[i].skipIndexes = NULL;
+		graphs->items[i].skipsCount = 0;
+		graphs->items[i].uniforms = NULL;
+		graphs->items[i].uniformBits = NULL;
+		graphs->items[i].uniformRanks = NULL;
+		graphs->items[i].uniformsCount = 0;
+		graphs->items[i].nodesMemory = NULL;
+		graphs->items[i].validated = false;
+		graphs->items[i].resolved = NULL;
+		graphs->items[i].nodesShared = NULL;
+		graphs->items[i].spansShared = NULL;
+		graphs->items[i].spanBytesShared = NULL;
+		graphs->items[i].clustersShared = NULL;
+		graphs->items[i].preparedShared = NULL;
+
+		Item itemInfo;
+		DataReset(&itemInfo.data);
+
+		// Get the information from the collection provided.
+		const CollectionKey infoKey = {
+			i,
+			&CollectionKeyType_GraphInfo,
+		};
+		const IpiCgInfo* const info = (IpiCgInfo*)collection->get(
+			collection, 
+			&infoKey,
+			&itemInfo,
+			exception);
+		if (!info || EXCEPTION_FAILED) {
+			Free(share.records);
+			fiftyoneDegreesIpiGraphFree(graphs);
+			return NULL;
+		}
+		graphs->items[i].info = *info;
+		COLLECTION_RELEASE(collection, &itemInfo);
+		graphs->count++;
+
+		// Create the collections for every part of the graph.
+		if (collectionsCreate(
+			&graphs->items[i],
+			FIFTYONE_DEGREES_IPI_CG_DELTA_COLLECTIONS,
+			collectionCreate,
+			state,
+			&share,
+			exception) == false) {
+			Free(share.records);
+			fiftyoneDegreesIpiGraphFree(graphs);
+			return NULL;
+		}
+	}
+	Free(share.records);
+
+	// Use the prepared structures from the snapshot if provided. The 
+	// structures are owned by the caller and are not freed with the graphs.
+	if (snapshot != NULL) {
+		graphs->snapshot = snapshot;
+		snapshotAttach(graphs, snapshot, snapshotLength, exception);
+	}
+
+	// Otherwise create the prepared structures.
+	else {
+		preparedCreateAll(graphs, exception);
+	}
+
+	// Check the graphs once if enabled so that the walk doesn't need to.
+	if (EXCEPTION_OKAY && config->validate) {
+		validateGraphs(graphs, exception);
+	}
+	if (EXCEPTION_FAILED) {
+		fiftyoneDegreesIpiGraphFree(graphs);
+		return NULL;
+	}
+
+	return graphs;
+}
+
+void fiftyoneDegreesIpiGraphFree(fiftyoneDegreesIpiCgArray* graphs) {
+
+	// Memory shared with other arrays is only freed with the last reference.
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		sharedRelease(graphs->items[i].nodesShared);
+		sharedRelease(graphs->items[i].spansShared);
+		sharedRelease(graphs->items[i].spanBytesShared);
+		sharedRelease(graphs->items[i].clustersShared);
+		sharedRelease(graphs->items[i].preparedShared);
+		if (graphs->items[i].resolved != NULL) {
+			Free(graphs->items[i].resolved);
+		}
+	}
+	Free(graphs);
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromMemory(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	fiftyoneDegreesException* exception) {
+	const IpiCgConfig graphConfig = FIFTYONE_DEGREES_IPI_CG_CONFIG_DEFAULT;
+	return fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig(
+		collection,
+		reader,
+		&graphConfig,
+		exception);
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception) {
+	return ipiGraphCreate(
+		collection,
+		ipiGraphCreateFromMemory,
+		(void*)reader,
+		graphConfig,
+		NULL,
+		0,
+		exception);
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFile(
+	fiftyoneDegreesCollection* collection,
+	FILE* file,
+	fiftyoneDegreesFilePool* reader,
+	const fiftyoneDegreesCollectionConfig config,
+	fiftyoneDegreesException* exception) {
+	const IpiCgConfig graphConfig = FIFTYONE_DEGREES_IPI_CG_CONFIG_DEFAULT;
+	return fiftyoneDegreesIpiGraphCreateFromFileWithConfig(
+		collection,
+		file,
+		reader,
+		config,
+		&graphConfig,
+		exception);
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFileWithConfig(
+	fiftyoneDegreesCollection* collection,
+	FILE* file,
+	fiftyoneDegreesFilePool* reader,
+	const fiftyoneDegreesCollectionConfig config,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception) {
+	FileCollection state = {
+		file,
+		reader,
+		config,
+		graphConfig->directReads
+	};
+	return ipiGraphCreate(
+		collection,
+		ipiGraphCreateFromFile,
+		(void*)&state,
+		graphConfig,
+		NULL,
+		0,
+		exception);
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromMemoryWithSnapshot(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const void* snapshot,
+	size_t length,
+	fiftyoneDegreesException* exception) {
+	const SnapshotHeader* const header = snapshotGetHeader(
+		snapshot, 
+		length, 
+		exception);
+	if (header == NULL) {
+		return NULL;
+	}
+	return ipiGraphCreate(
+		collection,
+		ipiGraphCreateFromMemory,
+		(void*)reader,
+		&header->config,
+		snapshot,
+		length,
+		exception);
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFileWithSnapshot(
+	fiftyoneDegreesCollection* collection,
+	FILE* file,
+	fiftyoneDegreesFilePool* reader,
+	const fiftyoneDegreesCollectionConfig config,
+	const void* snapshot,
+	size_t length,
+	fiftyoneDegreesException* exception) {
+	const SnapshotHeader* const header = snapshotGetHeader(
+		snapshot, 
+		length, 
+		exception);
+	if (header == NULL) {
+		return NULL;
+	}
+	FileCollection state = {
+		file,
+		reader,
+		config,
+		header->config.directReads
+	};
+	return ipiGraphCreate(
+		collection,
+		ipiGraphCreateFromFile,
+		(void*)&state,
+		&header->config,
+		snapshot,
+		length,
+		exception);
+}
+
+void fiftyoneDegreesIpiGraphSnapshotSave(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	FILE* file,
+	fiftyoneDegreesException* exception) {
+	if (snapshotWrite(graphs, snapshotWriteFile, file) == false) {
+		EXCEPTION_SET(FILE_WRITE_ERROR);
+	}
+}
+
+fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromDelta(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	void* delta,
+	size_t length,
+	fiftyoneDegreesException* exception) {
+	const IpiCgDeltaHeader* const header = deltaGetHeader(
+		graphs, 
+		delta, 
+		length, 
+		exception);
+	if (header == NULL) {
+		return NULL;
+	}
+	const IpiCgDeltaGraph* const entries = (const IpiCgDeltaGraph*)(header + 1);
+
+	// Copy the existing graphs adding a reference to everything they hold.
+	IpiCgArray* result;
+	FIFTYONE_DEGREES_ARRAY_CREATE(IpiCg, result, graphs->count);
+	if (result == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	result->config = graphs->config;
+	result->snapshot = graphs->snapshot;
+	result->arena = NULL;
+	result->arenaSize = 0;
+	result->arenaMapped = false;
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		IpiCg* const graph = &result->items[i];
+		*graph = graphs->items[i];
+		graph->resolved = NULL;
+		sharedRetain(graph->nodesShared);
+		sharedRetain(graph->spansShared);
+		sharedRetain(graph->spanBytesShared);
+		sharedRetain(graph->clustersShared);
+		sharedRetain(graph->preparedShared);
+		result->count++;
+	}
+
+	// Replace the parts that changed and prepare the graphs that need it. 
+	// Collections are only shared with others created from the delta.
+	MemoryReader reader;
+	CollectionShare share;
+	reader.startByte = (byte*)delta;
+	reader.current = (byte*)delta;
+	reader.lastByte = (byte*)delta + length;
+	reader.length = (long)length;
+	if (collectionShareCreate(&share, header->count, exception)) {
+		for (uint32_t i = 0; i < header->count && EXCEPTION_OKAY; i++) {
+			deltaApply(
+				&result->items[entries[i].index], 
+				&entries[i], 
+				&reader, 
+				&share,
+				exception);
+		}
+		Free(share.records);
+	}
+	if (EXCEPTION_OKAY) {
+		preparedCreateAll(result, exception);
+	}
+	if (EXCEPTION_OKAY && result->config.validate) {
+		validateGraphs(result, exception);
+	}
+	if (EXCEPTION_FAILED) {
+		fiftyoneDegreesIpiGraphFree(result);
+		return NULL;
+	}
+	return result;
+}
+
+fiftyoneDegreesIpiCgReplicaArray* 
+fiftyoneDegreesIpiGraphCreateReplicasFromMemory(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception) {
+	IpiCgReplicaArray* replicas;
+	const uint32_t nodes = placementGetNodeCount();
+	FIFTYONE_DEGREES_ARRAY_CREATE(IpiCgReplica, replicas, nodes);
+	if (replicas == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	uint32_t i;
+	for (i = 0; i < nodes; i++) {
+		IpiCgReplica* const replica = &replicas->items[replicas->count++];
+		IpiCgConfig config = *graphConfig;
+		MemoryReader* source = reader;
+		MemoryReader copy;
+		replica->graphs = NULL;
+		replica->data = NULL;
+		replica->dataSize = 0;
+		replica->dataMapped = false;
+
+		// With more than one node copy the source data into memory preferred
+		// on the node so that the collections of the replica are local.
+		if (nodes > 1) {
+			config.interleave = false;
+			config.numaNode = (int)i;
+			replica->dataSize = (size_t)reader->length;
+			replica->data = placementMalloc(
+				&config, 
+				&replica->dataSize, 
+				&replica->dataMapped);
+			if (replica->data == NULL) {
+				EXCEPTION_SET(INSUFFICIENT_MEMORY);
+				break;
+			}
+			memcpy(replica->data, reader->startByte, (size_t)reader->length);
+			copy.startByte = replica->data;
+			copy.current = replica->data + 
+				(reader->current - reader->startByte);
+			copy.lastByte = replica->data + 
+				(reader->lastByte - reader->startByte);
+			copy.length = reader->length;
+			source = &copy;
+		}
+
+		replica->graphs = fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig(
+			collection,
+			source,
+			&config,
+			exception);
+		if (replica->graphs == NULL) {
+			break;
+		}
+	}
+	if (i < nodes) {
+		fiftyoneDegreesIpiGraphReplicasFree(replicas);
+		return NULL;
+	}
+	return replicas;
+}
+
+const fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphReplicasGet(
+	const fiftyoneDegreesIpiCgReplicaArray* replicas) {
+	const uint32_t node = placementGetNode();
+	if (node < replicas->count) {
+		return replicas->items[node].graphs;
+	}
+	return replicas->items[0].graphs;
+}
+
+void fiftyoneDegreesIpiGraphReplicasFree(
+	fiftyoneDegreesIpiCgReplicaArray* replicas) {
+	for (uint32_t i = 0; i < replicas->count; i++) {
+		IpiCgReplica* const replica = &replicas->items[i];
+		if (replica->graphs != NULL) {
+			fiftyoneDegreesIpiGraphFree(replica->graphs);
+		}
+		if (replica->data != NULL) {
+			placementFree(
+				replica->data, 
+				replica->dataSize, 
+				replica->dataMapped);
+		}
+	}
+	Free(replicas);
+}
+
+/**
+ * SEGMENTS
+ * 
+ * A segment is named shared memory holding the source data, the information
+ * for each graph and a snapshot of the prepared structures so that any number
+ * of processes can evaluate with a single copy. Each generation published 
+ * has its own segment named after the name provided and the generation. A 
+ * control segment with the name provided holds the current generation so
+ * that processes can check for a new generation with a single read. The 
+ * segment of a generation is removed once the next is current. Memory that 
+ * is still mapped by a process remains valid until it is unmapped. Linux 
+ * only, and only when FIFTYONE_DEGREES_IPI_GRAPH_SEGMENTS is defined as POSIX
+ * shared memory needs librt with versions of glibc before 2.34.
+ */
+
+#if defined(__linux__) && defined(FIFTYONE_DEGREES_IPI_GRAPH_SEGMENTS)
+#define SEGMENTS_AVAILABLE
+#endif
+
+#ifdef SEGMENTS_AVAILABLE
+
+// Identifies the start of a segment.
+static const byte segmentMagic[8] = { 
+	'5', '1', 'D', 'I', 'P', 'I', 'S', 'M' };
+
+// Incremented whenever the layout of a segment changes.
+#define SEGMENT_FORMAT 1
+
+// Maximum length of the name of the segment for a generation.
+#define SEGMENT_NAME_LENGTH 256
+
+// Control segment with the name provided.
+typedef struct segment_control_t {
+	volatile long generation; // Current generation or 0 if none
+} SegmentControl;
+
+// Header at the start of the segment for each generation. All positions are
+// offsets from the start of the segment.
+typedef struct segment_header_t {
+	byte magic[8]; // Always segmentMagic
+	uint32_t format; // SEGMENT_FORMAT when created
+	uint32_t infoCount; // Number of graph information records
+	uint64_t infoOffset; // Offset of the graph information records
+	uint64_t dataOffset; // Offset of the source data
+	uint64_t dataLength; // Length of the source data in bytes
+	uint64_t snapshotOffset; // Offset of the snapshot
+	uint64_t snapshotLength; // Length of the snapshot in bytes
+} SegmentHeader;
+
+// Memory of the segment that the snapshot is written to.
+typedef struct segment_writer_t {
+	byte* current; // Next byte to write
+	byte* end; // Byte after the last that can be written
+} SegmentWriter;
+
+// Copies the bytes to the memory of the segment writer provided as the state
+// and moves past them. Returns false if the bytes don't fit.
+static bool segmentWriteMemory(
+	void* state,
+	const void* bytes,
+	const size_t length) {
+	SegmentWriter* const writer = (SegmentWriter*)state;
+	if (length > (size_t)(writer->end - writer->current)) {
+		return false;
+	}
+	memcpy(writer->current, bytes, length);
+	writer->current += length;
+	return true;
+}
+
+// Adds the number of bytes to the total provided as the state.
+static bool segmentWriteCount(
+	void* state,
+	const void* bytes,
+	const size_t length) {
+	(void)bytes;
+	*(uint64_t*)state += length;
+	return true;
+}
+
+// Sets the name of the segment for the generation. Returns false if the name
+// is too long.
+static bool segmentName(
+	char* const buffer,
+	const char* const name,
+	const long generation) {
+	const int length = snprintf(
+		buffer,
+		SEGMENT_NAME_LENGTH,
+		"%s.%ld",
+		name,
+		generation);
+	return length > 0 && length < SEGMENT_NAME_LENGTH;
+}
+
+// Maps the control segment for the name, creating it if requested. Only the
+// process publishing to the name can write to the control segment. Returns 
+// NULL if the control segment could not be mapped.
+static SegmentControl* segmentControlMap(
+	const char* const name,
+	const bool create) {
+	struct stat status;
+	void* pointer = MAP_FAILED;
+	const int file = create ?
+		shm_open(name, O_RDWR | O_CREAT, 0644) :
+		shm_open(name, O_RDONLY, 0);
+	if (file < 0) {
+		return NULL;
+	}
+	if (fstat(file, &status) == 0) {
+		if (create && (size_t)status.st_size < sizeof(SegmentControl)) {
+			status.st_size = ftruncate(file, sizeof(SegmentControl)) == 0 ?
+				sizeof(SegmentControl) : 0;
+		}
+		if ((size_t)status.st_size >= sizeof(SegmentControl)) {
+			pointer = mmap(
+				NULL,
+				sizeof(SegmentControl),
+				create ? PROT_READ | PROT_WRITE : PROT_READ,
+				MAP_SHARED,
+				file,
+				0);
+		}
+	}
+	close(file);
+	return pointer == MAP_FAILED ? NULL : (SegmentControl*)pointer;
+}
+
+// Creates the segment with the path for the graphs and the source data they
+// were created from. Returns false if the segment could not be created.
+static bool segmentCreate(
+	const char* const path,
+	const IpiCgArray* const graphs,
+	const MemoryReader* const reader,
+	Exception* exception) {
+	SegmentHeader header;
+	memset(&header, 0, sizeof(SegmentHeader));
+	memcpy(header.magic, segmentMagic, sizeof(segmentMagic));
+	header.format = SEGMENT_FORMAT;
+	header.infoCount = graphs->count;
+	header.infoOffset = snapshotAlign(sizeof(SegmentHeader));
+	header.dataOffset = snapshotAlign(
+		header.infoOffset + (uint64_t)graphs->count * sizeof(IpiCgInfo));
+	header.dataLength = (uint64_t)reader->length;
+	header.snapshotOffset = snapshotAlign(
+		header.dataOffset + header.dataLength);
+	if (snapshotWrite(
+		graphs, 
+		segmentWriteCount, 
+		&header.snapshotLength) == false) {
+		EXCEPTION_SET(FILE_WRITE_ERROR);
+		return false;
+	}
+	const size_t size = (size_t)(
+		header.snapshotOffset + header.snapshotLength);
+
+	// Remove any segment left by a process that failed before publishing. 
+	// The space is reserved before the segment is written so that a full 
+	// file system is reported rather than faulting when written.
+	shm_unlink(path);
+	const int file = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (file < 0) {
+		EXCEPTION_SET(FILE_FAILURE);
+		return false;
+	}
+	void* pointer = MAP_FAILED;
+	if (posix_fallocate(file, 0, (off_t)size) == 0) {
+		pointer = mmap(
+			NULL,
+			size,
+			PROT_READ | PROT_WRITE,
+			MAP_SHARED,
+			file,
+			0);
+	}
+	close(file);
+	if (pointer == MAP_FAILED) {
+		shm_unlink(path);
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return false;
+	}
+
+	// Copy the header, the information, the data and then the snapshot.
+	byte* const base = (byte*)pointer;
+	SegmentWriter writer = { base + header.snapshotOffset, base + size };
+	memcpy(base, &header, sizeof(SegmentHeader));
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		memcpy(
+			base + header.infoOffset + (size_t)i * sizeof(IpiCgInfo), 
+			&graphs->items[i].info, 
+			sizeof(IpiCgInfo));
+	}
+	memcpy(base + header.dataOffset, reader->startByte, header.dataLength);
+	const bool written = snapshotWrite(graphs, segmentWriteMemory, &writer);
+	munmap(pointer, size);
+	if (written == false) {
+		shm_unlink(path);
+		EXCEPTION_SET(FILE_WRITE_ERROR);
+		return false;
+	}
+	return true;
+}
+
+// Creates the graphs of the mapped segment using the data, information and
+// snapshot in the segment.
+static void segmentGraphsCreate(
+	IpiCgSegment* const segment,
+	Exception* exception) {
+	const SegmentHeader* const header = (const SegmentHeader*)segment->base;
+	const uint64_t size = (uint64_t)segment->size;
+	const uint64_t infoLength = 
+		(uint64_t)header->infoCount * sizeof(IpiCgInfo);
+	if (memcmp(header->magic, segmentMagic, sizeof(segmentMagic)) != 0) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
+	if (header->format != SEGMENT_FORMAT) {
+		EXCEPTION_SET(INCORRECT_VERSION);
+		return;
+	}
+	if (header->infoOffset > size || 
+		infoLength > size - header->infoOffset ||
+		infoLength > UINT32_MAX ||
+		header->dataOffset > size ||
+		header->dataLength > size - header->dataOffset ||
+		header->dataLength > LONG_MAX ||
+		header->snapshotOffset > size ||
+		header->snapshotLength > size - header->snapshotOffset) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
+
+	// The information records are only needed while the graphs are created.
+	MemoryReader infoReader;
+	infoReader.startByte = (byte*)segment->base + header->infoOffset;
+	infoReader.current = infoReader.startByte;
+	infoReader.lastByte = infoReader.startByte + infoLength;
+	infoReader.length = (long)infoLength;
+	const CollectionHeader infoHeader = {
+		0,
+		(uint32_t)infoLength,
+		header->infoCount
+	};
+	Collection* const info = CollectionCreateFromMemory(
+		&infoReader, 
+		infoHeader);
+	if (info == NULL) {
+		EXCEPTION_SET(COLLECTION_FAILURE);
+		return;
+	}
+
+	// The collections of the graphs use the data in the segment directly.
+	segment->reader.startByte = (byte*)segment->base + header->dataOffset;
+	segment->reader.current = segment->reader.startByte;
+	segment->reader.lastByte = segment->reader.startByte + header->dataLength;
+	segment->reader.length = (long)header->dataLength;
+	segment->graphs = fiftyoneDegreesIpiGraphCreateFromMemoryWithSnapshot(
+		info,
+		&segment->reader,
+		(const byte*)segment->base + header->snapshotOffset,
+		(size_t)header->snapshotLength,
+		exception);
+	FIFTYONE_DEGREES_COLLECTION_FREE(info);
+}
+
+#endif
+
+long fiftyoneDegreesIpiGraphSegmentPublish(
+	const char* name,
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception) {
+#ifdef SEGMENTS_AVAILABLE
+	char path[SEGMENT_NAME_LENGTH];
+	SegmentControl* const control = segmentControlMap(name, true);
+	if (control == NULL) {
+		EXCEPTION_SET(FILE_FAILURE);
+		return 0;
+	}
+	const long previous = control->generation;
+	const long generation = previous + 1;
+	if (segmentName(path, name, generation) == false) {
+		munmap(control, sizeof(SegmentControl));
+		EXCEPTION_SET(INVALID_INPUT);
+		return 0;
+	}
+
+	// Create the graphs and prepared structures in this process and copy 
+	// them to the segment for the generation.
+	IpiCgArray* const graphs = 
+		fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig(
+			collection,
+			reader,
+			graphConfig,
+			exception);
+	const bool created = graphs != NULL &&
+		segmentCreate(path, graphs, reader, exception);
+	if (graphs != NULL) {
+		fiftyoneDegreesIpiGraphFree(graphs);
+	}
+
+	// Make the new generation current in a single operation so that other
+	// processes see either the previous generation or the new one, and then
+	// remove the previous segment.
+	if (created) {
+		FIFTYONE_DEGREES_INTERLOCK_EXCHANGE(
+			control->generation,
+			generation,
+			previous);
+		if (previous > 0 && segmentName(path, name, previous)) {
+			shm_unlink(path);
+		}
+	}
+	munmap(control, sizeof(SegmentControl));
+	return created ? generation : 0;
+#else
+	(void)name;
+	(void)collection;
+	(void)reader;
+	(void)graphConfig;
+	EXCEPTION_SET(INVALID_CONFIG);
+	return 0;
+#endif
+}
+
+fiftyoneDegreesIpiCgSegment* fiftyoneDegreesIpiGraphSegmentAttach(
+	const char* name,
+	fiftyoneDegreesException* exception) {
+#ifdef SEGMENTS_AVAILABLE
+	char path[SEGMENT_NAME_LENGTH];
+	SegmentControl* const control = segmentControlMap(name, false);
+	if (control == NULL) {
+		EXCEPTION_SET(FILE_NOT_FOUND);
+		return NULL;
+	}
+	IpiCgSegment* const segment = (IpiCgSegment*)Malloc(
+		sizeof(IpiCgSegment));
+	if (segment == NULL) {
+		munmap(control, sizeof(SegmentControl));
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	segment->graphs = NULL;
+	segment->base = NULL;
+	segment->size = 0;
+	segment->current = &control->generation;
+
+	// The segment of a generation is removed once the next is published so
+	// try again if the generation changes before the segment is opened.
+	int file = -1;
+	do {
+		segment->generation = control->generation;
+		if (segment->generation > 0 &&
+			segmentName(path, name, segment->generation)) {
+			file = shm_open(path, O_RDONLY, 0);
+		}
+	} while (file < 0 && segment->generation != control->generation);
+	if (file < 0) {
+		fiftyoneDegreesIpiGraphSegmentFree(segment);
+		EXCEPTION_SET(FILE_NOT_FOUND);
+		return NULL;
+	}
+	struct stat status;
+	if (fstat(file, &status) == 0 &&
+		(size_t)status.st_size >= sizeof(SegmentHeader)) {
+		void* const pointer = mmap(
+			NULL,
+			(size_t)status.st_size,
+			PROT_READ,
+			MAP_SHARED,
+			file,
+			0);
+		if (pointer != MAP_FAILED) {
+			segment->base = pointer;
+			segment->size = (size_t)status.st_size;
+		}
+	}
+	close(file);
+	if (segment->base == NULL) {
+		fiftyoneDegreesIpiGraphSegmentFree(segment);
+		EXCEPTION_SET(CORRUPT_DATA);
+		return NULL;
+	}
+
+	segmentGraphsCreate(segment, exception);
+	if (EXCEPTION_FAILED) {
+		fiftyoneDegreesIpiGraphSegmentFree(segment);
+		return NULL;
+	}
+	return segment;
+#else
+	(void)name;
+	EXCEPTION_SET(INVALID_CONFIG);
+	return NULL;
+#endif
+}
+
+bool fiftyoneDegreesIpiGraphSegmentIsCurrent(
+	const fiftyoneDegreesIpiCgSegment* segment) {
+	return *segment->current == segment->generation;
+}
+
+void fiftyoneDegreesIpiGraphSegmentFree(
+	fiftyoneDegreesIpiCgSegment* segment) {
+	if (segment->graphs != NULL) {
+		fiftyoneDegreesIpiGraphFree(segment->graphs);
+	}
+#ifdef SEGMENTS_AVAILABLE
+	if (segment->base != NULL) {
+		munmap(segment->base, segment->size);
+	}
+	munmap((void*)segment->current, sizeof(SegmentControl));
+#endif
+	Free(segment);
+}
+
+void fiftyoneDegreesIpiGraphSegmentRemove(
+	const char* name,
+	fiftyoneDegreesException* exception) {
+#ifdef SEGMENTS_AVAILABLE
+	char path[SEGMENT_NAME_LENGTH];
+	SegmentControl* const control = segmentControlMap(name, false);
+	if (control == NULL) {
+		EXCEPTION_SET(FILE_NOT_FOUND);
+		return;
+	}
+	if (control->generation > 0 && 
+		segmentName(path, name, control->generation)) {
+		shm_unlink(path);
+	}
+	munmap(control, sizeof(SegmentControl));
+	shm_unlink(name);
+#else
+	(void)name;
+	EXCEPTION_SET(INVALID_CONFIG);
+#endif
+}
+
+size_t fiftyoneDegreesIpiGraphGetMemoryOverhead(
+	const fiftyoneDegreesIpiCg* graph) {
+	const size_t count = graph->info.nodes.collection.count;
+	size_t size = sizeof(IpiCgClusterRange) * graph->clustersCount;
+	if (graph->alignedNodes != NULL) {
+		size += sizeof(IpiCgNode) * count;
+	}
+	if (graph->spanIndexes != NULL) {
+		size += graph->spanIndexesSize * count;
+	}
+	if (graph->decodedSpans != NULL) {
+		size += sizeof(IpiCgSpan) * graph->spansCount;
+	}
+	if (graph->compressedNodes != NULL) {
+		size += graph->compressedNodesSize;
+	}
+	if (graph->skips != NULL) {
+		size += getSkipsSize(graph);
+	}
+	if (graph->uniforms != NULL) {
+		size += getUniformsSize(graph);
+	}
+	if (graph->resolved != NULL) {
+		size += sizeof(uint32_t) * ((size_t)graph->info.profileCount +
+			graph->info.profileGroupCount + 1);
+	}
+	return size;
+}
+
+fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluate(
+    const fiftyoneDegreesIpiCgArray*  const graphs,
+	const byte componentId,
+	const fiftyoneDegreesIpAddress address,
+	fiftyoneDegreesException* const exception) {
+
+	// String builder is not needed for normal usage without tracing.
+	StringBuilder sb = { NULL, 0 };
+
+	return ipiGraphEvaluate(graphs, componentId, address, &sb, exception);
+}
+
+fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluateTrace(
+	fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
+	char* buffer,
+	int const length,
+	fiftyoneDegreesException* exception) {
+	StringBuilder sb = { buffer, length };
+	StringBuilderInit(&sb);
+
+	// Add the bytes of the IP address to the trace.
+	StringBuilderAddChar(&sb, '\r');
+	StringBuilderAddChar(&sb, '\n');
+	StringBuilderAddChars(&sb, "IP:", sizeof("IP:") - 1);
+	int ipLength = 0;
+	switch (address.type) {
+	case FIFTYONE_DEGREES_IP_TYPE_IPV4:
+		ipLength = 4;
+		break;
+	case FIFTYONE_DEGREES_IP_TYPE_IPV6:
+		ipLength = 16;
+		break;
+	}
+	for (int i = 0; i < ipLength; i++) {
+		StringBuilderAddInteger(&sb, address.value[i]);
+		if (i < ipLength - 1) {
+			StringBuilderAddChar(&sb, '.');
+		}
+	}
+
+	const fiftyoneDegreesIpiCgResult result = ipiGraphEvaluate(
+		graphs, 
+		componentId, 
+		address, 
+		&sb,
+		exception);
+	StringBuilderAddChar(&sb, '\0');
+	return result;
+}
+
+/**
+ * BATCH EVALUATION
+ * 
+ * Addresses are evaluated in chunks. The addresses of a chunk that use the
+ * same graph start as a single group sharing one cursor. At each step every
+ * member of the group is compared to the span of the cursor in a single pass
+ * and the group is partitioned by the compare result. Each partition then 
+ * continues the walk with its own copy of the cursor. The nodes and spans 
+ * near the root are therefore fetched once per chunk rather than once per
+ * address, and members only walk alone once their paths diverge.
+ * 
+ * The pass compares a 64 bit window of each member's address to the span
+ * limits. Vector variants of the pass are selected at runtime when compiled
+ * with GCC or Clang for x86, otherwise when enabled by the compiler options.
+ * Spans with limits longer than 64 bits use the word wide scalar comparison.
+ */
+
+// Maximum number of addresses evaluated together.
+#define BATCH_CHUNK 256
+
+// Number of compare results that a group can be partitioned into.
+#define BATCH_RESULTS (GREATER_THAN_HIGH + 1)
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BATCH_TARGET(t) __attribute__((target(t)))
+#define BATCH_SUPPORTS(f) __builtin_cpu_supports(f)
+#define BATCH_SSE42
+#define BATCH_AVX2
+#define BATCH_AVX512
+#elif defined(__SSE4_2__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#define BATCH_TARGET(t)
+#define BATCH_SUPPORTS(f) true
+#define BATCH_SSE42
+#if defined(__AVX2__) || defined(__AVX512F__)
+#define BATCH_AVX2
+#endif
+#ifdef __AVX512F__
+#define BATCH_AVX512
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BATCH_NEON
+#endif
+
+// Compares the keys to the low and high limits setting the compare result for
+// each key.
+typedef void(*batchCompareKeys)(
+	const uint64_t* keys,
+	uint32_t count,
+	uint64_t low,
+	uint64_t lowMask,
+	uint64_t high,
+	uint64_t highMask,
+	byte* results);
+
+// Compare result indexed by a bit for each of the key being less than the 
+// low limit (1), equal to the low limit (2), less than the high limit (4) and
+// equal to the high limit (8). Matches getCompareResult.
+static const byte batchCompareResults[16] = {
+	GREATER_THAN_HIGH, LESS_THAN_LOW, EQUAL_LOW, LESS_THAN_LOW,
+	INBETWEEN, LESS_THAN_LOW, EQUAL_LOW, LESS_THAN_LOW,
+	EQUAL_HIGH, LESS_THAN_LOW, EQUAL_LOW, LESS_THAN_LOW,
+	INBETWEEN, LESS_THAN_LOW, EQUAL_LOW, LESS_THAN_LOW,
+};
+
+// Sets the compare results for lanes from the bit masks of the lane 
+// comparisons.
+static void batchSetResults(
+	byte* const results,
+	const int lanes,
+	const unsigned int lessLow,
+	const unsigned int equalLow,
+	const unsigned int lessHigh,
+	const unsigned int equalHigh) {
+	for (int i = 0; i < lanes; i++) {
+		results[i] = batchCompareResults[
+			((lessLow >> i) & 1) |
+			(((equalLow >> i) & 1) << 1) |
+			(((lessHigh >> i) & 1) << 2) |
+			(((equalHigh >> i) & 1) << 3)];
+	}
+}
+
+static void batchCompareKeysScalar(
+	const uint64_t* const keys,
+	const uint32_t count,
+	const uint64_t low,
+	const uint64_t lowMask,
+	const uint64_t high,
+	const uint64_t highMask,
+	byte* const results) {
+	for (uint32_t i = 0; i < count; i++) {
+		const uint64_t keyLow = keys[i] & lowMask;
+		const uint64_t keyHigh = keys[i] & highMask;
+		results[i] = batchCompareResults[
+			(keyLow < low) |
+			((keyLow == low) << 1) |
+			((keyHigh < high) << 2) |
+			((keyHigh == high) << 3)];
+	}
+}
+
+#ifdef BATCH_SSE42
+BATCH_TARGET("sse4.2")
+static void batchCompareKeysSse42(
+	const uint64_t* const keys,
+	const uint32_t count,
+	const uint64_t low,
+	const uint64_t lowMask,
+	const uint64_t high,
+	const uint64_t highMask,
+	byte* const results) {
+	// There is no unsigned compare so the sign bits are flipped.
+	const __m128i sign = _mm_set1_epi64x((long long)0x8000000000000000ULL);
+	const __m128i lowLimit = _mm_set1_epi64x((long long)low);
+	const __m128i lowSigned = _mm_xor_si128(lowLimit, sign);
+	const __m128i lowBits = _mm_set1_epi64x((long long)lowMask);
+	const __m128i highLimit = _mm_set1_epi64x((long long)high);
+	const __m128i highSigned = _mm_xor_si128(highLimit, sign);
+	const __m128i highBits = _mm_set1_epi64x((long long)highMask);
+	uint32_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const __m128i key = _mm_loadu_si128((const __m128i*)(keys + i));
+		const __m128i keyLow = _mm_and_si128(key, lowBits);
+		const __m128i keyHigh = _mm_and_si128(key, highBits);
+		batchSetResults(
+			results + i,
+			2,
+			_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(
+				lowSigned,
+				_mm_xor_si128(keyLow, sign)))),
+			_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(
+				keyLow,
+				lowLimit))),
+			_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(
+				highSigned,
+				_mm_xor_si128(keyHigh, sign)))),
+			_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(
+				keyHigh,
+				highLimit))));
+	}
+	batchCompareKeysScalar(
+		keys + i,
+		count - i,
+		low,
+		lowMask,
+		high,
+		highMask,
+		results + i);
+}
+#endif
+
+#ifdef BATCH_AVX2
+BATCH_TARGET("avx2")
+static void batchCompareKeysAvx2(
+	const uint64_t* const keys,
+	const uint32_t count,
+	const uint64_t low,
+	const uint64_t lowMask,
+	const uint64_t high,
+	const uint64_t highMask,
+	byte* const results) {
+	// There is no unsigned compare so the sign bits are flipped.
+	const __m256i sign = _mm256_set1_epi64x(
+		(long long)0x8000000000000000ULL);
+	const __m256i lowLimit = _mm256_set1_epi64x((long long)low);
+	const __m256i lowSigned = _mm256_xor_si256(lowLimit, sign);
+	const __m256i lowBits = _mm256_set1_epi64x((long long)lowMask);
+	const __m256i highLimit = _mm256_set1_epi64x((long long)high);
+	const __m256i highSigned = _mm256_xor_si256(highLimit, sign);
+	const __m256i highBits = _mm256_set1_epi64x((long long)highMask);
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m256i key = _mm256_loadu_si256((const __m256i*)(keys + i));
+		const __m256i keyLow = _mm256_and_si256(key, lowBits);
+		const __m256i keyHigh = _mm256_and_si256(key, highBits);
+		batchSetResults(
+			results + i,
+			4,
+			_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(
+				lowSigned,
+				_mm256_xor_si256(keyLow, sign)))),
+			_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(
+				keyLow,
+				lowLimit))),
+			_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(
+				highSigned,
+				_mm256_xor_si256(keyHigh, sign)))),
+			_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(
+				keyHigh,
+				highLimit))));
+	}
+	batchCompareKeysScalar(
+		keys + i,
+		count - i,
+		low,
+		lowMask,
+		high,
+		highMask,
+		results + i);
+}
+#endif
+
+#ifdef BATCH_AVX512
+BATCH_TARGET("avx512f")
+static void batchCompareKeysAvx512(
+	const uint64_t* const keys,
+	const uint32_t count,
+	const uint64_t low,
+	const uint64_t lowMask,
+	const uint64_t high,
+	const uint64_t highMask,
+	byte* const results) {
+	const __m512i lowLimit = _mm512_set1_epi64((long long)low);
+	const __m512i lowBits = _mm512_set1_epi64((long long)lowMask);
+	const __m512i highLimit = _mm512_set1_epi64((long long)high);
+	const __m512i highBits = _mm512_set1_epi64((long long)highMask);
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m512i key = _mm512_loadu_si512((const void*)(keys + i));
+		const __m512i keyLow = _mm512_and_si512(key, lowBits);
+		const __m512i keyHigh = _mm512_and_si512(key, highBits);
+		batchSetResults(
+			results + i,
+			8,
+			_mm512_cmplt_epu64_mask(keyLow, lowLimit),
+			_mm512_cmpeq_epu64_mask(keyLow, lowLimit),
+			_mm512_cmplt_epu64_mask(keyHigh, highLimit),
+			_mm512_cmpeq_epu64_mask(keyHigh, highLimit));
+	}
+	batchCompareKeysScalar(
+		keys + i,
+		count - i,
+		low,
+		lowMask,
+		high,
+		highMask,
+		results + i);
+}
+#endif
+
+#ifdef BATCH_NEON
+static void batchCompareKeysNeon(
+	const uint64_t* const keys,
+	const uint32_t count,
+	const uint64_t low,
+	const uint64_t lowMask,
+	const uint64_t high,
+	const uint64_t highMask,
+	byte* const results) {
+	const uint64x2_t lowLimit = vdupq_n_u64(low);
+	const uint64x2_t lowBits = vdupq_n_u64(lowMask);
+	const uint64x2_t highLimit = vdupq_n_u64(high);
+	const uint64x2_t highBits = vdupq_n_u64(highMask);
+	uint32_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const uint64x2_t key = vld1q_u64(keys + i);
+		const uint64x2_t keyLow = vandq_u64(key, lowBits);
+		const uint64x2_t keyHigh = vandq_u64(key, highBits);
+		const uint64x2_t lessLow = vcltq_u64(keyLow, lowLimit);
+		const uint64x2_t equalLow = vceqq_u64(keyLow, lowLimit);
+		const uint64x2_t lessHigh = vcltq_u64(keyHigh, highLimit);
+		const uint64x2_t equalHigh = vceqq_u64(keyHigh, highLimit);
+		batchSetResults(
+			results + i,
+			2,
+			(unsigned int)((vgetq_lane_u64(lessLow, 0) & 1) |
+				((vgetq_lane_u64(lessLow, 1) & 1) << 1)),
+			(unsigned int)((vgetq_lane_u64(equalLow, 0) & 1) |
+				((vgetq_lane_u64(equalLow, 1) & 1) << 1)),
+			(unsigned int)((vgetq_lane_u64(lessHigh, 0) & 1) |
+				((vgetq_lane_u64(lessHigh, 1) & 1) << 1)),
+			(unsigned int)((vgetq_lane_u64(equalHigh, 0) & 1) |
+				((vgetq_lane_u64(equalHigh, 1) & 1) << 1)));
+	}
+	batchCompareKeysScalar(
+		keys + i,
+		count - i,
+		low,
+		lowMask,
+		high,
+		highMask,
+		results + i);
+}
+#endif
+
+// Returns the fastest compare variant supported by the CPU.
+static batchCompareKeys getBatchCompareKeys(void) {
+#ifdef BATCH_AVX512
+	if (BATCH_SUPPORTS("avx512f")) return batchCompareKeysAvx512;
+#endif
+#ifdef BATCH_AVX2
+	if (BATCH_SUPPORTS("avx2")) return batchCompareKeysAvx2;
+#endif
+#ifdef BATCH_SSE42
+	if (BATCH_SUPPORTS("sse4.2")) return batchCompareKeysSse42;
+#endif
+#ifdef BATCH_NEON
+	return batchCompareKeysNeon;
+#endif
+	return batchCompareKeysScalar;
+}
+
+// State for the evaluation of a chunk of addresses.
+typedef struct batch_t {
+	const IpiCg* graphs[BATCH_CHUNK]; // Graph for each address or NULL
+	uint64_t words[BATCH_CHUNK][2]; // Each address as two words
+	fiftyoneDegreesIpiCgResult* results; // Result for each address
+	uint16_t members[BATCH_CHUNK]; // Address indexes ordered by group
+	uint16_t partitioned[BATCH_CHUNK]; // Used when partitioning a group
+	uint64_t keys[BATCH_CHUNK]; // Bits compared for each group member
+	byte compareResults[BATCH_CHUNK]; // Result for each group member
+	batchCompareKeys compareKeys; // Compare variant for the CPU
+	ComponentGraphs component; // Graphs of the component evaluated
+} Batch;
+
+// Sets the compare result for the members of the group against the span of
+// the cursor.
+static void batchCompare(
+	Batch* const batch,
+	const Cursor* const cursor,
+	const uint32_t start,
+	const uint32_t count) {
+	const uint16_t* const members = batch->members + start;
+	const uint64_t* const low = getSpanLimits(cursor)->low;
+	const uint64_t* const high = getSpanLimits(cursor)->high;
+	uint64_t words[2];
+	if (getMaxSpanLimitLength(cursor) <= 64) {
+		for (uint32_t i = 0; i < count; i++) {
+			shiftWords(batch->words[members[i]], cursor->bitIndex, words);
+			batch->keys[i] = words[0];
+		}
+		batch->compareKeys(
+			batch->keys,
+			count,
+			low[0],
+			wordMask(cursor->span.lengthLow),
+			high[0],
+			wordMask(cursor->span.lengthHigh),
+			batch->compareResults);
+	}
+	else {
+		for (uint32_t i = 0; i < count; i++) {
+			shiftWords(batch->words[members[i]], cursor->bitIndex, words);
+			batch->compareResults[i] = (byte)getCompareResult(
+				wordsCompare(words, low, cursor->span.lengthLow),
+				wordsCompare(words, high, cursor->span.lengthHigh));
+		}
+	}
+}
+
+// Sets the result for all the members of the group from the cursor.
+static void batchSetGroupResult(
+	Batch* const batch,
+	const Cursor* const cursor,
+	const uint32_t start,
+	const uint32_t end) {
+	Exception* exception = cursor->ex;
+	const fiftyoneDegreesIpiCgResult result = toResult(
+		getWalkResult(cursor),
+		cursor->graph,
+		exception);
+	if (EXCEPTION_FAILED) return;
+	for (uint32_t i = start; i < end; i++) {
+		batch->results[batch->members[i]] = result;
+	}
+}
+
+// Evaluates the group of members from start to end where the cursor is at the
+// current position of all the members. The group continues with the same
+// cursor while all the members have the same compare result, and is 
+// otherwise partitioned with each partition evaluated with its own cursor.
+static void batchEvaluateGroup(
+	Batch* const batch,
+	Cursor* const cursor,
+	const uint32_t start,
+	const uint32_t end) {
+	Exception* exception = cursor->ex;
+	uint32_t counts[BATCH_RESULTS];
+	uint32_t offsets[BATCH_RESULTS];
+	uint32_t partitions;
+	bool found = false;
+	do {
+		// Compare all the members to the span.
+		const uint32_t count = end - start;
+		batchCompare(batch, cursor, start, count);
+		memset(counts, 0, sizeof(counts));
+		for (uint32_t i = 0; i < count; i++) {
+			counts[batch->compareResults[i]]++;
+		}
+		partitions = 0;
+		for (int r = 0; r < BATCH_RESULTS; r++) {
+			if (counts[r] > 0) {
+				cursor->compareResult = (CompareResult)r;
+				partitions++;
+			}
+		}
+
+		// If all the members have the same result then move the cursor and
+		// continue with the same group.
+		if (partitions == 1) {
+			found = cursorSelect(cursor);
+			if (EXCEPTION_FAILED) return;
+		}
+	} while (partitions == 1 && 
+		found == false && 
+		isExhausted(cursor) == false);
+
+	if (partitions == 1) {
+		batchSetGroupResult(batch, cursor, start, end);
+		return;
+	}
+
+	// Partition the members by compare result.
+	const uint32_t count = end - start;
+	offsets[0] = 0;
+	for (int r = 1; r < BATCH_RESULTS; r++) {
+		offsets[r] = offsets[r - 1] + counts[r - 1];
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		batch->partitioned[offsets[batch->compareResults[i]]++] =
+			batch->members[start + i];
+	}
+	memcpy(
+		batch->members + start,
+		batch->partitioned,
+		count * sizeof(uint16_t));
+
+	// Evaluate each partition with a copy of the cursor. The cluster is 
+	// released first so that each copy fetches its own.
+	cursorReleaseData(cursor);
+	uint32_t partitionStart = start;
+	for (int r = 0; r < BATCH_RESULTS; r++) {
+		if (counts[r] == 0) {
+			continue;
+		}
+		const uint32_t partitionEnd = partitionStart + counts[r];
+		Cursor partition = *cursor;
+		partition.compareResult = (CompareResult)r;
+		found = cursorSelect(&partition);
+		if (EXCEPTION_OKAY) {
+			if (found || isExhausted(&partition)) {
+				batchSetGroupResult(
+					batch,
+					&partition,
+					partitionStart,
+					partitionEnd);
+			}
+			else {
+				batchEvaluateGroup(
+					batch,
+					&partition,
+					partitionStart,
+					partitionEnd);
+			}
+		}
+		cursorReleaseData(&partition);
+		if (EXCEPTION_FAILED) return;
+		partitionStart = partitionEnd;
+	}
+}
+
+// Evaluates the addresses of the chunk setting the results.
+static void batchEvaluateChunk(
+	Batch* const batch,
+	const fiftyoneDegreesIpAddress* const addresses,
+	const uint32_t count,
+	Exception* const exception) {
+	const IpiCg* const versions[] = {
+		batch->component.ipv4,
+		batch->component.ipv6 };
+
+	// Find the graph for each address and convert the address to words.
+	for (uint32_t i = 0; i < count; i++) {
+		IpAddress address = addresses[i];
+		batch->graphs[i] = getComponentGraph(&batch->component, &address);
+		if (batch->graphs[i] != NULL) {
+			const byte length = getIpLengthFromGraph(&batch->graphs[i]->info);
+			memset(address.value + length, 0, sizeof(address.value) - length);
+			batch->words[i][0] = bytesToWord(address.value);
+			batch->words[i][1] = bytesToWord(address.value + 8);
+		}
+	}
+
+	// Evaluate the addresses for each graph as a group.
+	for (uint32_t g = 0; g < sizeof(versions) / sizeof(versions[0]); g++) {
+		const IpiCg* const graph = versions[g];
+		uint32_t members = 0;
+		if (graph == NULL) {
+			continue;
+		}
+		for (uint32_t i = 0; i < count; i++) {
+			if (batch->graphs[i] == graph) {
+				batch->members[members++] = (uint16_t)i;
+			}
+		}
+		if (members == 0) {
+			continue;
+		}
+		StringBuilder sb = { NULL, 0 };
+		Cursor cursor = cursorCreate(
+			graph,
+			addresses[batch->members[0]],
+			&sb,
+			exception);
+		cursorMove(&cursor, getRootIndex(graph));
+		if (EXCEPTION_OKAY) {
+			batchEvaluateGroup(batch, &cursor, 0, members);
+		}
+		cursorReleaseData(&cursor);
+		if (EXCEPTION_FAILED) return;
+	}
+}
+
+void fiftyoneDegreesIpiGraphEvaluateBatch(
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	const fiftyoneDegreesIpAddress* const addresses,
+	fiftyoneDegreesIpiCgResult* const results,
+	const uint32_t count,
+	fiftyoneDegreesException* const exception) {
+	for (uint32_t i = 0; i < count; i++) {
+		results[i] = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+	}
+	Batch batch;
+	batch.compareKeys = getBatchCompareKeys();
+	batch.component = getComponentGraphs(graphs, componentId);
+	for (uint32_t i = 0; i < count; i += BATCH_CHUNK) {
+		batch.results = results + i;
+		batchEvaluateChunk(
+			&batch,
+			addresses + i,
+			count - i < BATCH_CHUNK ? count - i : BATCH_CHUNK,
+			exception);
+		if (EXCEPTION_FAILED) return;
+	}
+}
+
+/**
+ * BULK EVALUATION
+ *
+ * The addresses are divided into chunks and each worker thread is given a
+ * contiguous range of chunks. A worker claims the chunks of its own range in
+ * order and evaluates each with fiftyoneDegreesIpiGraphEvaluateBatch, writing
+ * the results in place so they remain in the order of the addresses. Once its
+ * own range is exhausted a worker steals the remaining chunks from the ranges
+ * of the other workers. Chunks are claimed by incrementing the next chunk of
+ * the range, so no locks are needed and a worker that is slow, or that failed
+ * to start, never delays the others. The calling thread is always the first 
+ * worker.
+ */
+
+// Default number of addresses claimed by a worker at a time.
+#define BULK_CHUNK_DEFAULT 4096
+
+// Default number of addresses read from a stream at a time.
+#define BULK_BLOCK_DEFAULT (1 << 20)
+
+// Maximum number of CPUs the worker threads can be pinned to.
+#define BULK_MAX_CPUS 1024
+
+// Bits in each word of a CPU mask.
+#define BULK_MASK_BITS (sizeof(unsigned long) * 8)
+
+typedef struct bulk_t Bulk;
+
+// Range of chunks owned by a worker.
+typedef struct bulk_worker_t {
+	Bulk* bulk; // Evaluation the worker is part of
+	uint32_t index; // Index of the worker
+	volatile long next; // Next chunk of the range to be claimed
+	long end; // Chunk after the last one of the range
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	FIFTYONE_DEGREES_THREAD thread; // Thread running the worker
+#endif
+	bool started; // True if the thread of the worker was started
+} BulkWorker;
+
+// State shared by the workers of a bulk evaluation.
+struct bulk_t {
+	const IpiCgArray* graphs; // Graphs to evaluate if there are no replicas
+	const IpiCgBulkConfig* config; // Options for the evaluation
+	byte componentId; // Component to evaluate
+	const IpAddress* addresses; // Addresses to evaluate
+	IpiCgResult* results; // Results in the same order as the addresses
+	size_t count; // Number of addresses and results
+	uint32_t chunkSize; // Number of addresses in each chunk
+	uint32_t nodes; // Number of NUMA nodes to pin workers to
+	BulkWorker* workers; // Workers with their ranges of chunks
+	uint32_t workersCount; // Number of workers
+	volatile long status; // Status of the first failure, or NOT_SET
+};
+
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+// Returns the number of CPUs available, or 1 if not known.
+static uint32_t bulkGetCpuCount(void) {
+#if defined(_MSC_VER)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#elif defined(__linux__)
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+#else
+	return 1;
+#endif
+}
+#endif
+
+// Pins the calling thread to the CPUs of the NUMA node. If the CPUs of the 
+// node can't be read the thread is left where it is.
+static void bulkPin(const uint32_t node) {
+#ifdef __linux__
+	char path[64];
+	unsigned long mask[BULK_MAX_CPUS / BULK_MASK_BITS];
+	unsigned int first, last;
+	int separator = ',';
+	bool found = false;
+	memset(mask, 0, sizeof(mask));
+	snprintf(
+		path, 
+		sizeof(path), 
+		"/sys/devices/system/node/node%u/cpulist", 
+		node);
+	FILE* const file = fopen(path, "r");
+	if (file == NULL) {
+		return;
+	}
+
+	// The file is a list of ranges such as 0-3,8-11.
+	while (separator == ',' && fscanf(file, "%u", &first) == 1) {
+		last = first;
+		separator = fgetc(file);
+		if (separator == '-') {
+			if (fscanf(file, "%u", &last) != 1) {
+				break;
+			}
+			separator = fgetc(file);
+		}
+		for (unsigned int cpu = first; 
+			cpu <= last && cpu < BULK_MAX_CPUS; 
+			cpu++) {
+			mask[cpu / BULK_MASK_BITS] |= 1UL << (cpu % BULK_MASK_BITS);
+			found = true;
+		}
+	}
+	fclose(file);
+	if (found) {
+		syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask);
+	}
+#else
+	(void)node;
+#endif
+}
+
+// Claims the next chunk of the worker's range. Returns false if there are no
+// chunks left in the range.
+static bool bulkClaim(BulkWorker* const worker, long* const chunk) {
+	*chunk = FIFTYONE_DEGREES_INTERLOCK_INC(&worker->next) - 1;
+	return *chunk < worker->end;
+}
+
+// Evaluates the addresses of the chunk. If another worker has failed the
+// results are set to the default instead.
+static void bulkEvaluateChunk(
+	Bulk* const bulk,
+	const IpiCgArray* const graphs,
+	const long chunk) {
+	const size_t start = (size_t)chunk * bulk->chunkSize;
+	const uint32_t count = bulk->count - start < bulk->chunkSize ?
+		(uint32_t)(bulk->count - start) : bulk->chunkSize;
+	if (bulk->status != NOT_SET) {
+		for (uint32_t i = 0; i < count; i++) {
+			bulk->results[start + i] = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+		}
+		return;
+	}
+	EXCEPTION_CREATE;
+	fiftyoneDegreesIpiGraphEvaluateBatch(
+		graphs,
+		bulk->componentId,
+		bulk->addresses + start,
+		bulk->results + start,
+		count,
+		exception);
+	if (EXCEPTION_FAILED) {
+		FIFTYONE_DEGREES_INTERLOCK_EXCHANGE(
+			bulk->status, 
+			(long)exception->status, 
+			(long)NOT_SET);
+	}
+}
+
+// Evaluates the chunks of the worker's own range and then those left in the
+// ranges of the other workers.
+static void* bulkWorkerRun(void* state) {
+	BulkWorker* const worker = (BulkWorker*)state;
+	Bulk* const bulk = worker->bulk;
+	const IpiCgArray* graphs = bulk->graphs;
+	long chunk;
+	if (bulk->config->pinThreads) {
+		bulkPin(worker->index % bulk->nodes);
+	}
+	if (bulk->config->replicas != NULL) {
+		graphs = fiftyoneDegreesIpiGraphReplicasGet(bulk->config->replicas);
+	}
+	for (uint32_t i = 0; i < bulk->workersCount; i++) {
+		BulkWorker* const victim = 
+			&bulk->workers[(worker->index + i) % bulk->workersCount];
+		while (bulkClaim(victim, &chunk)) {
+			bulkEvaluateChunk(bulk, graphs, chunk);
+		}
+	}
+	return NULL;
+}
+
+void fiftyoneDegreesIpiGraphEvaluateBulk(
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	const fiftyoneDegreesIpAddress* const addresses,
+	fiftyoneDegreesIpiCgResult* const results,
+	const size_t count,
+	const fiftyoneDegreesIpiCgBulkConfig* const config,
+	fiftyoneDegreesException* const exception) {
+	if (count == 0) {
+		return;
+	}
+	const IpiCgBulkConfig defaultConfig = 
+		FIFTYONE_DEGREES_IPI_CG_BULK_CONFIG_DEFAULT;
+	Bulk bulk;
+	bulk.graphs = graphs;
+	bulk.config = config != NULL ? config : &defaultConfig;
+	bulk.componentId = componentId;
+	bulk.addresses = addresses;
+	bulk.results = results;
+	bulk.count = count;
+	bulk.chunkSize = bulk.config->chunkSize > 0 ? 
+		bulk.config->chunkSize : BULK_CHUNK_DEFAULT;
+	bulk.nodes = bulk.config->pinThreads ? placementGetNodeCount() : 1;
+	bulk.status = NOT_SET;
+
+	// Work out how many workers are needed. There is no point in having more
+	// workers than chunks.
+	const size_t chunks = (count + bulk.chunkSize - 1) / bulk.chunkSize;
+	if (chunks > LONG_MAX) {
+		EXCEPTION_SET(INVALID_INPUT);
+		return;
+	}
+#ifdef FIFTYONE_DEGREES_NO_THREADING
+	bulk.workersCount = 1;
+#else
+	bulk.workersCount = bulk.config->threads > 0 ? 
+		bulk.config->threads : bulkGetCpuCount();
+#endif
+	if (bulk.workersCount > chunks) {
+		bulk.workersCount = (uint32_t)chunks;
+	}
+	bulk.workers = (BulkWorker*)Malloc(
+		sizeof(BulkWorker) * bulk.workersCount);
+	if (bulk.workers == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return;
+	}
+
+	// Give each worker an equal range of the chunks.
+	for (uint32_t i = 0; i < bulk.workersCount; i++) {
+		BulkWorker* const worker = &bulk.workers[i];
+		worker->bulk = &bulk;
+		worker->index = i;
+		worker->next = (long)(chunks * i / bulk.workersCount);
+		worker->end = (long)(chunks * (i + 1) / bulk.workersCount);
+		worker->started = false;
+	}
+
+	// Start the other workers and then run the first on the calling thread.
+	// Any worker that fails to start has its range stolen by the others.
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	for (uint32_t i = 1; i < bulk.workersCount; i++) {
+		BulkWorker* const worker = &bulk.workers[i];
+		worker->started = FIFTYONE_DEGREES_THREAD_CREATE(
+			worker->thread,
+			(FIFTYONE_DEGREES_THREAD_ROUTINE)&bulkWorkerRun,
+			worker) == 0;
+	}
+#endif
+	bulkWorkerRun(&bulk.workers[0]);
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	for (uint32_t i = 1; i < bulk.workersCount; i++) {
+		if (bulk.workers[i].started) {
+			FIFTYONE_DEGREES_THREAD_JOIN(bulk.workers[i].thread);
+			FIFTYONE_DEGREES_THREAD_CLOSE(bulk.workers[i].thread);
+		}
+	}
+#endif
+	Free(bulk.workers);
+	if (bulk.status != NOT_SET) {
+		EXCEPTION_SET((StatusCode)bulk.status);
+	}
+}
+
+void fiftyoneDegreesIpiGraphEvaluateStream(
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	const fiftyoneDegreesIpiCgBulkRead read,
+	const fiftyoneDegreesIpiCgBulkWrite write,
+	void* const state,
+	const fiftyoneDegreesIpiCgBulkConfig* const config,
+	fiftyoneDegreesException* const exception) {
+	const uint32_t blockSize = config != NULL && config->blockSize > 0 ?
+		config->blockSize : BULK_BLOCK_DEFAULT;
+	IpAddress* const addresses = (IpAddress*)Malloc(
+		sizeof(IpAddress) * blockSize);
+	IpiCgResult* const results = (IpiCgResult*)Malloc(
+		sizeof(IpiCgResult) * blockSize);
+	if (addresses == NULL || results == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+	}
+	else {
+		uint32_t count;
+		while ((count = read(state, addresses, blockSize)) > 0) {
+			if (count > blockSize) {
+				count = blockSize;
+			}
+			fiftyoneDegreesIpiGraphEvaluateBulk(
+				graphs,
+				componentId,
+				addresses,
+				results,
+				count,
+				config,
+				exception);
+			if (EXCEPTION_FAILED) break;
+			write(state, addresses, results, count);
+		}
+	}
+	if (addresses != NULL) {
+		Free(addresses);
+	}
+	if (results != NULL) {
+		Free(results);
+	}
+}
+
+/**
+ * TEXT EVALUATION
+ *
+ * Rows of text are split on new lines with memchr, which the C library
+ * vectorises, and the address field of each row is parsed directly into the
+ * bytes of an IP address without the intermediate copies of the general
+ * purpose parser. The valid addresses of a chunk of rows are then evaluated
+ * together with fiftyoneDegreesIpiGraphEvaluateBatch.
+ */
+
+// Number of rows parsed before the addresses are evaluated.
+#define TEXT_CHUNK 256
+
+// Returns the value of the hexadecimal character, or -1 if not hexadecimal.
+static int textHexValue(const char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// Returns true if the character is white space that surrounds a field.
+static bool textIsSpace(const char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parses the four decimal octets of an IPv4 address into the bytes. Returns
+// false if the text is not a valid IPv4 address.
+static bool textParseIpv4(
+	const char* current,
+	const char* const end,
+	byte* const bytes) {
+	for (int i = 0; i < FIFTYONE_DEGREES_IPV4_LENGTH; i++) {
+		if (i > 0) {
+			if (current >= end || *current != '.') {
+				return false;
+			}
+			current++;
+		}
+		uint32_t value = 0;
+		int digits = 0;
+		while (current < end && 
+			digits < 3 && 
+			*current >= '0' && 
+			*current <= '9') {
+			value = value * 10 + (uint32_t)(*current - '0');
+			current++;
+			digits++;
+		}
+		if (digits == 0 || value > 255) {
+			return false;
+		}
+		bytes[i] = (byte)value;
+	}
+	return current == end;
+}
+
+// Parses the groups of an IPv6 address, including those compressed with :: 
+// and a trailing IPv4 address, into the bytes. Returns false if the text is 
+// not a valid IPv6 address.
+static bool textParseIpv6(
+	const char* current,
+	const char* const end,
+	byte* const bytes) {
+	uint32_t groups[8];
+	int count = 0;
+	int gap = -1;
+	if (end - current >= 2 && current[0] == ':' && current[1] == ':') {
+		gap = 0;
+		current += 2;
+	}
+	while (current < end) {
+		if (count == 8) {
+			return false;
+		}
+
+		// Read up to four hexadecimal digits of the next group.
+		const char* next = current;
+		uint32_t value = 0;
+		int digits = 0, digit;
+		while (next < end && 
+			digits < 4 && 
+			(digit = textHexValue(*next)) >= 0) {
+			value = (value << 4) | (uint32_t)digit;
+			next++;
+			digits++;
+		}
+
+		// A dot means the rest of the address is in IPv4 form and forms the
+		// last two groups.
+		if (next < end && *next == '.') {
+			byte ipv4[FIFTYONE_DEGREES_IPV4_LENGTH];
+			if (count > 6 || textParseIpv4(current, end, ipv4) == false) {
+				return false;
+			}
+			groups[count++] = ((uint32_t)ipv4[0] << 8) | ipv4[1];
+			groups[count++] = ((uint32_t)ipv4[2] << 8) | ipv4[3];
+			current = end;
+			break;
+		}
+		if (digits == 0) {
+			return false;
+		}
+		groups[count++] = value;
+		current = next;
+		if (current == end) {
+			break;
+		}
+
+		// Groups are separated by a colon, or by two where zero groups have
+		// been compressed. Only one compression is allowed.
+		if (*current != ':' || ++current == end) {
+			return false;
+		}
+		if (*current == ':') {
+			if (gap >= 0) {
+				return false;
+			}
+			gap = count;
+			current++;
+		}
+	}
+	if (gap < 0 ? count != 8 : count > 7) {
+		return false;
+	}
+
+	// Place the groups before the gap at the start and the rest at the end.
+	memset(bytes, 0, FIFTYONE_DEGREES_IPV6_LENGTH);
+	const int before = gap < 0 ? count : gap;
+	for (int i = 0; i < count; i++) {
+		const int position = i < before ? i : 8 - count + i;
+		bytes[position * 2] = (byte)(groups[i] >> 8);
+		bytes[position * 2 + 1] = (byte)groups[i];
+	}
+	return true;
+}
+
+// Parses the address between start and end. Returns false if the text is not
+// a valid IPv4 or IPv6 address.
+static bool textParseAddress(
+	const char* const start,
+	const char* end,
+	IpAddress* const address) {
+	const char* const colon = (const char*)memchr(start, ':', end - start);
+	if (colon == NULL) {
+		memset(address->value, 0, sizeof(address->value));
+		address->type = IP_TYPE_IPV4;
+		return textParseIpv4(start, end, address->value);
+	}
+
+	// Any zone identifier does not form part of the address.
+	const char* const zone = (const char*)memchr(colon, '%', end - colon);
+	if (zone != NULL) {
+		end = zone;
+	}
+	address->type = IP_TYPE_IPV6;
+	return textParseIpv6(start, end, address->value);
+}
+
+// Sets the start and end to the field of the line that contains the address 
+// with any surrounding white space removed. Returns false if the line does 
+// not have enough fields.
+static bool textGetField(
+	const char** const start,
+	const char** const end,
+	const char delimiter,
+	const uint16_t field) {
+	if (delimiter != '\0') {
+		for (uint16_t i = 0; i < field; i++) {
+			const char* const next = (const char*)memchr(
+				*start, 
+				delimiter, 
+				*end - *start);
+			if (next == NULL) {
+				return false;
+			}
+			*start = next + 1;
+		}
+		const char* const next = (const char*)memchr(
+			*start, 
+			delimiter, 
+			*end - *start);
+		if (next != NULL) {
+			*end = next;
+		}
+	}
+	while (*start < *end && textIsSpace(**start)) (*start)++;
+	while (*end > *start && textIsSpace(*(*end - 1))) (*end)--;
+	return true;
+}
+
+size_t fiftyoneDegreesIpiGraphEvaluateText(
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	const char* const text,
+	const size_t length,
+	const char delimiter,
+	const uint16_t field,
+	const bool final,
+	fiftyoneDegreesIpiCgTextRow* const rows,
+	const size_t capacity,
+	size_t* const consumed,
+	fiftyoneDegreesException* const exception) {
+	IpAddress addresses[TEXT_CHUNK];
+	IpiCgResult results[TEXT_CHUNK];
+	size_t indexes[TEXT_CHUNK];
+	size_t count = 0;
+	size_t position = 0;
+	bool partial = false;
+	while (partial == false && count < capacity && position < length) {
+
+		// Parse the next chunk of rows recording the valid addresses.
+		uint32_t valid = 0;
+		while (valid < TEXT_CHUNK && count < capacity && position < length) {
+			const char* start = text + position;
+			const char* end = (const char*)memchr(
+				start, 
+				'\n', 
+				length - position);
+			if (end != NULL) {
+				position = end - text + 1;
+			}
+			else if (final) {
+				end = text + length;
+				position = length;
+			}
+			else {
+
+				// The last line is incomplete and will be evaluated when the
+				// rest of it is provided.
+				partial = true;
+				break;
+			}
+
+			// Skip empty lines.
+			const char* line = start;
+			while (line < end && textIsSpace(*line)) line++;
+			if (line == end) {
+				continue;
+			}
+
+			fiftyoneDegreesIpiCgTextRow* const row = &rows[count];
+			row->result = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+			row->valid = 
+				textGetField(&start, &end, delimiter, field) &&
+				textParseAddress(start, end, &addresses[valid]);
+			row->offset = start - text;
+			row->length = (uint32_t)(end - start);
+			if (row->valid) {
+				indexes[valid++] = count;
+			}
+			count++;
+		}
+
+		// Evaluate the valid addresses together and copy the results to
+		// their rows.
+		fiftyoneDegreesIpiGraphEvaluateBatch(
+			graphs,
+			componentId,
+			addresses,
+			results,
+			valid,
+			exception);
+		for (uint32_t i = 0; i < valid; i++) {
+			rows[indexes[i]].result = results[i];
+		}
+		if (EXCEPTION_FAILED) break;
+	}
+	if (consumed != NULL) {
+		*consumed = position;
+	}
+	return count;
+}
+
+/**
+ * RESOLVED EVALUATION
+ *
+ * The leaves of a graph are mapped to a profile or group index by toResult
+ * which the caller then uses to fetch the reference to the profile or group
+ * from another collection. A graph can instead hold a table of the references
+ * for every leaf, created once with a resolver provided by the caller, so 
+ * that evaluation returns the reference directly.
+ */
+
+// Returns the number of leaf values the graph can return.
+static uint32_t getResultsCount(const IpiCg* const graph) {
+	return graph->info.profileCount + graph->info.profileGroupCount;
+}
+
+// Returns the resolved reference for the profile index from the graph.
+static uint32_t getResolved(
+	const IpiCg* const graph,
+	const uint32_t profileIndex,
+	Exception* const exception) {
+	if (profileIndex == PROFILE_INDEX_NONE) {
+		return FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE;
+	}
+	if (profileIndex >= getResultsCount(graph)) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE;
+	}
+	return graph->resolved[profileIndex];
+}
+
+void fiftyoneDegreesIpiGraphResolve(
+	fiftyoneDegreesIpiCgArray* const graphs,
+	const fiftyoneDegreesIpiCgResolver resolver,
+	void* const state,
+	fiftyoneDegreesException* const exception) {
+	uint32_t** const tables = (uint32_t**)Malloc(
+		sizeof(uint32_t*) * graphs->count);
+	if (tables == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return;
+	}
+	memset(tables, 0, sizeof(uint32_t*) * graphs->count);
+
+	// Create the tables for every graph before replacing any so that the
+	// graphs are unchanged if a reference can't be resolved.
+	for (uint32_t i = 0; i < graphs->count && EXCEPTION_OKAY; i++) {
+		const IpiCg* const graph = &graphs->items[i];
+		const uint32_t count = getResultsCount(graph);
+		tables[i] = (uint32_t*)Malloc(sizeof(uint32_t) * ((size_t)count + 1));
+		if (tables[i] == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+			break;
+		}
+		for (uint32_t p = 0; p < count && EXCEPTION_OKAY; p++) {
+			const fiftyoneDegreesIpiCgResult result = toResult(
+				p, 
+				graph, 
+				exception);
+			if (EXCEPTION_OKAY) {
+				tables[i][p] = resolver(state, result, exception);
+			}
+		}
+	}
+	// Replace the tables. The caller ensures that no other thread is using 
+	// the graphs, so the existing tables can be freed immediately.
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		if (EXCEPTION_OKAY) {
+			if (graphs->items[i].resolved != NULL) {
+				Free(graphs->items[i].resolved);
+			}
+			graphs->items[i].resolved = tables[i];
+		}
+		else if (tables[i] != NULL) {
+			Free(tables[i]);
+		}
+	}
+	Free(tables);
+}
+
+uint32_t fiftyoneDegreesIpiGraphEvaluateResolved(
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	fiftyoneDegreesIpAddress address,
+	fiftyoneDegreesException* const exception) {
+	uint32_t resolved = FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE;
+	const IpiCg* const graph = getGraphForAddress(
+		graphs, 
+		componentId, 
+		&address);
+	if (graph == NULL) {
+		return resolved;
+	}
+	if (graph->resolved == NULL) {
+		EXCEPTION_SET(INVALID_CONFIG);
+		return resolved;
+	}
+	StringBuilder sb = { NULL, 0 };
+	Cursor cursor = cursorCreate(graph, address, &sb, exception);
+	const uint32_t profileIndex = evaluate(&cursor);
+	if (EXCEPTION_OKAY) {
+		resolved = getResolved(graph, profileIndex, exception);
+	}
+	cursorReleaseData(&cursor);
+	return resolved;
+}
+
+void fiftyoneDegreesIpiGraphEvaluateResolvedBatch(
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	const fiftyoneDegreesIpAddress* const addresses,
+	uint32_t* const resolved,
+	const uint32_t count,
+	fiftyoneDegreesException* const exception) {
+	IpiCgResult results[BATCH_CHUNK];
+	const ComponentGraphs component = getComponentGraphs(graphs, componentId);
+	for (uint32_t i = 0; i < count; i++) {
+		resolved[i] = FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE;
+	}
+	for (uint32_t i = 0; i < count; i += BATCH_CHUNK) {
+		const uint32_t chunk = count - i < BATCH_CHUNK ? 
+			count - i : 
+			BATCH_CHUNK;
+		fiftyoneDegreesIpiGraphEvaluateBatch(
+			graphs,
+			componentId,
+			addresses + i,
+			results,
+			chunk,
+			exception);
+		if (EXCEPTION_FAILED) return;
+
+		// The raw offset of each result is the profile index of the graph 
+		// evaluated.
+		for (uint32_t j = 0; j < chunk; j++) {
+			IpAddress address = addresses[i + j];
+			const IpiCg* const graph = getComponentGraph(&component, &address);
+			if (graph != NULL && graph->resolved == NULL) {
+				EXCEPTION_SET(INVALID_CONFIG);
+				return;
+			}
+			if (graph != NULL) {
+				resolved[i + j] = getResolved(
+					graph, 
+					results[j].rawOffset, 
+					exception);
+				if (EXCEPTION_FAILED) return;
+			}
+		}
+	}
+}
+
+/**
+ * VERIFICATION
+ *
+ * A verifier samples one in every sample rate evaluations and queues the 
+ * address and result. The samples are evaluated again on a background thread
+ * with a copy of each graph that has none of the prepared structures other 
+ * than the cluster ranges and is not validated, so the reference walk over 
+ * the collections is used. The queue is only locked when a sample is taken
+ * and samples are dropped rather than waiting if the queue is full.
+ */
+
+// Number of evaluations for each sample if not set in the options.
+#define VERIFY_SAMPLE_RATE 1000
+
+// Interlocked operations on the 64 bit counters of the verifier. Counters 
+// are 64 bit so that they don't wrap where long is 32 bits. Both return the 
+// value after the operation.
+#ifdef _MSC_VER
+#define VERIFY_INC(v) InterlockedIncrement64(v)
+#define VERIFY_ADD(v,a) (InterlockedExchangeAdd64(v, a) + (a))
+#else
+#define VERIFY_INC(v) __atomic_add_fetch(v, 1, __ATOMIC_SEQ_CST)
+#define VERIFY_ADD(v,a) __atomic_add_fetch(v, a, __ATOMIC_SEQ_CST)
+#endif
+
+// Maximum number of samples waiting if not set in the options.
+#define VERIFY_QUEUE_SIZE 1024
+
+// Evaluation waiting to be verified.
+typedef struct verify_sample_t {
+	byte componentId; // Component evaluated
+	IpAddress address; // Address evaluated
+	IpiCgResult result; // Result of the evaluation
+} VerifySample;
+
+// Verifier with the state used to verify the samples. Starts with the public
+// structure so that a pointer to one is a pointer to the other.
+typedef struct verify_t {
+	IpiCgVerifier verifier; // Options and counters
+	IpiCg* reference; // Graphs without the prepared structures
+	VerifySample* queue; // Circular queue of samples
+	uint32_t capacity; // Number of samples the queue can hold
+	uint32_t first; // Index of the first sample waiting
+	uint32_t count; // Number of samples waiting
+	bool stop; // True when the thread should stop
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	FIFTYONE_DEGREES_MUTEX mutex; // Locks the queue
+	Signal* signal; // Set when a sample is added or the thread should stop
+	FIFTYONE_DEGREES_THREAD thread; // Thread verifying the samples
+#endif
+	bool started; // True if the thread was started
+} Verify;
+
+// True if the results are the same.
+static bool verifyIsEqual(const IpiCgResult a, const IpiCgResult b) {
+	return a.rawOffset == b.rawOffset &&
+		a.offset == b.offset &&
+		a.isGroupOffset == b.isGroupOffset;
+}
+
+// Evaluates the address with the reference walk of the graph that would be
+// used by the graphs being verified.
+static IpiCgResult verifyReference(
+	const Verify* const verify,
+	const byte componentId,
+	IpAddress address,
+	Exception* exception) {
+	const IpiCgArray* const graphs = verify->verifier.graphs;
+	const IpiCg* const graph = getGraphForAddress(
+		graphs, 
+		componentId, 
+		&address);
+	if (graph == NULL) {
+		return FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+	}
+	StringBuilder sb = { NULL, 0 };
+	return ipiGraphEvaluateGraph(
+		&verify->reference[graph - graphs->items],
+		address,
+		&sb,
+		exception);
+}
+
+// Evaluates the sample again with the reference walk, disabling the verifier
+// and reporting the sample if the results differ. An exception from the 
+// reference walk leaves the default result which is treated as a mismatch.
+static void verifySample(Verify* const verify, const VerifySample* sample) {
+	IpiCgVerifier* const verifier = &verify->verifier;
+	EXCEPTION_CREATE;
+	const IpiCgResult reference = verifyReference(
+		verify,
+		sample->componentId,
+		sample->address,
+		exception);
+	VERIFY_INC(&verifier->verified);
+	if (verifyIsEqual(sample->result, reference) == false) {
+		FIFTYONE_DEGREES_INTERLOCK_EXCHANGE(verifier->disabled, 1, 0);
+		VERIFY_INC(&verifier->mismatches);
+		if (verifier->config.mismatch != NULL) {
+			verifier->config.mismatch(
+				verifier->config.state,
+				sample->componentId,
+				sample->address,
+				sample->result,
+				reference);
+		}
+	}
+}
+
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+// Verifies the samples as they are added to the queue until the verifier is
+// stopped and the queue is empty.
+static void* verifyRun(void* state) {
+	Verify* const verify = (Verify*)state;
+	VerifySample sample;
+	for (;;) {
+		FIFTYONE_DEGREES_MUTEX_LOCK(&verify->mutex);
+		const bool found = verify->count > 0;
+		const bool stop = verify->stop;
+		if (found) {
+			sample = verify->queue[verify->first];
+			verify->first = (verify->first + 1) % verify->capacity;
+			verify->count--;
+		}
+		FIFTYONE_DEGREES_MUTEX_UNLOCK(&verify->mutex);
+		if (found) {
+			verifySample(verify, &sample);
+		}
+		else if (stop) {
+			break;
+		}
+		else {
+			FIFTYONE_DEGREES_SIGNAL_WAIT(verify->signal);
+		}
+	}
+	return NULL;
+}
+#endif
+
+// Adds the evaluation to the queue, or verifies it immediately if there is 
+// no thread.
+static void verifyAdd(
+	Verify* const verify,
+	const byte componentId,
+	const IpAddress* const address,
+	const IpiCgResult* const result) {
+	VerifySample sample;
+	sample.componentId = componentId;
+	sample.address = *address;
+	sample.result = *result;
+	VERIFY_INC(&verify->verifier.sampled);
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	if (verify->started) {
+		bool added = false;
+		FIFTYONE_DEGREES_MUTEX_LOCK(&verify->mutex);
+		if (verify->count < verify->capacity) {
+			verify->queue[(verify->first + verify->count) % 
+				verify->capacity] = sample;
+			verify->count++;
+			added = true;
+		}
+		FIFTYONE_DEGREES_MUTEX_UNLOCK(&verify->mutex);
+		if (added) {
+			FIFTYONE_DEGREES_SIGNAL_SET(verify->signal);
+		}
+		else {
+			VERIFY_INC(&verify->verifier.dropped);
+		}
+		return;
+	}
+#endif
+	verifySample(verify, &sample);
+}
+
+fiftyoneDegreesIpiCgVerifier* fiftyoneDegreesIpiGraphVerifierCreate(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	const fiftyoneDegreesIpiCgVerifyConfig* config,
+	fiftyoneDegreesException* exception) {
+	Verify* const verify = (Verify*)Malloc(sizeof(Verify));
+	if (verify == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return NULL;
+	}
+	memset(verify, 0, sizeof(Verify));
+	verify->verifier.graphs = graphs;
+	verify->verifier.config = *config;
+	if (verify->verifier.config.sampleRate == 0) {
+		verify->verifier.config.sampleRate = VERIFY_SAMPLE_RATE;
+	}
+	if (verify->verifier.config.queueSize == 0) {
+		verify->verifier.config.queueSize = VERIFY_QUEUE_SIZE;
+	}
+	verify->capacity = verify->verifier.config.queueSize;
+
+	// Copy the graphs without the prepared structures that the faster walks
+	// use. The cluster ranges are needed by the reference walk.
+	verify->reference = (IpiCg*)Malloc(sizeof(IpiCg) * graphs->count);
+	verify->queue = (VerifySample*)Malloc(
+		sizeof(VerifySample) * verify->capacity);
+	if (verify->reference == NULL || verify->queue == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		fiftyoneDegreesIpiGraphVerifierFree(&verify->verifier);
+		return NULL;
+	}
+	for (uint32_t i = 0; i < graphs->count; i++) {
+		IpiCg* const reference = &verify->reference[i];
+		*reference = graphs->items[i];
+		reference->alignedNodes = NULL;
+		reference->spanIndexes = NULL;
+		reference->decodedSpans = NULL;
+		reference->compressedNodes = NULL;
+		reference->skips = NULL;
+		reference->skipIndexes = NULL;
+		reference->uniforms = NULL;
+		reference->uniformBits = NULL;
+		reference->uniformRanks = NULL;
+		reference->nodesMemory = NULL;
+		reference->validated = false;
 	}
 
-	return graphs;
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	FIFTYONE_DEGREES_MUTEX_CREATE(verify->mutex);
+	FIFTYONE_DEGREES_SIGNAL_CREATE(verify->signal);
+	if (verify->signal != NULL) {
+		verify->started = FIFTYONE_DEGREES_THREAD_CREATE(
+			verify->thread,
+			(FIFTYONE_DEGREES_THREAD_ROUTINE)&verifyRun,
+			verify) == 0;
+	}
+#endif
+	return &verify->verifier;
 }
 
-void fiftyoneDegreesIpiGraphFree(fiftyoneDegreesIpiCgArray* graphs) {
-	for (uint32_t i = 0; i < graphs->count; i++) {
-		FIFTYONE_DEGREES_COLLECTION_FREE(graphs->items[i].nodes);
-		FIFTYONE_DEGREES_COLLECTION_FREE(graphs->items[i].spans);
-		FIFTYONE_DEGREES_COLLECTION_FREE(graphs->items[i].spanBytes);
-		FIFTYONE_DEGREES_COLLECTION_FREE(graphs->items[i].clusters);
+void fiftyoneDegreesIpiGraphVerifierFree(
+	fiftyoneDegreesIpiCgVerifier* verifier) {
+	Verify* const verify = (Verify*)verifier;
+#ifndef FIFTYONE_DEGREES_NO_THREADING
+	if (verify->started) {
+		FIFTYONE_DEGREES_MUTEX_LOCK(&verify->mutex);
+		verify->stop = true;
+		FIFTYONE_DEGREES_MUTEX_UNLOCK(&verify->mutex);
+		FIFTYONE_DEGREES_SIGNAL_SET(verify->signal);
+		FIFTYONE_DEGREES_THREAD_JOIN(verify->thread);
+		FIFTYONE_DEGREES_THREAD_CLOSE(verify->thread);
 	}
-	Free(graphs);
+	if (verify->queue != NULL && verify->reference != NULL) {
+		if (verify->signal != NULL) {
+			FIFTYONE_DEGREES_SIGNAL_CLOSE(verify->signal);
+		}
+		FIFTYONE_DEGREES_MUTEX_CLOSE(verify->mutex);
+	}
+#endif
+	if (verify->queue != NULL) Free(verify->queue);
+	if (verify->reference != NULL) Free(verify->reference);
+	Free(verify);
 }
 
-fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromMemory(
-	fiftyoneDegreesCollection* collection,
-	fiftyoneDegreesMemoryReader* reader,
+fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluateVerified(
+	fiftyoneDegreesIpiCgVerifier* verifier,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
 	fiftyoneDegreesException* exception) {
-	return ipiGraphCreate(
-		collection,
-		ipiGraphCreateFromMemory,
-		(void*)reader,
+	Verify* const verify = (Verify*)verifier;
+	const int64_t evaluation = VERIFY_INC(&verifier->evaluations);
+	if (verifier->disabled) {
+		return verifyReference(verify, componentId, address, exception);
+	}
+	const IpiCgResult result = fiftyoneDegreesIpiGraphEvaluate(
+		verifier->graphs,
+		componentId,
+		address,
 		exception);
+	if (EXCEPTION_OKAY && evaluation % verifier->config.sampleRate == 0) {
+		verifyAdd(verify, componentId, &address, &result);
+	}
+	return result;
 }
 
-fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFile(
-	fiftyoneDegreesCollection* collection,
-	FILE* file,
-	fiftyoneDegreesFilePool* reader,
-	const fiftyoneDegreesCollectionConfig config,
+void fiftyoneDegreesIpiGraphEvaluateVerifiedBatch(
+	fiftyoneDegreesIpiCgVerifier* verifier,
+	byte componentId,
+	const fiftyoneDegreesIpAddress* addresses,
+	fiftyoneDegreesIpiCgResult* results,
+	uint32_t count,
 	fiftyoneDegreesException* exception) {
-	FileCollection state = {
-		file,
-		reader,
-		config
-	};
-	return ipiGraphCreate(
-		collection,
-		ipiGraphCreateFromFile,
-		(void*)&state,
+	Verify* const verify = (Verify*)verifier;
+	const int64_t last = VERIFY_ADD(
+		&verifier->evaluations, 
+		(int64_t)count);
+	if (verifier->disabled) {
+		for (uint32_t i = 0; i < count; i++) {
+			results[i] = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+		}
+		for (uint32_t i = 0; i < count && EXCEPTION_OKAY; i++) {
+			results[i] = verifyReference(
+				verify, 
+				componentId, 
+				addresses[i], 
+				exception);
+		}
+		return;
+	}
+	fiftyoneDegreesIpiGraphEvaluateBatch(
+		verifier->graphs,
+		componentId,
+		addresses,
+		results,
+		count,
 		exception);
+	if (EXCEPTION_FAILED) return;
+
+	// Sample the evaluations numbered as if they had been evaluated one at a
+	// time.
+	const int64_t rate = (int64_t)verifier->config.sampleRate;
+	const int64_t first = last - (int64_t)count + 1;
+	for (int64_t evaluation = ((first + rate - 1) / rate) * rate; 
+		evaluation <= last; 
+		evaluation += rate) {
+		const uint32_t i = (uint32_t)(evaluation - first);
+		verifyAdd(verify, componentId, &addresses[i], &results[i]);
+	}
 }
 
-fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluate(
-    const fiftyoneDegreesIpiCgArray*  const graphs,
-	const byte componentId,
-	const fiftyoneDegreesIpAddress address,
-	fiftyoneDegreesException* const exception) {
+/**
+ * STATISTICS
+ *
+ * The statistics are gathered from the collections rather than the prepared
+ * structures so that they are the same whatever options the graph was 
+ * created with. Walk depths are found with a single pass over the nodes the
+ * walk can reach in topological order, counting every distinct path from the
+ * root to a leaf, rather than by walking each path.
+ */
 
-	// String builder is not needed for normal usage without tracing.
-	StringBuilder sb = { NULL, 0 };
+// State of a node of the walk when gathering statistics.
+typedef struct stats_node_t {
+	double paths; // Number of distinct paths from the root to the node
+	double depths; // Sum of the depths of the node over all the paths
+	uint32_t depthMin; // Fewest nodes on a path from the root to the node
+	uint32_t depthMax; // Most nodes on a path from the root to the node
+	uint32_t inDegree; // Edges into the node from nodes the walk enters
+	bool entered; // True if the walk can enter the node from the root
+	bool visited; // True if the walk can read the node
+} StatsNode;
+
+// Counts the spans of the graph by where their limits are held and the bit
+// length of the limits.
+static void statsSpans(
+	const IpiCg* const graph,
+	IpiCgStats* const stats,
+	Exception* exception) {
+	for (uint32_t i = 0; i < graph->spansCount; i++) {
+		byte lengthLow, lengthHigh;
+		if (graph->decodedSpans != NULL) {
+			lengthLow = graph->decodedSpans[i].lengthLow;
+			lengthHigh = graph->decodedSpans[i].lengthHigh;
+		}
+		else {
+			Item item;
+			DataReset(&item.data);
+			const CollectionKey key = {
+				i,
+				&CollectionKeyType_Span,
+			};
+			const Span* const span = (const Span*)graph->spans->get(
+				graph->spans,
+				&key,
+				&item,
+				exception);
+			if (!span || EXCEPTION_FAILED) return;
+			lengthLow = span->lengthLow;
+			lengthHigh = span->lengthHigh;
+			COLLECTION_RELEASE(graph->spans, &item);
+		}
+		if (lengthLow >= FIFTYONE_DEGREES_IPI_CG_STATS_SPAN_LENGTHS ||
+			lengthHigh >= FIFTYONE_DEGREES_IPI_CG_STATS_SPAN_LENGTHS) {
+			EXCEPTION_SET(CORRUPT_DATA);
+			return;
+		}
+		stats->spanLengths[lengthLow]++;
+		stats->spanLengths[lengthHigh]++;
+		if (lengthLow + lengthHigh > 32) {
+			stats->spansInBytes++;
+		}
+		else {
+			stats->spansInline++;
+		}
+	}
+	stats->spansCount = graph->spansCount;
+}
 
-	return ipiGraphEvaluate(graphs, componentId, address, &sb, exception);
+// Sets the range of the number of nodes covered by each cluster.
+static void statsClusters(
+	const IpiCg* const graph,
+	IpiCgStats* const stats,
+	Exception* exception) {
+	const IpiCgClusterRange* ranges = graph->clusterRanges;
+	if (ranges == NULL) {
+		ranges = clusterRangesCreate(graph, NULL, exception);
+		if (ranges == NULL) return;
+	}
+	uint64_t total = 0;
+	stats->clustersCount = graph->clustersCount;
+	stats->clusterCapacity = 
+		(graph->clusters->elementSize - 2 * sizeof(uint32_t)) / 
+		sizeof(uint32_t);
+	stats->clusterNodesMin = graph->clustersCount > 0 ? UINT32_MAX : 0;
+	for (uint32_t i = 0; i < graph->clustersCount; i++) {
+		const uint32_t nodes = ranges[i].endIndex >= ranges[i].startIndex ?
+			ranges[i].endIndex - ranges[i].startIndex + 1 :
+			0;
+		if (nodes < stats->clusterNodesMin) stats->clusterNodesMin = nodes;
+		if (nodes > stats->clusterNodesMax) stats->clusterNodesMax = nodes;
+		total += nodes;
+	}
+	if (graph->clustersCount > 0) {
+		stats->clusterNodesAverage = (double)total / graph->clustersCount;
+	}
+	if (ranges != graph->clusterRanges) {
+		preparedFree(NULL, (void*)ranges);
+	}
 }
 
-fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluateTrace(
-	fiftyoneDegreesIpiCgArray* graphs,
-	byte componentId,
-	fiftyoneDegreesIpAddress address,
-	char* buffer,
-	int const length,
+// Edge of the walk from a node where the walk moves to another node, or ends
+// with a leaf.
+typedef struct stats_edge_t {
+	uint32_t index; // Node moved to, or UINT32_MAX if the walk ends
+	uint32_t depth; // Nodes visited after the node from to reach the index
+} StatsEdge;
+
+// Sets the low and high edges of the walk from the node at the index. When
+// the low flag is set the node holds the low entry and the high entry is the
+// next node. Otherwise the next node is the low entry. See selectLow and 
+// selectHigh. Returns false if the walk would leave the graph.
+static bool statsEdges(
+	const IpiCgNode* const decoded,
+	const uint32_t count,
+	const uint32_t index,
+	StatsEdge* const edges) {
+	const IpiCgNode* const node = &decoded[index];
+	const bool lowFlag = (node->flags & 
+		FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG) != 0;
+	if (index + 1 >= count) {
+		return false;
+	}
+	const IpiCgNode* const high = lowFlag ? &decoded[index + 1] : node;
+	edges[0].index = lowFlag ? 
+		(node->value < count ? node->value : UINT32_MAX) :
+		index + 1;
+	edges[0].depth = edges[0].index != UINT32_MAX ? 1 : 0;
+	edges[1].index = high->value < count ? high->value : UINT32_MAX;
+	edges[1].depth = (lowFlag ? 1 : 0) + (edges[1].index != UINT32_MAX);
+	return true;
+}
+
+// Passes the paths of the node along the edge, adding the node moved to to 
+// the queue once every edge into it has been passed, or adding the paths to
+// the totals of the leaves if the walk ends.
+static void statsFollow(
+	StatsNode* const nodes,
+	const StatsNode* const from,
+	const StatsEdge* const edge,
+	uint32_t* const queue,
+	uint32_t* const queued,
+	StatsNode* const leaves) {
+	StatsNode* const to = edge->index != UINT32_MAX ? 
+		&nodes[edge->index] : 
+		leaves;
+	to->paths += from->paths;
+	to->depths += from->depths + from->paths * edge->depth;
+	if (from->depthMin + edge->depth < to->depthMin) {
+		to->depthMin = from->depthMin + edge->depth;
+	}
+	if (from->depthMax + edge->depth > to->depthMax) {
+		to->depthMax = from->depthMax + edge->depth;
+	}
+	if (to != leaves && --to->inDegree == 0) {
+		queue[(*queued)++] = edge->index;
+	}
+}
+
+// Sets the number of reachable and leaf nodes, and the depth of the walks, 
+// from the decoded nodes.
+static void statsDepths(
+	const IpiCg* const graph,
+	const IpiCgNode* const decoded,
+	IpiCgStats* const stats,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	const uint32_t root = graph->info.graphIndex;
+	if (root >= count) {
+		EXCEPTION_SET(CORRUPT_DATA);
+		return;
+	}
+	StatsNode* const nodes = (StatsNode*)Malloc(sizeof(StatsNode) * count);
+	uint32_t* const queue = (uint32_t*)Malloc(sizeof(uint32_t) * count);
+	if (nodes == NULL || queue == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+	}
+	else {
+		StatsNode leaves = { 0, 0, UINT32_MAX, 0, 0, false, false };
+		StatsEdge edges[2];
+		for (uint32_t i = 0; i < count; i++) {
+			nodes[i] = leaves;
+		}
+
+		// Find the nodes the walk can enter breadth first from the root, 
+		// counting the edges into each one and marking every node visited.
+		uint32_t queued = 1;
+		bool valid = true;
+		queue[0] = root;
+		nodes[root].entered = true;
+		for (uint32_t head = 0; valid && head < queued; head++) {
+			const uint32_t index = queue[head];
+			valid = statsEdges(decoded, count, index, edges);
+			nodes[index].visited = true;
+			if (valid && 
+				(decoded[index].flags & 
+					FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG)) {
+				nodes[index + 1].visited = true;
+			}
+			for (int e = 0; valid && e < 2; e++) {
+				if (edges[e].index != UINT32_MAX) {
+					StatsNode* const to = &nodes[edges[e].index];
+					to->inDegree++;
+					if (to->entered == false) {
+						to->entered = true;
+						queue[queued++] = edges[e].index;
+					}
+				}
+			}
+		}
+		for (uint32_t i = 0; valid && i < count; i++) {
+			if (nodes[i].visited) {
+				stats->nodesReachable++;
+				if (decoded[i].value >= count) {
+					stats->nodesLeaf++;
+				}
+			}
+		}
+
+		// Pass the paths from the root through the nodes in topological 
+		// order. A node is only processed once the paths of every edge into
+		// it have been passed. Nodes left over must be part of a cycle.
+		if (valid && nodes[root].inDegree == 0) {
+			const uint32_t entered = queued;
+			nodes[root].paths = 1;
+			nodes[root].depths = 1;
+			nodes[root].depthMin = 1;
+			nodes[root].depthMax = 1;
+			queued = 1;
+			for (uint32_t head = 0; head < queued; head++) {
+				const StatsNode* const from = &nodes[queue[head]];
+				statsEdges(decoded, count, queue[head], edges);
+				for (int e = 0; e < 2; e++) {
+					statsFollow(
+						nodes, 
+						from, 
+						&edges[e], 
+						queue, 
+						&queued, 
+						&leaves);
+				}
+			}
+			valid = queued == entered;
+		}
+		else {
+			valid = false;
+		}
+		if (valid == false) {
+			EXCEPTION_SET(CORRUPT_DATA);
+		}
+		else if (leaves.paths > 0) {
+			stats->depthMin = leaves.depthMin;
+			stats->depthMax = leaves.depthMax;
+			stats->depthAverage = leaves.depths / leaves.paths;
+		}
+	}
+	if (nodes != NULL) Free(nodes);
+	if (queue != NULL) Free(queue);
+}
+
+// Decodes the nodes of the graph and sets the statistics that relate to them.
+static void statsNodes(
+	const IpiCg* const graph,
+	IpiCgStats* const stats,
+	Exception* exception) {
+	const uint32_t count = graph->info.nodes.collection.count;
+	stats->nodesCount = count;
+	stats->recordSize = graph->info.nodes.recordSize;
+	if (count == 0) {
+		return;
+	}
+	IpiCgNode* const decoded = (IpiCgNode*)Malloc(sizeof(IpiCgNode) * count);
+	if (decoded == NULL) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return;
+	}
+	if (alignedNodesDecode(graph, decoded, exception)) {
+		statsDepths(graph, decoded, stats, exception);
+	}
+	Free(decoded);
+}
+
+void fiftyoneDegreesIpiGraphGetStats(
+	const fiftyoneDegreesIpiCg* graph,
+	fiftyoneDegreesIpiCgStats* stats,
 	fiftyoneDegreesException* exception) {
-	StringBuilder sb = { buffer, length };
-	StringBuilderInit(&sb);
+	memset(stats, 0, sizeof(IpiCgStats));
+	stats->version = graph->info.version;
+	stats->componentId = graph->info.componentId;
+	stats->nodesBytes = graph->info.nodes.collection.length;
+	stats->nodesCompressedBytes = graph->compressedNodes != NULL ?
+		graph->compressedNodesSize :
+		0;
+	stats->skipsCount = graph->skips != NULL ? graph->skipsCount : 0;
+	stats->uniformsCount = graph->uniforms != NULL ? 
+		graph->uniformsCount : 
+		0;
+	stats->spansBytes = graph->info.spans.length;
+	stats->spanBytesBytes = graph->info.spanBytes.length;
+	stats->clustersBytes = graph->info.clusters.length;
+	stats->preparedBytes = fiftyoneDegreesIpiGraphGetMemoryOverhead(graph);
+	statsSpans(graph, stats, exception);
+	if (EXCEPTION_FAILED) return;
+	statsClusters(graph, stats, exception);
+	if (EXCEPTION_FAILED) return;
+	statsNodes(graph, stats, exception);
+}
 
-	// Add the bytes of the IP address to the trace.
-	StringBuilderAddChar(&sb, '\r');
-	StringBuilderAddChar(&sb, '\n');
-	StringBuilderAddChars(&sb, "IP:", sizeof("IP:") - 1);
-	int ipLength = 0;
-	switch (address.type) {
-	case FIFTYONE_DEGREES_IP_TYPE_IPV4:
-		ipLength = 4;
-		break;
-	case FIFTYONE_DEGREES_IP_TYPE_IPV6:
-		ipLength = 16;
-		break;
+/**
+ * NON-BLOCKING EVALUATION
+ * 
+ * The cursor of the walk is kept between steps in a copy of the graph whose
+ * collections only return bytes already supplied by the caller. The first 
+ * fetch that can not be satisfied records the bytes needed and aborts the 
+ * stage of the walk in progress. The cursor is saved at the start of each
+ * stage, either the move to the root or the compare and move at a node, so
+ * the next step resumes from the start of the stage that was aborted rather
+ * than from the root. Supplied blocks are ordered by collection and offset so
+ * the block holding the bytes of a fetch is found with a binary search.
+ */
+
+// Stages of a non-blocking walk.
+typedef enum walk_stage_e {
+	WALK_ROOT, // The cursor must be moved to the root node
+	WALK_NODE // The cursor is at a node to compare with the address
+} WalkStage;
+
+// State for a collection that serves the bytes supplied to an evaluation.
+typedef struct supplied_collection_t {
+	fiftyoneDegreesIpiCgEvaluation* evaluation; // Evaluation being stepped
+	const Collection* source; // Collection of the graph being substituted
+	fiftyoneDegreesIpiCgCollection type; // The collection of the graph
+	uint32_t startPosition; // Position of the first byte of the collection
+} SuppliedCollection;
+
+// State of a non-blocking walk kept between the steps of an evaluation.
+typedef struct evaluation_walk_t {
+	IpiCg shadow; // Copy of the graph with the supplied collections
+	Collection nodes; // Supplied nodes collection
+	Collection spans; // Supplied spans collection
+	Collection spanBytes; // Supplied span bytes collection
+	Collection clusters; // Supplied clusters collection
+	SuppliedCollection nodesState; // State of the nodes collection
+	SuppliedCollection spansState; // State of the spans collection
+	SuppliedCollection spanBytesState; // State of the span bytes collection
+	SuppliedCollection clustersState; // State of the clusters collection
+	StringBuilder sb; // Trace output of the cursor which is not used
+	Exception exception; // Exception of the stage in progress
+	Cursor cursor; // Cursor at the start of the stage in progress
+	WalkStage stage; // Stage in progress
+	uint32_t profileIndex; // Result of the walk once complete
+} EvaluationWalk;
+
+// Returns the index of the first block that is after the offset of the 
+// collection in the order of the blocks.
+static uint32_t suppliedUpperBound(
+	const fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	const fiftyoneDegreesIpiCgCollection type,
+	const uint32_t offset) {
+	uint32_t lower = 0, upper = evaluation->blocksCount;
+	while (lower < upper) {
+		const uint32_t middle = lower + (upper - lower) / 2;
+		const fiftyoneDegreesIpiCgBlock* const block = 
+			&evaluation->blocks[middle];
+		if (block->collection < type ||
+			(block->collection == type && block->offset <= offset)) {
+			lower = middle + 1;
+		}
+		else {
+			upper = middle;
+		}
 	}
-	for (int i = 0; i < ipLength; i++) {
-		StringBuilderAddInteger(&sb, address.value[i]);
-		if (i < ipLength - 1) {
-			StringBuilderAddChar(&sb, '.');
+	return lower;
+}
+
+// Returns a pointer to the supplied bytes that contain the range, or NULL if
+// the range has not been supplied. The blocks that start at or before the 
+// offset are checked from the nearest, which is usually the one needed.
+static byte* suppliedFind(
+	const fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	const fiftyoneDegreesIpiCgCollection type,
+	const uint32_t offset,
+	const uint32_t length) {
+	uint32_t i = suppliedUpperBound(evaluation, type, offset);
+	while (i > 0 && evaluation->blocks[i - 1].collection == type) {
+		const fiftyoneDegreesIpiCgBlock* const block = 
+			&evaluation->blocks[--i];
+		if ((uint64_t)offset + length <= 
+			(uint64_t)block->offset + block->length) {
+			return evaluation->data + block->dataOffset + 
+				(offset - block->offset);
 		}
 	}
+	return NULL;
+}
+
+// Collection get method that returns the supplied bytes or records the bytes
+// needed and fails if they are not yet available.
+static void* suppliedGet(
+	const Collection* collection,
+	const CollectionKey* key,
+	Item* item,
+	Exception* exception) {
+	const SuppliedCollection* const state = 
+		(const SuppliedCollection*)collection->state;
+	fiftyoneDegreesIpiCgEvaluation* const evaluation = state->evaluation;
+	const Collection* const source = state->source;
+	const uint32_t index = key->indexOrOffset.index;
+	if (index >= source->count) {
+		EXCEPTION_SET(FIFTYONE_DEGREES_STATUS_POINTER_OUT_OF_BOUNDS);
+		return NULL;
+	}
 
-	const fiftyoneDegreesIpiCgResult result = ipiGraphEvaluate(
-		graphs, 
-		componentId, 
+	// Variable width keys need more bytes than the element size.
+	uint32_t length = source->elementSize;
+	if (key->keyType->initialBytesCount > length) {
+		length = key->keyType->initialBytesCount;
+	}
+	const uint64_t offset = (uint64_t)index * source->elementSize;
+	if (offset + length > source->size) {
+		length = (uint32_t)(source->size - offset);
+	}
+
+	byte* const ptr = suppliedFind(
+		evaluation,
+		state->type,
+		(uint32_t)offset,
+		length);
+	if (ptr == NULL) {
+		evaluation->request.collection = state->type;
+		evaluation->request.offset = (uint32_t)offset;
+		evaluation->request.length = length;
+		evaluation->request.position = state->startPosition + offset;
+		evaluation->pending = true;
+		EXCEPTION_SET(COLLECTION_FAILURE);
+		return NULL;
+	}
+	item->data.ptr = ptr;
+	item->data.used = length;
+	item->handle = NULL;
+	item->collection = collection;
+	return ptr;
+}
+
+// Nothing to release as the evaluation owns the supplied bytes.
+static void suppliedRelease(Item* item) {
+	(void)item;
+}
+
+// Initialises the collection to serve supplied bytes in place of the source.
+static void suppliedCollectionInit(
+	Collection* const collection,
+	SuppliedCollection* const state,
+	fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	const Collection* const source,
+	const fiftyoneDegreesIpiCgCollection type,
+	const uint32_t startPosition) {
+	*collection = *source;
+	collection->get = suppliedGet;
+	collection->release = suppliedRelease;
+	collection->freeCollection = NULL;
+	collection->state = state;
+	state->evaluation = evaluation;
+	state->source = source;
+	state->type = type;
+	state->startPosition = startPosition;
+}
+
+// Creates the walk for the address copying the graph with collections that
+// serve the bytes supplied to the evaluation. The nodes are not prefetched as
+// they are not read from memory. Returns NULL if memory can't be allocated.
+static EvaluationWalk* evaluationWalkCreate(
+	fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	const IpiCg* const graph,
+	const IpAddress address) {
+	EvaluationWalk* const walk = (EvaluationWalk*)Malloc(
+		sizeof(EvaluationWalk));
+	if (walk == NULL) {
+		return NULL;
+	}
+	memset(walk, 0, sizeof(EvaluationWalk));
+	walk->shadow = *graph;
+	walk->shadow.nodesMemory = NULL;
+	suppliedCollectionInit(
+		&walk->nodes, 
+		&walk->nodesState, 
+		evaluation,
+		graph->nodes,
+		FIFTYONE_DEGREES_IPI_CG_COLLECTION_NODES,
+		graph->info.nodes.collection.startPosition);
+	suppliedCollectionInit(
+		&walk->spans,
+		&walk->spansState,
+		evaluation,
+		graph->spans,
+		FIFTYONE_DEGREES_IPI_CG_COLLECTION_SPANS,
+		graph->info.spans.startPosition);
+	suppliedCollectionInit(
+		&walk->spanBytes,
+		&walk->spanBytesState,
+		evaluation,
+		graph->spanBytes,
+		FIFTYONE_DEGREES_IPI_CG_COLLECTION_SPAN_BYTES,
+		graph->info.spanBytes.startPosition);
+	suppliedCollectionInit(
+		&walk->clusters,
+		&walk->clustersState,
+		evaluation,
+		graph->clusters,
+		FIFTYONE_DEGREES_IPI_CG_COLLECTION_CLUSTERS,
+		graph->info.clusters.startPosition);
+	walk->shadow.nodes = &walk->nodes;
+	walk->shadow.spans = &walk->spans;
+	walk->shadow.spanBytes = &walk->spanBytes;
+	walk->shadow.clusters = &walk->clusters;
+	walk->exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+
+	// The cursor has constant members so is copied into the walk as bytes.
+	const Cursor cursor = cursorCreate(
+		&walk->shadow, 
 		address, 
-		&sb,
-		exception);
-	StringBuilderAddChar(&sb, '\0');
-	return result;
+		&walk->sb, 
+		&walk->exception);
+	memcpy(&walk->cursor, &cursor, sizeof(Cursor));
+	walk->stage = WALK_ROOT;
+	walk->profileIndex = PROFILE_INDEX_NONE;
+	return walk;
+}
+
+// Performs the stage of the walk in progress in the same way as 
+// EVALUATE_WITH. Returns true if the walk is complete and the profile index
+// is set.
+static bool evaluationWalkAdvance(EvaluationWalk* const walk) {
+	Cursor* const cursor = &walk->cursor;
+	Exception* const exception = cursor->ex;
+	if (walk->stage == WALK_ROOT) {
+		traceNewLine(cursor);
+		cursorMove(cursor, getRootIndex(cursor->graph));
+		if (EXCEPTION_OKAY) {
+			walk->stage = WALK_NODE;
+		}
+		return false;
+	}
+	bool found;
+	const IpiCgUniform* const uniform = getUniform(cursor);
+	if (uniform != NULL) {
+		walk->profileIndex = uniform->profileIndex;
+		return true;
+	}
+	if (cursor->ipLength == FIFTYONE_DEGREES_IPV4_LENGTH) {
+		compareIpv4ToSpan(cursor);
+	}
+	else {
+		compareIpv6ToSpan(cursor);
+	}
+	const IpiCgSkip* const skip = getSkip(cursor);
+	if (skip != NULL) {
+		skipAdvance(cursor, skip);
+		cursorMove(cursor, skip->target);
+		found = false;
+	}
+	else {
+		found = cursorSelect(cursor);
+	}
+	if (EXCEPTION_FAILED) {
+		return false;
+	}
+	if (found || isExhausted(cursor)) {
+		walk->profileIndex = getWalkResult(cursor);
+		return true;
+	}
+	return false;
+}
+
+// Frees the walk of the evaluation if there is one.
+static void evaluationWalkFree(
+	fiftyoneDegreesIpiCgEvaluation* const evaluation) {
+	EvaluationWalk* const walk = (EvaluationWalk*)evaluation->walk;
+	if (walk != NULL) {
+		cursorReleaseData(&walk->cursor);
+		Free(walk);
+		evaluation->walk = NULL;
+	}
+}
+
+void fiftyoneDegreesIpiGraphEvaluationInit(
+	fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	const fiftyoneDegreesIpiCgArray* const graphs,
+	const byte componentId,
+	const fiftyoneDegreesIpAddress address) {
+	evaluation->graphs = graphs;
+	evaluation->componentId = componentId;
+	evaluation->address = address;
+	evaluation->result = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+	evaluation->pending = false;
+	evaluation->request.collection = FIFTYONE_DEGREES_IPI_CG_COLLECTION_NODES;
+	evaluation->request.offset = 0;
+	evaluation->request.length = 0;
+	evaluation->request.position = 0;
+	evaluation->blocks = NULL;
+	evaluation->blocksCount = 0;
+	evaluation->blocksCapacity = 0;
+	evaluation->data = NULL;
+	evaluation->dataUsed = 0;
+	evaluation->dataCapacity = 0;
+	evaluation->walk = NULL;
+}
+
+bool fiftyoneDegreesIpiGraphEvaluationStep(
+	fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	fiftyoneDegreesException* const exception) {
+	EvaluationWalk* walk = (EvaluationWalk*)evaluation->walk;
+	evaluation->pending = false;
+
+	// Start the walk on the first step. A validated graph is walked without
+	// reading its collections so it never needs bytes to be supplied.
+	if (walk == NULL) {
+		IpAddress address = evaluation->address;
+		const IpiCg* const graph = getGraphForAddress(
+			evaluation->graphs,
+			evaluation->componentId,
+			&address);
+		evaluation->result = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+		if (graph == NULL) {
+			return true;
+		}
+		if (graph->validated) {
+			StringBuilder sb = { NULL, 0 };
+			evaluation->result = ipiGraphEvaluateGraph(
+				graph, 
+				address, 
+				&sb, 
+				exception);
+			return true;
+		}
+		walk = evaluationWalkCreate(evaluation, graph, address);
+		if (walk == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+			return true;
+		}
+		evaluation->walk = walk;
+	}
+
+	// The cluster held by the cursor points to supplied bytes which might 
+	// have moved since the last step, so it is fetched again when needed.
+	walk->cursor.cluster.ptr = NULL;
+	walk->nodesState.evaluation = evaluation;
+	walk->spansState.evaluation = evaluation;
+	walk->spanBytesState.evaluation = evaluation;
+	walk->clustersState.evaluation = evaluation;
+
+	// Advance the walk a stage at a time until it is complete or bytes are
+	// needed. Failures caused by missing bytes are not reported to the 
+	// caller and the stage is resumed from its start on the next step.
+	bool complete = false;
+	while (complete == false && 
+		walk->exception.status == FIFTYONE_DEGREES_STATUS_NOT_SET) {
+		const Cursor start = walk->cursor;
+		complete = evaluationWalkAdvance(walk);
+		if (evaluation->pending) {
+			memcpy(&walk->cursor, &start, sizeof(Cursor));
+			walk->exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			return false;
+		}
+	}
+	if (walk->exception.status == FIFTYONE_DEGREES_STATUS_NOT_SET) {
+		evaluation->result = toResult(
+			walk->profileIndex,
+			&walk->shadow,
+			&walk->exception);
+	}
+	if (walk->exception.status != FIFTYONE_DEGREES_STATUS_NOT_SET) {
+		evaluation->result = FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT;
+		if (exception != NULL) {
+			*exception = walk->exception;
+		}
+	}
+	evaluationWalkFree(evaluation);
+	return true;
+}
+
+void fiftyoneDegreesIpiGraphEvaluationSupply(
+	fiftyoneDegreesIpiCgEvaluation* const evaluation,
+	const uint32_t offset,
+	const byte* const data,
+	const uint32_t length,
+	fiftyoneDegreesException* const exception) {
+	if (evaluation->pending == false || 
+		offset > evaluation->request.offset ||
+		(uint64_t)offset + length < 
+			(uint64_t)evaluation->request.offset + 
+			evaluation->request.length) {
+		EXCEPTION_SET(INVALID_INPUT);
+		return;
+	}
+
+	// Ensure there is space for the bytes and the block that records them.
+	// The sizes are worked out in 64 bits so that they can't wrap.
+	const uint64_t needed = (uint64_t)evaluation->dataUsed + length;
+	if (needed > UINT32_MAX) {
+		EXCEPTION_SET(INSUFFICIENT_MEMORY);
+		return;
+	}
+	if (needed > evaluation->dataCapacity) {
+		uint64_t capacity = evaluation->dataCapacity ? 
+			evaluation->dataCapacity : 1024;
+		while (needed > capacity) {
+			capacity *= 2;
+		}
+		if (capacity > UINT32_MAX) {
+			capacity = UINT32_MAX;
+		}
+		byte* const grown = (byte*)Malloc((size_t)capacity);
+		if (grown == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+			return;
+		}
+		if (evaluation->data != NULL) {
+			memcpy(grown, evaluation->data, evaluation->dataUsed);
+			Free(evaluation->data);
+		}
+		evaluation->data = grown;
+		evaluation->dataCapacity = (uint32_t)capacity;
+	}
+	if (evaluation->blocksCount == evaluation->blocksCapacity) {
+		const uint64_t capacity = evaluation->blocksCapacity ?
+			(uint64_t)evaluation->blocksCapacity * 2 : 16;
+		if (capacity > UINT32_MAX ||
+			capacity > SIZE_MAX / sizeof(fiftyoneDegreesIpiCgBlock)) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+			return;
+		}
+		fiftyoneDegreesIpiCgBlock* const grown = (fiftyoneDegreesIpiCgBlock*)
+			Malloc(sizeof(fiftyoneDegreesIpiCgBlock) * (size_t)capacity);
+		if (grown == NULL) {
+			EXCEPTION_SET(INSUFFICIENT_MEMORY);
+			return;
+		}
+		if (evaluation->blocks != NULL) {
+			memcpy(
+				grown,
+				evaluation->blocks,
+				sizeof(fiftyoneDegreesIpiCgBlock) * evaluation->blocksCount);
+			Free(evaluation->blocks);
+		}
+		evaluation->blocks = grown;
+		evaluation->blocksCapacity = (uint32_t)capacity;
+	}
+
+	// Record the bytes against the collection and offset supplied keeping
+	// the blocks in order.
+	const uint32_t index = suppliedUpperBound(
+		evaluation,
+		evaluation->request.collection,
+		offset);
+	memmove(
+		&evaluation->blocks[index + 1],
+		&evaluation->blocks[index],
+		sizeof(fiftyoneDegreesIpiCgBlock) * 
+			(evaluation->blocksCount - index));
+	evaluation->blocksCount++;
+	fiftyoneDegreesIpiCgBlock* const block = &evaluation->blocks[index];
+	block->collection = evaluation->request.collection;
+	block->offset = offset;
+	block->length = length;
+	block->dataOffset = evaluation->dataUsed;
+	memcpy(evaluation->data + evaluation->dataUsed, data, length);
+	evaluation->dataUsed += length;
+	evaluation->pending = false;
+}
+
+void fiftyoneDegreesIpiGraphEvaluationRelease(
+	fiftyoneDegreesIpiCgEvaluation* const evaluation) {
+	evaluationWalkFree(evaluation);
+	if (evaluation->blocks != NULL) {
+		Free(evaluation->blocks);
+		evaluation->blocks = NULL;
+	}
+	if (evaluation->data != NULL) {
+		Free(evaluation->data);
+		evaluation->data = NULL;
+	}
+	evaluation->blocksCount = 0;
+	evaluation->blocksCapacity = 0;
+	evaluation->dataUsed = 0;
+	evaluation->dataCapacity = 0;
 }
@@ -88,13 +88,42 @@
  * The array created must be freed with the fiftyoneDegreesIpiGraphFree method
  * when finished with.
  * 
+ * ## Thread Safety
+ * 
+ * Once created the array of graphs is never modified and evaluation holds all
+ * of its state in a cursor on the calling thread's stack. Any number of 
+ * threads may therefore call fiftyoneDegreesIpiGraphEvaluate concurrently with
+ * the same array.
+ * 
+ * Where the array is created with fiftyoneDegreesIpiGraphCreateFromMemory no
+ * locks are taken during evaluation.
+ * 
+ * Where the array is created with fiftyoneDegreesIpiGraphCreateFromFile every
+ * fetch that misses the memory resident data goes through the file pool and 
+ * the cache of the collection concerned. The number of readers in the pool,
+ * set by the concurrency of the collection configuration, should be at least
+ * the number of threads that will evaluate at the same time, otherwise threads
+ * will wait for a free reader. To limit the fetches made the node ranges of 
+ * the clusters are held in memory, so a cursor fetches only the cluster it
+ * moves to rather than every cluster visited while searching for it, and 
+ * holds at most one cluster between fetches. The pool and the caches are
+ * shared by every thread and take a lock for each fetch, so evaluation from
+ * a file does not scale linearly with threads.
+ * 
+ * For workloads where lock contention matters on Linux, set the directReads
+ * option of fiftyoneDegreesIpiCgConfig. Each thread then reads from the file
+ * with its own positional reads, and pages already read are found without a
+ * lock, so evaluation does not use the pool. Otherwise a
+ * loaded value equal to the count of entries should be used in the 
+ * collection configuration, or the memory create method.
+ * 
  * ## Note
  * 
  * The methods marked trace are for 51Degrees internal purposes and are not
  * intended for production usage.
  * 
- * Associated tests are not provided as open source. Contact 51Degrees if more
- * information is required.
+ * Tests that evaluate synthetic graphs with each of the options are in the
+ * tests directory. See README.md.
  */
 
 #if !defined(DEBUG) && !defined(_DEBUG) && !defined(NDEBUG)
@@ -161,6 +190,102 @@ typedef struct fiftyone_degrees_ipi_cg_info_t {
 } fiftyoneDegreesIpiCgInfo;
 #pragma pack(pop)
 
+/**
+ * The inclusive range of node indexes covered by a cluster. The ranges for all
+ * the clusters of a graph are held in memory so that the cluster for a node
+ * can be found without fetching each cluster visited by the search from the
+ * clusters collection.
+ */
+typedef struct fiftyone_degrees_ipi_cg_cluster_range_t {
+	uint32_t startIndex; /**< The inclusive start index in the nodes 
+						 collection */
+	uint32_t endIndex; /**< The inclusive end index in the nodes collection */
+} fiftyoneDegreesIpiCgClusterRange;
+
+/**
+ * Node of a graph decoded from the bit packed nodes collection into a fixed
+ * width aligned record. Used when the graph is created with the alignNodes
+ * configuration option. Four nodes fit exactly in a 64 byte cache line so no
+ * node straddles two lines.
+ */
+typedef struct fiftyone_degrees_ipi_cg_node_t {
+	uint32_t value; /**< Index of the aligned node the value points to, or the
+					original value if a leaf. Leaf values are always equal to
+					or greater than the number of nodes. */
+	uint32_t next; /**< Index of the aligned node that followed this node in
+				   the nodes collection, or the number of nodes if this was
+				   the last. A trap node that ends the walk with corrupt 
+				   data is held at that index */
+	uint32_t spanIndex; /**< Index in the spans collection resolved from the
+						cluster span index */
+	uint32_t flags; /**< Flags for the node. See 
+					FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG */
+} fiftyoneDegreesIpiCgNode;
+
+/**
+ * Flag set in fiftyoneDegreesIpiCgNode.flags if the node has the low flag.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_NODE_LOW_FLAG 1
+
+/**
+ * Span of a graph decoded from the spans and span bytes collections into a
+ * fixed width record. Used when the graph is created with the decodeSpans
+ * configuration option. The limits are held as 128 bit values split into two
+ * 64 bit words, most significant word first, with the first bit of the limit
+ * in the most significant bit of the first word and all bits after the length
+ * of the limit set to zero. Limits can then be compared with the bits of an 
+ * IP address a word at a time.
+ */
+typedef struct fiftyone_degrees_ipi_cg_span_t {
+	uint64_t low[2]; /**< Low limit of the span */
+	uint64_t high[2]; /**< High limit of the span */
+	byte lengthLow; /**< Bit length of the low limit */
+	byte lengthHigh; /**< Bit length of the high limit */
+} fiftyoneDegreesIpiCgSpan;
+
+/**
+ * Chain of nodes where the walk only continues if the bits of the address 
+ * are equal to the low or high limit of each span, created when the graph 
+ * is created with the compressPaths configuration option. The walk compares
+ * the bits of the address with the limits of the whole chain at once and 
+ * moves directly to the node at the end of the chain if they are equal. The
+ * bits are held in the same form as the limits of 
+ * fiftyoneDegreesIpiCgSpan.
+ */
+typedef struct fiftyone_degrees_ipi_cg_skip_t {
+	uint64_t bits[2]; /**< Limits of the spans in the chain one after the 
+					  other */
+	uint32_t target; /**< Index of the node at the end of the chain */
+	uint32_t previousHigh; /**< Index of the last node in the chain where the
+						   high entry was followed, or UINT32_MAX if none 
+						   was */
+	byte length; /**< Number of bits in the chain */
+} fiftyoneDegreesIpiCgSkip;
+
+/**
+ * Result shared by every walk from a node, created when the graph is created
+ * with the markUniform configuration option.
+ */
+typedef struct fiftyone_degrees_ipi_cg_uniform_t {
+	uint32_t profileIndex; /**< Profile index every walk from the node 
+						   returns */
+	byte length; /**< Most bits of the address the walk from the node can 
+				 consume before it reaches a leaf. The walk only returns the
+				 profile index early if more bits than this follow, as it 
+				 would otherwise end at a node that is not a leaf */
+} fiftyoneDegreesIpiCgUniform;
+
+/**
+ * Reference count for a collection or prepared structures that can be used
+ * by the graphs of more than one array. See 
+ * fiftyoneDegreesIpiGraphCreateFromDelta.
+ */
+typedef struct fiftyone_degrees_ipi_cg_shared_t {
+	volatile long references; /**< Number of graphs using the memory */
+	void(*free)(void* shared); /**< Frees the memory and the record when the
+							   last reference is released */
+} fiftyoneDegreesIpiCgShared;
+
 /**
  * The information and a working collection to retrieve entries from the 
  * component graph.
@@ -173,8 +298,190 @@ typedef struct fiftyone_degrees_ipi_cg_t {
 	fiftyoneDegreesCollection* clusters; /**< Clusters collection */
 	uint32_t spansCount; /**< Number of spans available */
 	uint32_t clustersCount; /**< Number of clusters available */
+	fiftyoneDegreesIpiCgClusterRange* clusterRanges; /**< Node index range
+													 for each cluster */
+	fiftyoneDegreesIpiCgNode* alignedNodes; /**< Nodes decoded and reordered 
+											breadth first from the root, or 
+											NULL if not enabled */
+	uint32_t alignedRootIndex; /**< Index of the graph's root node in the
+							   aligned nodes */
+	void* spanIndexes; /**< Span index for each node in the nodes collection,
+					   or NULL if not enabled */
+	byte spanIndexesSize; /**< Bytes used for each entry in spanIndexes, 2 if
+						  all span indexes fit in 16 bits otherwise 4 */
+	fiftyoneDegreesIpiCgSpan* decodedSpans; /**< Every span of the spans 
+											collection decoded, or NULL if 
+											not enabled */
+	void* compressedNodes; /**< Nodes compressed into blocks that each node
+						   can be decoded from directly, or NULL if not 
+						   enabled */
+	size_t compressedNodesSize; /**< Bytes used by compressedNodes */
+	fiftyoneDegreesIpiCgSkip* skips; /**< Chains of nodes the walk can skip,
+									 or NULL if not enabled */
+	uint32_t* skipIndexes; /**< Index in skips of the chain that starts at 
+						   each node, or UINT32_MAX if none does */
+	uint32_t skipsCount; /**< Number of chains in skips */
+	fiftyoneDegreesIpiCgUniform* uniforms; /**< Result of each node where
+										   every walk returns the same
+										   result, or NULL if not enabled */
+	uint64_t* uniformBits; /**< Bit set for each node with an entry in 
+						   uniforms */
+	uint32_t* uniformRanks; /**< Number of bits set in uniformBits before 
+							each word */
+	uint32_t uniformsCount; /**< Number of entries in uniforms */
+	const byte* nodesMemory; /**< First byte of the nodes collection if the
+							 graph was created from memory, otherwise NULL.
+							 Used to prefetch nodes ahead of the walk */
+	bool validated; /**< True if the graph was checked when created and is
+					evaluated without checks at each step */
+	uint32_t* resolved; /**< Resolved reference for each profile index, or
+						NULL if fiftyoneDegreesIpiGraphResolve has not been
+						called */
+	fiftyoneDegreesIpiCgShared* nodesShared; /**< Reference to the nodes 
+											 collection */
+	fiftyoneDegreesIpiCgShared* spansShared; /**< Reference to the spans 
+											 collection */
+	fiftyoneDegreesIpiCgShared* spanBytesShared; /**< Reference to the span
+												 bytes collection */
+	fiftyoneDegreesIpiCgShared* clustersShared; /**< Reference to the 
+												clusters collection */
+	fiftyoneDegreesIpiCgShared* preparedShared; /**< Reference to the 
+												prepared structures, or NULL
+												if they are held in a 
+												snapshot */
 } fiftyoneDegreesIpiCg;
 
+/**
+ * Options applied when the graphs are created. All options default to false
+ * and trade additional memory and creation time for faster evaluation, other
+ * than compressNodes which trades evaluation time for less memory.
+ */
+typedef struct fiftyone_degrees_ipi_cg_config_t {
+	bool alignNodes; /**< Decode the bit packed nodes of each graph into
+					 fixed width cache aligned records with the span index
+					 already resolved from the cluster. The nodes are reordered
+					 breadth first from the root so the nodes visited at each
+					 depth of the walk are close together, and a node with the
+					 low flag is always followed by the node that holds its
+					 high entry. The clusters collection is not used by the
+					 walk. Requires 16 bytes per node. */
+	bool resolveSpanIndexes; /**< Resolve the span index of every node from
+							 its cluster when the graph is created and hold
+							 them in an array alongside the bit packed nodes.
+							 The walk then reads the span index directly and
+							 the clusters collection is not used. Requires 2
+							 bytes per node if there are fewer than 65536 spans
+							 otherwise 4 bytes. Ignored if alignNodes is 
+							 enabled as the aligned nodes already hold the 
+							 span index. */
+	bool decodeSpans; /**< Decode every span, including the limits held in 
+					  the span bytes collection, into fixed width records 
+					  when the graph is created. The walk then reads a span
+					  with a single indexed load and compares the limits a
+					  64 bit word at a time. The spans and span bytes 
+					  collections are not used by the walk and spans are
+					  validated once when the graph is created. Requires 40
+					  bytes per span. */
+	bool normalizeIpv4; /**< Evaluate IPv6 addresses that embed an IPv4
+						address with the IPv4 graph for the component. 
+						Applies to IPv4-mapped (::ffff:a.b.c.d), 
+						IPv4-compatible (::a.b.c.d) and 6to4 (2002:aabb:ccdd::)
+						addresses. The shorter IPv4 walk is used and dual 
+						stack clients get the same result for either form of
+						their address. If there is no IPv4 graph for the 
+						component then the IPv6 graph is used. */
+	bool useArena; /**< Allocate the structures prepared for all the graphs
+				   from a single block of memory that is freed in one 
+				   operation with the graphs. Blocks of 2MB or more are 
+				   aligned to 2MB so they can be backed by huge pages. The
+				   collections are still allocated by the collection 
+				   layer. */
+	bool hugePages; /**< Back the structures prepared for all the graphs 
+					with huge pages. Reserved 2MB huge pages are used if 
+					available, otherwise transparent huge pages are 
+					requested for the 2MB aligned block. Implies useArena. 
+					Only supported on Linux. */
+	bool interleave; /**< Interleave the pages of the structures prepared for
+					 all the graphs across all the NUMA nodes so that 
+					 threads on every node see the same average latency. 
+					 Implies useArena. Only supported on Linux. */
+	int numaNode; /**< NUMA node to prefer for the pages of the structures 
+				  prepared for all the graphs, or -1 for the default policy
+				  of the thread creating the graphs. Ignored if interleave
+				  is enabled. Implies useArena if 0 or more. Only supported
+				  on Linux. */
+	bool validate; /**< Check every node that can be reached from the root
+				   of each graph, and every span, when the graph is 
+				   created. Creation fails with a corrupt data status if a
+				   check fails. Evaluation of a validated graph then makes
+				   no checks and raises no exceptions at each step of the
+				   walk. Implies alignNodes and decodeSpans. The graphs are
+				   validated in parallel where threading is available. */
+	bool compressNodes; /**< Compress the bit packed nodes of each graph into
+						blocks of 64 nodes when the graph is created. Each 
+						field of a node is stored as the difference from the
+						smallest in its block using as few bits as the block
+						needs, and child nodes as the distance from the node.
+						A leaf value repeated in a block is stored once. Any
+						node can be decoded directly from its block so 
+						the walk reads the compressed nodes in place of the
+						nodes collection. Use with a file collection 
+						configuration that does not load the nodes so only 
+						the compressed nodes are held in memory. The nodes of
+						a graph are only compressed if they are then smaller.
+						See fiftyoneDegreesIpiCgStats.nodesCompressedBytes 
+						for the compression achieved. Ignored if alignNodes 
+						is enabled. */
+	bool compressPaths; /**< Find the chains of two or more nodes in each 
+						graph where the walk only continues if the bits of 
+						the address are equal to a limit of each span, like
+						the single child paths of a radix trie. The walk 
+						compares the limits of the whole chain with the 
+						address at once and moves to the node at the end of
+						the chain, so fewer nodes and spans are read. 
+						Results are the same as without the option. Requires
+						4 bytes per node and 32 bytes per chain. See 
+						fiftyoneDegreesIpiCgStats.skipsCount. */
+	bool markUniform; /**< Find the nodes of each graph where every walk 
+					  from the node returns the same profile index, such as
+					  large unallocated or default regions of the address 
+					  space. The walk returns the profile index as soon as
+					  it reaches such a node rather than comparing spans 
+					  down to a leaf. Results are the same as without the 
+					  option. Requires 1.5 bits per node and 8 bytes per 
+					  marked node. See 
+					  fiftyoneDegreesIpiCgStats.uniformsCount. */
+	bool directReads; /**< For graphs created from a file, read the bytes of
+					  each fetch with a positional read of the file on the
+					  calling thread rather than through the file pool and
+					  the cache of the collection, so threads never wait
+					  for each other. Pages of 4KB are held once read until
+					  the graphs are freed, up to the capacity of the
+					  collection configuration in pages for each
+					  collection, and found without a lock. Collections
+					  the configuration loads into memory are unchanged.
+					  Only supported on Linux. */
+} fiftyoneDegreesIpiCgConfig;
+
+/**
+ * Default value for fiftyoneDegreesIpiCgConfig.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_CONFIG_DEFAULT (fiftyoneDegreesIpiCgConfig){ \
+	false, \
+	false, \
+	false, \
+	false, \
+	false, \
+	false, \
+	false, \
+	-1, \
+	false, \
+	false, \
+	false, \
+	false, \
+	false \
+}
+
 /**
  * The evaluation result from graph collection.
  */
@@ -195,10 +502,269 @@ typedef struct fiftyone_degrees_ipi_cg_result_t {
 	false \
 }
 
+/**
+ * The collections of a graph that bytes might be needed from when evaluating
+ * without blocking.
+ */
+typedef enum e_fiftyone_degrees_ipi_cg_collection {
+	FIFTYONE_DEGREES_IPI_CG_COLLECTION_NODES = 0, /**< Nodes collection */
+	FIFTYONE_DEGREES_IPI_CG_COLLECTION_SPANS = 1, /**< Spans collection */
+	FIFTYONE_DEGREES_IPI_CG_COLLECTION_SPAN_BYTES = 2, /**< Span bytes 
+													   collection */
+	FIFTYONE_DEGREES_IPI_CG_COLLECTION_CLUSTERS = 3 /**< Clusters collection */
+} fiftyoneDegreesIpiCgCollection;
+
+/**
+ * The bytes needed before a non-blocking evaluation can continue.
+ */
+typedef struct fiftyone_degrees_ipi_cg_request_t {
+	fiftyoneDegreesIpiCgCollection collection; /**< Collection of the graph the
+											   bytes are needed from */
+	uint32_t offset; /**< Offset of the first byte in the collection */
+	uint32_t length; /**< Number of bytes needed */
+	uint64_t position; /**< Position of the first byte in the data source. The
+					   start position of the collection header in the graph
+					   information plus the offset */
+} fiftyoneDegreesIpiCgRequest;
+
+/**
+ * Bytes supplied to a non-blocking evaluation.
+ */
+typedef struct fiftyone_degrees_ipi_cg_block_t {
+	fiftyoneDegreesIpiCgCollection collection; /**< Collection of the graph the
+											   bytes were read from */
+	uint32_t offset; /**< Offset of the first byte in the collection */
+	uint32_t length; /**< Number of bytes supplied */
+	uint32_t dataOffset; /**< Offset of the first byte in the data buffer of
+						 the evaluation */
+} fiftyoneDegreesIpiCgBlock;
+
 /**
  * An array of all the component graphs and collections available.
  */
-FIFTYONE_DEGREES_ARRAY_TYPE(fiftyoneDegreesIpiCg,)
+FIFTYONE_DEGREES_ARRAY_TYPE(
+	fiftyoneDegreesIpiCg,
+	fiftyoneDegreesIpiCgConfig config; /**< Options the graphs were created 
+									   with */
+	const void* snapshot; /**< Snapshot holding the prepared structures of
+						  the graphs if created from one, otherwise NULL */
+	void* arena; /**< Block of memory holding the prepared structures of the
+				 graphs if created with the useArena option, otherwise 
+				 NULL */
+	size_t arenaSize; /**< Size of the arena in bytes */
+	bool arenaMapped; /**< True if the arena was mapped from the operating
+					  system rather than allocated from the heap */)
+
+/**
+ * Version of the delta layout read by fiftyoneDegreesIpiGraphCreateFromDelta.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_FORMAT 1
+
+/**
+ * Flags for the parts of a graph changed by a delta. The nodes, spans, span
+ * bytes and clusters flags replace the collection. The profiles flag 
+ * replaces the first index and count of the profiles and profile groups.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_NODES 1
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_SPANS 2
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_SPAN_BYTES 4
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_CLUSTERS 8
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_PROFILES 16
+
+/**
+ * All the flags that replace a collection.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_DELTA_COLLECTIONS ( \
+	FIFTYONE_DEGREES_IPI_CG_DELTA_NODES | \
+	FIFTYONE_DEGREES_IPI_CG_DELTA_SPANS | \
+	FIFTYONE_DEGREES_IPI_CG_DELTA_SPAN_BYTES | \
+	FIFTYONE_DEGREES_IPI_CG_DELTA_CLUSTERS)
+
+/**
+ * Header at the start of a delta. It is followed by an entry for each graph
+ * that changed in ascending order of graph index, and then the bytes of the
+ * collections that replace those of the graphs.
+ */
+#pragma pack(push, 1)
+typedef struct fiftyone_degrees_ipi_cg_delta_header_t {
+	uint32_t format; /**< FIFTYONE_DEGREES_IPI_CG_DELTA_FORMAT */
+	uint32_t graphsCount; /**< Number of graphs in the array the delta is 
+						  applied to */
+	uint64_t checksum; /**< 64 bit FNV-1a hash of the 
+					   fiftyoneDegreesIpiCgInfo record of every graph in the
+					   array the delta is applied to */
+	uint32_t count; /**< Number of entries following the header */
+} fiftyoneDegreesIpiCgDeltaHeader;
+#pragma pack(pop)
+
+/**
+ * Entry in a delta for a graph that changed.
+ */
+#pragma pack(push, 1)
+typedef struct fiftyone_degrees_ipi_cg_delta_graph_t {
+	uint32_t index; /**< Index of the graph in the array */
+	uint32_t changed; /**< The parts of the graph that changed. See 
+					  FIFTYONE_DEGREES_IPI_CG_DELTA_NODES */
+	fiftyoneDegreesIpiCgInfo info; /**< Information for the graph. Only the
+								   parts that changed are used. Collection
+								   start positions are relative to the first
+								   byte of the delta */
+} fiftyoneDegreesIpiCgDeltaGraph;
+#pragma pack(pop)
+
+/**
+ * Copy of the graphs, and optionally the data they were created from, placed
+ * in the memory of one NUMA node. See 
+ * fiftyoneDegreesIpiGraphCreateReplicasFromMemory.
+ */
+typedef struct fiftyone_degrees_ipi_cg_replica_t {
+	fiftyoneDegreesIpiCgArray* graphs; /**< Graphs of the replica */
+	byte* data; /**< Copy of the source data placed on the node of the 
+				replica, or NULL if the source data is shared */
+	size_t dataSize; /**< Size of the data in bytes */
+	bool dataMapped; /**< True if the data was mapped from the operating
+					 system rather than allocated from the heap */
+} fiftyoneDegreesIpiCgReplica;
+
+/**
+ * An array of replicas with one for each NUMA node.
+ */
+FIFTYONE_DEGREES_ARRAY_TYPE(fiftyoneDegreesIpiCgReplica, )
+
+/**
+ * Graphs attached to a named shared memory segment published by a loader
+ * process with fiftyoneDegreesIpiGraphSegmentPublish. See 
+ * fiftyoneDegreesIpiGraphSegmentAttach.
+ *
+ * Segments use POSIX shared memory and are only available on Linux when 
+ * FIFTYONE_DEGREES_IPI_GRAPH_SEGMENTS is defined. Programs built against 
+ * versions of glibc before 2.34 must then also link with -lrt. Otherwise 
+ * the segment functions fail with the invalid config status.
+ */
+typedef struct fiftyone_degrees_ipi_cg_segment_t {
+	fiftyoneDegreesIpiCgArray* graphs; /**< Graphs to evaluate with. The 
+									   collections and prepared structures
+									   are in the segment */
+	fiftyoneDegreesMemoryReader reader; /**< Reader for the source data in 
+										the segment */
+	long generation; /**< Generation of the segment attached */
+	void* base; /**< First byte of the segment mapped read only */
+	size_t size; /**< Size of the segment mapping in bytes */
+	volatile long* current; /**< Current generation published for the name,
+							in memory shared with the loader */
+} fiftyoneDegreesIpiCgSegment;
+
+/**
+ * Options for fiftyoneDegreesIpiGraphEvaluateBulk and 
+ * fiftyoneDegreesIpiGraphEvaluateStream.
+ */
+typedef struct fiftyone_degrees_ipi_cg_bulk_config_t {
+	uint16_t threads; /**< Number of threads to evaluate with, including the
+					  calling thread, or 0 for one for each CPU */
+	uint32_t chunkSize; /**< Number of addresses a thread claims at a time, 
+						or 0 for the default. Smaller chunks balance the work
+						better, larger ones reduce contention */
+	uint32_t blockSize; /**< Number of addresses read from a stream at a 
+						time, or 0 for the default */
+	bool pinThreads; /**< Pin each thread to the CPUs of a NUMA node, 
+					 spreading the threads evenly across the nodes. Linux 
+					 only */
+	const fiftyoneDegreesIpiCgReplicaArray* replicas; /**< If not NULL each 
+													  thread evaluates with 
+													  the replica for the 
+													  node it runs on rather 
+													  than the graphs 
+													  provided */
+} fiftyoneDegreesIpiCgBulkConfig;
+
+/**
+ * Default options for bulk evaluation.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_BULK_CONFIG_DEFAULT \
+	(fiftyoneDegreesIpiCgBulkConfig){ 0, 0, 0, false, NULL }
+
+/**
+ * Reads the next addresses of a stream.
+ * @param state provided to fiftyoneDegreesIpiGraphEvaluateStream
+ * @param addresses to populate
+ * @param length maximum number of addresses to read
+ * @return number of addresses read, or 0 at the end of the stream
+ */
+typedef uint32_t(*fiftyoneDegreesIpiCgBulkRead)(
+	void* state,
+	fiftyoneDegreesIpAddress* addresses,
+	uint32_t length);
+
+/**
+ * Receives the results for the addresses last read from a stream.
+ * @param state provided to fiftyoneDegreesIpiGraphEvaluateStream
+ * @param addresses that were read
+ * @param results for each address in the same order
+ * @param count number of addresses and results
+ */
+typedef void(*fiftyoneDegreesIpiCgBulkWrite)(
+	void* state,
+	const fiftyoneDegreesIpAddress* addresses,
+	const fiftyoneDegreesIpiCgResult* results,
+	uint32_t count);
+
+/**
+ * Row of text evaluated by fiftyoneDegreesIpiGraphEvaluateText.
+ */
+typedef struct fiftyone_degrees_ipi_cg_text_row_t {
+	size_t offset; /**< Offset of the address field in the text */
+	uint32_t length; /**< Number of characters in the address field */
+	bool valid; /**< False if the field is missing or is not a valid IPv4 or
+				IPv6 address */
+	fiftyoneDegreesIpiCgResult result; /**< Result for the address, or
+									   FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT
+									   if the row is not valid */
+} fiftyoneDegreesIpiCgTextRow;
+
+/**
+ * Resolved reference returned when an address has no result.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE UINT32_MAX
+
+/**
+ * Returns the reference to store for a result when a resolved table is built
+ * by fiftyoneDegreesIpiGraphResolve. This is usually the offset of the 
+ * profile or profile group in the data set's collections, or a pointer to it 
+ * when the collection is held in memory.
+ * @param state pointer provided to fiftyoneDegreesIpiGraphResolve
+ * @param result the offset and group flag for a profile index
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return the reference for the result
+ */
+typedef uint32_t(*fiftyoneDegreesIpiCgResolver)(
+	void* state,
+	fiftyoneDegreesIpiCgResult result,
+	fiftyoneDegreesException* exception);
+
+/**
+ * State of an evaluation that returns the bytes it needs rather than blocking
+ * on a read. See fiftyoneDegreesIpiGraphEvaluationStep.
+ */
+typedef struct fiftyone_degrees_ipi_cg_evaluation_t {
+	const fiftyoneDegreesIpiCgArray* graphs; /**< Array of graphs being
+											 evaluated */
+	byte componentId; /**< The component id of the graph */
+	fiftyoneDegreesIpAddress address; /**< The IP address to evaluate */
+	fiftyoneDegreesIpiCgResult result; /**< Result once complete */
+	bool pending; /**< True if the request must be satisfied before the next
+				  step */
+	fiftyoneDegreesIpiCgRequest request; /**< The bytes needed if pending */
+	fiftyoneDegreesIpiCgBlock* blocks; /**< Blocks of bytes supplied in order
+									   of collection and offset */
+	uint32_t blocksCount; /**< Number of blocks supplied */
+	uint32_t blocksCapacity; /**< Number of blocks that can be recorded */
+	byte* data; /**< Bytes supplied for all the blocks */
+	uint32_t dataUsed; /**< Number of bytes used in data */
+	uint32_t dataCapacity; /**< Number of bytes allocated to data */
+	void* walk; /**< State of the walk between steps, or NULL if the walk has
+				not started */
+} fiftyoneDegreesIpiCgEvaluation;
 
 /**
  * Frees all the memory and resources associated with an array of graphs
@@ -206,7 +772,7 @@ FIFTYONE_DEGREES_ARRAY_TYPE(fiftyoneDegreesIpiCg,)
  * fiftyoneDegreesIpiGraphCreateFromMemory.
  * @param graphs pointer to the array to be freed
  */
-void fiftyoneDegreesIpiGraphFree(fiftyoneDegreesIpiCgArray* graphs);
+EXTERNAL void fiftyoneDegreesIpiGraphFree(fiftyoneDegreesIpiCgArray* graphs);
 
 /**
  * Creates and initializes an array of graphs for the collection where the
@@ -242,6 +808,354 @@ EXTERNAL fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFile(
 	const fiftyoneDegreesCollectionConfig config,
 	fiftyoneDegreesException* exception);
 
+/**
+ * Creates and initializes an array of graphs for the collection where the
+ * underlying data set is held in memory, applying the options provided.
+ * @param collection of fiftyoneDegreesIpiCgInfo records
+ * @param reader to the source data
+ * @param graphConfig options to apply to the graphs
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return a pointer to the newly allocated array, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromMemoryWithConfig(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Creates and initializes an array of graphs for the collection where the
+ * underlying data set is on the file system, applying the options provided.
+ * Options that decode data into memory read all the data concerned from the
+ * file during creation.
+ * @param collection of fiftyoneDegreesIpiCgInfo records
+ * @param file for to the source data
+ * @param reader pool connected to the file
+ * @param config for the collections created for each graph
+ * @param graphConfig options to apply to the graphs
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return a pointer to the newly allocated array, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFileWithConfig(
+	fiftyoneDegreesCollection* collection,
+	FILE* file,
+	fiftyoneDegreesFilePool* reader,
+	const fiftyoneDegreesCollectionConfig config,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Creates and initializes an array of graphs for the collection where the
+ * underlying data set is held in memory, using the structures prepared in a
+ * snapshot saved with fiftyoneDegreesIpiGraphSnapshotSave rather than building
+ * them again. The snapshot would typically be a memory mapped file. It is 
+ * validated against the graph information in the collection and must remain 
+ * available, unmodified, until the graphs are freed. The options the graphs 
+ * were created with when the snapshot was saved are used.
+ * @param collection of fiftyoneDegreesIpiCgInfo records
+ * @param reader to the source data
+ * @param snapshot memory containing the snapshot aligned to at least 8 bytes
+ * @param length of the snapshot in bytes
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h. The status is incorrect version if the
+ * snapshot was saved by a different version of the library or for different
+ * data.
+ * @return a pointer to the newly allocated array, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgArray* 
+fiftyoneDegreesIpiGraphCreateFromMemoryWithSnapshot(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const void* snapshot,
+	size_t length,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Creates and initializes an array of graphs for the collection where the
+ * underlying data set is on the file system, using the structures prepared in
+ * a snapshot. See fiftyoneDegreesIpiGraphCreateFromMemoryWithSnapshot.
+ * @param collection of fiftyoneDegreesIpiCgInfo records
+ * @param file for to the source data
+ * @param reader pool connected to the file
+ * @param config for the collections created for each graph
+ * @param snapshot memory containing the snapshot aligned to at least 8 bytes
+ * @param length of the snapshot in bytes
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return a pointer to the newly allocated array, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgArray* 
+fiftyoneDegreesIpiGraphCreateFromFileWithSnapshot(
+	fiftyoneDegreesCollection* collection,
+	FILE* file,
+	fiftyoneDegreesFilePool* reader,
+	const fiftyoneDegreesCollectionConfig config,
+	const void* snapshot,
+	size_t length,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Writes the structures prepared when the graphs were created to the file as
+ * a snapshot. The snapshot can only be used with the same data and the same
+ * build of the library. Structures are aligned to cache lines relative to the
+ * start of the snapshot so it should be loaded at an aligned address such as
+ * the start of a memory mapped file.
+ * @param graphs array to save the prepared structures of
+ * @param file to write the snapshot to at the current position
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphSnapshotSave(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	FILE* file,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Creates an array of graphs from an existing array and a delta holding only
+ * the parts of the graphs that changed. The collections and prepared 
+ * structures of the existing array that are not changed by the delta are 
+ * shared with the new array rather than created again, so the time and memory
+ * needed scale with the size of the change. Shared memory is reference 
+ * counted and both arrays can be freed in any order with 
+ * fiftyoneDegreesIpiGraphFree. The existing array is not modified and can be
+ * evaluated while the new array is created. Prepared structures are created
+ * for the graphs with changed collections using the options of the existing
+ * array. Resolved tables are not copied and must be created again with
+ * fiftyoneDegreesIpiGraphResolve if needed.
+ *
+ * The collections that the delta does not change still read from the source
+ * of the existing array, either the memory the data set was loaded into or 
+ * the file and file pool it was opened with. That source is not owned or 
+ * reference counted by the graphs. It must remain available, unmodified, 
+ * until every array created from it, directly or through any number of 
+ * deltas, has been freed. Freeing the existing array does not release the 
+ * source, and releasing the source while a derived array is in use leaves 
+ * that array reading freed memory or a closed file.
+ * @param graphs existing array the delta is applied to
+ * @param delta memory containing the delta which must remain available, 
+ * unmodified, until the new array and any created from it are freed
+ * @param length of the delta in bytes
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h. The status is incorrect version if the
+ * delta is for a different array.
+ * @return a pointer to the newly allocated array, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromDelta(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	void* delta,
+	size_t length,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Creates a replica of the graphs for each NUMA node of the machine where the
+ * underlying data set is held in memory. The source data and the structures
+ * prepared for each replica are copied into memory preferred on the node of 
+ * the replica, so a thread evaluating with the replica for its own node never
+ * reads memory from a remote node. The numaNode option is set for each 
+ * replica and the interleave option is ignored. If the machine has a single
+ * node, or is not Linux, a single replica is created which uses the source 
+ * data directly.
+ * @param collection of fiftyoneDegreesIpiCgInfo records
+ * @param reader to the source data
+ * @param graphConfig options to apply to the graphs of every replica
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return a pointer to the newly allocated array, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgReplicaArray* 
+fiftyoneDegreesIpiGraphCreateReplicasFromMemory(
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Gets the graphs of the replica for the NUMA node of the CPU the calling 
+ * thread is running on. Threads should be bound to a node for the result to
+ * remain local.
+ * @param replicas created with 
+ * fiftyoneDegreesIpiGraphCreateReplicasFromMemory
+ * @return graphs to evaluate with
+ */
+EXTERNAL const fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphReplicasGet(
+	const fiftyoneDegreesIpiCgReplicaArray* replicas);
+
+/**
+ * Frees the replicas, their graphs and any copies of the source data.
+ * @param replicas to free
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphReplicasFree(
+	fiftyoneDegreesIpiCgReplicaArray* replicas);
+
+/**
+ * Publishes a new generation of the graphs for the collection, where the 
+ * underlying data set is held in memory, to the named shared memory segment
+ * so that other processes can evaluate with a single copy of the data. The
+ * graphs are created with the options provided and the source data, the
+ * graph information and the prepared structures are copied into a new 
+ * segment for the generation. Once the segment is complete the current 
+ * generation of the name is changed in a single atomic operation and the 
+ * segment of the previous generation is removed. Processes that attached to
+ * the previous generation keep it until they free it. Only one process
+ * should publish to a name. See fiftyoneDegreesIpiCgSegment for the
+ * platforms supported.
+ * @param name of the segment starting with a forward slash and containing
+ * no other forward slashes
+ * @param collection of fiftyoneDegreesIpiCgInfo records
+ * @param reader to the source data
+ * @param graphConfig options to create the graphs with
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return the generation published, or 0 if the operation was not successful
+ */
+EXTERNAL long fiftyoneDegreesIpiGraphSegmentPublish(
+	const char* name,
+	fiftyoneDegreesCollection* collection,
+	fiftyoneDegreesMemoryReader* reader,
+	const fiftyoneDegreesIpiCgConfig* graphConfig,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Attaches to the current generation of the named shared memory segment
+ * published with fiftyoneDegreesIpiGraphSegmentPublish. The segment is
+ * mapped read only and the graphs use the data and prepared structures in
+ * the segment without copying them, so the memory used by each process is
+ * small and constant. The graphs are evaluated in the same way as any other
+ * graphs, for example with fiftyoneDegreesIpiGraphEvaluate. See 
+ * fiftyoneDegreesIpiCgSegment for the platforms supported.
+ * @param name of the segment used to publish the graphs
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h. The status is file not found if 
+ * nothing has been published to the name.
+ * @return a pointer to the newly allocated segment, or null if the operation
+ * was not successful.
+ */
+EXTERNAL fiftyoneDegreesIpiCgSegment* fiftyoneDegreesIpiGraphSegmentAttach(
+	const char* name,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Determines if the segment is still the current generation. The check is a
+ * single read of shared memory so it can be made before every evaluation. 
+ * When false a new segment should be attached, swapped for the existing one
+ * once attached, and the existing one freed once it is no longer being used.
+ * @param segment attached with fiftyoneDegreesIpiGraphSegmentAttach
+ * @return true if no newer generation has been published
+ */
+EXTERNAL bool fiftyoneDegreesIpiGraphSegmentIsCurrent(
+	const fiftyoneDegreesIpiCgSegment* segment);
+
+/**
+ * Frees the graphs of the segment and removes the mappings from the process.
+ * The segment itself remains available to other processes.
+ * @param segment to free
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphSegmentFree(
+	fiftyoneDegreesIpiCgSegment* segment);
+
+/**
+ * Removes the current generation of the named shared memory segment and the
+ * name so that the memory is released once every process has freed its 
+ * segment. See fiftyoneDegreesIpiCgSegment for the platforms supported.
+ * @param name of the segment used to publish the graphs
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphSegmentRemove(
+	const char* name,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Number of entries in fiftyoneDegreesIpiCgStats.spanLengths. One for each
+ * bit length of a span limit from 0 to 128.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_STATS_SPAN_LENGTHS 129
+
+/**
+ * Structure and memory footprint of a graph. See
+ * fiftyoneDegreesIpiGraphGetStats.
+ */
+typedef struct fiftyone_degrees_ipi_cg_stats_t {
+	byte version; /**< IP version of the graph (4 or 6) */
+	byte componentId; /**< Component the graph relates to */
+	uint32_t nodesCount; /**< Number of nodes in the nodes collection */
+	uint16_t recordSize; /**< Number of bits in each node record */
+	uint32_t nodesReachable; /**< Number of nodes the walk can reach from the
+							 root */
+	uint32_t nodesLeaf; /**< Number of reachable nodes with a value that is
+						a profile or group rather than another node */
+	uint64_t nodesBytes; /**< Bytes of the nodes collection */
+	uint64_t nodesCompressedBytes; /**< Bytes of the compressed nodes, or 0
+								   if the graph was not created with 
+								   compressNodes */
+	uint64_t spansBytes; /**< Bytes of the spans collection */
+	uint64_t spanBytesBytes; /**< Bytes of the span bytes collection */
+	uint64_t clustersBytes; /**< Bytes of the clusters collection */
+	uint64_t preparedBytes; /**< Bytes used in addition to the collections.
+							See fiftyoneDegreesIpiGraphGetMemoryOverhead */
+	uint32_t spansCount; /**< Number of spans */
+	uint32_t spansInline; /**< Number of spans with limits held in the span
+						  record */
+	uint32_t spansInBytes; /**< Number of spans with limits held in the span
+						   bytes collection */
+	uint32_t spanLengths[FIFTYONE_DEGREES_IPI_CG_STATS_SPAN_LENGTHS]; /**<
+						   Number of span limits of each bit length, with
+						   the low and high limit of every span counted */
+	uint32_t clustersCount; /**< Number of clusters */
+	uint32_t clusterCapacity; /**< Number of span indexes each cluster
+							  record can hold */
+	uint32_t clusterNodesMin; /**< Fewest nodes covered by a cluster */
+	uint32_t clusterNodesMax; /**< Most nodes covered by a cluster */
+	double clusterNodesAverage; /**< Average nodes covered by a cluster */
+	uint32_t depthMin; /**< Fewest nodes visited by a walk from the root to
+					   a leaf */
+	uint32_t depthMax; /**< Most nodes visited by a walk from the root to a
+					   leaf */
+	double depthAverage; /**< Average nodes visited over every distinct walk
+						 from the root to a leaf */
+	uint32_t skipsCount; /**< Chains of nodes the walk can skip, or 0 if the
+						 graph was not created with compressPaths */
+	uint32_t uniformsCount; /**< Nodes where every walk returns the same 
+							profile index, or 0 if the graph was not created
+							with markUniform */
+} fiftyoneDegreesIpiCgStats;
+
+/**
+ * Sets the statistics for the structure and memory footprint of the graph.
+ * Every node is decoded and every span read so the time taken is 
+ * proportional to the size of the graph. Intended for capacity planning and
+ * choosing the options of fiftyoneDegreesIpiCgConfig for each component, not
+ * for use while evaluating.
+ * @param graph to return the statistics for
+ * @param stats set to the statistics of the graph
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h. The status is corrupt data if a walk
+ * could leave the graph or visit a node twice.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphGetStats(
+	const fiftyoneDegreesIpiCg* graph,
+	fiftyoneDegreesIpiCgStats* stats,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Returns the number of bytes of memory used by the graph in addition to its
+ * collections. This includes the cluster ranges and any data created by the 
+ * options of fiftyoneDegreesIpiCgConfig and can be used to judge whether an
+ * option is worth its memory for each component.
+ * @param graph to return the overhead for
+ * @return number of bytes allocated for the graph outside its collections
+ */
+EXTERNAL size_t fiftyoneDegreesIpiGraphGetMemoryOverhead(
+	const fiftyoneDegreesIpiCg* graph);
+
 /**
  * Obtains the profile index for the IP address and component id provided.
  * @param graphs array for each component id and IP version
@@ -249,7 +1163,10 @@ EXTERNAL fiftyoneDegreesIpiCgArray* fiftyoneDegreesIpiGraphCreateFromFile(
  * @param address IP address to return a profile index for
  * @param exception pointer to an exception data structure to be used if an
  * exception occurs. See exceptions.h.
- * @return the index of the profile (or group) associated with the IP address.
+ * @return the index of the profile (or group) associated with the IP address,
+ * or FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT if the walk does not reach a 
+ * leaf. A walk of an IPv4 address that does not reach a leaf after its 32 
+ * bits continues with zero bits.
  */
 EXTERNAL fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluate(
 	const fiftyoneDegreesIpiCgArray* graphs,
@@ -278,6 +1195,371 @@ EXTERNAL fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluateTrace(
 	int const length,
 	fiftyoneDegreesException* exception);
 
+/**
+ * Obtains the profile index for each of the IP addresses provided. The 
+ * addresses are evaluated together in chunks so that the nodes and spans
+ * shared by the paths of several addresses are fetched and compared once for
+ * all of them, with the comparisons vectorised where the CPU supports it. The
+ * results are the same as calling fiftyoneDegreesIpiGraphEvaluate for each
+ * address. If an exception occurs the remaining results are left as
+ * FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT.
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param addresses IP addresses to return profile indexes for
+ * @param results populated with the result for each address
+ * @param count number of addresses and results
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluateBatch(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	const fiftyoneDegreesIpAddress* addresses,
+	fiftyoneDegreesIpiCgResult* results,
+	uint32_t count,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Obtains the profile index for each of the IP addresses provided using 
+ * several threads. The addresses are divided into chunks which are evaluated 
+ * with fiftyoneDegreesIpiGraphEvaluateBatch. Each thread starts with its own
+ * range of chunks and then takes the chunks left in the ranges of the other 
+ * threads, so the work stays balanced when some addresses are slower to 
+ * evaluate than others. The results are in the same order as the addresses.
+ * The graphs are shared by all the threads. If an exception occurs the 
+ * results not yet evaluated are left as FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT
+ * and the exception of the first failure is returned. When compiled with
+ * FIFTYONE_DEGREES_NO_THREADING only the calling thread is used.
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param addresses IP addresses to return profile indexes for
+ * @param results populated with the result for each address
+ * @param count number of addresses and results
+ * @param config options for the evaluation, or NULL for the defaults
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluateBulk(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	const fiftyoneDegreesIpAddress* addresses,
+	fiftyoneDegreesIpiCgResult* results,
+	size_t count,
+	const fiftyoneDegreesIpiCgBulkConfig* config,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Obtains the profile index for every IP address of a stream. Blocks of
+ * addresses are read with the read function, evaluated with
+ * fiftyoneDegreesIpiGraphEvaluateBulk and passed to the write function with
+ * their results until the read function returns 0 or an exception occurs.
+ * Only blocks that were evaluated without an exception are passed to the 
+ * write function, so the block that failed and any after it are never 
+ * written.
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param read function returning the next block of addresses
+ * @param write function receiving each block of addresses with its results
+ * @param state passed to the read and write functions
+ * @param config options for the evaluation, or NULL for the defaults
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluateStream(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	fiftyoneDegreesIpiCgBulkRead read,
+	fiftyoneDegreesIpiCgBulkWrite write,
+	void* state,
+	const fiftyoneDegreesIpiCgBulkConfig* config,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Obtains the profile index for the IP address in each line of the text.
+ * Lines are separated by new lines and empty lines are ignored. If a 
+ * delimiter is provided the address is taken from the field of the line with
+ * the index provided, otherwise the whole line is used. White space around 
+ * the address is ignored, as is the zone of an IPv6 address. The addresses are
+ * parsed directly from the text and evaluated in chunks with 
+ * fiftyoneDegreesIpiGraphEvaluateBatch. A row that does not contain a valid 
+ * address is marked as not valid and does not stop the evaluation of the 
+ * others. Evaluation stops when the rows are full, or at the start of a last
+ * line that is not terminated by a new line unless final is true. The 
+ * consumed bytes can then be discarded and the remaining text provided again
+ * with more data appended. If an exception occurs the rows not yet evaluated
+ * have the default result.
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param text containing the lines to evaluate
+ * @param length of the text in bytes
+ * @param delimiter separating the fields of a line, or '\0' if the whole 
+ * line is the address
+ * @param field index of the field containing the address
+ * @param final true if the text is the end of the input and a last line 
+ * without a new line should be evaluated
+ * @param rows populated with the address and result of each line
+ * @param capacity maximum number of rows to populate
+ * @param consumed set to the number of bytes of text used, or NULL if not 
+ * needed
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return number of rows populated
+ */
+EXTERNAL size_t fiftyoneDegreesIpiGraphEvaluateText(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	const char* text,
+	size_t length,
+	char delimiter,
+	uint16_t field,
+	bool final,
+	fiftyoneDegreesIpiCgTextRow* rows,
+	size_t capacity,
+	size_t* consumed,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Builds a table for each graph that maps the profile index at a leaf 
+ * directly to the reference returned by the resolver, so that 
+ * fiftyoneDegreesIpiGraphEvaluateResolved can return it without mapping the
+ * profile index to an offset and the offset to a profile. Any existing tables
+ * are only replaced if the tables for every graph are built.
+ *
+ * The existing tables are freed when they are replaced and the graphs are not
+ * locked. This method must therefore only be called when no other thread is 
+ * evaluating or resolving the graphs, typically once after they are created.
+ * @param graphs array for each component id and IP version
+ * @param resolver called once for each profile index of each graph
+ * @param state passed to the resolver
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphResolve(
+	fiftyoneDegreesIpiCgArray* graphs,
+	fiftyoneDegreesIpiCgResolver resolver,
+	void* state,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Obtains the resolved reference for the IP address and component id. The 
+ * graph must have been resolved with fiftyoneDegreesIpiGraphResolve.
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param address IP address to return a reference for
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return the reference for the address, or 
+ * FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE if there is no graph for the address
+ */
+EXTERNAL uint32_t fiftyoneDegreesIpiGraphEvaluateResolved(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Obtains the resolved reference for each of the IP addresses using 
+ * fiftyoneDegreesIpiGraphEvaluateBatch. If an exception occurs the references
+ * not yet obtained are FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE.
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param addresses IP addresses to return references for
+ * @param resolved populated with the reference for each address
+ * @param count number of addresses
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluateResolvedBatch(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	const fiftyoneDegreesIpAddress* addresses,
+	uint32_t* resolved,
+	uint32_t count,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Called when a verifier finds that the result of an evaluation differs from
+ * the result of the reference walk.
+ * @param state pointer provided in the verifier configuration
+ * @param componentId of the evaluation
+ * @param address evaluated
+ * @param result returned by the evaluation
+ * @param reference result of the reference walk
+ */
+typedef void(*fiftyoneDegreesIpiCgVerifyMismatch)(
+	void* state,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
+	fiftyoneDegreesIpiCgResult result,
+	fiftyoneDegreesIpiCgResult reference);
+
+/**
+ * Options for fiftyoneDegreesIpiGraphVerifierCreate.
+ */
+typedef struct fiftyone_degrees_ipi_cg_verify_config_t {
+	uint32_t sampleRate; /**< One in this many evaluations is verified, or 0
+						 for 1000 */
+	uint32_t queueSize; /**< Maximum number of samples waiting to be 
+						verified, or 0 for 1024. Samples are dropped when the
+						queue is full so evaluation never waits */
+	fiftyoneDegreesIpiCgVerifyMismatch mismatch; /**< Called for each 
+												 mismatch on the thread 
+												 verifying the samples, or
+												 NULL */
+	void* state; /**< Passed to the mismatch callback */
+} fiftyoneDegreesIpiCgVerifyConfig;
+
+/**
+ * Default value for fiftyoneDegreesIpiCgVerifyConfig.
+ */
+#define FIFTYONE_DEGREES_IPI_CG_VERIFY_CONFIG_DEFAULT \
+	(fiftyoneDegreesIpiCgVerifyConfig){ 0, 0, NULL, NULL }
+
+/**
+ * Samples evaluations of graphs created with options that make evaluation 
+ * faster, such as alignNodes, decodeSpans or validate, and verifies them 
+ * with the reference walk over the collections on a background thread. The 
+ * counters can be read at any time.
+ */
+typedef struct fiftyone_degrees_ipi_cg_verifier_t {
+	const fiftyoneDegreesIpiCgArray* graphs; /**< Graphs being evaluated */
+	fiftyoneDegreesIpiCgVerifyConfig config; /**< Options the verifier was
+											 created with */
+	volatile int64_t evaluations; /**< Number of addresses evaluated */
+	volatile int64_t sampled; /**< Number of evaluations sampled */
+	volatile int64_t verified; /**< Number of samples verified */
+	volatile int64_t mismatches; /**< Number of samples that differed from 
+								 the reference walk */
+	volatile int64_t dropped; /**< Number of samples dropped because the 
+							  queue was full */
+	volatile long disabled; /**< Non-zero once a mismatch has been found. 
+							All later evaluations use the reference walk */
+} fiftyoneDegreesIpiCgVerifier;
+
+/**
+ * Creates a verifier for the graphs and starts the thread that verifies the
+ * samples. Where threading is not available samples are verified when they 
+ * are taken. The verifier must be freed before the graphs.
+ * @param graphs array for each component id and IP version
+ * @param config options for the verifier
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return the verifier, or NULL if it could not be created
+ */
+EXTERNAL fiftyoneDegreesIpiCgVerifier* fiftyoneDegreesIpiGraphVerifierCreate(
+	const fiftyoneDegreesIpiCgArray* graphs,
+	const fiftyoneDegreesIpiCgVerifyConfig* config,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Stops the thread of the verifier once the samples waiting have been 
+ * verified and frees the verifier.
+ * @param verifier to free
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphVerifierFree(
+	fiftyoneDegreesIpiCgVerifier* verifier);
+
+/**
+ * Obtains the profile index for the IP address and component id as 
+ * fiftyoneDegreesIpiGraphEvaluate does, sampling the evaluation for 
+ * verification. Once the verifier is disabled the reference walk is used.
+ * @param verifier of the graphs
+ * @param componentId of the index required
+ * @param address IP address to return a profile index for
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return the result for the address
+ */
+EXTERNAL fiftyoneDegreesIpiCgResult fiftyoneDegreesIpiGraphEvaluateVerified(
+	fiftyoneDegreesIpiCgVerifier* verifier,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Obtains the profile index for each of the IP addresses as 
+ * fiftyoneDegreesIpiGraphEvaluateBatch does, sampling the evaluations for 
+ * verification. Once the verifier is disabled the reference walk is used.
+ * @param verifier of the graphs
+ * @param componentId of the index required
+ * @param addresses IP addresses to return profile indexes for
+ * @param results populated with the result for each address
+ * @param count number of addresses
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluateVerifiedBatch(
+	fiftyoneDegreesIpiCgVerifier* verifier,
+	byte componentId,
+	const fiftyoneDegreesIpAddress* addresses,
+	fiftyoneDegreesIpiCgResult* results,
+	uint32_t count,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Initialises an evaluation that can be stepped without blocking on reads from
+ * the data source. No memory is allocated until the first step.
+ * @param evaluation to initialise
+ * @param graphs array for each component id and IP version
+ * @param componentId of the index required
+ * @param address IP address to return a profile index for
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluationInit(
+	fiftyoneDegreesIpiCgEvaluation* evaluation,
+	const fiftyoneDegreesIpiCgArray* graphs,
+	byte componentId,
+	fiftyoneDegreesIpAddress address);
+
+/**
+ * Advances the evaluation using only the bytes supplied so far. If more bytes
+ * are needed false is returned and the request of the evaluation contains the
+ * collection, offset and length of the bytes that must be read and passed to
+ * fiftyoneDegreesIpiGraphEvaluationSupply before stepping again. The read can
+ * be performed by any means, for example io_uring, allowing an event loop to 
+ * run many evaluations without a thread per blocking read. When true is
+ * returned the result of the evaluation is complete.
+ * 
+ * The position of the walk is kept between steps so each step resumes from
+ * the node that needed the bytes. The first step allocates the state of the
+ * walk which is freed when the evaluation completes or is released.
+ * @param evaluation to advance
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ * @return true if the evaluation is complete, false if bytes are needed
+ */
+EXTERNAL bool fiftyoneDegreesIpiGraphEvaluationStep(
+	fiftyoneDegreesIpiCgEvaluation* evaluation,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Supplies the bytes for the pending request of the evaluation. More bytes
+ * than requested can be supplied, for example a whole page read from an 
+ * aligned position before the request, and will be used to satisfy later 
+ * requests for the same collection that fall within them.
+ * @param evaluation the request relates to
+ * @param offset in the collection of the request of the first byte of the 
+ * data. Must not be after the offset of the request, and the data must not
+ * include bytes before the start of the collection
+ * @param data bytes read from the offset
+ * @param length of the data which must reach at least the end of the request
+ * @param exception pointer to an exception data structure to be used if an
+ * exception occurs. See exceptions.h.
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluationSupply(
+	fiftyoneDegreesIpiCgEvaluation* evaluation,
+	uint32_t offset,
+	const byte* data,
+	uint32_t length,
+	fiftyoneDegreesException* exception);
+
+/**
+ * Frees the bytes supplied to the evaluation. The evaluation can be 
+ * initialised again and reused.
+ * @param evaluation to release
+ */
+EXTERNAL void fiftyoneDegreesIpiGraphEvaluationRelease(
+	fiftyoneDegreesIpiCgEvaluation* evaluation);
+
 /**
  * @}
  */
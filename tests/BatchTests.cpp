@@ -0,0 +1,166 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Checks that a batch evaluation, which compares the addresses of a group
+ * with a span using the widest vector instructions the CPU supports, returns
+ * the same results as evaluating each address on its own with the scalar
+ * compare. Batches of every size up to twice the widest vector, and starting
+ * at every offset in the addresses, cover the lanes left over for the
+ * scalar compare after the last full vector.
+ */
+class BatchTest : public ::testing::Test {
+protected:
+	/**
+	 * Largest batch size tested for the lanes left over. Two full vectors
+	 * of 8 lanes and one more.
+	 */
+	static const uint32_t maxCount = 17;
+
+	BatchTest() : data(5, 256, 4) {}
+
+	/**
+	 * Returns addresses for the graphs given in turn.
+	 */
+	std::vector<fiftyoneDegreesIpAddress> getAddresses(
+		std::vector<uint32_t> graphs,
+		uint32_t count) {
+		std::vector<fiftyoneDegreesIpAddress> addresses;
+		for (uint32_t i = 0; i < count; i++) {
+			addresses.push_back(data.nextAddress(graphs[i % graphs.size()]));
+		}
+		return addresses;
+	}
+
+	void expectSameResults(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		byte componentId,
+		const fiftyoneDegreesIpAddress* addresses,
+		uint32_t count) {
+		std::vector<fiftyoneDegreesIpiCgResult> results(count);
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateBatch(
+			graphs,
+			componentId,
+			addresses,
+			results.data(),
+			count,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		for (uint32_t i = 0; i < count; i++) {
+			const fiftyoneDegreesIpiCgResult expected =
+				fiftyoneDegreesIpiGraphEvaluate(
+					graphs,
+					componentId,
+					addresses[i],
+					&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			ASSERT_EQ(expected.rawOffset, results[i].rawOffset) <<
+				"address " << i << " of " << count;
+			ASSERT_EQ(expected.offset, results[i].offset);
+			ASSERT_EQ(expected.isGroupOffset, results[i].isGroupOffset);
+		}
+	}
+
+	/**
+	 * Evaluates batches of every size up to maxCount from every offset, and
+	 * a batch that spans several chunks.
+	 */
+	void expectSameResults(
+		const fiftyoneDegreesIpiCgConfig& config,
+		byte componentId,
+		std::vector<uint32_t> graphIndexes) {
+		IpiGraph graphs = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader(),
+			config);
+		const std::vector<fiftyoneDegreesIpAddress> addresses =
+			getAddresses(graphIndexes, 1003);
+		for (uint32_t offset = 0; offset < maxCount; offset++) {
+			for (uint32_t count = 1; count <= maxCount; count++) {
+				expectSameResults(
+					graphs.get(),
+					componentId,
+					addresses.data() + offset,
+					count);
+			}
+		}
+		expectSameResults(
+			graphs.get(),
+			componentId,
+			addresses.data(),
+			(uint32_t)addresses.size());
+	}
+
+	/**
+	 * Options that change how the span of each group is read.
+	 */
+	static std::vector<fiftyoneDegreesIpiCgConfig> getConfigs() {
+		std::vector<fiftyoneDegreesIpiCgConfig> configs;
+		configs.push_back(IpiGraph::defaultConfig());
+		fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+		configs.push_back(config);
+		config = IpiGraph::defaultConfig();
+		config.compressNodes = true;
+		config.compressPaths = true;
+		config.markUniform = true;
+		configs.push_back(config);
+		return configs;
+	}
+
+	GraphTestData data;
+};
+
+TEST_F(BatchTest, Ipv4) {
+	for (const fiftyoneDegreesIpiCgConfig& config : getConfigs()) {
+		expectSameResults(config, 1, { 0 });
+		expectSameResults(config, 2, { 3 });
+	}
+}
+
+TEST_F(BatchTest, Ipv6) {
+	for (const fiftyoneDegreesIpiCgConfig& config : getConfigs()) {
+		expectSameResults(config, 1, { 1 });
+		expectSameResults(config, 3, { 4 });
+	}
+}
+
+TEST_F(BatchTest, Mixed) {
+	for (const fiftyoneDegreesIpiCgConfig& config : getConfigs()) {
+		expectSameResults(config, 1, { 0, 1, 1 });
+		expectSameResults(config, 2, { 2, 3 });
+	}
+}
@@ -0,0 +1,184 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <cstring>
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Stream of addresses read in blocks that are shorter than the length
+ * requested, with the blocks written collected in order.
+ */
+struct BulkStream {
+	const std::vector<fiftyoneDegreesIpAddress>* addresses;
+	size_t position;
+	uint32_t reads;
+	std::vector<fiftyoneDegreesIpAddress> written;
+	std::vector<fiftyoneDegreesIpiCgResult> results;
+};
+
+static uint32_t bulkRead(
+	void* state,
+	fiftyoneDegreesIpAddress* addresses,
+	uint32_t length) {
+	BulkStream* const stream = (BulkStream*)state;
+	const size_t remaining = stream->addresses->size() - stream->position;
+
+	// Return between one and all of the addresses requested.
+	uint32_t count = 1 + (stream->reads++ * 7919) % length;
+	if (count > remaining) {
+		count = (uint32_t)remaining;
+	}
+	memcpy(
+		addresses,
+		stream->addresses->data() + stream->position,
+		count * sizeof(fiftyoneDegreesIpAddress));
+	stream->position += count;
+	return count;
+}
+
+static void bulkWrite(
+	void* state,
+	const fiftyoneDegreesIpAddress* addresses,
+	const fiftyoneDegreesIpiCgResult* results,
+	uint32_t count) {
+	BulkStream* const stream = (BulkStream*)state;
+	stream->written.insert(stream->written.end(), addresses, addresses + count);
+	stream->results.insert(stream->results.end(), results, results + count);
+}
+
+/**
+ * Checks bulk and stream evaluation with several threads return the same
+ * results, in the same order, as evaluating each address on its own.
+ */
+class BulkTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses, which is not a multiple of any chunk size.
+	 */
+	static const uint32_t addressesCount = 10007;
+
+	BulkTest() : data(25, 256, 0) {}
+
+	void SetUp() override {
+		graphs = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader());
+		for (uint32_t i = 0; i < addressesCount; i++) {
+			addresses.push_back(data.nextAddress(i % 2));
+			fiftyoneDegreesException exception;
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			expected.push_back(fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				1,
+				addresses.back(),
+				&exception));
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		}
+	}
+
+	void expectSameResults(
+		const std::vector<fiftyoneDegreesIpiCgResult>& results,
+		const char* name,
+		const fiftyoneDegreesIpiCgBulkConfig& config) {
+		ASSERT_EQ(expected.size(), results.size());
+		for (size_t i = 0; i < expected.size(); i++) {
+			ASSERT_EQ(expected[i].rawOffset, results[i].rawOffset) << name <<
+				" threads " << config.threads << " chunk " << 
+				config.chunkSize << " address " << i;
+			ASSERT_EQ(expected[i].offset, results[i].offset);
+			ASSERT_EQ(expected[i].isGroupOffset, results[i].isGroupOffset);
+		}
+	}
+
+	/**
+	 * Options for each number of threads and chunk size tested.
+	 */
+	static std::vector<fiftyoneDegreesIpiCgBulkConfig> getConfigs() {
+		std::vector<fiftyoneDegreesIpiCgBulkConfig> configs;
+		for (uint16_t threads : { 1, 2, 3, 8 }) {
+			for (uint32_t chunkSize : { 0u, 1u, 100u, 4096u, 20000u }) {
+				fiftyoneDegreesIpiCgBulkConfig config = {};
+				config.threads = threads;
+				config.chunkSize = chunkSize;
+				configs.push_back(config);
+			}
+		}
+		return configs;
+	}
+
+	GraphTestData data;
+	IpiGraph graphs;
+	std::vector<fiftyoneDegreesIpAddress> addresses;
+	std::vector<fiftyoneDegreesIpiCgResult> expected;
+};
+
+TEST_F(BulkTest, Bulk) {
+	for (const fiftyoneDegreesIpiCgBulkConfig& config : getConfigs()) {
+		std::vector<fiftyoneDegreesIpiCgResult> results(addresses.size());
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateBulk(
+			graphs.get(),
+			1,
+			addresses.data(),
+			results.data(),
+			addresses.size(),
+			&config,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		expectSameResults(results, "bulk", config);
+	}
+}
+
+TEST_F(BulkTest, Stream) {
+	for (fiftyoneDegreesIpiCgBulkConfig config : getConfigs()) {
+		config.blockSize = 1000;
+		BulkStream stream = { &addresses, 0, 0, {}, {} };
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateStream(
+			graphs.get(),
+			1,
+			bulkRead,
+			bulkWrite,
+			&stream,
+			&config,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		EXPECT_LT(addresses.size() / config.blockSize, stream.reads);
+		ASSERT_EQ(addresses.size(), stream.written.size());
+		EXPECT_EQ(0, memcmp(
+			addresses.data(),
+			stream.written.data(),
+			addresses.size() * sizeof(fiftyoneDegreesIpAddress)));
+		expectSameResults(stream.results, "stream", config);
+	}
+}
@@ -0,0 +1,263 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "FileGraphs.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Checks that many threads evaluating the same graphs at the same time get
+ * the same results as one thread, for graphs in memory, graphs read from a
+ * file through the pool with and without a cache, and graphs read from a
+ * file with direct reads holding none, some or all of the pages.
+ */
+class ConcurrencyTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses evaluated by each thread.
+	 */
+	static const uint32_t addressesCount = 2000;
+
+	/**
+	 * Number of threads evaluating at the same time, more than the readers
+	 * in the pool so some threads wait for a reader.
+	 */
+	static const uint32_t threadsCount = 8;
+
+	/**
+	 * Number of times each thread evaluates the addresses when measuring
+	 * the throughput.
+	 */
+	static const uint32_t scalingPasses = 50;
+
+	ConcurrencyTest() : data(7, 256, 0) {}
+
+	void SetUp() override {
+		addresses = data.nextAddresses(addressesCount);
+		fileName = ::testing::TempDir() + "ConcurrencyTests.dat";
+		ASSERT_TRUE(data.save(fileName));
+	}
+
+	void TearDown() override {
+		remove(fileName.c_str());
+	}
+
+	/**
+	 * Evaluates every address, starting at the one given so that threads
+	 * are on different parts of the graphs at the same time.
+	 * @return result for each address in address order, or the raw offset
+	 * set to the status code if the evaluation failed
+	 */
+	std::vector<fiftyoneDegreesIpiCgResult> evaluate(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		uint32_t start) const {
+		std::vector<fiftyoneDegreesIpiCgResult> results(addresses.size());
+		for (uint32_t i = 0; i < addresses.size(); i++) {
+			const uint32_t index = (start + i) % addresses.size();
+			fiftyoneDegreesException exception;
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			results[index] = fiftyoneDegreesIpiGraphEvaluate(
+				graphs,
+				addresses[index].first,
+				addresses[index].second,
+				&exception);
+			if (exception.status != FIFTYONE_DEGREES_STATUS_NOT_SET) {
+				results[index].rawOffset = (uint32_t)exception.status;
+			}
+		}
+		return results;
+	}
+
+	/**
+	 * Evaluates every address on each of the threads at the same time and
+	 * checks each thread gets the same results as the expected.
+	 */
+	void expectSameResults(
+		const std::vector<fiftyoneDegreesIpiCgResult>& expected,
+		const fiftyoneDegreesIpiCgArray* graphs) {
+		std::vector<std::vector<fiftyoneDegreesIpiCgResult>> actual(
+			threadsCount);
+		std::vector<std::thread> threads;
+		for (uint32_t t = 0; t < threadsCount; t++) {
+			threads.emplace_back([this, &actual, graphs, t]() {
+				actual[t] = evaluate(
+					graphs,
+					t * (uint32_t)addresses.size() / threadsCount);
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		for (uint32_t t = 0; t < threadsCount; t++) {
+			for (uint32_t i = 0; i < expected.size(); i++) {
+				ASSERT_EQ(expected[i].rawOffset, actual[t][i].rawOffset) <<
+					"thread " << t << " address " << i;
+				ASSERT_EQ(expected[i].offset, actual[t][i].offset);
+				ASSERT_EQ(
+					expected[i].isGroupOffset,
+					actual[t][i].isGroupOffset);
+			}
+		}
+	}
+
+	/**
+	 * Evaluates the addresses on each number of threads from one to the
+	 * number of CPUs, at most 32, and prints the throughput and the speed up
+	 * over one thread.
+	 * @param name of the graphs printed with the results
+	 * @param graphs to evaluate
+	 */
+	void measureScaling(
+		const char* name,
+		const fiftyoneDegreesIpiCgArray* graphs) {
+		const uint32_t maxThreads = std::min(
+			32u,
+			std::max(1u, std::thread::hardware_concurrency()));
+		double single = 0;
+		for (uint32_t count = 1; count <= maxThreads; count *= 2) {
+			const auto start = std::chrono::steady_clock::now();
+			std::vector<std::thread> threads;
+			for (uint32_t t = 0; t < count; t++) {
+				threads.emplace_back([this, graphs, count, t]() {
+					for (uint32_t p = 0; p < scalingPasses; p++) {
+						evaluate(
+							graphs,
+							t * (uint32_t)addresses.size() / count);
+					}
+				});
+			}
+			for (std::thread& thread : threads) {
+				thread.join();
+			}
+			const std::chrono::duration<double> elapsed =
+				std::chrono::steady_clock::now() - start;
+			const double rate = (double)count * scalingPasses *
+				addresses.size() / elapsed.count();
+			if (count == 1) {
+				single = rate;
+			}
+			printf("%s threads %2u: %10.0f per second, %5.2fx\n",
+				name,
+				count,
+				rate,
+				rate / single);
+		}
+	}
+
+	GraphTestData data;
+	std::vector<std::pair<byte, fiftyoneDegreesIpAddress>> addresses;
+	std::string fileName;
+};
+
+TEST_F(ConcurrencyTest, Memory) {
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	expectSameResults(evaluate(graphs.get(), 0), graphs.get());
+}
+
+TEST_F(ConcurrencyTest, MemoryOptions) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.alignNodes = true;
+	config.decodeSpans = true;
+	config.compressPaths = true;
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader(),
+		config);
+	expectSameResults(evaluate(graphs.get(), 0), graphs.get());
+}
+
+TEST_F(ConcurrencyTest, File) {
+	IpiGraph expected = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	FileGraphs graphs(data, fileName, threadsCount / 2, 0);
+	expectSameResults(evaluate(expected.get(), 0), graphs.get());
+}
+
+TEST_F(ConcurrencyTest, FileCache) {
+	IpiGraph expected = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	FileGraphs graphs(data, fileName, threadsCount / 2, 100);
+	expectSameResults(evaluate(expected.get(), 0), graphs.get());
+}
+
+TEST_F(ConcurrencyTest, FileDirect) {
+	IpiGraph expected = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.directReads = true;
+	for (uint32_t pages : { 0u, 4u, 100000u }) {
+		FileGraphs graphs(data, fileName, 1, pages, config);
+		expectSameResults(evaluate(expected.get(), 0), graphs.get());
+	}
+}
+
+TEST_F(ConcurrencyTest, FileDirectOptions) {
+	IpiGraph expected = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.directReads = true;
+	config.compressNodes = true;
+	config.compressPaths = true;
+	config.markUniform = true;
+	FileGraphs graphs(data, fileName, 1, 16, config);
+	expectSameResults(evaluate(expected.get(), 0), graphs.get());
+}
+
+/**
+ * Benchmark of the throughput as threads are added. Disabled by default, run
+ * with --gtest_also_run_disabled_tests --gtest_filter=*Scaling.
+ */
+TEST_F(ConcurrencyTest, DISABLED_Scaling) {
+	const uint16_t readers = 32;
+	IpiGraph memory = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	measureScaling("memory    ", memory.get());
+	FileGraphs file(data, fileName, readers, 0);
+	measureScaling("file      ", file.get());
+	FileGraphs cache(data, fileName, readers, 1000);
+	measureScaling("file cache", cache.get());
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.directReads = true;
+	FileGraphs direct(data, fileName, 1, 0, config);
+	measureScaling("direct    ", direct.get());
+	FileGraphs pages(data, fileName, 1, 100000, config);
+	measureScaling("pages     ", pages.get());
+}
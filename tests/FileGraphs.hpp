@@ -0,0 +1,104 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#ifndef FIFTYONE_DEGREES_IPI_GRAPH_FILE_GRAPHS_HPP
+#define FIFTYONE_DEGREES_IPI_GRAPH_FILE_GRAPHS_HPP
+
+#include <cstdio>
+#include <string>
+#include "GraphTestData.hpp"
+
+/**
+ * Graphs created from a copy of the test data written to a file with
+ * GraphTestData::save. The pool and the file are released after the graphs.
+ */
+class FileGraphs {
+public:
+	/**
+	 * @param data to create the graphs for
+	 * @param fileName of the copy of the data
+	 * @param concurrency number of readers in the pool
+	 * @param capacity of the cache of each collection, or 0 for none
+	 * @param config options to apply to the graphs
+	 */
+	FileGraphs(
+		GraphTestData& data,
+		const std::string& fileName,
+		uint16_t concurrency,
+		uint32_t capacity,
+		const fiftyoneDegreesIpiCgConfig& config =
+			FiftyoneDegrees::IpIntelligence::IpiGraph::defaultConfig()) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesStatusCode status = fiftyoneDegreesFilePoolInit(
+			&pool,
+			fileName.c_str(),
+			concurrency,
+			&exception);
+		if (status != FIFTYONE_DEGREES_STATUS_SUCCESS) {
+			throw FiftyoneDegrees::Common::StatusCodeException(status);
+		}
+		file = fopen(fileName.c_str(), "rb");
+		const fiftyoneDegreesCollectionConfig collectionConfig = {
+			0,
+			capacity,
+			concurrency };
+		try {
+			graphs =
+				FiftyoneDegrees::IpIntelligence::IpiGraph::createFromFile(
+					data.getInfos(),
+					file,
+					&pool,
+					collectionConfig,
+					config);
+		}
+		catch (...) {
+			fiftyoneDegreesFilePoolRelease(&pool);
+			fclose(file);
+			throw;
+		}
+	}
+
+	~FileGraphs() {
+		graphs.reset(nullptr);
+		fiftyoneDegreesFilePoolRelease(&pool);
+		fclose(file);
+	}
+
+	FileGraphs(const FileGraphs&) = delete;
+
+	FileGraphs& operator=(const FileGraphs&) = delete;
+
+	const fiftyoneDegreesIpiCgArray* get() const { return graphs.get(); }
+
+private:
+	fiftyoneDegreesFilePool pool;
+	FILE* file = nullptr;
+	FiftyoneDegrees::IpIntelligence::IpiGraph graphs;
+};
+
+#endif
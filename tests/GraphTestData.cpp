@@ -0,0 +1,619 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "GraphTestData.hpp"
+
+// Span limits are held most significant bit first in the same way as the
+// bits of an IP address.
+static int getBit(const byte* bytes, int index) {
+	return (bytes[index / 8] >> (7 - index % 8)) & 1;
+}
+
+static void setBit(byte* bytes, int index, int value) {
+	if (value) {
+		bytes[index / 8] |= (byte)(1 << (7 - index % 8));
+	}
+	else {
+		bytes[index / 8] &= (byte)~(1 << (7 - index % 8));
+	}
+}
+
+static int compareBits(const byte* a, const byte* b, int length) {
+	for (int i = 0; i < length; i++) {
+		const int difference = getBit(a, i) - getBit(b, i);
+		if (difference != 0) {
+			return difference;
+		}
+	}
+	return 0;
+}
+
+// Compares the bits of the address from the start bit to the limit.
+static int compareBitsAt(
+	const byte* address,
+	int start,
+	const byte* limit,
+	int length) {
+	for (int i = 0; i < length; i++) {
+		const int difference = getBit(address, start + i) - getBit(limit, i);
+		if (difference != 0) {
+			return difference;
+		}
+	}
+	return 0;
+}
+
+static uint32_t append(
+	std::vector<byte>& bytes,
+	const void* data,
+	size_t size) {
+	const uint32_t position = (uint32_t)bytes.size();
+	bytes.insert(
+		bytes.end(),
+		(const byte*)data,
+		(const byte*)data + size);
+	return position;
+}
+
+// Builds the nodes and spans of a graph. Every walk from a root consumes at
+// most the number of bits in the address, and the overrun for IPv4. Nodes 
+// are added depth first so a node without the low flag is followed by the 
+// node for its low result, and a node with the low flag is followed by the 
+// node that holds its high result. Some nodes point to a node that has 
+// already been built so the graph is not a tree.
+class GraphTestData::Builder {
+public:
+	Builder(GraphTestData* data, byte version, uint32_t leaves)
+		: data(data),
+		limitBits(version == 4 ? 32 + data->overrun : 128),
+		addressBits(version == 4 ? 32 : 128),
+		leaves(leaves) {}
+
+	// Adds a node, and the nodes below it, for a walk that has already
+	// consumed the bits used. Returns the index of the node.
+	uint32_t add(int used, int depth) {
+		const uint32_t span = addSpan(used);
+		const uint32_t index = addNode(span);
+		int maxBits = std::max(
+			spans[span].lengthLow,
+			spans[span].lengthHigh);
+		if (data->next(2) == 0) {
+			const uint32_t high = addNode(addSpan(used));
+			const int64_t lowValue = addChild(
+				used + spans[span].lengthLow,
+				depth);
+			const int64_t highValue = addChild(
+				used + spans[span].lengthHigh,
+				depth);
+			nodes[index].lowFlag = true;
+			nodes[index].value = lowValue;
+			nodes[high].lowFlag = data->next(4) == 0;
+			nodes[high].value = highValue;
+			maxBits = std::max(maxBits, getMaxBits(
+				spans[span].lengthLow,
+				lowValue));
+			maxBits = std::max(maxBits, getMaxBits(
+				spans[span].lengthHigh,
+				highValue));
+		}
+		else if (used + spans[span].lengthLow >= limitBits - 1) {
+			const int64_t lowValue = addLeaf();
+			const uint32_t high = addNode(addSpan(used));
+			nodes[index].lowFlag = true;
+			nodes[index].value = lowValue;
+			nodes[high].value = addLeaf();
+		}
+		else {
+			const uint32_t low = add(used + spans[span].lengthLow, depth - 1);
+			const int64_t highValue = addChild(
+				used + spans[span].lengthHigh,
+				depth);
+			nodes[index].value = highValue;
+			maxBits = std::max(maxBits, getMaxBits(
+				spans[span].lengthLow,
+				low));
+			maxBits = std::max(maxBits, getMaxBits(
+				spans[span].lengthHigh,
+				highValue));
+		}
+		maxBitsBelow[index] = maxBits;
+		completed.push_back(index);
+		return index;
+	}
+
+	std::vector<Node> nodes;
+	std::vector<Span> spans;
+
+private:
+	uint32_t addNode(uint32_t span) {
+		Node node = { span, false, 0 };
+		nodes.push_back(node);
+		maxBitsBelow.push_back(0);
+		return (uint32_t)nodes.size() - 1;
+	}
+
+	// Returns an existing span that fits in the bits remaining, or a new
+	// span with a low limit less than the high limit. The bits of the low 
+	// limit after the end of the address are zero so that walks which are
+	// equal to it continue after the address.
+	uint32_t addSpan(int used) {
+		const int remaining = limitBits - used;
+		if (spans.empty() == false && data->next(3) == 0) {
+			const uint32_t index = data->next((uint32_t)spans.size());
+			if (std::max(spans[index].lengthLow, spans[index].lengthHigh) <=
+				remaining) {
+				return index;
+			}
+		}
+		Span span;
+		do {
+			memset(&span, 0, sizeof(Span));
+			int maxLength = std::min(remaining, 40);
+			if (maxLength > 8 && data->next(2) == 0) {
+				maxLength = 8;
+			}
+			span.lengthLow = 1 + (int)data->next((uint32_t)maxLength);
+			span.lengthHigh = 1 + (int)data->next((uint32_t)maxLength);
+			for (int i = 0; i < span.lengthLow; i++) {
+				setBit(span.low, i, (int)data->next(2));
+			}
+			for (int i = addressBits - used; i < span.lengthLow; i++) {
+				setBit(span.low, i, 0);
+			}
+			for (int i = 0; i < span.lengthHigh; i++) {
+				setBit(span.high, i, (int)data->next(2));
+			}
+		} while (compareBits(
+			span.low,
+			span.high,
+			std::max(span.lengthLow, span.lengthHigh)) >= 0);
+		spans.push_back(span);
+		return (uint32_t)spans.size() - 1;
+	}
+
+	int64_t addLeaf() {
+		if (data->repeat != 0 && data->next(data->repeat) != 0) {
+			return -1;
+		}
+		return -(int64_t)(1 + data->next(leaves));
+	}
+
+	int64_t addChild(int used, int depth) {
+		if (depth <= 0 || used >= limitBits - 1 || data->next(5) == 0) {
+			return addLeaf();
+		}
+		if (completed.size() > 4 && data->next(6) == 0) {
+			const uint32_t index = completed[
+				data->next((uint32_t)completed.size())];
+			if (used + maxBitsBelow[index] <= limitBits) {
+				return index;
+			}
+		}
+		return add(used, depth - 1);
+	}
+
+	int getMaxBits(int length, int64_t value) const {
+		return value >= 0 ? length + maxBitsBelow[(size_t)value] : 0;
+	}
+
+	GraphTestData* const data;
+	const int limitBits;
+	const int addressBits;
+	const uint32_t leaves;
+	std::vector<int> maxBitsBelow; // Most bits consumed from each node
+	std::vector<uint32_t> completed; // Nodes that other nodes can point to
+};
+
+GraphTestData::GraphTestData(
+	uint64_t seed,
+	uint32_t localSpans,
+	uint32_t repeat,
+	int overrun)
+	: state(seed * 0x9E3779B97F4A7C15ULL + 1),
+	localSpans(localSpans),
+	repeat(repeat),
+	overrun(overrun) {
+	const byte first[] = { 1 };
+	const byte shared[] = { 1, 2 };
+	const byte second[] = { 2 };
+	const byte third[] = { 3 };
+	bytes.resize(sizeof(fiftyoneDegreesIpiCgInfo) * graphsCount);
+	addGraphs(4, 8 + (int)next(8), 1, first);
+	addGraphs(6, 10 + (int)next(20), 2, shared);
+	addGraphs(4, 6 + (int)next(6), 1, second);
+	addGraphs(6, 6 + (int)next(6), 1, third);
+	addInfos();
+}
+
+GraphTestData::GraphTestData(
+	byte version,
+	const std::vector<Node>& nodes,
+	const std::vector<Span>& spans,
+	uint32_t profiles)
+	: state(0x9E3779B97F4A7C15ULL + 1),
+	localSpans(256),
+	repeat(0),
+	overrun(0) {
+	const byte first[] = { 1 };
+	const std::vector<uint32_t> roots = { 0 };
+	bytes.resize(sizeof(fiftyoneDegreesIpiCgInfo));
+	addGraphs(version, nodes, spans, roots, first, profiles, 0);
+	addInfos();
+}
+
+void GraphTestData::addInfos() {
+	const uint32_t count = (uint32_t)graphs.size();
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(
+			&bytes[sizeof(fiftyoneDegreesIpiCgInfo) * i],
+			&graphs[i].info,
+			sizeof(fiftyoneDegreesIpiCgInfo));
+	}
+	reader.startByte = bytes.data();
+	reader.current = bytes.data();
+	reader.lastByte = bytes.data() + bytes.size();
+	reader.length = (long)bytes.size();
+	fiftyoneDegreesCollectionHeader header = {
+		0,
+		(uint32_t)(sizeof(fiftyoneDegreesIpiCgInfo) * count),
+		count
+	};
+	infos = fiftyoneDegreesCollectionCreateFromMemory(&reader, header);
+}
+
+GraphTestData::~GraphTestData() {
+	if (infos != nullptr) {
+		FIFTYONE_DEGREES_COLLECTION_FREE(infos);
+	}
+}
+
+bool GraphTestData::save(const std::string& fileName) const {
+	FILE* file = fopen(fileName.c_str(), "wb");
+	if (file == nullptr) {
+		return false;
+	}
+	const bool written =
+		fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	return fclose(file) == 0 && written;
+}
+
+uint64_t GraphTestData::next() {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+void GraphTestData::addGraphs(
+	byte version,
+	int depth,
+	uint32_t roots,
+	const byte* componentIds) {
+	const uint32_t profiles = 1 + next(50);
+	const uint32_t groups = next(20);
+	Builder builder(this, version, profiles + groups);
+	std::vector<uint32_t> rootIndexes;
+	for (uint32_t i = 0; i < roots; i++) {
+		rootIndexes.push_back(builder.add(0, depth));
+	}
+	addGraphs(
+		version,
+		builder.nodes,
+		builder.spans,
+		rootIndexes,
+		componentIds,
+		profiles,
+		groups);
+}
+
+void GraphTestData::addGraphs(
+	byte version,
+	const std::vector<Node>& nodes,
+	const std::vector<Span>& spans,
+	const std::vector<uint32_t>& rootIndexes,
+	const byte* componentIds,
+	uint32_t profiles,
+	uint32_t groups) {
+	const uint32_t count = (uint32_t)nodes.size();
+
+	// Group runs of nodes into clusters that each use at most localSpans
+	// distinct spans, and find the index of the span of each node in its
+	// cluster.
+	std::vector<uint32_t> clusters;
+	std::vector<uint32_t> localIndexes(count);
+	for (uint32_t start = 0, end; start < count; start = end) {
+		std::vector<uint32_t> clusterSpans;
+		const uint32_t maxNodes = 1 + next(40);
+		for (end = start; end < count && end - start < maxNodes; end++) {
+			const auto found = std::find(
+				clusterSpans.begin(),
+				clusterSpans.end(),
+				nodes[end].span);
+			localIndexes[end] = (uint32_t)(found - clusterSpans.begin());
+			if (found == clusterSpans.end()) {
+				if (clusterSpans.size() == localSpans) {
+					break;
+				}
+				clusterSpans.push_back(nodes[end].span);
+			}
+		}
+		clusters.push_back(start);
+		clusters.push_back(end - 1);
+		clusterSpans.resize(localSpans, 0);
+		clusters.insert(
+			clusters.end(),
+			clusterSpans.begin(),
+			clusterSpans.end());
+	}
+
+	// Spans with limits of up to 32 bits hold them in place of the offset in
+	// the span bytes.
+	std::vector<byte> spanBytes(1, 0);
+	std::vector<byte> spanRecords;
+	for (const Span& span : spans) {
+		byte limits[16] = { 0 };
+		uint32_t trail = 0;
+		for (int i = 0; i < span.lengthLow; i++) {
+			setBit(limits, i, getBit(span.low, i));
+		}
+		for (int i = 0; i < span.lengthHigh; i++) {
+			setBit(limits, span.lengthLow + i, getBit(span.high, i));
+		}
+		const int length = span.lengthLow + span.lengthHigh;
+		if (length > 32) {
+			trail = append(spanBytes, limits, (size_t)(length + 7) / 8);
+		}
+		else {
+			memcpy(&trail, limits, sizeof(uint32_t));
+		}
+		const byte lengths[] = { (byte)span.lengthLow, (byte)span.lengthHigh };
+		append(spanRecords, lengths, sizeof(lengths));
+		append(spanRecords, &trail, sizeof(trail));
+	}
+	spanBytes.resize(spanBytes.size() + sizeof(uint64_t), 0);
+
+	// Pack the nodes with the span index first, then the low flag, then the
+	// value which is the count plus the profile for a leaf.
+	int localBits = 0;
+	while ((1U << localBits) < localSpans) {
+		localBits++;
+	}
+	int valueBits = 1;
+	while ((1ULL << valueBits) <= (uint64_t)count + profiles + groups) {
+		valueBits++;
+	}
+	const int recordSize = localBits + 1 + valueBits;
+	std::vector<byte> nodeBytes(
+		((size_t)count * recordSize + 7) / 8 + sizeof(uint64_t),
+		0);
+	for (uint32_t i = 0; i < count; i++) {
+		const uint64_t value = nodes[i].value >= 0 ?
+			(uint64_t)nodes[i].value :
+			(uint64_t)count + (uint64_t)(-nodes[i].value - 1);
+		const uint64_t record =
+			((uint64_t)localIndexes[i] << (valueBits + 1)) |
+			((uint64_t)nodes[i].lowFlag << valueBits) |
+			value;
+		for (int b = 0; b < recordSize; b++) {
+			setBit(
+				nodeBytes.data(),
+				(int)((uint64_t)i * recordSize + b),
+				(int)((record >> (recordSize - 1 - b)) & 1));
+		}
+	}
+
+	Graph graph;
+	memset(&graph.info, 0, sizeof(fiftyoneDegreesIpiCgInfo));
+	graph.info.version = version;
+	graph.info.profileCount = profiles;
+	graph.info.profileGroupCount = groups;
+	graph.info.firstProfileIndex = next(1000);
+	graph.info.firstProfileGroupIndex = next(1000);
+	graph.info.spanBytes.startPosition = append(
+		bytes,
+		spanBytes.data(),
+		spanBytes.size());
+	graph.info.spanBytes.length = (uint32_t)spanBytes.size();
+	graph.info.spanBytes.count = (uint32_t)spanBytes.size();
+	graph.info.spans.startPosition = append(
+		bytes,
+		spanRecords.data(),
+		spanRecords.size());
+	graph.info.spans.length = (uint32_t)spanRecords.size();
+	graph.info.spans.count = (uint32_t)spans.size();
+	graph.info.clusters.startPosition = append(
+		bytes,
+		clusters.data(),
+		clusters.size() * sizeof(uint32_t));
+	graph.info.clusters.length = (uint32_t)(clusters.size() * sizeof(uint32_t));
+	graph.info.clusters.count = (uint32_t)(clusters.size() / (2 + localSpans));
+	graph.info.nodes.collection.startPosition = append(
+		bytes,
+		nodeBytes.data(),
+		nodeBytes.size());
+	graph.info.nodes.collection.length = (uint32_t)nodeBytes.size();
+	graph.info.nodes.collection.count = count;
+	graph.info.nodes.recordSize = (uint16_t)recordSize;
+	graph.info.nodes.value.mask = (1ULL << valueBits) - 1;
+	graph.info.nodes.value.shift = 0;
+	graph.info.nodes.lowFlag.mask = 1ULL << valueBits;
+	graph.info.nodes.lowFlag.shift = (uint64_t)valueBits;
+	graph.info.nodes.spanIndex.mask =
+		((1ULL << localBits) - 1) << (valueBits + 1);
+	graph.info.nodes.spanIndex.shift = (uint64_t)valueBits + 1;
+	graph.nodes = nodes;
+	graph.spans = spans;
+	for (size_t i = 0; i < rootIndexes.size(); i++) {
+		graph.info.componentId = componentIds[i];
+		graph.info.graphIndex = rootIndexes[i];
+		graph.root = rootIndexes[i];
+		graphs.push_back(graph);
+	}
+}
+
+fiftyoneDegreesIpAddress GraphTestData::nextAddress(uint32_t index) {
+	const Graph& graph = graphs[index];
+	const int length = graph.info.version == 4 ?
+		FIFTYONE_DEGREES_IPV4_LENGTH :
+		FIFTYONE_DEGREES_IPV6_LENGTH;
+	fiftyoneDegreesIpAddress address;
+	memset(&address, 0, sizeof(fiftyoneDegreesIpAddress));
+	address.type = graph.info.version;
+	for (int i = 0; i < length; i++) {
+		address.value[i] = (byte)next();
+	}
+	if (next(4) == 0) {
+		return address;
+	}
+
+	// Set the bits of the address to the limits of the spans from the root.
+	uint32_t node = graph.root;
+	for (int bit = 0; next(10) != 0;) {
+		const Node& current = graph.nodes[node];
+		const Span& span = graph.spans[current.span];
+		int64_t value;
+		if (next(2) == 0) {
+			if (bit + span.lengthLow > length * 8) {
+				// Set the bits of the limit that are in the address so the
+				// walk continues after it if the rest of the limit is zero.
+				for (int i = 0; bit < length * 8; i++) {
+					setBit(address.value, bit++, getBit(span.low, i));
+				}
+				break;
+			}
+			for (int i = 0; i < span.lengthLow; i++) {
+				setBit(address.value, bit++, getBit(span.low, i));
+			}
+			value = current.lowFlag ? current.value : (int64_t)node + 1;
+		}
+		else {
+			if (bit + span.lengthHigh > length * 8) {
+				break;
+			}
+			for (int i = 0; i < span.lengthHigh; i++) {
+				setBit(address.value, bit++, getBit(span.high, i));
+			}
+			value = current.lowFlag ?
+				graph.nodes[node + 1].value :
+				current.value;
+		}
+		if (value < 0) {
+			break;
+		}
+		node = (uint32_t)value;
+	}
+	return address;
+}
+
+// Returns the value for the low entry of the node, which is a leaf if it is
+// less than zero.
+int64_t GraphTestData::selectLow(const Graph& graph, uint32_t node) {
+	return graph.nodes[node].lowFlag ?
+		graph.nodes[node].value :
+		(int64_t)node + 1;
+}
+
+// Returns the value for the high entry of the node, which is a leaf if it is
+// less than zero.
+int64_t GraphTestData::selectHigh(const Graph& graph, uint32_t node) {
+	if (graph.nodes[node].lowFlag) {
+		node++;
+	}
+	return graph.nodes[node].value;
+}
+
+uint32_t GraphTestData::walk(
+	uint32_t index,
+	const fiftyoneDegreesIpAddress& address,
+	int& bits) const {
+	const Graph& graph = graphs[index];
+	byte value[32] = { 0 };
+	memcpy(
+		value,
+		address.value,
+		graph.info.version == 4 ?
+			FIFTYONE_DEGREES_IPV4_LENGTH :
+			FIFTYONE_DEGREES_IPV6_LENGTH);
+	uint32_t previousHigh = graph.root;
+	int64_t next = graph.root;
+	bits = 0;
+	while (next >= 0 && bits < 128) {
+		const uint32_t node = (uint32_t)next;
+		const Span& span = graph.spans[graph.nodes[node].span];
+		const int low = compareBitsAt(value, bits, span.low, span.lengthLow);
+		const int high = compareBitsAt(
+			value,
+			bits,
+			span.high,
+			span.lengthHigh);
+		if (low < 0) {
+			// Back to the low entry of the last node that was equal to its
+			// high limit, then the high entries to a leaf.
+			next = selectLow(graph, previousHigh);
+			while (next >= 0) {
+				next = selectHigh(graph, (uint32_t)next);
+			}
+		}
+		else if (low == 0) {
+			bits += span.lengthLow;
+			next = selectLow(graph, node);
+		}
+		else if (high < 0) {
+			next = selectLow(graph, node);
+			while (next >= 0) {
+				next = selectHigh(graph, (uint32_t)next);
+			}
+		}
+		else if (high == 0) {
+			previousHigh = node;
+			bits += span.lengthHigh;
+			next = selectHigh(graph, node);
+		}
+		else {
+			next = selectHigh(graph, node);
+			while (next >= 0) {
+				next = selectHigh(graph, (uint32_t)next);
+			}
+		}
+	}
+	return next < 0 ? (uint32_t)(-next - 1) : UINT32_MAX;
+}
+
+std::vector<std::pair<byte, fiftyoneDegreesIpAddress>>
+GraphTestData::nextAddresses(uint32_t count) {
+	std::vector<std::pair<byte, fiftyoneDegreesIpAddress>> addresses;
+	for (uint32_t i = 0; i < count; i++) {
+		const uint32_t graph = i % (uint32_t)graphs.size();
+		addresses.push_back(std::make_pair(
+			graphs[graph].info.componentId,
+			nextAddress(graph)));
+	}
+	return addresses;
+}
@@ -0,0 +1,223 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#ifndef FIFTYONE_DEGREES_IPI_GRAPH_TEST_DATA_HPP
+#define FIFTYONE_DEGREES_IPI_GRAPH_TEST_DATA_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../IpiGraph.hpp"
+
+/**
+ * Data set of synthetic graphs held in memory in the same layout as the
+ * graphs of an IP Intelligence data file. Used to test that the options of
+ * the graphs do not change the results of the walk. The data set holds five
+ * graphs: component 1 has an IPv4 and an IPv6 graph, component 2 has an
+ * IPv4 graph and an IPv6 graph that shares the collections of the IPv6 graph
+ * of component 1, and component 3 only has an IPv6 graph. The same seed
+ * always creates the same data. A data set can instead hold a single graph
+ * of a known shape from the nodes and spans provided.
+ */
+class GraphTestData {
+public:
+	/**
+	 * Number of graphs in a data set created with a seed.
+	 */
+	static const uint32_t graphsCount = 5;
+
+	/**
+	 * Span with the limits held most significant bit first in the same way
+	 * as the bits of an IP address.
+	 */
+	struct Span {
+		int lengthLow;
+		int lengthHigh;
+		byte low[16];
+		byte high[16];
+	};
+
+	/**
+	 * Node of a graph. A node without the low flag is followed by the node
+	 * for its low result, and a node with the low flag is followed by the
+	 * node that holds its high result.
+	 */
+	struct Node {
+		uint32_t span;
+		bool lowFlag;
+		int64_t value; // Index of a node, or -(profile + 1) for a leaf
+	};
+
+	/**
+	 * Creates the data set.
+	 * @param seed for the random numbers used to build the graphs
+	 * @param localSpans number of distinct spans each cluster can hold, at
+	 * most 256
+	 * @param repeat if not 0, one leaf in every repeat uses a random profile
+	 * and the others use the first profile so large parts of each graph
+	 * return the same profile
+	 * @param overrun number of bits after the 32 bits of an IPv4 address that
+	 * the walks of the IPv4 graphs can compare, which are always zero
+	 */
+	GraphTestData(
+		uint64_t seed,
+		uint32_t localSpans,
+		uint32_t repeat,
+		int overrun = 0);
+
+	/**
+	 * Creates a data set with a single graph for component 1 from the nodes
+	 * and spans provided, with the root at the first node.
+	 * @param version of the graph, 4 or 6
+	 * @param nodes of the graph
+	 * @param spans used by the nodes
+	 * @param profiles number of profiles the leaves can return
+	 */
+	GraphTestData(
+		byte version,
+		const std::vector<Node>& nodes,
+		const std::vector<Span>& spans,
+		uint32_t profiles);
+
+	~GraphTestData();
+
+	GraphTestData(const GraphTestData&) = delete;
+
+	GraphTestData& operator=(const GraphTestData&) = delete;
+
+	/**
+	 * @return collection of the fiftyoneDegreesIpiCgInfo records
+	 */
+	fiftyoneDegreesCollection* getInfos() { return infos; }
+
+	/**
+	 * @return reader for the whole data set
+	 */
+	fiftyoneDegreesMemoryReader* getReader() { return &reader; }
+
+	/**
+	 * @return bytes of the whole data set
+	 */
+	const std::vector<byte>& getBytes() const { return bytes; }
+
+	/**
+	 * Writes the whole data set to a file so that graphs can be created from
+	 * it in file mode. Positions in the file are the same as in getBytes.
+	 * @param fileName of the file to write
+	 * @return true if every byte was written
+	 */
+	bool save(const std::string& fileName) const;
+
+	/**
+	 * @param index of the graph
+	 * @return information for the graph as held in the data set
+	 */
+	const fiftyoneDegreesIpiCgInfo& getInfo(uint32_t index) const {
+		return graphs[index].info;
+	}
+
+	/**
+	 * Returns an address for the graph. Three in four addresses follow the
+	 * limits of the spans from the root for a random number of nodes so
+	 * that they reach deep into the graph and are equal to the limits
+	 * compared, the others are random.
+	 * @param index of the graph
+	 * @return address of the same version as the graph
+	 */
+	fiftyoneDegreesIpAddress nextAddress(uint32_t index);
+
+	/**
+	 * Walks the graph for the address in the way the graphs of a data file
+	 * are walked, one node at a time from the root without any options.
+	 * The bits that follow the address are zero.
+	 * @param index of the graph
+	 * @param address of the same version as the graph
+	 * @param bits set to the number of bits compared before the leaf
+	 * @return index of the profile or group of the leaf
+	 */
+	uint32_t walk(
+		uint32_t index,
+		const fiftyoneDegreesIpAddress& address,
+		int& bits) const;
+
+	/**
+	 * Returns addresses for every graph in turn.
+	 * @param count of addresses
+	 * @return addresses with the component id of the graph for each
+	 */
+	std::vector<std::pair<byte, fiftyoneDegreesIpAddress>> nextAddresses(
+		uint32_t count);
+
+	/**
+	 * @return random number
+	 */
+	uint64_t next();
+
+private:
+	struct Graph {
+		fiftyoneDegreesIpiCgInfo info;
+		std::vector<Node> nodes;
+		std::vector<Span> spans;
+		uint32_t root;
+	};
+
+	class Builder;
+
+	void addGraphs(
+		byte version,
+		int depth,
+		uint32_t roots,
+		const byte* componentIds);
+
+	void addGraphs(
+		byte version,
+		const std::vector<Node>& nodes,
+		const std::vector<Span>& spans,
+		const std::vector<uint32_t>& rootIndexes,
+		const byte* componentIds,
+		uint32_t profiles,
+		uint32_t groups);
+
+	void addInfos();
+
+	static int64_t selectLow(const Graph& graph, uint32_t node);
+
+	static int64_t selectHigh(const Graph& graph, uint32_t node);
+
+	uint32_t next(uint32_t limit) { return (uint32_t)(next() % limit); }
+
+	uint64_t state;
+	uint32_t localSpans;
+	uint32_t repeat;
+	int overrun;
+	std::vector<byte> bytes;
+	std::vector<Graph> graphs;
+	fiftyoneDegreesMemoryReader reader;
+	fiftyoneDegreesCollection* infos;
+};
+
+#endif
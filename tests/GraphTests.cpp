@@ -0,0 +1,696 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "gtest/gtest.h"
+#include "FileGraphs.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Options for the synthetic data set used by each instance of the tests.
+ */
+struct GraphTestParameters {
+	uint64_t seed;
+	uint32_t localSpans;
+	uint32_t repeat;
+};
+
+/**
+ * Returns success if the results and the status of two evaluations are the
+ * same.
+ */
+static ::testing::AssertionResult isSameResult(
+	const fiftyoneDegreesIpiCgResult& expected,
+	fiftyoneDegreesStatusCode expectedStatus,
+	const fiftyoneDegreesIpiCgResult& actual,
+	fiftyoneDegreesStatusCode actualStatus) {
+	if (expectedStatus != actualStatus) {
+		return ::testing::AssertionFailure() << "status " << actualStatus <<
+			" expected " << expectedStatus;
+	}
+	if (expected.rawOffset != actual.rawOffset ||
+		expected.offset != actual.offset ||
+		expected.isGroupOffset != actual.isGroupOffset) {
+		return ::testing::AssertionFailure() << "result " <<
+			actual.rawOffset << "/" << actual.offset << "/" <<
+			actual.isGroupOffset << " expected " << expected.rawOffset <<
+			"/" << expected.offset << "/" << expected.isGroupOffset;
+	}
+	return ::testing::AssertionSuccess();
+}
+
+/**
+ * Reads the bytes at the position of the file without moving its offset, in
+ * the way a caller of the non-blocking evaluation reads from the data file.
+ */
+static bool readAt(FILE* file, uint64_t position, std::vector<byte>& bytes) {
+#ifdef _WIN32
+	return _fseeki64(file, (__int64)position, SEEK_SET) == 0 &&
+		fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+#else
+	return pread(
+		fileno(file),
+		bytes.data(),
+		bytes.size(),
+		(off_t)position) == (ssize_t)bytes.size();
+#endif
+}
+
+/**
+ * Evaluates addresses that reach deep into synthetic graphs with the graphs
+ * under test, and checks the results are the same as the walk of the bit
+ * packed nodes and collections without any options.
+ */
+class GraphTest : public ::testing::TestWithParam<GraphTestParameters> {
+protected:
+	/**
+	 * Number of addresses evaluated by each test.
+	 */
+	static const uint32_t addressesCount = 5000;
+
+	void SetUp() override {
+		data.reset(new GraphTestData(
+			GetParam().seed,
+			GetParam().localSpans,
+			GetParam().repeat));
+		addresses = data->nextAddresses(addressesCount);
+		baseline = create(IpiGraph::defaultConfig());
+	}
+
+	IpiGraph create(const fiftyoneDegreesIpiCgConfig& config) {
+		return IpiGraph::createFromMemory(
+			data->getInfos(),
+			data->getReader(),
+			config);
+	}
+
+	/**
+	 * Evaluates every address with both arrays of graphs, and with a
+	 * component that has no graphs.
+	 */
+	void expectSameResults(
+		const fiftyoneDegreesIpiCgArray* expected,
+		const fiftyoneDegreesIpiCgArray* actual) {
+		uint32_t failures = 0;
+		for (size_t i = 0; i < addresses.size() && failures < 10; i++) {
+			const byte componentId = i % 100 == 0 ?
+				(byte)9 :
+				addresses[i].first;
+			fiftyoneDegreesException expectedException;
+			fiftyoneDegreesException actualException;
+			expectedException.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			actualException.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			const fiftyoneDegreesIpiCgResult expectedResult =
+				fiftyoneDegreesIpiGraphEvaluate(
+					expected,
+					componentId,
+					addresses[i].second,
+					&expectedException);
+			const fiftyoneDegreesIpiCgResult actualResult =
+				fiftyoneDegreesIpiGraphEvaluate(
+					actual,
+					componentId,
+					addresses[i].second,
+					&actualException);
+			const ::testing::AssertionResult same = isSameResult(
+				expectedResult,
+				expectedException.status,
+				actualResult,
+				actualException.status);
+			EXPECT_TRUE(same) << "address " << i;
+			if (same == false) {
+				failures++;
+			}
+		}
+	}
+
+	void expectSameResults(const fiftyoneDegreesIpiCgArray* graphs) {
+		expectSameResults(baseline.get(), graphs);
+	}
+
+	/**
+	 * Saves the prepared structures of the graphs to a snapshot held in
+	 * memory aligned to 8 bytes.
+	 */
+	std::vector<uint64_t> saveSnapshot(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		size_t* length) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		FILE* file = tmpfile();
+		EXPECT_NE(nullptr, file);
+		fiftyoneDegreesIpiGraphSnapshotSave(graphs, file, &exception);
+		EXPECT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		*length = (size_t)ftell(file);
+		std::vector<uint64_t> snapshot(
+			(*length + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+		rewind(file);
+		EXPECT_EQ(*length, fread(snapshot.data(), 1, *length, file));
+		fclose(file);
+		return snapshot;
+	}
+
+	IpiGraph createFromSnapshot(
+		const std::vector<uint64_t>& snapshot,
+		size_t length,
+		fiftyoneDegreesStatusCode* status) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		IpiGraph graphs(fiftyoneDegreesIpiGraphCreateFromMemoryWithSnapshot(
+			data->getInfos(),
+			data->getReader(),
+			snapshot.data(),
+			length,
+			&exception));
+		*status = exception.status;
+		return graphs;
+	}
+
+	/**
+	 * Creates a delta that changes the parts of each graph in changes. The
+	 * delta holds a copy of the whole data set after the entries so the
+	 * changed collections are the same as the existing ones. The first
+	 * profile and profile group indexes are moved by the shift given.
+	 */
+	std::vector<byte> createDelta(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		const std::vector<std::pair<uint32_t, uint32_t>>& changes,
+		uint32_t shift) {
+		const size_t entriesLength =
+			sizeof(fiftyoneDegreesIpiCgDeltaHeader) +
+			sizeof(fiftyoneDegreesIpiCgDeltaGraph) * changes.size();
+		std::vector<byte> delta(entriesLength, 0);
+		delta.insert(
+			delta.end(),
+			data->getBytes().begin(),
+			data->getBytes().end());
+		fiftyoneDegreesIpiCgDeltaHeader header;
+		header.format = FIFTYONE_DEGREES_IPI_CG_DELTA_FORMAT;
+		header.graphsCount = graphs->count;
+		header.checksum = 0xcbf29ce484222325ULL;
+		for (uint32_t i = 0; i < graphs->count; i++) {
+			const byte* info = (const byte*)&graphs->items[i].info;
+			for (size_t j = 0; j < sizeof(fiftyoneDegreesIpiCgInfo); j++) {
+				header.checksum =
+					(header.checksum ^ info[j]) * 0x100000001b3ULL;
+			}
+		}
+		header.count = (uint32_t)changes.size();
+		memcpy(delta.data(), &header, sizeof(header));
+		for (size_t i = 0; i < changes.size(); i++) {
+			fiftyoneDegreesIpiCgDeltaGraph entry;
+			entry.index = changes[i].first;
+			entry.changed = changes[i].second;
+			entry.info = data->getInfo(entry.index);
+			entry.info.firstProfileIndex =
+				graphs->items[entry.index].info.firstProfileIndex + shift;
+			entry.info.firstProfileGroupIndex =
+				graphs->items[entry.index].info.firstProfileGroupIndex +
+				shift;
+			entry.info.nodes.collection.startPosition +=
+				(uint32_t)entriesLength;
+			entry.info.spans.startPosition += (uint32_t)entriesLength;
+			entry.info.spanBytes.startPosition += (uint32_t)entriesLength;
+			entry.info.clusters.startPosition += (uint32_t)entriesLength;
+			memcpy(
+				delta.data() + sizeof(header) + sizeof(entry) * i,
+				&entry,
+				sizeof(entry));
+		}
+		return delta;
+	}
+
+	IpiGraph createFromDelta(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		std::vector<byte>& delta,
+		size_t length,
+		fiftyoneDegreesStatusCode* status) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		IpiGraph created(fiftyoneDegreesIpiGraphCreateFromDelta(
+			graphs,
+			delta.data(),
+			length,
+			&exception));
+		*status = exception.status;
+		return created;
+	}
+
+	/**
+	 * Options tested in combination with snapshots and deltas.
+	 */
+	static std::vector<fiftyoneDegreesIpiCgConfig> getConfigs() {
+		std::vector<fiftyoneDegreesIpiCgConfig> configs;
+		fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+		configs.push_back(config);
+		config = IpiGraph::defaultConfig();
+		config.resolveSpanIndexes = true;
+		config.compressNodes = true;
+		config.compressPaths = true;
+		configs.push_back(config);
+		config = IpiGraph::defaultConfig();
+		config.markUniform = true;
+		config.useArena = true;
+		configs.push_back(config);
+		config = IpiGraph::defaultConfig();
+		config.validate = true;
+		configs.push_back(config);
+		return configs;
+	}
+
+	std::unique_ptr<GraphTestData> data;
+	std::vector<std::pair<byte, fiftyoneDegreesIpAddress>> addresses;
+	IpiGraph baseline;
+};
+
+TEST_P(GraphTest, AlignedNodes) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.alignNodes = true;
+	IpiGraph graphs = create(config);
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		EXPECT_NE(nullptr, graphs.get()->items[i].alignedNodes);
+	}
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, ResolvedSpanIndexes) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.resolveSpanIndexes = true;
+	IpiGraph graphs = create(config);
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		EXPECT_NE(nullptr, graphs.get()->items[i].spanIndexes);
+	}
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, DecodedSpans) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.decodeSpans = true;
+	IpiGraph graphs = create(config);
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		EXPECT_NE(nullptr, graphs.get()->items[i].decodedSpans);
+	}
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, CompressedNodes) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.compressNodes = true;
+	IpiGraph graphs = create(config);
+	uint32_t compressedCount = 0;
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		const fiftyoneDegreesIpiCg* graph = &graphs.get()->items[i];
+		const size_t nodesLength = graph->info.nodes.collection.length;
+		if (graph->compressedNodes != nullptr) {
+			EXPECT_LT(graph->compressedNodesSize, nodesLength);
+			compressedCount++;
+		}
+	}
+	EXPECT_LT(0U, compressedCount);
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, CompressedPaths) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.compressPaths = true;
+	IpiGraph graphs = create(config);
+	uint32_t skipsCount = 0;
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		skipsCount += graphs.get()->items[i].skipsCount;
+	}
+	EXPECT_LT(0U, skipsCount);
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, UniformNodes) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.markUniform = true;
+	IpiGraph graphs = create(config);
+	uint32_t uniformsCount = 0;
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		uniformsCount += graphs.get()->items[i].uniformsCount;
+	}
+	if (GetParam().repeat != 0) {
+		EXPECT_LT(0U, uniformsCount);
+	}
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, Validated) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.validate = true;
+	IpiGraph graphs = create(config);
+	for (uint32_t i = 0; i < graphs.get()->count; i++) {
+		EXPECT_TRUE(graphs.get()->items[i].validated);
+	}
+	expectSameResults(graphs.get());
+}
+
+TEST_P(GraphTest, CombinedOptions) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.compressNodes = true;
+	config.compressPaths = true;
+	config.markUniform = true;
+	config.resolveSpanIndexes = true;
+	config.decodeSpans = true;
+	config.useArena = true;
+	expectSameResults(create(config).get());
+	config = IpiGraph::defaultConfig();
+	config.alignNodes = true;
+	config.decodeSpans = true;
+	config.compressPaths = true;
+	config.markUniform = true;
+	expectSameResults(create(config).get());
+}
+
+TEST_P(GraphTest, SharedCollections) {
+	// Graphs 1 and 2 have the same headers for every collection.
+	const fiftyoneDegreesIpiCgArray* graphs = baseline.get();
+	EXPECT_EQ(graphs->items[1].nodes, graphs->items[2].nodes);
+	EXPECT_EQ(graphs->items[1].spans, graphs->items[2].spans);
+	EXPECT_EQ(graphs->items[1].spanBytes, graphs->items[2].spanBytes);
+	EXPECT_EQ(graphs->items[1].clusters, graphs->items[2].clusters);
+	EXPECT_NE(graphs->items[0].nodes, graphs->items[1].nodes);
+	EXPECT_NE(graphs->items[3].nodes, graphs->items[4].nodes);
+
+	// Each graph still has its own prepared structures.
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.alignNodes = true;
+	IpiGraph aligned = create(config);
+	EXPECT_EQ(aligned.get()->items[1].nodes, aligned.get()->items[2].nodes);
+	EXPECT_NE(
+		aligned.get()->items[1].alignedNodes,
+		aligned.get()->items[2].alignedNodes);
+	expectSameResults(aligned.get());
+}
+
+TEST_P(GraphTest, SnapshotRoundTrip) {
+	for (const fiftyoneDegreesIpiCgConfig& config : getConfigs()) {
+		IpiGraph graphs = create(config);
+		size_t length;
+		const std::vector<uint64_t> snapshot = saveSnapshot(
+			graphs.get(),
+			&length);
+		fiftyoneDegreesStatusCode status;
+		IpiGraph attached = createFromSnapshot(snapshot, length, &status);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, status);
+		ASSERT_TRUE((bool)attached);
+		for (uint32_t i = 0; i < attached.get()->count; i++) {
+			EXPECT_EQ(
+				graphs.get()->items[i].validated,
+				attached.get()->items[i].validated);
+		}
+		expectSameResults(attached.get());
+	}
+}
+
+TEST_P(GraphTest, SnapshotTruncated) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.alignNodes = true;
+	config.compressPaths = true;
+	IpiGraph graphs = create(config);
+	size_t length;
+	const std::vector<uint64_t> snapshot = saveSnapshot(graphs.get(), &length);
+	fiftyoneDegreesStatusCode status;
+	IpiGraph attached = createFromSnapshot(snapshot, length - 1, &status);
+	EXPECT_FALSE((bool)attached);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA, status);
+}
+
+TEST_P(GraphTest, SnapshotOtherData) {
+	GraphTestData other(GetParam().seed + 1000, 256, 0);
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.alignNodes = true;
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		other.getInfos(),
+		other.getReader(),
+		config);
+	size_t length;
+	const std::vector<uint64_t> snapshot = saveSnapshot(graphs.get(), &length);
+	fiftyoneDegreesStatusCode status;
+	IpiGraph attached = createFromSnapshot(snapshot, length, &status);
+	EXPECT_FALSE((bool)attached);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_INCORRECT_VERSION, status);
+}
+
+TEST_P(GraphTest, DeltaCollections) {
+	const std::vector<std::pair<uint32_t, uint32_t>> changes = {
+		{ 0, FIFTYONE_DEGREES_IPI_CG_DELTA_COLLECTIONS },
+		{ 2, FIFTYONE_DEGREES_IPI_CG_DELTA_SPANS |
+			FIFTYONE_DEGREES_IPI_CG_DELTA_CLUSTERS },
+		{ 4, FIFTYONE_DEGREES_IPI_CG_DELTA_NODES }
+	};
+	for (const fiftyoneDegreesIpiCgConfig& config : getConfigs()) {
+		IpiGraph graphs = create(config);
+		std::vector<byte> delta = createDelta(graphs.get(), changes, 0);
+		fiftyoneDegreesStatusCode status;
+		IpiGraph changed = createFromDelta(
+			graphs.get(),
+			delta,
+			delta.size(),
+			&status);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, status);
+		ASSERT_TRUE((bool)changed);
+		const fiftyoneDegreesIpiCgArray* before = graphs.get();
+		const fiftyoneDegreesIpiCgArray* after = changed.get();
+		EXPECT_NE(before->items[0].nodes, after->items[0].nodes);
+		EXPECT_EQ(before->items[1].nodes, after->items[1].nodes);
+		EXPECT_EQ(before->items[2].nodes, after->items[2].nodes);
+		EXPECT_NE(before->items[2].spans, after->items[2].spans);
+		EXPECT_EQ(before->items[3].spans, after->items[3].spans);
+		EXPECT_EQ(before->items[4].spans, after->items[4].spans);
+		EXPECT_NE(before->items[4].nodes, after->items[4].nodes);
+		expectSameResults(after);
+
+		// The existing graphs must still work once freed in either order.
+		graphs.reset(nullptr);
+		expectSameResults(after);
+	}
+}
+
+TEST_P(GraphTest, DeltaProfiles) {
+	const uint32_t shift = 7;
+	IpiGraph graphs = create(IpiGraph::defaultConfig());
+	std::vector<byte> delta = createDelta(
+		graphs.get(),
+		{ { 1, FIFTYONE_DEGREES_IPI_CG_DELTA_PROFILES } },
+		shift);
+	fiftyoneDegreesStatusCode status;
+	IpiGraph changed = createFromDelta(
+		graphs.get(),
+		delta,
+		delta.size(),
+		&status);
+	ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, status);
+	EXPECT_EQ(graphs.get()->items[1].nodes, changed.get()->items[1].nodes);
+	for (size_t i = 1; i < addresses.size(); i += GraphTestData::graphsCount) {
+		const fiftyoneDegreesIpAddress& address = addresses[i].second;
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesIpiCgResult expected =
+			fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				1,
+				address,
+				&exception);
+		const fiftyoneDegreesIpiCgResult actual =
+			fiftyoneDegreesIpiGraphEvaluate(
+				changed.get(),
+				1,
+				address,
+				&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		EXPECT_EQ(expected.rawOffset, actual.rawOffset);
+		EXPECT_EQ(expected.isGroupOffset, actual.isGroupOffset);
+		if (expected.rawOffset != UINT32_MAX) {
+			EXPECT_EQ(expected.offset + shift, actual.offset);
+		}
+	}
+
+	// The delta is for the original graphs and not the changed ones.
+	IpiGraph again = createFromDelta(
+		changed.get(),
+		delta,
+		delta.size(),
+		&status);
+	EXPECT_FALSE((bool)again);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_INCORRECT_VERSION, status);
+}
+
+TEST_P(GraphTest, DeltaCorrupt) {
+	IpiGraph graphs = create(IpiGraph::defaultConfig());
+	std::vector<byte> delta = createDelta(
+		graphs.get(),
+		{ { 3, FIFTYONE_DEGREES_IPI_CG_DELTA_COLLECTIONS } },
+		0);
+	const size_t entriesLength =
+		sizeof(fiftyoneDegreesIpiCgDeltaHeader) +
+		sizeof(fiftyoneDegreesIpiCgDeltaGraph);
+	fiftyoneDegreesStatusCode status;
+	IpiGraph truncated = createFromDelta(
+		graphs.get(),
+		delta,
+		entriesLength - 1,
+		&status);
+	EXPECT_FALSE((bool)truncated);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA, status);
+
+	// A collection that is not inside the delta.
+	fiftyoneDegreesIpiCgDeltaGraph entry;
+	byte* const entryBytes =
+		delta.data() + sizeof(fiftyoneDegreesIpiCgDeltaHeader);
+	memcpy(&entry, entryBytes, sizeof(entry));
+	entry.info.spans.startPosition = (uint32_t)delta.size();
+	memcpy(entryBytes, &entry, sizeof(entry));
+	IpiGraph outside = createFromDelta(
+		graphs.get(),
+		delta,
+		delta.size(),
+		&status);
+	EXPECT_FALSE((bool)outside);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA, status);
+}
+
+TEST_P(GraphTest, NonBlocking) {
+	const std::vector<byte>& bytes = data->getBytes();
+	for (size_t i = 0; i < addresses.size(); i++) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesIpiCgResult expected =
+			fiftyoneDegreesIpiGraphEvaluate(
+				baseline.get(),
+				addresses[i].first,
+				addresses[i].second,
+				&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+
+		// Supply either exactly the bytes requested, or a larger block
+		// that starts before the request and covers later requests.
+		fiftyoneDegreesIpiCgEvaluation evaluation;
+		fiftyoneDegreesIpiGraphEvaluationInit(
+			&evaluation,
+			baseline.get(),
+			addresses[i].first,
+			addresses[i].second);
+		while (fiftyoneDegreesIpiGraphEvaluationStep(
+			&evaluation,
+			&exception) == false) {
+			const uint32_t before = i % 2 == 0 ?
+				0 :
+				std::min(evaluation.request.offset, (uint32_t)i % 64);
+			const uint32_t position =
+				evaluation.request.position - before;
+			const uint32_t length = std::min(
+				evaluation.request.length + before + (uint32_t)(i % 128),
+				(uint32_t)bytes.size() - position);
+			fiftyoneDegreesIpiGraphEvaluationSupply(
+				&evaluation,
+				evaluation.request.offset - before,
+				bytes.data() + position,
+				length,
+				&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		}
+		fiftyoneDegreesIpiGraphEvaluationRelease(&evaluation);
+		EXPECT_TRUE(isSameResult(
+			expected,
+			FIFTYONE_DEGREES_STATUS_NOT_SET,
+			evaluation.result,
+			exception.status)) << "address " << i;
+	}
+}
+
+TEST_P(GraphTest, NonBlockingFile) {
+	// The supplied collections take their count, size and element size from
+	// the file collections, and each request is read from its position.
+	const std::string fileName = ::testing::TempDir() + "GraphTests.dat";
+	ASSERT_TRUE(data->save(fileName));
+	FILE* file = fopen(fileName.c_str(), "rb");
+	ASSERT_NE(nullptr, file);
+	{
+		FileGraphs graphs(*data, fileName, 1, 0);
+		std::vector<byte> block;
+		for (size_t i = 0; i < addresses.size(); i++) {
+			fiftyoneDegreesException exception;
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			const fiftyoneDegreesIpiCgResult expected =
+				fiftyoneDegreesIpiGraphEvaluate(
+					baseline.get(),
+					addresses[i].first,
+					addresses[i].second,
+					&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			fiftyoneDegreesIpiCgEvaluation evaluation;
+			fiftyoneDegreesIpiGraphEvaluationInit(
+				&evaluation,
+				graphs.get(),
+				addresses[i].first,
+				addresses[i].second);
+			while (fiftyoneDegreesIpiGraphEvaluationStep(
+				&evaluation,
+				&exception) == false) {
+				ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+				block.resize(evaluation.request.length);
+				ASSERT_TRUE(readAt(file, evaluation.request.position, block));
+				fiftyoneDegreesIpiGraphEvaluationSupply(
+					&evaluation,
+					evaluation.request.offset,
+					block.data(),
+					(uint32_t)block.size(),
+					&exception);
+				ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			}
+			fiftyoneDegreesIpiGraphEvaluationRelease(&evaluation);
+			EXPECT_TRUE(isSameResult(
+				expected,
+				FIFTYONE_DEGREES_STATUS_NOT_SET,
+				evaluation.result,
+				exception.status)) << "address " << i;
+		}
+	}
+	fclose(file);
+	remove(fileName.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+	GraphTests,
+	GraphTest,
+	::testing::Values(
+		GraphTestParameters{ 1, 256, 0 },
+		GraphTestParameters{ 2, 16, 0 },
+		GraphTestParameters{ 3, 256, 4 },
+		GraphTestParameters{ 4, 16, 32 }));
@@ -0,0 +1,172 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Checks the graphs of every replica, the graphs returned for the node of the
+ * calling thread, and bulk evaluation with the replicas get the same results
+ * as graphs created in memory without replicas.
+ */
+class ReplicaTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses evaluated.
+	 */
+	static const uint32_t addressesCount = 5003;
+
+	ReplicaTest() : data(31, 256, 0) {}
+
+	void SetUp() override {
+		graphs = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader());
+		fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+		config.compressPaths = true;
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		replicas = fiftyoneDegreesIpiGraphCreateReplicasFromMemory(
+			data.getInfos(),
+			data.getReader(),
+			&config,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		ASSERT_NE(nullptr, replicas);
+		ASSERT_LT(0u, replicas->count);
+		for (uint32_t i = 0; i < addressesCount; i++) {
+			addresses.push_back(data.nextAddress(i % 2));
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			expected.push_back(fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				1,
+				addresses.back(),
+				&exception));
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		}
+	}
+
+	void TearDown() override {
+		if (replicas != nullptr) {
+			fiftyoneDegreesIpiGraphReplicasFree(replicas);
+		}
+	}
+
+	/**
+	 * Evaluates every address with the graphs and checks the results are
+	 * the expected.
+	 */
+	void expectSameResults(const fiftyoneDegreesIpiCgArray* replicaGraphs) {
+		for (size_t i = 0; i < addresses.size(); i++) {
+			fiftyoneDegreesException exception;
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			const fiftyoneDegreesIpiCgResult result =
+				fiftyoneDegreesIpiGraphEvaluate(
+					replicaGraphs,
+					1,
+					addresses[i],
+					&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			expectSameResult(result, i);
+		}
+	}
+
+	void expectSameResult(
+		const fiftyoneDegreesIpiCgResult& result,
+		size_t index) {
+		ASSERT_EQ(expected[index].rawOffset, result.rawOffset) <<
+			"address " << index;
+		ASSERT_EQ(expected[index].offset, result.offset);
+		ASSERT_EQ(expected[index].isGroupOffset, result.isGroupOffset);
+	}
+
+	GraphTestData data;
+	IpiGraph graphs;
+	fiftyoneDegreesIpiCgReplicaArray* replicas = nullptr;
+	std::vector<fiftyoneDegreesIpAddress> addresses;
+	std::vector<fiftyoneDegreesIpiCgResult> expected;
+};
+
+TEST_F(ReplicaTest, Replicas) {
+	// A single replica uses the source data rather than a copy, and more
+	// than one each prefer their own node.
+	if (replicas->count == 1) {
+		EXPECT_EQ(nullptr, replicas->items[0].data);
+	}
+	for (uint32_t i = 0; i < replicas->count; i++) {
+		if (replicas->count > 1) {
+			EXPECT_NE(nullptr, replicas->items[i].data);
+			EXPECT_EQ(
+				(int)i,
+				replicas->items[i].graphs->config.numaNode);
+		}
+		expectSameResults(replicas->items[i].graphs);
+	}
+}
+
+TEST_F(ReplicaTest, Get) {
+	const fiftyoneDegreesIpiCgArray* const local =
+		fiftyoneDegreesIpiGraphReplicasGet(replicas);
+	bool found = false;
+	for (uint32_t i = 0; i < replicas->count; i++) {
+		found |= replicas->items[i].graphs == local;
+	}
+	EXPECT_TRUE(found);
+	expectSameResults(local);
+}
+
+TEST_F(ReplicaTest, Bulk) {
+	for (bool pinThreads : { false, true }) {
+		for (uint16_t threads : { 1, 4 }) {
+			fiftyoneDegreesIpiCgBulkConfig config = {};
+			config.threads = threads;
+			config.chunkSize = 100;
+			config.pinThreads = pinThreads;
+			config.replicas = replicas;
+			std::vector<fiftyoneDegreesIpiCgResult> results(addresses.size());
+			fiftyoneDegreesException exception;
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			fiftyoneDegreesIpiGraphEvaluateBulk(
+				graphs.get(),
+				1,
+				addresses.data(),
+				results.data(),
+				addresses.size(),
+				&config,
+				&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			for (size_t i = 0; i < results.size(); i++) {
+				expectSameResult(results[i], i);
+			}
+		}
+	}
+}
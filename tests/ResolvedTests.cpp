@@ -0,0 +1,258 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <cstring>
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Mapping from the results to the references, and the number of results
+ * resolved.
+ */
+struct ResolvedMapping {
+	uint32_t multiplier;
+	uint32_t calls;
+};
+
+static uint32_t resolve(
+	void* state,
+	fiftyoneDegreesIpiCgResult result,
+	fiftyoneDegreesException* exception) {
+	(void)exception;
+	ResolvedMapping* const mapping = (ResolvedMapping*)state;
+	mapping->calls++;
+	return result.offset * mapping->multiplier +
+		(result.isGroupOffset ? 1 : 0);
+}
+
+/**
+ * Checks the references returned by resolved evaluation are the mapping of
+ * the results of evaluation, for single addresses and batches.
+ */
+class ResolvedTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses evaluated.
+	 */
+	static const uint32_t addressesCount = 2000;
+
+	ResolvedTest() : data(29, 256, 0) {}
+
+	void SetUp() override {
+		fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+		graphs = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader(),
+			config);
+		addresses = data.nextAddresses(addressesCount);
+	}
+
+	/**
+	 * Resolves the graphs with the mapping.
+	 */
+	static void resolveGraphs(IpiGraph& graphs, ResolvedMapping& mapping) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphResolve(
+			(fiftyoneDegreesIpiCgArray*)graphs.get(),
+			resolve,
+			&mapping,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	}
+
+	/**
+	 * Returns the reference expected for the address.
+	 */
+	static uint32_t getExpected(
+		const IpiGraph& graphs,
+		const ResolvedMapping& mapping,
+		byte componentId,
+		const fiftyoneDegreesIpAddress& address) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesIpiCgResult result =
+			fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				componentId,
+				address,
+				&exception);
+		EXPECT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		return result.rawOffset == UINT32_MAX ?
+			FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE :
+			result.offset * mapping.multiplier +
+				(result.isGroupOffset ? 1 : 0);
+	}
+
+	/**
+	 * Checks the single and batch references for the addresses of the
+	 * component.
+	 */
+	static void expectResolved(
+		const IpiGraph& graphs,
+		const ResolvedMapping& mapping,
+		byte componentId,
+		const std::vector<fiftyoneDegreesIpAddress>& addresses) {
+		std::vector<uint32_t> resolved(addresses.size());
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateResolvedBatch(
+			graphs.get(),
+			componentId,
+			addresses.data(),
+			resolved.data(),
+			(uint32_t)addresses.size(),
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		for (size_t i = 0; i < addresses.size(); i++) {
+			const uint32_t expected = getExpected(
+				graphs,
+				mapping,
+				componentId,
+				addresses[i]);
+			EXPECT_EQ(
+				expected,
+				fiftyoneDegreesIpiGraphEvaluateResolved(
+					graphs.get(),
+					componentId,
+					addresses[i],
+					&exception)) << "address " << i;
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			EXPECT_EQ(expected, resolved[i]) << "batch address " << i;
+		}
+	}
+
+	/**
+	 * Returns the addresses of the component.
+	 */
+	std::vector<fiftyoneDegreesIpAddress> getAddresses(byte componentId) {
+		std::vector<fiftyoneDegreesIpAddress> result;
+		for (const auto& address : addresses) {
+			if (address.first == componentId) {
+				result.push_back(address.second);
+			}
+		}
+		return result;
+	}
+
+	GraphTestData data;
+	IpiGraph graphs;
+	std::vector<std::pair<byte, fiftyoneDegreesIpAddress>> addresses;
+};
+
+TEST_F(ResolvedTest, NotResolved) {
+	fiftyoneDegreesException exception;
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	EXPECT_EQ(
+		FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE,
+		fiftyoneDegreesIpiGraphEvaluateResolved(
+			graphs.get(),
+			addresses[0].first,
+			addresses[0].second,
+			&exception));
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_INVALID_CONFIG, exception.status);
+	uint32_t resolved = 0;
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	fiftyoneDegreesIpiGraphEvaluateResolvedBatch(
+		graphs.get(),
+		addresses[0].first,
+		&addresses[0].second,
+		&resolved,
+		1,
+		&exception);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_INVALID_CONFIG, exception.status);
+	EXPECT_EQ(FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE, resolved);
+}
+
+TEST_F(ResolvedTest, Resolved) {
+	ResolvedMapping mapping = { 3, 0 };
+	resolveGraphs(graphs, mapping);
+
+	// The resolver is called once for every profile and group of each
+	// graph.
+	uint32_t results = 0;
+	for (uint32_t i = 0; i < GraphTestData::graphsCount; i++) {
+		results += data.getInfo(i).profileCount +
+			data.getInfo(i).profileGroupCount;
+	}
+	EXPECT_EQ(results, mapping.calls);
+	for (byte componentId : { 1, 2, 3 }) {
+		expectResolved(graphs, mapping, componentId, getAddresses(componentId));
+	}
+
+	// A component without graphs has no reference.
+	expectResolved(graphs, mapping, 9, getAddresses(1));
+
+	// Resolving again replaces the references.
+	mapping = { 5, 0 };
+	resolveGraphs(graphs, mapping);
+	expectResolved(graphs, mapping, 1, getAddresses(1));
+}
+
+TEST_F(ResolvedTest, NoLeaf) {
+	// A graph where the walk of the unspecified address consumes every bit
+	// at node 2 which is not a leaf, and the walk of any other address that
+	// starts with 64 set bits ends at the high leaf of the root.
+	GraphTestData::Span span;
+	memset(&span, 0, sizeof(GraphTestData::Span));
+	span.lengthLow = 64;
+	span.lengthHigh = 64;
+	memset(span.high, 0xff, 8);
+	const std::vector<GraphTestData::Node> nodes = {
+		{ 0, false, -2 },
+		{ 0, false, -2 },
+		{ 0, false, 3 },
+		{ 0, true, -1 },
+		{ 0, false, -2 }
+	};
+	GraphTestData shape(6, nodes, { span }, 2);
+	IpiGraph shapeGraphs = IpiGraph::createFromMemory(
+		shape.getInfos(),
+		shape.getReader());
+	ResolvedMapping mapping = { 3, 0 };
+	resolveGraphs(shapeGraphs, mapping);
+	fiftyoneDegreesIpAddress unspecified;
+	memset(&unspecified, 0, sizeof(fiftyoneDegreesIpAddress));
+	unspecified.type = FIFTYONE_DEGREES_IP_TYPE_IPV6;
+	fiftyoneDegreesIpAddress ones = unspecified;
+	memset(ones.value, 0xff, sizeof(ones.value));
+	int bits;
+	EXPECT_EQ(UINT32_MAX, shape.walk(0, unspecified, bits));
+	EXPECT_EQ(1u, shape.walk(0, ones, bits));
+	EXPECT_EQ(
+		FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE,
+		getExpected(shapeGraphs, mapping, 1, unspecified));
+	EXPECT_NE(
+		FIFTYONE_DEGREES_IPI_CG_RESOLVED_NONE,
+		getExpected(shapeGraphs, mapping, 1, ones));
+	expectResolved(shapeGraphs, mapping, 1, { unspecified, ones, unspecified });
+}
@@ -0,0 +1,190 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Checks graphs published to a named shared memory segment and attached from
+ * it get the same results as the graphs created in memory, and that a new
+ * generation replaces the one before. The segment functions are only
+ * available on Linux when FIFTYONE_DEGREES_IPI_GRAPH_SEGMENTS is defined and
+ * otherwise fail with the invalid config status.
+ */
+class SegmentTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses evaluated with each generation.
+	 */
+	static const uint32_t addressesCount = 2000;
+
+	SegmentTest() : first(11, 256, 0), second(13, 256, 4) {}
+
+	void SetUp() override {
+		name = "/51d-ipi-segment-test";
+#ifdef __linux__
+		name += "-" + std::to_string(getpid());
+#endif
+		config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+	}
+
+	void TearDown() override {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphSegmentRemove(name.c_str(), &exception);
+	}
+
+	/**
+	 * Checks the graphs give the same results as the graphs of the data set
+	 * created in memory.
+	 */
+	static void expectSameResults(
+		GraphTestData& data,
+		const fiftyoneDegreesIpiCgArray* graphs) {
+		IpiGraph expected = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader());
+		for (const auto& address : data.nextAddresses(addressesCount)) {
+			fiftyoneDegreesException exception;
+			exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+			const fiftyoneDegreesIpiCgResult e =
+				fiftyoneDegreesIpiGraphEvaluate(
+					expected.get(),
+					address.first,
+					address.second,
+					&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			const fiftyoneDegreesIpiCgResult a =
+				fiftyoneDegreesIpiGraphEvaluate(
+					graphs,
+					address.first,
+					address.second,
+					&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			ASSERT_EQ(e.rawOffset, a.rawOffset);
+			ASSERT_EQ(e.offset, a.offset);
+			ASSERT_EQ(e.isGroupOffset, a.isGroupOffset);
+		}
+	}
+
+	GraphTestData first;
+	GraphTestData second;
+	std::string name;
+	fiftyoneDegreesIpiCgConfig config;
+};
+
+#if defined(__linux__) && defined(FIFTYONE_DEGREES_IPI_GRAPH_SEGMENTS)
+
+TEST_F(SegmentTest, Generations) {
+	fiftyoneDegreesException exception;
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+
+	// Nothing has been published to the name yet.
+	EXPECT_EQ(nullptr, fiftyoneDegreesIpiGraphSegmentAttach(
+		name.c_str(),
+		&exception));
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_FILE_NOT_FOUND, exception.status);
+
+	// Publish and attach to the first generation.
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	const long generation = fiftyoneDegreesIpiGraphSegmentPublish(
+		name.c_str(),
+		first.getInfos(),
+		first.getReader(),
+		&config,
+		&exception);
+	ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	ASSERT_LT(0, generation);
+	fiftyoneDegreesIpiCgSegment* const attached =
+		fiftyoneDegreesIpiGraphSegmentAttach(name.c_str(), &exception);
+	ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	ASSERT_NE(nullptr, attached);
+	EXPECT_EQ(generation, attached->generation);
+	EXPECT_TRUE(fiftyoneDegreesIpiGraphSegmentIsCurrent(attached));
+	expectSameResults(first, attached->graphs);
+
+	// Publishing the next generation leaves the attached segment usable but
+	// no longer current.
+	EXPECT_EQ(generation + 1, fiftyoneDegreesIpiGraphSegmentPublish(
+		name.c_str(),
+		second.getInfos(),
+		second.getReader(),
+		&config,
+		&exception));
+	ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	EXPECT_FALSE(fiftyoneDegreesIpiGraphSegmentIsCurrent(attached));
+	expectSameResults(first, attached->graphs);
+	fiftyoneDegreesIpiCgSegment* const next =
+		fiftyoneDegreesIpiGraphSegmentAttach(name.c_str(), &exception);
+	ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	ASSERT_NE(nullptr, next);
+	EXPECT_EQ(generation + 1, next->generation);
+	EXPECT_TRUE(fiftyoneDegreesIpiGraphSegmentIsCurrent(next));
+	expectSameResults(second, next->graphs);
+	fiftyoneDegreesIpiGraphSegmentFree(attached);
+
+	// Once removed the name can not be attached to, but the segment already
+	// attached remains usable until freed.
+	fiftyoneDegreesIpiGraphSegmentRemove(name.c_str(), &exception);
+	ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	EXPECT_EQ(nullptr, fiftyoneDegreesIpiGraphSegmentAttach(
+		name.c_str(),
+		&exception));
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_FILE_NOT_FOUND, exception.status);
+	expectSameResults(second, next->graphs);
+	fiftyoneDegreesIpiGraphSegmentFree(next);
+}
+
+#else
+
+TEST_F(SegmentTest, Unavailable) {
+	fiftyoneDegreesException exception;
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	EXPECT_EQ(0, fiftyoneDegreesIpiGraphSegmentPublish(
+		name.c_str(),
+		first.getInfos(),
+		first.getReader(),
+		&config,
+		&exception));
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_INVALID_CONFIG, exception.status);
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	EXPECT_EQ(nullptr, fiftyoneDegreesIpiGraphSegmentAttach(
+		name.c_str(),
+		&exception));
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_INVALID_CONFIG, exception.status);
+}
+
+#endif
@@ -0,0 +1,178 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <cstring>
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Returns a span with the limits given as the least significant bits of the
+ * values.
+ */
+static GraphTestData::Span span(
+	int lengthLow,
+	uint64_t low,
+	int lengthHigh,
+	uint64_t high) {
+	GraphTestData::Span result;
+	memset(&result, 0, sizeof(GraphTestData::Span));
+	result.lengthLow = lengthLow;
+	result.lengthHigh = lengthHigh;
+	for (int i = 0; i < lengthLow; i++) {
+		if ((low >> (lengthLow - 1 - i)) & 1) {
+			result.low[i / 8] |= (byte)(1 << (7 - i % 8));
+		}
+	}
+	for (int i = 0; i < lengthHigh; i++) {
+		if ((high >> (lengthHigh - 1 - i)) & 1) {
+			result.high[i / 8] |= (byte)(1 << (7 - i % 8));
+		}
+	}
+	return result;
+}
+
+/**
+ * Returns the statistics of the only graph of the data set.
+ */
+static fiftyoneDegreesIpiCgStats getStats(
+	GraphTestData& data,
+	const fiftyoneDegreesIpiCgConfig& config,
+	fiftyoneDegreesStatusCode& status) {
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader(),
+		config);
+	fiftyoneDegreesIpiCgStats stats;
+	fiftyoneDegreesException exception;
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	fiftyoneDegreesIpiGraphGetStats(
+		&graphs.get()->items[0],
+		&stats,
+		&exception);
+	status = exception.status;
+	return stats;
+}
+
+/**
+ * Spans of the graphs. Limits of up to 32 bits in total are held in the 
+ * span record, and the 40 bits of the second span in the span bytes.
+ */
+static const std::vector<GraphTestData::Span> spans = {
+	span(4, 0x4, 4, 0x8),
+	span(20, 0x00001, 20, 0x80000),
+	span(1, 0, 1, 1)
+};
+
+/**
+ * Nodes of a graph where the walk can visit the first six nodes and the 
+ * last is unreachable. Node 1 holds its low entry and node 2 its high entry,
+ * as do nodes 4 and 5. Counting each node read, the seven distinct walks 
+ * from the root to a leaf visit 2, 4, 5, 6, 2, 3 and 4 nodes:
+ * 0 low to 1 low leaf,
+ * 0 low to 1 high (2) to 3 high leaf,
+ * 0 low to 1 high (2) to 3 low to 4 low leaf,
+ * 0 low to 1 high (2) to 3 low to 4 high (5) leaf,
+ * 0 high to 3 high leaf,
+ * 0 high to 3 low to 4 low leaf,
+ * 0 high to 3 low to 4 high (5) leaf.
+ */
+static const std::vector<GraphTestData::Node> nodes = {
+	{ 0, false, 3 },
+	{ 1, true, -1 },
+	{ 1, false, 3 },
+	{ 2, false, -2 },
+	{ 2, true, -3 },
+	{ 2, false, -1 },
+	{ 0, false, -2 }
+};
+
+TEST(StatsTest, Shape) {
+	GraphTestData data(4, nodes, spans, 3);
+	// The statistics are the same whatever options the graph is created
+	// with.
+	std::vector<fiftyoneDegreesIpiCgConfig> configs(
+		3,
+		IpiGraph::defaultConfig());
+	configs[1].alignNodes = true;
+	configs[1].decodeSpans = true;
+	configs[2].compressNodes = true;
+	for (const fiftyoneDegreesIpiCgConfig& config : configs) {
+		fiftyoneDegreesStatusCode status;
+		const fiftyoneDegreesIpiCgStats stats = getStats(data, config, status);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, status);
+		EXPECT_EQ(4, stats.version);
+		EXPECT_EQ(1, stats.componentId);
+		EXPECT_EQ(7u, stats.nodesCount);
+		EXPECT_EQ(6u, stats.nodesReachable);
+		EXPECT_EQ(4u, stats.nodesLeaf);
+		EXPECT_EQ(2u, stats.depthMin);
+		EXPECT_EQ(6u, stats.depthMax);
+		EXPECT_DOUBLE_EQ(26.0 / 7.0, stats.depthAverage);
+		EXPECT_EQ(3u, stats.spansCount);
+		EXPECT_EQ(2u, stats.spansInline);
+		EXPECT_EQ(1u, stats.spansInBytes);
+		EXPECT_EQ(2u, stats.spanLengths[1]);
+		EXPECT_EQ(2u, stats.spanLengths[4]);
+		EXPECT_EQ(2u, stats.spanLengths[20]);
+		EXPECT_EQ(0u, stats.spanLengths[8]);
+	}
+}
+
+TEST(StatsTest, Walk) {
+	// The walk of the graph returns the results of its leaves.
+	GraphTestData data(4, nodes, spans, 3);
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	for (uint32_t i = 0; i < 1000; i++) {
+		const fiftyoneDegreesIpAddress address = data.nextAddress(0);
+		int bits;
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		EXPECT_EQ(
+			data.walk(0, address, bits),
+			fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				1,
+				address,
+				&exception).rawOffset);
+		EXPECT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	}
+}
+
+TEST(StatsTest, Cycle) {
+	// The low entry of node 4 moves back to node 3.
+	std::vector<GraphTestData::Node> cycle = nodes;
+	cycle[4].value = 3;
+	GraphTestData data(4, cycle, spans, 3);
+	fiftyoneDegreesStatusCode status;
+	getStats(data, IpiGraph::defaultConfig(), status);
+	EXPECT_EQ(FIFTYONE_DEGREES_STATUS_CORRUPT_DATA, status);
+}
@@ -0,0 +1,434 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Checks the addresses parsed from text, and the field of each line that
+ * holds the address, by comparing the result of each row with the result of
+ * evaluating the address it was formatted from.
+ */
+class TextTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses formatted in each form.
+	 */
+	static const uint32_t addressesCount = 1000;
+
+	TextTest() : data(17, 256, 0) {}
+
+	void SetUp() override {
+		graphs = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader());
+	}
+
+	/**
+	 * Returns the address of the version with the bytes given.
+	 */
+	static fiftyoneDegreesIpAddress address(
+		fiftyoneDegreesIpType type,
+		std::vector<byte> bytes) {
+		fiftyoneDegreesIpAddress result;
+		memset(&result, 0, sizeof(fiftyoneDegreesIpAddress));
+		result.type = (byte)type;
+		memcpy(result.value, bytes.data(), bytes.size());
+		return result;
+	}
+
+	/**
+	 * Formats the IPv4 address as four decimal octets.
+	 */
+	static std::string formatIpv4(const byte* value) {
+		char text[16];
+		snprintf(text, sizeof(text), "%u.%u.%u.%u",
+			value[0], value[1], value[2], value[3]);
+		return text;
+	}
+
+	/**
+	 * Formats the IPv6 address as eight groups, with the first run of zero 
+	 * groups compressed if compress is true, and the last two groups as an
+	 * IPv4 address if ipv4 is true.
+	 */
+	static std::string formatIpv6(
+		const fiftyoneDegreesIpAddress& address,
+		bool compress,
+		bool ipv4) {
+		const int groups = ipv4 ? 6 : 8;
+		int gapStart = groups, gapEnd = groups;
+		for (int i = 0; compress && i < groups; i++) {
+			if (address.value[i * 2] == 0 && address.value[i * 2 + 1] == 0) {
+				gapStart = i;
+				gapEnd = i;
+				while (gapEnd < groups &&
+					address.value[gapEnd * 2] == 0 &&
+					address.value[gapEnd * 2 + 1] == 0) {
+					gapEnd++;
+				}
+				break;
+			}
+		}
+		std::string text;
+		for (int i = 0; i < groups; i++) {
+			if (i == gapStart) {
+				text += "::";
+				i = gapEnd - 1;
+				continue;
+			}
+			char group[6];
+			snprintf(group, sizeof(group), "%x",
+				(address.value[i * 2] << 8) | address.value[i * 2 + 1]);
+			if (text.empty() == false && text.back() != ':') {
+				text += ":";
+			}
+			text += group;
+		}
+		if (ipv4) {
+			if (text.empty() == false && text.back() != ':') {
+				text += ":";
+			}
+			text += formatIpv4(address.value + 12);
+		}
+		return text;
+	}
+
+	/**
+	 * Returns an IPv6 address from the graph with some of the groups set to
+	 * zero so that they can be compressed.
+	 */
+	fiftyoneDegreesIpAddress nextIpv6() {
+		fiftyoneDegreesIpAddress address = data.nextAddress(1);
+		const uint32_t start = (uint32_t)(data.next() % 8);
+		const uint32_t count = (uint32_t)(data.next() % (9 - start));
+		memset(address.value + start * 2, 0, count * 2);
+		return address;
+	}
+
+	/**
+	 * Evaluates the text and returns the rows.
+	 */
+	std::vector<fiftyoneDegreesIpiCgTextRow> evaluate(
+		const std::string& text,
+		char delimiter,
+		uint16_t field,
+		bool final,
+		size_t* consumed) {
+		std::vector<fiftyoneDegreesIpiCgTextRow> rows(text.size() + 1);
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		rows.resize(fiftyoneDegreesIpiGraphEvaluateText(
+			graphs.get(),
+			1,
+			text.data(),
+			text.size(),
+			delimiter,
+			field,
+			final,
+			rows.data(),
+			rows.size(),
+			consumed,
+			&exception));
+		EXPECT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		return rows;
+	}
+
+	/**
+	 * Evaluates the text as a single line and checks the address parsed from
+	 * it has the same result as the address provided.
+	 */
+	void expectValid(
+		const std::string& text,
+		const fiftyoneDegreesIpAddress& expected) {
+		const std::vector<fiftyoneDegreesIpiCgTextRow> rows = evaluate(
+			text,
+			'\0',
+			0,
+			true,
+			nullptr);
+		ASSERT_EQ(1u, rows.size()) << text;
+		EXPECT_TRUE(rows[0].valid) << text;
+		expectResult(expected, rows[0].result, text);
+	}
+
+	/**
+	 * Evaluates the text as a single line and checks it is not valid.
+	 */
+	void expectInvalid(const std::string& text) {
+		const std::vector<fiftyoneDegreesIpiCgTextRow> rows = evaluate(
+			text,
+			'\0',
+			0,
+			true,
+			nullptr);
+		ASSERT_EQ(1u, rows.size()) << text;
+		EXPECT_FALSE(rows[0].valid) << text;
+		// The raw offset of FIFTYONE_DEGREES_IPI_CG_RESULT_DEFAULT.
+		EXPECT_EQ(UINT32_MAX, rows[0].result.rawOffset) << text;
+	}
+
+	/**
+	 * Checks the result is the same as evaluating the address.
+	 */
+	void expectResult(
+		const fiftyoneDegreesIpAddress& address,
+		const fiftyoneDegreesIpiCgResult& actual,
+		const std::string& text) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesIpiCgResult expected =
+			fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				1,
+				address,
+				&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		EXPECT_EQ(expected.rawOffset, actual.rawOffset) << text;
+		EXPECT_EQ(expected.offset, actual.offset) << text;
+		EXPECT_EQ(expected.isGroupOffset, actual.isGroupOffset) << text;
+	}
+
+	GraphTestData data;
+	IpiGraph graphs;
+};
+
+TEST_F(TextTest, Ipv4) {
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		const fiftyoneDegreesIpAddress address = data.nextAddress(0);
+		expectValid(formatIpv4(address.value), address);
+	}
+	expectValid(
+		"0.0.0.0",
+		address(FIFTYONE_DEGREES_IP_TYPE_IPV4, { 0, 0, 0, 0 }));
+	expectValid(
+		"255.255.255.255",
+		address(FIFTYONE_DEGREES_IP_TYPE_IPV4, { 255, 255, 255, 255 }));
+	expectInvalid("256.1.1.1");
+	expectInvalid("1.2.3");
+	expectInvalid("1.2.3.4.5");
+	expectInvalid("1..2.3");
+	expectInvalid("1.2.3.");
+	expectInvalid("0001.2.3.4");
+	expectInvalid("1.2.3.4x");
+	expectInvalid("1.2. 3.4");
+}
+
+TEST_F(TextTest, Ipv6) {
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		const fiftyoneDegreesIpAddress address = nextIpv6();
+		expectValid(formatIpv6(address, false, false), address);
+		expectValid(formatIpv6(address, true, false), address);
+		expectValid(formatIpv6(address, true, true), address);
+		expectValid(formatIpv6(address, true, false) + "%eth0", address);
+	}
+	expectValid("::", address(FIFTYONE_DEGREES_IP_TYPE_IPV6, {}));
+	expectValid("1::", address(FIFTYONE_DEGREES_IP_TYPE_IPV6, { 0, 1 }));
+	expectValid(
+		"1:2:3:4:5:6:7::",
+		address(
+			FIFTYONE_DEGREES_IP_TYPE_IPV6,
+			{ 0, 1, 0, 2, 0, 3, 0, 4, 0, 5, 0, 6, 0, 7, 0, 0 }));
+	expectValid(
+		"::ffff:1.2.3.4",
+		address(
+			FIFTYONE_DEGREES_IP_TYPE_IPV6,
+			{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, 1, 2, 3, 4 }));
+	expectValid(
+		"fe80::1%eth0",
+		address(
+			FIFTYONE_DEGREES_IP_TYPE_IPV6,
+			{ 0xfe, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 }));
+	expectInvalid("1::2::3");
+	expectInvalid("1:2:3:4:5:6:7:8:9");
+	expectInvalid(":1::");
+	expectInvalid("::1:2:3:4:5:6:7:8");
+	expectInvalid("1:2:3:4:5:6:7");
+	expectInvalid("1:");
+	expectInvalid("12345::");
+	expectInvalid("g::");
+	expectInvalid("::ffff:1.2.3");
+	expectInvalid("1:2:3:4:5:6:7:1.2.3.4");
+}
+
+TEST_F(TextTest, EmbeddedIpv4) {
+	// With the normalizeIpv4 option the IPv4 graph is only used if the 
+	// groups of the IPv6 address are in the right place, and the result then
+	// depends on each of the 32 bits taken from them.
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.normalizeIpv4 = true;
+	graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader(),
+		config);
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		const fiftyoneDegreesIpAddress address = data.nextAddress(0);
+		const byte* const v = address.value;
+		char hex[10];
+		snprintf(hex, sizeof(hex), "%x:%x",
+			(v[0] << 8) | v[1],
+			(v[2] << 8) | v[3]);
+		const std::string ipv4 = formatIpv4(v);
+		expectValid("::ffff:" + ipv4, address);
+		expectValid("::ffff:" + std::string(hex), address);
+		expectValid("0:0:0:0:0:ffff:" + std::string(hex), address);
+		expectValid("0::ffff:" + ipv4 + "%1", address);
+		expectValid("2002:" + std::string(hex) + "::", address);
+		expectValid("2002:" + std::string(hex) + "::1:2", address);
+		expectValid("2002:" + std::string(hex) + ":0:0:0:0:0", address);
+		if (memcmp(v, "\0\0\0", 3) != 0 || v[3] > 1) {
+			expectValid("::" + std::string(hex), address);
+			expectValid("::" + ipv4, address);
+		}
+	}
+}
+
+TEST_F(TextTest, Fields) {
+	const fiftyoneDegreesIpAddress expected = address(
+		FIFTYONE_DEGREES_IP_TYPE_IPV4,
+		{ 10, 1, 2, 3 });
+	const std::string text =
+		"a,b, 10.1.2.3 ,c\n"
+		" \t\n"
+		"\n"
+		"a,b,\t10.1.2.3\r\n"
+		"a,b\n"
+		"a,b,x,c\n";
+	const std::vector<fiftyoneDegreesIpiCgTextRow> rows = evaluate(
+		text,
+		',',
+		2,
+		true,
+		nullptr);
+	ASSERT_EQ(4u, rows.size());
+	EXPECT_TRUE(rows[0].valid);
+	EXPECT_EQ("10.1.2.3", text.substr(rows[0].offset, rows[0].length));
+	expectResult(expected, rows[0].result, "first");
+	EXPECT_TRUE(rows[1].valid);
+	EXPECT_EQ("10.1.2.3", text.substr(rows[1].offset, rows[1].length));
+	expectResult(expected, rows[1].result, "second");
+	EXPECT_FALSE(rows[2].valid);
+	EXPECT_FALSE(rows[3].valid);
+	EXPECT_EQ("x", text.substr(rows[3].offset, rows[3].length));
+
+	// Without a delimiter the whole line is the address.
+	expectValid("  10.1.2.3\t\r", expected);
+	expectInvalid("10.1.2.3,a");
+}
+
+TEST_F(TextTest, Partial) {
+	const std::string text = "1.2.3.4\n5.6.7.8\n9.10";
+	size_t consumed = 0;
+	std::vector<fiftyoneDegreesIpiCgTextRow> rows = evaluate(
+		text,
+		'\0',
+		0,
+		false,
+		&consumed);
+	EXPECT_EQ(2u, rows.size());
+	EXPECT_EQ(text.find("9.10"), consumed);
+
+	// The rest of the last line is provided with the part not consumed.
+	const std::string rest = text.substr(consumed) + ".11.12\n13";
+	rows = evaluate(rest, '\0', 0, false, &consumed);
+	ASSERT_EQ(1u, rows.size());
+	EXPECT_EQ(rest.find("13"), consumed);
+	expectResult(
+		address(FIFTYONE_DEGREES_IP_TYPE_IPV4, { 9, 10, 11, 12 }),
+		rows[0].result,
+		rest);
+
+	// The last line is evaluated when the text is final.
+	rows = evaluate(text, '\0', 0, true, &consumed);
+	ASSERT_EQ(3u, rows.size());
+	EXPECT_EQ(text.size(), consumed);
+	EXPECT_FALSE(rows[2].valid);
+
+	// Evaluation stops when the rows are full.
+	fiftyoneDegreesIpiCgTextRow row;
+	fiftyoneDegreesException exception;
+	exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+	EXPECT_EQ(1u, fiftyoneDegreesIpiGraphEvaluateText(
+		graphs.get(),
+		1,
+		text.data(),
+		text.size(),
+		'\0',
+		0,
+		true,
+		&row,
+		1,
+		&consumed,
+		&exception));
+	EXPECT_EQ(text.find("5.6"), consumed);
+	expectResult(
+		address(FIFTYONE_DEGREES_IP_TYPE_IPV4, { 1, 2, 3, 4 }),
+		row.result,
+		text);
+}
+
+TEST_F(TextTest, Chunks) {
+	std::string text;
+	std::vector<fiftyoneDegreesIpAddress> addresses;
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		if (i % 7 == 0) {
+			text += "not an address\n";
+			addresses.push_back(address(FIFTYONE_DEGREES_IP_TYPE_INVALID, {}));
+		}
+		else if (i % 2 == 0) {
+			addresses.push_back(data.nextAddress(0));
+			text += formatIpv4(addresses.back().value) + "\n";
+		}
+		else {
+			addresses.push_back(nextIpv6());
+			text += formatIpv6(addresses.back(), true, false) + "\n";
+		}
+	}
+	size_t consumed = 0;
+	const std::vector<fiftyoneDegreesIpiCgTextRow> rows = evaluate(
+		text,
+		'\0',
+		0,
+		false,
+		&consumed);
+	ASSERT_EQ(addresses.size(), rows.size());
+	EXPECT_EQ(text.size(), consumed);
+	for (size_t i = 0; i < rows.size(); i++) {
+		EXPECT_EQ(
+			addresses[i].type != FIFTYONE_DEGREES_IP_TYPE_INVALID,
+			rows[i].valid) << i;
+		if (rows[i].valid) {
+			expectResult(addresses[i], rows[i].result, std::to_string(i));
+		}
+	}
+}
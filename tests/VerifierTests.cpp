@@ -0,0 +1,306 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Mismatches reported to the callback of the verifier.
+ */
+struct VerifierMismatches {
+	std::mutex lock;
+	std::vector<fiftyoneDegreesIpiCgResult> results;
+	std::vector<fiftyoneDegreesIpiCgResult> references;
+};
+
+static void onMismatch(
+	void* state,
+	byte componentId,
+	fiftyoneDegreesIpAddress address,
+	fiftyoneDegreesIpiCgResult result,
+	fiftyoneDegreesIpiCgResult reference) {
+	(void)componentId;
+	(void)address;
+	VerifierMismatches* const mismatches = (VerifierMismatches*)state;
+	std::lock_guard<std::mutex> guard(mismatches->lock);
+	mismatches->results.push_back(result);
+	mismatches->references.push_back(reference);
+}
+
+/**
+ * Checks the evaluations sampled by a verifier, and that a verifier that
+ * finds a mismatch disables the faster walk and uses the reference walk.
+ */
+class VerifierTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses evaluated.
+	 */
+	static const uint32_t addressesCount = 1000;
+
+	VerifierTest() : data(21, 256, 4) {}
+
+	void SetUp() override {
+		addresses = data.nextAddresses(addressesCount);
+		fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+		config.markUniform = true;
+		graphs = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader(),
+			config);
+		reference = IpiGraph::createFromMemory(
+			data.getInfos(),
+			data.getReader());
+	}
+
+	void TearDown() override {
+		if (verifier != nullptr) {
+			fiftyoneDegreesIpiGraphVerifierFree(verifier);
+		}
+	}
+
+	void createVerifier(uint32_t sampleRate, VerifierMismatches* state) {
+		fiftyoneDegreesIpiCgVerifyConfig config = {};
+		config.sampleRate = sampleRate;
+		config.queueSize = addressesCount * 4;
+		config.mismatch = onMismatch;
+		config.state = state;
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		verifier = fiftyoneDegreesIpiGraphVerifierCreate(
+			graphs.get(),
+			&config,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		ASSERT_NE(nullptr, verifier);
+	}
+
+	/**
+	 * Waits for the samples taken to be verified.
+	 */
+	void waitForSamples() {
+		for (int i = 0; i < 10000 &&
+			verifier->verified + verifier->dropped < verifier->sampled; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		ASSERT_EQ(0, verifier->dropped);
+		ASSERT_EQ(verifier->sampled, verifier->verified);
+	}
+
+	/**
+	 * Evaluates the address with the verifier and checks the result is the
+	 * same as the expected graphs return.
+	 */
+	void expectVerified(
+		const fiftyoneDegreesIpiCgArray* expected,
+		const std::pair<byte, fiftyoneDegreesIpAddress>& address) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesIpiCgResult actual =
+			fiftyoneDegreesIpiGraphEvaluateVerified(
+				verifier,
+				address.first,
+				address.second,
+				&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		const fiftyoneDegreesIpiCgResult result = 
+			fiftyoneDegreesIpiGraphEvaluate(
+				expected,
+				address.first,
+				address.second,
+				&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		EXPECT_EQ(result.rawOffset, actual.rawOffset);
+		EXPECT_EQ(result.offset, actual.offset);
+		EXPECT_EQ(result.isGroupOffset, actual.isGroupOffset);
+	}
+
+	/**
+	 * Evaluates the addresses of the component as a batch with the verifier
+	 * and checks the results are the same as the expected graphs return.
+	 */
+	void expectVerifiedBatch(
+		const fiftyoneDegreesIpiCgArray* expected,
+		byte componentId,
+		uint32_t start,
+		uint32_t count) {
+		std::vector<fiftyoneDegreesIpAddress> batch;
+		for (uint32_t i = start; batch.size() < count; i++) {
+			if (addresses[i % addresses.size()].first == componentId) {
+				batch.push_back(addresses[i % addresses.size()].second);
+			}
+		}
+		std::vector<fiftyoneDegreesIpiCgResult> results(count);
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateVerifiedBatch(
+			verifier,
+			componentId,
+			batch.data(),
+			results.data(),
+			count,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		for (uint32_t i = 0; i < count; i++) {
+			const fiftyoneDegreesIpiCgResult result = 
+				fiftyoneDegreesIpiGraphEvaluate(
+					expected,
+					componentId,
+					batch[i],
+					&exception);
+			ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+			EXPECT_EQ(result.rawOffset, results[i].rawOffset) << i;
+			EXPECT_EQ(result.offset, results[i].offset);
+			EXPECT_EQ(result.isGroupOffset, results[i].isGroupOffset);
+		}
+	}
+
+	/**
+	 * Changes the result of every node where all the walks return the same
+	 * result so that the faster walk returns a different result to the
+	 * reference walk for some addresses.
+	 */
+	void corruptUniforms() {
+		fiftyoneDegreesIpiCgArray* const array = 
+			(fiftyoneDegreesIpiCgArray*)graphs.get();
+		std::set<fiftyoneDegreesIpiCgUniform*> changed;
+		for (uint32_t i = 0; i < array->count; i++) {
+			fiftyoneDegreesIpiCg* const graph = &array->items[i];
+			if (changed.insert(graph->uniforms).second == false) {
+				continue;
+			}
+			for (uint32_t u = 0; u < graph->uniformsCount; u++) {
+				graph->uniforms[u].profileIndex = 
+					(graph->uniforms[u].profileIndex + 1) % 
+					graph->info.profileCount;
+			}
+		}
+	}
+
+	GraphTestData data;
+	std::vector<std::pair<byte, fiftyoneDegreesIpAddress>> addresses;
+	IpiGraph graphs;
+	IpiGraph reference;
+	fiftyoneDegreesIpiCgVerifier* verifier = nullptr;
+};
+
+TEST_F(VerifierTest, Sampled) {
+	VerifierMismatches mismatches;
+	createVerifier(7, &mismatches);
+	for (const auto& address : addresses) {
+		expectVerified(graphs.get(), address);
+	}
+	EXPECT_EQ(1000, verifier->evaluations);
+	EXPECT_EQ(142, verifier->sampled);
+
+	// Batches are numbered from the evaluations before them so that the 
+	// same evaluations are sampled as if they were evaluated one at a time.
+	expectVerifiedBatch(graphs.get(), 1, 0, 100);
+	EXPECT_EQ(1100, verifier->evaluations);
+	EXPECT_EQ(157, verifier->sampled);
+	expectVerifiedBatch(graphs.get(), 1, 100, 13);
+	EXPECT_EQ(1113, verifier->evaluations);
+	EXPECT_EQ(159, verifier->sampled);
+	expectVerifiedBatch(graphs.get(), 1, 200, 6);
+	EXPECT_EQ(159, verifier->sampled);
+	expectVerifiedBatch(graphs.get(), 1, 300, 1);
+	EXPECT_EQ(1120, verifier->evaluations);
+	EXPECT_EQ(160, verifier->sampled);
+
+	waitForSamples();
+	EXPECT_EQ(0, verifier->mismatches);
+	EXPECT_EQ(0, verifier->disabled);
+	EXPECT_TRUE(mismatches.results.empty());
+}
+
+TEST_F(VerifierTest, Mismatch) {
+	corruptUniforms();
+	uint32_t different = 0;
+	for (const auto& address : addresses) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		if (fiftyoneDegreesIpiGraphEvaluate(
+				graphs.get(),
+				address.first,
+				address.second,
+				&exception).rawOffset !=
+			fiftyoneDegreesIpiGraphEvaluate(
+				reference.get(),
+				address.first,
+				address.second,
+				&exception).rawOffset) {
+			different++;
+		}
+	}
+	ASSERT_LT(0u, different);
+
+	// Every evaluation is sampled so the first that differs is found.
+	VerifierMismatches mismatches;
+	createVerifier(1, &mismatches);
+	for (const auto& address : addresses) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateVerified(
+			verifier,
+			address.first,
+			address.second,
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+	}
+	waitForSamples();
+	EXPECT_NE(0, verifier->disabled);
+	EXPECT_LT(0, verifier->mismatches);
+	{
+		std::lock_guard<std::mutex> guard(mismatches.lock);
+		ASSERT_EQ(
+			(size_t)verifier->mismatches,
+			mismatches.results.size());
+		for (size_t i = 0; i < mismatches.results.size(); i++) {
+			EXPECT_NE(
+				mismatches.results[i].rawOffset,
+				mismatches.references[i].rawOffset);
+		}
+	}
+
+	// Once disabled the reference walk is used, and nothing is sampled.
+	const int64_t sampled = verifier->sampled;
+	for (const auto& address : addresses) {
+		expectVerified(reference.get(), address);
+	}
+	expectVerifiedBatch(reference.get(), 1, 0, 100);
+	expectVerifiedBatch(reference.get(), 2, 0, 100);
+	EXPECT_EQ(sampled, verifier->sampled);
+}
@@ -0,0 +1,312 @@
+/* *********************************************************************
+ * This Original Work is copyright of 51 Degrees Mobile Experts Limited.
+ * Copyright 2025 51 Degrees Mobile Experts Limited, Davidson House,
+ * Forbury Square, Reading, Berkshire, United Kingdom RG1 3EU.
+ *
+ * This Original Work is the subject of the following patent application,
+ * owned by 51 Degrees Mobile Experts Limited of
+ * Regus Forbury Square, Davidson House, Reading RG1 3EU, United Kingdom:
+ * United Kingdom Patent Application No. 2506025.2.
+ *
+ * This Original Work is licensed under the European Union Public Licence (EUPL)
+ * v.1.2 and is subject to its terms as set out below.
+ *
+ * If a copy of the EUPL was not distributed with this file, You can obtain
+ * one at https://opensource.org/licenses/EUPL-1.2.
+ *
+ * The 'Compatible Licences' set out in the Appendix to the EUPL (as may be
+ * amended by the European Commission) shall be deemed incompatible for
+ * the purposes of the Work and the provisions of the compatibility
+ * clause in Article 5 of the EUPL shall not apply.
+ *
+ * If using the Work as, or as part of, a network application, by
+ * including the attribution notice(s) required under Article 5 of the EUPL
+ * in the end user terms of the application under an appropriate heading,
+ * such notice(s) shall fulfill the requirements of that article.
+ * ********************************************************************* */
+
+#include <cstring>
+#include <vector>
+#include "gtest/gtest.h"
+#include "GraphTestData.hpp"
+
+using namespace FiftyoneDegrees::IpIntelligence;
+
+/**
+ * Checks the results of the walk against a walk of the synthetic graphs one
+ * node at a time. IPv4 graphs whose walks continue after the 32 bits of the
+ * address compare the zero bits that follow it. IPv6 addresses that embed
+ * an IPv4 address use the IPv4 graph of the component if the graphs are
+ * created with the normalizeIpv4 option.
+ */
+class WalkTest : public ::testing::Test {
+protected:
+	/**
+	 * Number of addresses evaluated for each graph.
+	 */
+	static const uint32_t addressesCount = 2000;
+
+	/**
+	 * Bits after the end of an IPv4 address that walks can compare.
+	 */
+	static const int overrun = 24;
+
+	WalkTest() : data(9, 256, 0), overrunData(13, 256, 0, overrun) {}
+
+	/**
+	 * Evaluates the address and returns the result.
+	 */
+	static fiftyoneDegreesIpiCgResult evaluate(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		byte componentId,
+		const fiftyoneDegreesIpAddress& address) {
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		const fiftyoneDegreesIpiCgResult result =
+			fiftyoneDegreesIpiGraphEvaluate(
+				graphs,
+				componentId,
+				address,
+				&exception);
+		EXPECT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		return result;
+	}
+
+	/**
+	 * Checks the batch evaluation of the addresses returns the same results
+	 * as evaluating each address on its own.
+	 */
+	static void expectSameBatch(
+		const fiftyoneDegreesIpiCgArray* graphs,
+		byte componentId,
+		const std::vector<fiftyoneDegreesIpAddress>& addresses) {
+		std::vector<fiftyoneDegreesIpiCgResult> results(addresses.size());
+		fiftyoneDegreesException exception;
+		exception.status = FIFTYONE_DEGREES_STATUS_NOT_SET;
+		fiftyoneDegreesIpiGraphEvaluateBatch(
+			graphs,
+			componentId,
+			addresses.data(),
+			results.data(),
+			(uint32_t)addresses.size(),
+			&exception);
+		ASSERT_EQ(FIFTYONE_DEGREES_STATUS_NOT_SET, exception.status);
+		for (size_t i = 0; i < addresses.size(); i++) {
+			const fiftyoneDegreesIpiCgResult expected = evaluate(
+				graphs,
+				componentId,
+				addresses[i]);
+			ASSERT_EQ(expected.rawOffset, results[i].rawOffset) <<
+				"address " << i;
+			ASSERT_EQ(expected.offset, results[i].offset);
+			ASSERT_EQ(expected.isGroupOffset, results[i].isGroupOffset);
+		}
+	}
+
+	/**
+	 * Returns the IPv6 address with the bytes given and the rest zero.
+	 */
+	static fiftyoneDegreesIpAddress ipv6(
+		const byte* bytes,
+		size_t offset,
+		size_t length) {
+		fiftyoneDegreesIpAddress address;
+		memset(&address, 0, sizeof(fiftyoneDegreesIpAddress));
+		address.type = FIFTYONE_DEGREES_IP_TYPE_IPV6;
+		memcpy(address.value + offset, bytes, length);
+		return address;
+	}
+
+	/**
+	 * Options that change how the nodes and spans are read by the walk.
+	 */
+	static std::vector<fiftyoneDegreesIpiCgConfig> getConfigs() {
+		std::vector<fiftyoneDegreesIpiCgConfig> configs;
+		configs.push_back(IpiGraph::defaultConfig());
+		fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+		config.alignNodes = true;
+		config.decodeSpans = true;
+		config.compressPaths = true;
+		configs.push_back(config);
+		config = IpiGraph::defaultConfig();
+		config.validate = true;
+		configs.push_back(config);
+		config = IpiGraph::defaultConfig();
+		config.compressNodes = true;
+		config.compressPaths = true;
+		config.markUniform = true;
+		configs.push_back(config);
+		return configs;
+	}
+
+	GraphTestData data;
+	GraphTestData overrunData;
+};
+
+TEST_F(WalkTest, Reference) {
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	for (uint32_t g = 0; g < GraphTestData::graphsCount; g++) {
+		for (uint32_t i = 0; i < addressesCount; i++) {
+			const fiftyoneDegreesIpAddress address = data.nextAddress(g);
+			int bits;
+			const uint32_t expected = data.walk(g, address, bits);
+			EXPECT_EQ(
+				expected,
+				evaluate(
+					graphs.get(),
+					data.getInfo(g).componentId,
+					address).rawOffset) << "graph " << g;
+		}
+	}
+}
+
+TEST_F(WalkTest, PastIpv4Address) {
+	for (uint32_t g : { 0u, 3u }) {
+		const byte componentId = overrunData.getInfo(g).componentId;
+		std::vector<fiftyoneDegreesIpAddress> addresses;
+		std::vector<uint32_t> expected;
+		uint32_t past = 0;
+		for (uint32_t i = 0; i < addressesCount; i++) {
+			addresses.push_back(overrunData.nextAddress(g));
+			int bits;
+			expected.push_back(overrunData.walk(g, addresses.back(), bits));
+			if (bits > 32) {
+				past++;
+			}
+		}
+		EXPECT_LT(0u, past) << "graph " << g;
+		for (const fiftyoneDegreesIpiCgConfig& config : getConfigs()) {
+			IpiGraph graphs = IpiGraph::createFromMemory(
+				overrunData.getInfos(),
+				overrunData.getReader(),
+				config);
+			for (size_t i = 0; i < addresses.size(); i++) {
+				ASSERT_EQ(
+					expected[i],
+					evaluate(graphs.get(), componentId, addresses[i])
+						.rawOffset) << "graph " << g << " address " << i;
+			}
+			expectSameBatch(graphs.get(), componentId, addresses);
+		}
+	}
+}
+
+TEST_F(WalkTest, NormalizeEmbedded) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.normalizeIpv4 = true;
+	IpiGraph normalized = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader(),
+		config);
+	IpiGraph graphs = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader());
+	const byte mapped[] = { 0xff, 0xff };
+	const byte sixToFour[] = { 0x20, 0x02 };
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		const fiftyoneDegreesIpAddress ipv4 = data.nextAddress(0);
+		int bits;
+		const uint32_t expected = data.walk(0, ipv4, bits);
+
+		// IPv4-mapped, IPv4-compatible and 6to4 forms of the address. The
+		// 6to4 address has random bits after the IPv4 address.
+		std::vector<fiftyoneDegreesIpAddress> embedded;
+		fiftyoneDegreesIpAddress address = ipv6(ipv4.value, 12, 4);
+		memcpy(address.value + 10, mapped, sizeof(mapped));
+		embedded.push_back(address);
+		address = ipv6(ipv4.value, 12, 4);
+		if (memcmp(ipv4.value, "\0\0\0", 3) != 0 || ipv4.value[3] > 1) {
+			embedded.push_back(address);
+		}
+		address = data.nextAddress(1);
+		memcpy(address.value, sixToFour, sizeof(sixToFour));
+		memcpy(address.value + 2, ipv4.value, 4);
+		embedded.push_back(address);
+
+		for (const fiftyoneDegreesIpAddress& form : embedded) {
+			EXPECT_EQ(
+				expected,
+				evaluate(normalized.get(), 1, form).rawOffset);
+			EXPECT_EQ(
+				data.walk(1, form, bits),
+				evaluate(graphs.get(), 1, form).rawOffset);
+		}
+	}
+}
+
+TEST_F(WalkTest, NormalizeIpv6) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.normalizeIpv4 = true;
+	IpiGraph normalized = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader(),
+		config);
+	int bits;
+
+	// The unspecified and loopback addresses are not IPv4-compatible.
+	const byte loopback[] = { 1 };
+	for (const fiftyoneDegreesIpAddress& address : {
+		ipv6(loopback, 0, 0),
+		ipv6(loopback, 15, 1) }) {
+		EXPECT_EQ(
+			data.walk(1, address, bits),
+			evaluate(normalized.get(), 1, address).rawOffset);
+	}
+
+	// Component 3 has no IPv4 graph so the IPv6 graph is used, as it is for
+	// addresses that do not embed an IPv4 address.
+	const byte mapped[] = { 0xff, 0xff, 10, 1, 2, 3 };
+	const fiftyoneDegreesIpAddress address = ipv6(mapped, 10, 6);
+	EXPECT_EQ(
+		data.walk(4, address, bits),
+		evaluate(normalized.get(), 3, address).rawOffset);
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		const fiftyoneDegreesIpAddress other = data.nextAddress(1);
+		if (other.value[0] == 0x20 && other.value[1] == 0x02) {
+			continue;
+		}
+		EXPECT_EQ(
+			data.walk(1, other, bits),
+			evaluate(normalized.get(), 1, other).rawOffset);
+	}
+}
+
+TEST_F(WalkTest, NormalizeBatch) {
+	fiftyoneDegreesIpiCgConfig config = IpiGraph::defaultConfig();
+	config.normalizeIpv4 = true;
+	IpiGraph normalized = IpiGraph::createFromMemory(
+		data.getInfos(),
+		data.getReader(),
+		config);
+	const byte mapped[] = { 0xff, 0xff };
+	std::vector<fiftyoneDegreesIpAddress> addresses;
+	for (uint32_t i = 0; i < addressesCount; i++) {
+		const fiftyoneDegreesIpAddress ipv4 = data.nextAddress(0);
+		fiftyoneDegreesIpAddress address = ipv6(ipv4.value, 12, 4);
+		switch (i % 5) {
+		case 0:
+			addresses.push_back(ipv4);
+			break;
+		case 1:
+			memcpy(address.value + 10, mapped, sizeof(mapped));
+			addresses.push_back(address);
+			break;
+		case 2:
+			addresses.push_back(address);
+			break;
+		case 3:
+			address = data.nextAddress(1);
+			address.value[0] = 0x20;
+			address.value[1] = 0x02;
+			addresses.push_back(address);
+			break;
+		default:
+			addresses.push_back(data.nextAddress(1));
+			break;
+		}
+	}
+	expectSameBatch(normalized.get(), 1, addresses);
+	expectSameBatch(normalized.get(), 3, addresses);
+}